@@ -167,7 +167,7 @@
  * @brief   Enables the UART subsystem.
  */
 #if !defined(HAL_USE_UART) || defined(__DOXYGEN__)
-#define HAL_USE_UART                FALSE
+#define HAL_USE_UART                TRUE
 #endif
 
 /**
@@ -332,10 +332,11 @@
 
 /**
  * @brief   Serial over USB number of buffers.
- * @note    The default is 2 buffers.
+ * @note    The default is 2 buffers, 4 keeps the IN endpoint busy during
+ *          flash downloads.
  */
 #if !defined(SERIAL_USB_BUFFERS_NUMBER) || defined(__DOXYGEN__)
-#define SERIAL_USB_BUFFERS_NUMBER   2
+#define SERIAL_USB_BUFFERS_NUMBER   4
 #endif
 
 /*===========================================================================*/
@@ -0,0 +1,5 @@
+# List of all the module's related files.
+BLACKBOX_SRCS = $(MODULE_DIR)/blackbox/src/blackbox.c
+
+# Required include directories
+BLACKBOX_INC = $(MODULE_DIR)/blackbox/inc
@@ -0,0 +1,230 @@
+#ifndef __BLACKBOX_H
+#define __BLACKBOX_H
+
+#include "flash_save.h"
+
+/*===========================================================================*/
+/* Module global definitions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Pages of the external flash used by the blackbox, all pages after
+ *          the settings log.
+ */
+#define BLACKBOX_FIRST_PAGE             FLASHSAVE_NUM_PAGES
+#define BLACKBOX_NUM_PAGES              (M25PE40_NUM_PAGES -                  \
+                                         FLASHSAVE_NUM_PAGES)
+
+/**
+ * @brief   Number of frames in the ring between the control loop and the
+ *          writer thread.
+ */
+#define BLACKBOX_RING_SIZE              32
+
+/**
+ * @brief   Maximum number of fields in a frame, time and all streams.
+ */
+#define BLACKBOX_MAX_FIELDS             38
+
+/**
+ * @brief   Maximum encoded size of a frame, marker and 5 bytes per field.
+ */
+#define BLACKBOX_MAX_FRAME_BYTES        (1 + 5 * BLACKBOX_MAX_FIELDS)
+
+/**
+ * @brief   Time the writer sleeps when there are no frames to write.
+ */
+#define BLACKBOX_IDLE_SLEEP_MS          5
+
+/**
+ * @brief   Frame markers, the first frame of each page is an intra frame.
+ */
+#define BLACKBOX_MARKER_SESSION         'H'
+#define BLACKBOX_MARKER_INTRA           'I'
+#define BLACKBOX_MARKER_DELTA           'P'
+
+#define BLACKBOX_SESSION_MAGIC          0x4242464b  /* "KFBB" */
+#define BLACKBOX_VERSION                1
+
+/**
+ * @brief   Scaling of floating point fields to integers.
+ */
+#define BLACKBOX_SCALE_QUATERNION       10000.0f
+#define BLACKBOX_SCALE_RATE             1000.0f
+#define BLACKBOX_SCALE_CONTROL          1000.0f
+
+#define BLACKBOX_SETTINGS_SIZE          (sizeof(blackbox_settings_t))
+#define BLACKBOX_STATUS_SIZE            (sizeof(blackbox_status_t))
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Blackbox recording modes.
+ */
+typedef enum PACKED_VAR {
+    /**
+     * @brief   Recording disabled.
+     */
+    BLACKBOX_MODE_OFF = 0,
+    /**
+     * @brief   Record while armed, one session per arming.
+     */
+    BLACKBOX_MODE_ARMED = 1,
+    /**
+     * @brief   Record continuously.
+     */
+    BLACKBOX_MODE_ALWAYS = 2
+} blackbox_mode_t;
+
+/**
+ * @brief   Blackbox stream selectors, in the order they appear in a frame.
+ */
+typedef enum {
+    /**
+     * @brief   Raw gyroscope, 3 fields.
+     */
+    BLACKBOX_STREAM_GYRO = 0x01,
+    /**
+     * @brief   Raw accelerometer, 3 fields.
+     */
+    BLACKBOX_STREAM_ACCELEROMETER = 0x02,
+    /**
+     * @brief   Estimated attitude quaternion and angular rate, 7 fields.
+     */
+    BLACKBOX_STREAM_ESTIMATION = 0x04,
+    /**
+     * @brief   Rate reference, rate PID error, integral state and torque
+     *          output, 12 fields.
+     */
+    BLACKBOX_STREAM_PID = 0x08,
+    /**
+     * @brief   Mixer outputs, 8 fields.
+     */
+    BLACKBOX_STREAM_OUTPUTS = 0x10,
+    /**
+     * @brief   RC throttle, pitch, roll and yaw levels, 4 fields.
+     */
+    BLACKBOX_STREAM_RC = 0x20,
+    /**
+     * @brief   All streams.
+     */
+    BLACKBOX_STREAM_ALL = 0x3f
+} blackbox_stream_t;
+
+/**
+ * @brief   Blackbox settings.
+ */
+typedef struct PACKED_VAR {
+    /**
+     * @brief   Recording mode.
+     */
+    blackbox_mode_t mode;
+    /**
+     * @brief   Bitmask of blackbox_stream_t to record.
+     */
+    uint8_t streams;
+    /**
+     * @brief   Record every n:th control loop iteration.
+     */
+    uint8_t rate_divider;
+} blackbox_settings_t;
+
+/**
+ * @brief   Blackbox status.
+ */
+typedef struct PACKED_VAR {
+    /**
+     * @brief   Number of frames written to the flash.
+     */
+    uint32_t frames_written;
+    /**
+     * @brief   Number of frames dropped as the ring was full.
+     */
+    uint32_t frames_dropped;
+    /**
+     * @brief   Number of bytes written to the flash.
+     */
+    uint32_t bytes_written;
+    /**
+     * @brief   Next page to be written, relative to the first blackbox page.
+     */
+    uint16_t next_page;
+    /**
+     * @brief   Number of pages available to the blackbox.
+     */
+    uint16_t num_pages;
+    /**
+     * @brief   True while recording.
+     */
+    uint8_t recording;
+    /**
+     * @brief   True if recording stopped as the flash is full.
+     */
+    uint8_t flash_full;
+    /**
+     * @brief   True while the blackbox is being erased.
+     */
+    uint8_t erasing;
+} blackbox_status_t;
+
+/**
+ * @brief   Header written at the start of each recording session.
+ */
+typedef struct PACKED_VAR {
+    /**
+     * @brief   BLACKBOX_MARKER_SESSION.
+     */
+    uint8_t marker;
+    /**
+     * @brief   BLACKBOX_SESSION_MAGIC.
+     */
+    uint32_t magic;
+    /**
+     * @brief   BLACKBOX_VERSION.
+     */
+    uint8_t version;
+    /**
+     * @brief   Recorded streams.
+     */
+    uint8_t streams;
+    /**
+     * @brief   Number of fields per frame.
+     */
+    uint8_t num_fields;
+    /**
+     * @brief   Frame rate in Hz.
+     */
+    uint16_t frame_rate;
+} blackbox_session_header_t;
+
+/**
+ * @brief   Unencoded frame in the ring.
+ */
+typedef struct {
+    /**
+     * @brief   Fields, time in us followed by the streams.
+     */
+    int32_t field[BLACKBOX_MAX_FIELDS];
+} blackbox_frame_t;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+void BlackboxInit(void);
+void BlackboxLogControlStep(void);
+void BlackboxSettingsValidate(blackbox_settings_t *settings);
+void BlackboxRequestErase(void);
+blackbox_settings_t *ptrGetBlackboxSettings(void);
+blackbox_status_t *ptrGetBlackboxStatus(void);
+
+#endif
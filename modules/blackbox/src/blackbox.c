@@ -0,0 +1,683 @@
+/* *
+ *
+ * Blackbox flight recorder.
+ *
+ * The control loop samples the selected streams into a single producer,
+ * single consumer ring, which never blocks and counts the frames dropped if
+ * the ring is full. A low priority thread encodes the frames and writes them
+ * to the external flash after the settings log.
+ *
+ * Each recording session starts on a new page with a session header. Frames
+ * never cross a page and the first frame of each page is an intra frame with
+ * the absolute values, following frames store the difference to the previous
+ * frame. All values are zigzag and varint encoded. The unused end of a page
+ * is left erased (0xff), which is not a valid frame marker.
+ *
+ * Page writes are queued to the external flash without waiting, the next
+ * page is encoded into the second buffer while the write is in progress.
+ * The flash is expected to be erased beforehand with BlackboxRequestErase,
+ * recording stops when the flash is full.
+ *
+ * */
+
+#include "ch.h"
+#include "hal.h"
+#include "blackbox.h"
+#include "sensor_read.h"
+#include "estimation.h"
+#include "control.h"
+#include "arming.h"
+#include "rc_input.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Blackbox settings and status.
+ */
+static blackbox_settings_t blackbox_settings;
+static blackbox_status_t blackbox_status;
+
+/**
+ * @brief   Ring of frames from the control loop, the head is only written by
+ *          the control loop and the tail only by the writer thread.
+ */
+static blackbox_frame_t blackbox_ring[BLACKBOX_RING_SIZE];
+static volatile uint32_t blackbox_ring_head;
+static volatile uint32_t blackbox_ring_tail;
+
+/**
+ * @brief   Streams and rate divider of the current session.
+ */
+static volatile bool blackbox_recording;
+static uint8_t blackbox_session_streams;
+static uint8_t blackbox_session_divider;
+static uint32_t blackbox_divider_count;
+
+/**
+ * @brief   Encoder state, the previous frame and the number of fields.
+ */
+static int32_t blackbox_previous[BLACKBOX_MAX_FIELDS];
+static uint32_t blackbox_num_fields;
+static bool blackbox_page_has_frame;
+
+/**
+ * @brief   Page buffers, one being filled and one being written.
+ */
+static uint8_t blackbox_page[2][FLASH_PAGE_SIZE];
+static uint32_t blackbox_page_active;
+static uint32_t blackbox_page_offset;
+static bool blackbox_write_pending;
+static ExternalFlashRequest blackbox_write_request;
+
+/**
+ * @brief   Set to erase the blackbox from the writer thread.
+ */
+static volatile bool blackbox_erase_requested;
+
+THD_WORKING_AREA(waThreadBlackbox, 512);
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief           Number of fields in a frame with the selected streams.
+ *
+ * @param[in] streams   Bitmask of blackbox_stream_t.
+ * @return          Number of fields.
+ */
+static uint32_t BlackboxNumFields(const uint8_t streams)
+{
+    uint32_t n = 1;
+
+    if (streams & BLACKBOX_STREAM_GYRO)
+        n += 3;
+    if (streams & BLACKBOX_STREAM_ACCELEROMETER)
+        n += 3;
+    if (streams & BLACKBOX_STREAM_ESTIMATION)
+        n += 7;
+    if (streams & BLACKBOX_STREAM_PID)
+        n += 12;
+    if (streams & BLACKBOX_STREAM_OUTPUTS)
+        n += 8;
+    if (streams & BLACKBOX_STREAM_RC)
+        n += 4;
+
+    return n;
+}
+
+/**
+ * @brief           Samples the selected streams into a frame.
+ *
+ * @param[out] frame    Frame to fill.
+ * @param[in] streams   Bitmask of blackbox_stream_t.
+ */
+static void BlackboxSampleFrame(blackbox_frame_t *frame, const uint8_t streams)
+{
+    int32_t *f = frame->field;
+    int i;
+
+    *f++ = (int32_t)(rtGetLatestAccelerometerSamplingTimeNS() / 1000);
+
+    if (streams & BLACKBOX_STREAM_GYRO)
+    {
+        const int16_t *gyro = ptrGetRawGyroscopeData();
+
+        for (i = 0; i < 3; i++)
+            *f++ = gyro[i];
+    }
+
+    if (streams & BLACKBOX_STREAM_ACCELEROMETER)
+    {
+        const int16_t *acc = ptrGetRawAccelerometerData();
+
+        for (i = 0; i < 3; i++)
+            *f++ = acc[i];
+    }
+
+    if (streams & BLACKBOX_STREAM_ESTIMATION)
+    {
+        const attitude_states_t *states = ptrGetAttitudeEstimationStates();
+
+        *f++ = (int32_t)(states->q.w * BLACKBOX_SCALE_QUATERNION);
+        *f++ = (int32_t)(states->q.x * BLACKBOX_SCALE_QUATERNION);
+        *f++ = (int32_t)(states->q.y * BLACKBOX_SCALE_QUATERNION);
+        *f++ = (int32_t)(states->q.z * BLACKBOX_SCALE_QUATERNION);
+        *f++ = (int32_t)(states->w.x * BLACKBOX_SCALE_RATE);
+        *f++ = (int32_t)(states->w.y * BLACKBOX_SCALE_RATE);
+        *f++ = (int32_t)(states->w.z * BLACKBOX_SCALE_RATE);
+    }
+
+    if (streams & BLACKBOX_STREAM_PID)
+    {
+        const control_reference_t *ref = ptrGetControlReferences();
+        const control_data_t *data = ptrGetControlData();
+
+        *f++ = (int32_t)(ref->rate_reference.x * BLACKBOX_SCALE_RATE);
+        *f++ = (int32_t)(ref->rate_reference.y * BLACKBOX_SCALE_RATE);
+        *f++ = (int32_t)(ref->rate_reference.z * BLACKBOX_SCALE_RATE);
+
+        for (i = 0; i < 3; i++)
+        {
+            *f++ = (int32_t)(data->rate_controller[i].error_old *
+                             BLACKBOX_SCALE_RATE);
+            *f++ = (int32_t)(data->rate_controller[i].I_state *
+                             BLACKBOX_SCALE_CONTROL);
+        }
+
+        *f++ = (int32_t)(ref->actuator_desired.torque.x *
+                         BLACKBOX_SCALE_CONTROL);
+        *f++ = (int32_t)(ref->actuator_desired.torque.y *
+                         BLACKBOX_SCALE_CONTROL);
+        *f++ = (int32_t)(ref->actuator_desired.torque.z *
+                         BLACKBOX_SCALE_CONTROL);
+    }
+
+    if (streams & BLACKBOX_STREAM_OUTPUTS)
+    {
+        const control_reference_t *ref = ptrGetControlReferences();
+
+        for (i = 0; i < 8; i++)
+            *f++ = (int32_t)(ref->output[i] * BLACKBOX_SCALE_CONTROL);
+    }
+
+    if (streams & BLACKBOX_STREAM_RC)
+    {
+        *f++ = (int32_t)(RCInputGetInterpolatedLevel(RCINPUT_ROLE_THROTTLE) *
+                         BLACKBOX_SCALE_CONTROL);
+        *f++ = (int32_t)(RCInputGetInterpolatedLevel(RCINPUT_ROLE_PITCH) *
+                         BLACKBOX_SCALE_CONTROL);
+        *f++ = (int32_t)(RCInputGetInterpolatedLevel(RCINPUT_ROLE_ROLL) *
+                         BLACKBOX_SCALE_CONTROL);
+        *f++ = (int32_t)(RCInputGetInterpolatedLevel(RCINPUT_ROLE_YAW) *
+                         BLACKBOX_SCALE_CONTROL);
+    }
+}
+
+/**
+ * @brief           Writes an unsigned varint, 7 bits per byte, least
+ *                  significant first.
+ *
+ * @param[out] p    Pointer to the output.
+ * @param[in] v     Value to write.
+ * @return          Pointer to the byte after the varint.
+ */
+static uint8_t *BlackboxPutVarint(uint8_t *p, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+
+    *p++ = (uint8_t)v;
+
+    return p;
+}
+
+/**
+ * @brief           Zigzag encodes a signed value, so small magnitudes give
+ *                  short varints.
+ *
+ * @param[in] v     Value to encode.
+ * @return          Encoded value.
+ */
+static inline uint32_t BlackboxZigzag(const int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+/**
+ * @brief           Waits for a pending page write.
+ */
+static void BlackboxWaitWrite(void)
+{
+    if (blackbox_write_pending == false)
+        return;
+
+    ExternalFlash_Wait(&blackbox_write_request);
+
+    blackbox_write_pending = false;
+}
+
+/**
+ * @brief           Checks if the pending page write is done.
+ */
+static void BlackboxPollWrite(void)
+{
+    if ((blackbox_write_pending == true) &&
+        (blackbox_write_request.done == true))
+        blackbox_write_pending = false;
+}
+
+/**
+ * @brief           Queues a write of the active page buffer and switches to
+ *                  the other buffer.
+ *
+ * @return          False if the flash is full.
+ */
+static bool BlackboxFlushPage(void)
+{
+    const ExternalFlashConfig *flashcfg = ptrGetExternalFlashConfig();
+
+    if (blackbox_page_offset == 0)
+        return true;
+
+    /* Only one write at a time. */
+    BlackboxWaitWrite();
+
+    if (blackbox_status.next_page >= BLACKBOX_NUM_PAGES)
+    {
+        blackbox_status.flash_full = true;
+        return false;
+    }
+
+    blackbox_write_request.operation = FLASH_REQUEST_PROGRAM;
+    blackbox_write_request.address = (BLACKBOX_FIRST_PAGE +
+                                        blackbox_status.next_page) *
+                                        FLASH_PAGE_SIZE;
+    blackbox_write_request.buffer = blackbox_page[blackbox_page_active];
+    blackbox_write_request.count = blackbox_page_offset;
+    blackbox_write_request.callback = NULL;
+    blackbox_write_request.arg = NULL;
+
+    ExternalFlash_Submit(flashcfg, &blackbox_write_request);
+
+    blackbox_write_pending = true;
+    blackbox_status.next_page++;
+    blackbox_status.bytes_written += blackbox_page_offset;
+
+    blackbox_page_active ^= 1;
+    blackbox_page_offset = 0;
+    blackbox_page_has_frame = false;
+
+    return true;
+}
+
+/**
+ * @brief           Encodes a frame into the active page, starting a new page
+ *                  if it does not fit.
+ *
+ * @param[in] frame Frame to encode.
+ * @return          False if the flash is full.
+ */
+static bool BlackboxEncodeFrame(const blackbox_frame_t *frame)
+{
+    uint8_t encoded[BLACKBOX_MAX_FRAME_BYTES];
+    uint8_t *p;
+    uint32_t i, size;
+    bool intra;
+
+    do
+    {
+        /* Each page starts with an intra frame, so it can be decoded on its
+         * own. */
+        intra = (blackbox_page_has_frame == false);
+        p = encoded;
+
+        if (intra)
+        {
+            *p++ = BLACKBOX_MARKER_INTRA;
+
+            for (i = 0; i < blackbox_num_fields; i++)
+                p = BlackboxPutVarint(p, BlackboxZigzag(frame->field[i]));
+        }
+        else
+        {
+            *p++ = BLACKBOX_MARKER_DELTA;
+
+            /* Differences with wrap around, for the time field. */
+            for (i = 0; i < blackbox_num_fields; i++)
+                p = BlackboxPutVarint(p, BlackboxZigzag(
+                        (int32_t)((uint32_t)frame->field[i] -
+                                  (uint32_t)blackbox_previous[i])));
+        }
+
+        size = p - encoded;
+
+        if (blackbox_page_offset + size <= FLASH_PAGE_SIZE)
+            break;
+
+        if (BlackboxFlushPage() == false)
+            return false;
+
+    } while (1);
+
+    memcpy(&blackbox_page[blackbox_page_active][blackbox_page_offset],
+           encoded, size);
+    blackbox_page_offset += size;
+    blackbox_page_has_frame = true;
+
+    memcpy(blackbox_previous, frame->field,
+           blackbox_num_fields * sizeof(int32_t));
+
+    blackbox_status.frames_written++;
+
+    return true;
+}
+
+/**
+ * @brief           Encodes all frames in the ring.
+ *
+ * @return          Number of frames encoded.
+ */
+static uint32_t BlackboxDrainRing(void)
+{
+    uint32_t count = 0;
+
+    while (blackbox_ring_tail != blackbox_ring_head)
+    {
+        if (blackbox_recording == true)
+        {
+            if (BlackboxEncodeFrame(
+                    &blackbox_ring[blackbox_ring_tail % BLACKBOX_RING_SIZE]) ==
+                false)
+                blackbox_recording = false;
+        }
+
+        /* Hand the slot back to the control loop after it is read. */
+        __DMB();
+        blackbox_ring_tail++;
+        count++;
+    }
+
+    return count;
+}
+
+/**
+ * @brief           Starts a new session with the current settings.
+ */
+static void BlackboxStartSession(void)
+{
+    blackbox_session_header_t header;
+
+    /* Sessions start on a new page. */
+    if (BlackboxFlushPage() == false)
+        return;
+
+    if (blackbox_status.next_page >= BLACKBOX_NUM_PAGES)
+    {
+        blackbox_status.flash_full = true;
+        return;
+    }
+
+    blackbox_session_streams = blackbox_settings.streams;
+    blackbox_session_divider = blackbox_settings.rate_divider;
+    blackbox_num_fields = BlackboxNumFields(blackbox_session_streams);
+
+    header.marker = BLACKBOX_MARKER_SESSION;
+    header.magic = BLACKBOX_SESSION_MAGIC;
+    header.version = BLACKBOX_VERSION;
+    header.streams = blackbox_session_streams;
+    header.num_fields = blackbox_num_fields;
+    header.frame_rate = (uint16_t)(SENSOR_ACCGYRO_HZ /
+                                   blackbox_session_divider);
+
+    memcpy(blackbox_page[blackbox_page_active], &header, sizeof(header));
+    blackbox_page_offset = sizeof(header);
+    blackbox_page_has_frame = false;
+
+    /* Discard old frames before starting the control loop sampling. */
+    blackbox_ring_tail = blackbox_ring_head;
+    blackbox_divider_count = 0;
+    __DMB();
+    blackbox_recording = true;
+    blackbox_status.recording = true;
+}
+
+/**
+ * @brief           Stops the current session and writes the last page.
+ */
+static void BlackboxStopSession(void)
+{
+    BlackboxDrainRing();
+
+    blackbox_recording = false;
+    blackbox_status.recording = false;
+
+    BlackboxFlushPage();
+    BlackboxWaitWrite();
+}
+
+/**
+ * @brief           Finds the first unwritten page, sessions are written one
+ *                  after the other from the first page.
+ */
+static void BlackboxFindEnd(void)
+{
+    const ExternalFlashConfig *flashcfg = ptrGetExternalFlashConfig();
+    uint16_t low = 0, high = BLACKBOX_NUM_PAGES, mid;
+    uint8_t marker;
+
+    ExternalFlash_Claim(flashcfg);
+
+    /* Written pages start with a frame marker, erased pages with 0xff. */
+    while (low < high)
+    {
+        mid = (low + high) / 2;
+
+        ExternalFlash_ReadBuffer(flashcfg,
+                                 (BLACKBOX_FIRST_PAGE + mid) * FLASH_PAGE_SIZE,
+                                 &marker,
+                                 1);
+
+        if (marker == 0xff)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+
+    ExternalFlash_Release(flashcfg);
+
+    blackbox_status.next_page = low;
+    blackbox_status.flash_full = (low >= BLACKBOX_NUM_PAGES);
+}
+
+/**
+ * @brief           Erases the blackbox sectors of the flash.
+ */
+static void BlackboxErase(void)
+{
+    const ExternalFlashConfig *flashcfg = ptrGetExternalFlashConfig();
+    uint32_t address;
+
+    blackbox_status.erasing = true;
+
+    /* One request per sector, the settings can be saved in between. */
+    for (address = BLACKBOX_FIRST_PAGE * FLASH_PAGE_SIZE;
+         address < M25PE40_NUM_PAGES * FLASH_PAGE_SIZE;
+         address += FLASH_SECTOR_SIZE)
+        ExternalFlash_EraseSector(flashcfg, address);
+
+    blackbox_status.next_page = 0;
+    blackbox_status.flash_full = false;
+    blackbox_status.erasing = false;
+}
+
+/**
+ * @brief           Checks if the blackbox should be recording.
+ *
+ * @return          True if recording.
+ */
+static bool BlackboxShouldRecord(void)
+{
+    if (blackbox_settings.mode == BLACKBOX_MODE_ALWAYS)
+        return true;
+    else if (blackbox_settings.mode == BLACKBOX_MODE_ARMED)
+        return bIsSystemArmed();
+    else
+        return false;
+}
+
+/**
+ * @brief           Thread encoding and writing the frames to the flash.
+ *
+ * @param[in] arg   Unused.
+ * @return          Unused.
+ */
+static THD_FUNCTION(ThreadBlackbox, arg)
+{
+    (void)arg;
+    bool record;
+
+    /* Set thread name */
+    chRegSetThreadName("Blackbox");
+
+    BlackboxFindEnd();
+
+    while (1)
+    {
+        if (blackbox_erase_requested == true)
+        {
+            if (blackbox_recording == true)
+                BlackboxStopSession();
+
+            BlackboxErase();
+            blackbox_erase_requested = false;
+        }
+
+        record = BlackboxShouldRecord() &&
+                 (blackbox_status.flash_full == false);
+
+        if ((record == true) && (blackbox_status.recording == false))
+            BlackboxStartSession();
+        else if ((record == false) && (blackbox_status.recording == true))
+            BlackboxStopSession();
+
+        if (BlackboxDrainRing() == 0)
+        {
+            BlackboxPollWrite();
+            chThdSleepMilliseconds(BLACKBOX_IDLE_SLEEP_MS);
+        }
+
+        /* Stopped by a full flash while draining. */
+        if ((blackbox_recording == false) &&
+            (blackbox_status.recording == true))
+            BlackboxStopSession();
+    }
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief           Initializes the blackbox and starts the writer thread.
+ */
+void BlackboxInit(void)
+{
+    /* Off until enabled, the blackbox area is not erased by default */
+    blackbox_settings.mode = BLACKBOX_MODE_OFF;
+    blackbox_settings.streams = BLACKBOX_STREAM_ALL;
+    blackbox_settings.rate_divider = 1;
+
+    blackbox_status.num_pages = BLACKBOX_NUM_PAGES;
+
+    /* Read settings from flash */
+    FlashSave_Read(FlashSave_STR2ID("BBOX"),
+                   (uint8_t *)&blackbox_settings,
+                   BLACKBOX_SETTINGS_SIZE);
+
+    BlackboxSettingsValidate(&blackbox_settings);
+
+    /* Register the settings for saving to flash */
+    FlashSave_Register(FlashSave_STR2ID("BBOX"),
+                       &blackbox_settings,
+                       BLACKBOX_SETTINGS_SIZE,
+                       NULL);
+
+    chThdCreateStatic(waThreadBlackbox,
+                      sizeof(waThreadBlackbox),
+                      LOWPRIO,
+                      ThreadBlackbox,
+                      NULL);
+}
+
+/**
+ * @brief           Samples a frame for the blackbox, called from the control
+ *                  loop after each update.
+ * @note            Never blocks, if the ring is full the frame is dropped and
+ *                  counted.
+ */
+void BlackboxLogControlStep(void)
+{
+    const uint32_t head = blackbox_ring_head;
+
+    if (blackbox_recording == false)
+        return;
+
+    if (++blackbox_divider_count < blackbox_session_divider)
+        return;
+
+    blackbox_divider_count = 0;
+
+    if (head - blackbox_ring_tail >= BLACKBOX_RING_SIZE)
+    {
+        blackbox_status.frames_dropped++;
+        return;
+    }
+
+    BlackboxSampleFrame(&blackbox_ring[head % BLACKBOX_RING_SIZE],
+                        blackbox_session_streams);
+
+    /* Publish the frame after it is written. */
+    __DMB();
+    blackbox_ring_head = head + 1;
+}
+
+/**
+ * @brief               Bounds the settings to valid values.
+ *
+ * @param[in/out] settings  Settings to validate.
+ */
+void BlackboxSettingsValidate(blackbox_settings_t *settings)
+{
+    if (settings->mode != BLACKBOX_MODE_OFF &&
+        settings->mode != BLACKBOX_MODE_ARMED &&
+        settings->mode != BLACKBOX_MODE_ALWAYS)
+        settings->mode = BLACKBOX_MODE_OFF;
+
+    settings->streams &= BLACKBOX_STREAM_ALL;
+
+    if (settings->rate_divider == 0)
+        settings->rate_divider = 1;
+}
+
+/**
+ * @brief           Requests the blackbox to be erased, the erase is done in
+ *                  the background and stops any recording.
+ */
+void BlackboxRequestErase(void)
+{
+    blackbox_erase_requested = true;
+}
+
+/**
+ * @brief           Return the pointer to the blackbox settings.
+ *
+ * @return          Pointer to the blackbox settings.
+ */
+blackbox_settings_t *ptrGetBlackboxSettings(void)
+{
+    return &blackbox_settings;
+}
+
+/**
+ * @brief           Return the pointer to the blackbox status.
+ *
+ * @return          Pointer to the blackbox status.
+ */
+blackbox_status_t *ptrGetBlackboxStatus(void)
+{
+    return &blackbox_status;
+}
@@ -6,7 +6,8 @@ COMMUNICATION_SRCS = $(MODULE_DIR)/communication/src/circularbuffer.c \
                      $(MODULE_DIR)/communication/src/subscriptions.c \
                      $(MODULE_DIR)/communication/src/kflypacket_generators.c \
                      $(MODULE_DIR)/communication/src/kflypacket_parsers.c \
-                     $(MODULE_DIR)/communication/src/slip2kflypacket.c
+                     $(MODULE_DIR)/communication/src/slip2kflypacket.c \
+                     $(MODULE_DIR)/communication/src/flash_download.c
 
 # Required include directories
 COMMUNICATION_INC = $(MODULE_DIR)/communication/inc
@@ -9,6 +9,9 @@
 /* Module global definitions.                                                */
 /*===========================================================================*/
 
+/* Size of the length prefix stored before each frame of a framed buffer */
+#define CIRCULAR_BUFFER_FRAME_PREFIX        2
+
 /*===========================================================================*/
 /* Module data structures and types.                                         */
 /*===========================================================================*/
@@ -38,6 +41,10 @@ typedef struct
      * @brief   Mask for wrapping the buffer on overflow.
      */
     size_t mask;
+    /**
+     * @brief   Bytes kept free, not reported by CircularBuffer_SpaceLeft.
+     */
+    size_t reserved;
     /**
      * @brief   Pointer to the data holding region.
      */
@@ -73,13 +80,44 @@ static inline void CircularBuffer_Release(circular_buffer_t *Cbuff)
 }
 
 /**
- * @brief               Calculates the space left in a circular buffer.
+ * @brief               Calculates the space left in a circular buffer,
+ *                      excluding the reserved bytes.
  *
  * @param[in] Cbuff     Pointer to the circular buffer.
  */
 static inline size_t CircularBuffer_SpaceLeft(circular_buffer_t *Cbuff)
 {
-    return (Cbuff->tail + Cbuff->size - Cbuff->head - 1) & Cbuff->mask;
+    const size_t space = (Cbuff->tail + Cbuff->size - Cbuff->head - 1) &
+                         Cbuff->mask;
+
+    if (space > Cbuff->reserved)
+        return space - Cbuff->reserved;
+    else
+        return 0;
+}
+
+/**
+ * @brief               Calculates the number of bytes waiting in a circular
+ *                      buffer.
+ *
+ * @param[in] Cbuff     Pointer to the circular buffer.
+ */
+static inline size_t CircularBuffer_Count(circular_buffer_t *Cbuff)
+{
+    return (Cbuff->head - Cbuff->tail) & Cbuff->mask;
+}
+
+/**
+ * @brief               Sets the number of bytes kept free in a circular
+ *                      buffer, only writers ignoring the reserve may use them.
+ *
+ * @param[in/out] Cbuff Pointer to the circular buffer.
+ * @param[in] reserved  Number of bytes to keep free.
+ */
+static inline void CircularBuffer_SetReserved(circular_buffer_t *Cbuff,
+                                              const size_t reserved)
+{
+    Cbuff->reserved = reserved;
 }
 
 /**
@@ -157,5 +195,12 @@ void CircularBuffer_ReadChunk(circular_buffer_t *Cbuff,
                               const size_t count);
 uint8_t *CircularBuffer_GetReadPointer(circular_buffer_t *Cbuff,
                                        size_t *size);
+bool CircularBuffer_BeginFrame(circular_buffer_t *Cbuff, size_t *start);
+size_t CircularBuffer_EndFrame(circular_buffer_t *Cbuff, const size_t start);
+void CircularBuffer_AbortFrame(circular_buffer_t *Cbuff, const size_t start);
+size_t CircularBuffer_DropFrame(circular_buffer_t *Cbuff);
+size_t CircularBuffer_ReadFrames(circular_buffer_t *Cbuff,
+                                 uint8_t *data,
+                                 const size_t max_size);
 
 #endif
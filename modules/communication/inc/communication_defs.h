@@ -12,6 +12,21 @@
 /* Module data structures and types.                                         */
 /*===========================================================================*/
 
+/**
+ * @brief   Link layer framing of a serial port.
+ */
+typedef enum
+{
+    /**
+     * @brief   Serial Line Internet Protocol, escapes the reserved bytes.
+     */
+    LINK_FRAMING_SLIP = 0,
+    /**
+     * @brief   Consistent Overhead Byte Stuffing, bounded overhead.
+     */
+    LINK_FRAMING_COBS = 1
+} link_framing_t;
+
 /**
  * @brief   The generic structure to keep track of the data through the
  *          decoding flow.
@@ -0,0 +1,109 @@
+#ifndef __FLASH_DOWNLOAD_H
+#define __FLASH_DOWNLOAD_H
+
+#include "slip2kflypacket.h"
+
+/*===========================================================================*/
+/* Module global definitions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Size of the data in each chunk, read with one flash request and a
+ *          multiple of the USB packet size.
+ */
+#define FLASH_DOWNLOAD_CHUNK_SIZE       1024
+
+/**
+ * @brief   Maximum number of unacknowledged chunks in flight.
+ */
+#define FLASH_DOWNLOAD_MAX_WINDOW       8
+
+/**
+ * @brief   Time to wait for an acknowledgement before going back to the
+ *          first unacknowledged chunk.
+ */
+#define FLASH_DOWNLOAD_ACK_TIMEOUT_MS   200
+
+/**
+ * @brief   Number of timeouts in a row before the download is aborted.
+ */
+#define FLASH_DOWNLOAD_MAX_RETRIES      5
+
+/**
+ * @brief   Sync word at the start of each chunk header.
+ */
+#define FLASH_DOWNLOAD_SYNC             0x5aa5
+
+/**
+ * @brief   Bytes from the host during a download, each ACK and NAK is
+ *          followed by a little endian 16-bit sequence number.
+ */
+#define FLASH_DOWNLOAD_ACK              0x06
+#define FLASH_DOWNLOAD_NAK              0x15
+#define FLASH_DOWNLOAD_CAN              0x18
+
+#define FLASH_DOWNLOAD_REQUEST_SIZE     (sizeof(flash_download_request_t))
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Flash download request, payload of the ReadFlash command.
+ */
+typedef struct PACKED_VAR {
+    /**
+     * @brief   Byte address of the first byte to read.
+     */
+    uint32_t address;
+    /**
+     * @brief   Number of bytes to read.
+     */
+    uint32_t length;
+    /**
+     * @brief   Number of unacknowledged chunks allowed in flight, limited to
+     *          FLASH_DOWNLOAD_MAX_WINDOW.
+     */
+    uint8_t window;
+} flash_download_request_t;
+
+/**
+ * @brief   Header in front of each chunk of the stream. The data and a
+ *          CRC16 of the data follows the header. The stream ends with a
+ *          header with zero length and no data or CRC.
+ */
+typedef struct PACKED_VAR {
+    /**
+     * @brief   FLASH_DOWNLOAD_SYNC.
+     */
+    uint16_t sync;
+    /**
+     * @brief   Chunk sequence number, starting from 0.
+     */
+    uint16_t sequence;
+    /**
+     * @brief   Byte address of the first byte in the chunk.
+     */
+    uint32_t address;
+    /**
+     * @brief   Number of data bytes in the chunk.
+     */
+    uint16_t length;
+} flash_download_header_t;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+void FlashDownloadInit(void);
+bool FlashDownload_Start(const flash_download_request_t *request);
+bool FlashDownload_IsActive(void);
+
+#endif
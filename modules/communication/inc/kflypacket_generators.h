@@ -24,6 +24,9 @@
 /*===========================================================================*/
 
 bool GenerateMessage(kfly_command_t command, external_port_t port);
+bool GenerateTelemetryMessage(kfly_command_t command,
+                              external_port_t port,
+                              size_t *size);
 bool GenerateCustomMessage(kfly_command_t command,
                            uint8_t *data,
                            uint16_t size,
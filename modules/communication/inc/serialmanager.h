@@ -7,10 +7,184 @@
 /* Module global definitions.                                                */
 /*===========================================================================*/
 
+/**
+ * @brief   Link layer framing of each port at start, LINK_FRAMING_SLIP or
+ *          LINK_FRAMING_COBS. COBS has a bounded overhead of one byte per
+ *          208, SLIP doubles the size of data full of reserved bytes.
+ */
+#if !defined(SERIAL_USB_FRAMING)
+#define SERIAL_USB_FRAMING                  LINK_FRAMING_SLIP
+#endif
+#if !defined(SERIAL_AUX1_FRAMING)
+#define SERIAL_AUX1_FRAMING                 LINK_FRAMING_SLIP
+#endif
+#if !defined(SERIAL_AUX2_FRAMING)
+#define SERIAL_AUX2_FRAMING                 LINK_FRAMING_SLIP
+#endif
+#if !defined(SERIAL_AUX3_FRAMING)
+#define SERIAL_AUX3_FRAMING                 LINK_FRAMING_SLIP
+#endif
+#if !defined(SERIAL_AUX4_FRAMING)
+#define SERIAL_AUX4_FRAMING                 LINK_FRAMING_SLIP
+#endif
+
+/**
+ * @brief   Role of each port at start, see serial_port_role_t. AUX3 (UART4)
+ *          is driven by the UART driver of the CRSF receiver and AUX4 is the
+ *          CAN bus, so neither can be a KFly port.
+ */
+#if !defined(SERIAL_USB_ROLE)
+#define SERIAL_USB_ROLE                     SERIAL_ROLE_KFLY
+#endif
+#if !defined(SERIAL_AUX1_ROLE)
+#define SERIAL_AUX1_ROLE                    SERIAL_ROLE_KFLY
+#endif
+#if !defined(SERIAL_AUX2_ROLE)
+#define SERIAL_AUX2_ROLE                    SERIAL_ROLE_NONE
+#endif
+#if !defined(SERIAL_AUX3_ROLE)
+#define SERIAL_AUX3_ROLE                    SERIAL_ROLE_CRSF
+#endif
+#if !defined(SERIAL_AUX4_ROLE)
+#define SERIAL_AUX4_ROLE                    SERIAL_ROLE_NONE
+#endif
+
+/* Baudrate of the KFly role on the AUX ports at start, and its bounds */
+#define SERIAL_AUX_BAUDRATE                 115200
+#define SERIAL_MIN_BAUDRATE                 9600
+#define SERIAL_MAX_BAUDRATE                 2000000
+
+/* Time between polls of the ports if no events arrive, in ms */
+#define SERIAL_POLL_MS                      10
+
+/* Bytes read from a port at a time */
+#define SERIAL_RECEIVE_CHUNK_SIZE           16
+
+/* Number of external ports, PORT_USB to PORT_AUX4 */
+#define SERIAL_NUMBER_OF_PORTS              5
+
+/* Size of the telemetry queue of each port, kept small so the oldest
+   telemetry is dropped before it gets stale */
+#define SERIAL_TELEMETRY_BUFFER_SIZE        512
+
+/* Largest framed telemetry message, the data pumps copy the telemetry out
+   of the queue so the oldest frames can be dropped while transmitting */
+#define SERIAL_TELEMETRY_FRAME_SIZE         256
+
+/* Bytes of the response buffer only ACKs may use, a SLIP framed ACK is at
+   most 10 bytes */
+#define SERIAL_ACK_RESERVE                  32
+
+/* Time a response waits for space in the transmit buffer before it is
+   dropped, in ms */
+#define SERIAL_RESPONSE_TIMEOUT_MS          50
+
+/* Time the replies queued on a port are given to go out before its driver
+   is restarted with a new configuration, in ms */
+#define SERIAL_RECONFIGURE_FLUSH_MS         20
+
+/* Window of the throughput measurement, in ms */
+#define SERIAL_THROUGHPUT_WINDOW_MS         1000
+
+#define SERIAL_PORT_STATISTICS_SIZE         (sizeof(serial_port_statistics_t))
+#define SERIAL_PORT_CONFIG_SIZE             (sizeof(serial_port_config_t))
+
 /*===========================================================================*/
 /* Module data structures and types.                                         */
 /*===========================================================================*/
 
+/**
+ * @brief   Protocol spoken on a port.
+ */
+typedef enum PACKED_VAR
+{
+    /**
+     * @brief   The port is not in use.
+     */
+    SERIAL_ROLE_NONE = 0,
+    /**
+     * @brief   KFly protocol, for ground stations and companion computers.
+     */
+    SERIAL_ROLE_KFLY = 1,
+    /**
+     * @brief   SBUS receiver, needs an external inverter on the AUX ports.
+     */
+    SERIAL_ROLE_SBUS = 2,
+    /**
+     * @brief   CRSF receiver.
+     */
+    SERIAL_ROLE_CRSF = 3,
+    /**
+     * @brief   KISS / BLHeli32 ESC telemetry.
+     */
+    SERIAL_ROLE_ESC_TELEMETRY = 4
+} serial_port_role_t;
+
+/**
+ * @brief   Configuration of a port.
+ */
+typedef struct PACKED_VAR
+{
+    /**
+     * @brief   Protocol spoken on the port.
+     */
+    serial_port_role_t role;
+    /**
+     * @brief   Link layer framing of the KFly role, link_framing_t.
+     */
+    uint8_t framing;
+    /**
+     * @brief   Reserved for alignment.
+     */
+    uint16_t reserved;
+    /**
+     * @brief   Baudrate of the KFly role, the other roles have the baudrate
+     *          of their protocol. Not used by the USB.
+     */
+    uint32_t baudrate;
+} serial_port_config_t;
+
+/**
+ * @brief   Transmit statistics of a port.
+ */
+typedef struct PACKED_VAR
+{
+    /**
+     * @brief   Bytes put in the transmit queues since start.
+     */
+    uint32_t bytes_queued;
+    /**
+     * @brief   Bytes transmitted since start.
+     */
+    uint32_t bytes_sent;
+    /**
+     * @brief   Bytes of queued telemetry dropped to make room for newer
+     *          telemetry since start.
+     */
+    uint32_t bytes_dropped;
+    /**
+     * @brief   Telemetry messages dropped since start, queued or not.
+     */
+    uint32_t telemetry_dropped;
+    /**
+     * @brief   Responses and ACKs dropped since start as the transmit buffer
+     *          stayed full.
+     */
+    uint32_t responses_dropped;
+    /**
+     * @brief   Bytes transmitted per second over the last window.
+     */
+    uint32_t throughput;
+    /**
+     * @brief   Bytes waiting in the transmit queues.
+     */
+    uint16_t bytes_waiting;
+    /**
+     * @brief   Largest number of bytes waiting since start.
+     */
+    uint16_t peak_waiting;
+} serial_port_statistics_t;
+
 /*===========================================================================*/
 /* Module macros.                                                            */
 /*===========================================================================*/
@@ -25,6 +199,23 @@
 void vSerialManagerInit(void);
 circular_buffer_t *SerialManager_GetCircularBufferFromPort(external_port_t port);
 void SerialManager_StartTransmission(external_port_t port);
+link_framing_t SerialManager_GetFraming(external_port_t port);
+void SerialManager_SetFraming(external_port_t port, link_framing_t framing);
+link_framing_t SerialManager_GetFramingFromCircularBuffer(
+        circular_buffer_t *Cbuff);
+circular_buffer_t *SerialManager_GetTelemetryBufferFromPort(
+        external_port_t port);
+void SerialManager_CountQueued(external_port_t port, size_t bytes);
+void SerialManager_CountDropped(external_port_t port,
+                                size_t bytes,
+                                bool telemetry);
+void SerialManager_GetStatistics(
+        serial_port_statistics_t stats[SERIAL_NUMBER_OF_PORTS]);
+bool SerialManager_WaitForSpace(external_port_t port, systime_t timeout);
+void SerialManager_GetConfig(
+        serial_port_config_t config[SERIAL_NUMBER_OF_PORTS]);
+void SerialManager_SetConfig(
+        const serial_port_config_t config[SERIAL_NUMBER_OF_PORTS]);
 
 
 #endif
@@ -3,6 +3,7 @@
 
 #include "circularbuffer.h"
 #include "slip.h"
+#include "communication_defs.h"
 
 /*===========================================================================*/
 /* Module global definitions.                                                */
@@ -259,6 +260,125 @@ typedef enum PACKED_VAR
      */
     Cmd_SetControlFilters           = 57,
 
+    /*===============================================*/
+    /* Output allocation specific commands.          */
+    /*===============================================*/
+
+    /**
+     * @brief   Get output allocation settings.
+     */
+    Cmd_GetOutputAllocation         = 58,
+    /**
+     * @brief   Set output allocation settings.
+     */
+    Cmd_SetOutputAllocation         = 59,
+    /**
+     * @brief   Get thrust curves.
+     */
+    Cmd_GetThrustCurves             = 60,
+    /**
+     * @brief   Set thrust curves.
+     */
+    Cmd_SetThrustCurves             = 61,
+    /**
+     * @brief   Calibrate a thrust curve from bench measurements.
+     */
+    Cmd_CalibrateThrustCurve        = 62,
+
+    /*===============================================*/
+    /* RC link and interpolation commands.           */
+    /*===============================================*/
+
+    /**
+     * @brief   Get RC link statistics.
+     */
+    Cmd_GetRCLinkStatistics         = 63,
+    /**
+     * @brief   Get RC interpolation settings.
+     */
+    Cmd_GetRCInterpolation          = 64,
+    /**
+     * @brief   Set RC interpolation settings.
+     */
+    Cmd_SetRCInterpolation          = 65,
+
+    /*===============================================*/
+    /* Blackbox commands.                            */
+    /*===============================================*/
+
+    /**
+     * @brief   Get blackbox settings.
+     */
+    Cmd_GetBlackboxSettings         = 66,
+    /**
+     * @brief   Set blackbox settings.
+     */
+    Cmd_SetBlackboxSettings         = 67,
+    /**
+     * @brief   Get blackbox status and dropped frame counters.
+     */
+    Cmd_GetBlackboxStatus           = 68,
+    /**
+     * @brief   Erase the blackbox recordings.
+     */
+    Cmd_EraseBlackbox               = 69,
+    /**
+     * @brief   Stream a region of the external flash over the USB.
+     */
+    Cmd_ReadFlash                   = 70,
+    /**
+     * @brief   Get the status and fit of the magnetometer calibration.
+     */
+    Cmd_GetMagCalibrationStatus     = 71,
+    /**
+     * @brief   Start, stop or commit the magnetometer calibration.
+     */
+    Cmd_ManageMagCalibration        = 72,
+    /**
+     * @brief   Get the status and solution of the accelerometer calibration.
+     */
+    Cmd_GetAccelCalibrationStatus   = 73,
+    /**
+     * @brief   Start, stop or commit the accelerometer calibration.
+     */
+    Cmd_ManageAccelCalibration      = 74,
+    /**
+     * @brief   Get sensor health statistics
+     */
+    Cmd_GetSensorHealth             = 75,
+    /**
+     * @brief   Get the status of the subscriptions
+     */
+    Cmd_GetSubscriptionStatus       = 76,
+    /**
+     * @brief   Get the transmit statistics of all ports.
+     */
+    Cmd_GetPortStatistics           = 77,
+    /**
+     * @brief   Get the role, framing and baudrate of all serial ports
+     */
+    Cmd_GetSerialPortConfig         = 78,
+    /**
+     * @brief   Set the role, framing and baudrate of all serial ports
+     */
+    Cmd_SetSerialPortConfig         = 79,
+    /**
+     * @brief   Get the latest ESC telemetry
+     */
+    Cmd_GetEscTelemetry             = 80,
+    /**
+     * @brief   Get the description of a range of parameters
+     */
+    Cmd_GetParameterInfo            = 81,
+    /**
+     * @brief   Get the values of a range of parameters
+     */
+    Cmd_GetParameters               = 82,
+    /**
+     * @brief   Set the values of a range of parameters
+     */
+    Cmd_SetParameters               = 83,
+
     /*===============================================*/
     /* Computer control specific commands.           */
     /*===============================================*/
@@ -367,5 +487,6 @@ void InitKFlyPacketParser(kfly_parser_t *p,
                           external_port_t port,
                           uint8_t *buffer);
 void ParseKFlyPacketFromSLIP(slip_parser_t *slip, kfly_parser_t *p);
+void ParseKFlyPacketFromCOBS(communication_decoder_t *dec, kfly_parser_t *p);
 
 #endif
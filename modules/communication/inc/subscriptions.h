@@ -8,10 +8,61 @@
 /* Module global definitions.                                                */
 /*===========================================================================*/
 
+/* Subscriptions are limited by the status of all of them fitting in one
+   message */
+#define MAX_NUMBER_OF_SUBSCRIPTIONS         30
+
+/* Number of subscription_priority_t classes */
+#define SUBSCRIPTION_PRIORITY_CLASSES       3
+
+/* Period of the scheduler, the shortest time between messages */
+#define SUBSCRIPTION_TICK_MS                1
+
+/* Streams short of budget are decimated by up to this factor */
+#define SUBSCRIPTION_MAX_DECIMATION         16
+
+/* Window of the achieved rate measurement */
+#define SUBSCRIPTION_RATE_WINDOW_MS         1000
+
+/* Budget burst, the time of budget a port may use at once. Each priority
+   class below high must leave a quarter of it for the classes above */
+#define SUBSCRIPTION_BURST_MS               100
+
+/* Budget of each port in bytes per second, 0 for unlimited. The UART
+   budgets leave 20 % of 115200 baud for responses */
+#if !defined(SUBSCRIPTION_USB_BUDGET)
+#define SUBSCRIPTION_USB_BUDGET             0
+#endif
+#if !defined(SUBSCRIPTION_AUX_BUDGET)
+#define SUBSCRIPTION_AUX_BUDGET             (115200 / 10 * 8 / 10)
+#endif
+
+#define SUBSCRIPTION_STATUS_SIZE            (sizeof(subscription_status_t))
+
 /*===========================================================================*/
 /* Module data structures and types.                                         */
 /*===========================================================================*/
 
+/**
+ * @brief   Priority class of a subscription, the classes are served in
+ *          order from the budget of the port.
+ */
+typedef enum PACKED_VAR
+{
+    /**
+     * @brief   Never decimated, a message short of budget is delayed.
+     */
+    SUBSCRIPTION_PRIORITY_HIGH = 0,
+    /**
+     * @brief   Decimated when short of budget.
+     */
+    SUBSCRIPTION_PRIORITY_NORMAL = 1,
+    /**
+     * @brief   Decimated when short of budget, served last.
+     */
+    SUBSCRIPTION_PRIORITY_LOW = 2
+} subscription_priority_t;
+
 /**
  * @brief   Parsing structure for the management of subscriptions.
  */
@@ -34,8 +85,44 @@ typedef struct PACKED_VAR
      * @brief   The time between transmissions of the subscription in ms.
      */
     uint32_t delta_time;
+    /**
+     * @brief   Priority class of the subscription, optional. Messages
+     *          without it subscribe with SUBSCRIPTION_PRIORITY_NORMAL.
+     */
+    subscription_priority_t priority;
 } subscription_parser_t;
 
+/**
+ * @brief   Status of a subscription.
+ */
+typedef struct PACKED_VAR
+{
+    /**
+     * @brief   Subscribed command.
+     */
+    kfly_command_t command;
+    /**
+     * @brief   Port the subscription is transmitted on.
+     */
+    external_port_t port;
+    /**
+     * @brief   Priority class.
+     */
+    subscription_priority_t priority;
+    /**
+     * @brief   Current decimation of the requested rate.
+     */
+    uint8_t decimation;
+    /**
+     * @brief   Achieved rate over the last window, in 0.1 Hz.
+     */
+    uint16_t rate;
+    /**
+     * @brief   Messages dropped since the subscription was made, saturated.
+     */
+    uint16_t dropped;
+} subscription_status_t;
+
 /*===========================================================================*/
 /* Module macros.                                                            */
 /*===========================================================================*/
@@ -46,12 +133,16 @@ typedef struct PACKED_VAR
 void vSubscriptionsInit(void);
 bool bSubscribeToCommandI(kfly_command_t command,
                           external_port_t port,
-                          uint32_t delay_ms);
+                          uint32_t delay_ms,
+                          subscription_priority_t priority);
 bool bUnsubscribeFromCommandI(kfly_command_t command, external_port_t port);
 void vUnsubscribeFromAllI(void);
 void vParseManageSubscription(const uint8_t *data,
                               const uint8_t size,
                               external_port_t reception_port);
+void vSetSubscriptionBudget(external_port_t port, uint32_t bytes_per_s);
+uint32_t GetSubscriptionStatus(
+        subscription_status_t status[MAX_NUMBER_OF_SUBSCRIPTIONS]);
 
 /*===========================================================================*/
 /* Module inline functions.                                                  */
@@ -63,16 +154,18 @@ void vParseManageSubscription(const uint8_t *data,
  * @param[in] command   Command to subscribe to.
  * @param[in] port      Port to transmit the subscription on.
  * @param[in] delay_ms  Time between transmits.
+ * @param[in] priority  Priority class of the subscription.
  * @return              Return true if there was a free slot, else false.
  */
 static inline bool bSubscribeToCommand(kfly_command_t command,
                                        external_port_t port,
-                                       uint32_t delay_ms)
+                                       uint32_t delay_ms,
+                                       subscription_priority_t priority)
 {
     bool result;
 
     osalSysLock();
-    result = bSubscribeToCommandI(command, port, delay_ms);
+    result = bSubscribeToCommandI(command, port, delay_ms, priority);
     osalSysUnlock();
 
     return result;
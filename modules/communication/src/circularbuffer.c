@@ -54,6 +54,7 @@ void CircularBuffer_Init(circular_buffer_t *Cbuff,
 {
     Cbuff->head = 0;
     Cbuff->tail = 0;
+    Cbuff->reserved = 0;
 
     if (isPowerOfTwo(buffer_size))
     {
@@ -117,13 +118,16 @@ void CircularBuffer_WriteChunk(circular_buffer_t *Cbuff,
         for (i = 0; i < count; i++)
             Cbuff->buffer[head + i] = data[i];
 
-        Cbuff->head = (Cbuff->head + count); /* There will be no wrap around */
+        /* The head wraps to 0 if the chunk ends at the top */
+        Cbuff->head = ((Cbuff->head + count) & Cbuff->mask);
     }
 }
 
 
 /**
  * @brief               Reads a chunk of data from a circular buffer.
+ * @note                This algorithm assumes you have checked that the
+ *                      data is available in the buffer.
  *
  * @param[in/out] Cbuff Pointer to the circular buffer.
  * @param[out] data     Pointer to write the data.
@@ -133,9 +137,30 @@ void CircularBuffer_ReadChunk(circular_buffer_t *Cbuff,
                               uint8_t *data,
                               size_t count)
 {
-    (void)Cbuff;
-    (void)data;
-    (void)count;
+    size_t i, tail, from_bot, to_top;
+
+    tail = Cbuff->tail;
+    to_top = Cbuff->size - Cbuff->tail;
+
+    if (to_top < count)
+    {   /* If we need to wrap around during the read */
+        from_bot = count - to_top;
+
+        for (i = 0; i < to_top; i++)
+            data[i] = Cbuff->buffer[tail + i];
+
+        for (i = 0; i < from_bot; i++)
+            data[to_top + i] = Cbuff->buffer[i];
+
+        Cbuff->tail = from_bot;
+    }
+    else
+    {
+        for (i = 0; i < count; i++)
+            data[i] = Cbuff->buffer[tail + i];
+
+        Cbuff->tail = ((Cbuff->tail + count) & Cbuff->mask);
+    }
 }
 
 
@@ -163,3 +188,111 @@ uint8_t *CircularBuffer_GetReadPointer(circular_buffer_t *Cbuff,
     return p;
 }
 
+/**
+ * @brief               Starts a frame in a framed circular buffer by making
+ *                      room for its length prefix. The frame is written with
+ *                      the ordinary functions and ended with
+ *                      CircularBuffer_EndFrame or CircularBuffer_AbortFrame.
+ *
+ * @param[in/out] Cbuff Pointer to the circular buffer.
+ * @param[out] start    Position of the frame, used to end it.
+ * @return              HAL_FAILED if the prefix did not fit, else HAL_SUCCESS.
+ */
+bool CircularBuffer_BeginFrame(circular_buffer_t *Cbuff, size_t *start)
+{
+    if (CircularBuffer_SpaceLeft(Cbuff) < CIRCULAR_BUFFER_FRAME_PREFIX)
+        return HAL_FAILED;
+
+    *start = Cbuff->head;
+    Cbuff->head = ((Cbuff->head + CIRCULAR_BUFFER_FRAME_PREFIX) & Cbuff->mask);
+
+    return HAL_SUCCESS;
+}
+
+/**
+ * @brief               Ends a frame by writing its length prefix.
+ *
+ * @param[in/out] Cbuff Pointer to the circular buffer.
+ * @param[in] start     Position of the frame from CircularBuffer_BeginFrame.
+ * @return              Size of the frame, excluding the prefix.
+ */
+size_t CircularBuffer_EndFrame(circular_buffer_t *Cbuff, const size_t start)
+{
+    const size_t length = (Cbuff->head - start - CIRCULAR_BUFFER_FRAME_PREFIX) &
+                          Cbuff->mask;
+
+    Cbuff->buffer[start] = (uint8_t)length;
+    Cbuff->buffer[(start + 1) & Cbuff->mask] = (uint8_t)(length >> 8);
+
+    return length;
+}
+
+/**
+ * @brief               Removes a frame which has not been ended.
+ *
+ * @param[in/out] Cbuff Pointer to the circular buffer.
+ * @param[in] start     Position of the frame from CircularBuffer_BeginFrame.
+ */
+void CircularBuffer_AbortFrame(circular_buffer_t *Cbuff, const size_t start)
+{
+    Cbuff->head = start;
+}
+
+/**
+ * @brief               Removes the oldest frame of a framed circular buffer.
+ *
+ * @param[in/out] Cbuff Pointer to the circular buffer.
+ * @return              Size of the removed frame, 0 if the buffer was empty.
+ */
+size_t CircularBuffer_DropFrame(circular_buffer_t *Cbuff)
+{
+    size_t length;
+
+    if (CircularBuffer_Count(Cbuff) == 0)
+        return 0;
+
+    length = Cbuff->buffer[Cbuff->tail] |
+             (Cbuff->buffer[(Cbuff->tail + 1) & Cbuff->mask] << 8);
+
+    CircularBuffer_IncrementTail(Cbuff, CIRCULAR_BUFFER_FRAME_PREFIX + length);
+
+    return length;
+}
+
+/**
+ * @brief               Reads whole frames from a framed circular buffer,
+ *                      without their length prefixes. A first frame larger
+ *                      than the destination is removed, so the reader can
+ *                      not get stuck on it.
+ *
+ * @param[in/out] Cbuff Pointer to the circular buffer.
+ * @param[out] data     Pointer to write the frames.
+ * @param[in] max_size  Size of the destination in bytes.
+ * @return              Number of bytes read.
+ */
+size_t CircularBuffer_ReadFrames(circular_buffer_t *Cbuff,
+                                 uint8_t *data,
+                                 const size_t max_size)
+{
+    size_t length, count = 0;
+
+    while (CircularBuffer_Count(Cbuff) > 0)
+    {
+        length = Cbuff->buffer[Cbuff->tail] |
+                 (Cbuff->buffer[(Cbuff->tail + 1) & Cbuff->mask] << 8);
+
+        if (count + length > max_size)
+        {
+            if (count == 0)
+                CircularBuffer_DropFrame(Cbuff);
+
+            break;
+        }
+
+        CircularBuffer_IncrementTail(Cbuff, CIRCULAR_BUFFER_FRAME_PREFIX);
+        CircularBuffer_ReadChunk(Cbuff, &data[count], length);
+        count += length;
+    }
+
+    return count;
+}
@@ -108,7 +108,7 @@ static inline void StartPacket(int32_t *count,
  * @param[in] code  The code to be checked.
  * @return          Returns true if it is Diff2Zero.
  */
-inline bool isDiff2Zero(const uint8_t code)
+static inline bool isDiff2Zero(const uint8_t code)
 {
     return (code >= COBS_Diff2Zero);
 }
@@ -119,7 +119,7 @@ inline bool isDiff2Zero(const uint8_t code)
  * @param[in] code  The code to be checked.
  * @return          Returns true if it is RunZero.
  */
-inline bool isRunZero(const uint8_t code)
+static inline bool isRunZero(const uint8_t code)
 {
     return ((code >= COBS_RunZero) && (code <= COBS_RunZeroMax));
 }
@@ -136,7 +136,7 @@ static inline bool DecodedSizeFitsBuffer(const size_t added_size,
                                          cobs_decoder_t *dec)
 {
     /* Check if the data fits in the buffer, if not reset the decoder. */
-    if (dec->generic_decoder.buffer_count + added_size <
+    if (dec->generic_decoder.buffer_count + added_size <=
             dec->generic_decoder.buffer_size)
     {
         return true;
@@ -146,11 +146,36 @@ static inline bool DecodedSizeFitsBuffer(const size_t added_size,
         dec->generic_decoder.buffer_count = 0;
         dec->generic_decoder.buffer_overrun++;
         dec->state = COBS_STATE_AWAITING_CODE;
+        dec->num_zeros = 0;
 
         return false;
     }
 }
 
+/**
+ * @brief           Writes the zeros that ended the previous block. They are
+ *                  held back until the next code byte, as the zero ending the
+ *                  last block of a frame is not part of the data.
+ *
+ * @param[in] count         Number of zeros to write.
+ * @param[in/out] dec       The pointer to the COBS decoder.
+ * @return                  Returns true if they fit, else false.
+ */
+static inline bool AddPendingZeros(const size_t count, cobs_decoder_t *dec)
+{
+    size_t i;
+
+    if (!DecodedSizeFitsBuffer(count, dec))
+        return false;
+
+    for (i = 0; i < count; i++)
+        dec->generic_decoder.buffer[dec->generic_decoder.buffer_count++] = 0;
+
+    dec->num_zeros = 0;
+
+    return true;
+}
+
 /*===============================================================*/
 /* Expansion of circular buffers required by the serial protocol */
 /*===============================================================*/
@@ -346,6 +371,7 @@ void COBSInitDecoder(uint8_t *buffer,
 {
     GenericDecoderInit(buffer, buffer_size, parser, &dec->generic_decoder);
     dec->state = COBS_STATE_AWAITING_CODE;
+    dec->num_zeros = 0;
 }
 
 /**
@@ -357,6 +383,7 @@ void COBSResetDecoder(cobs_decoder_t *dec)
 {
     GenericDecoderReset(&dec->generic_decoder);
     dec->state = COBS_STATE_AWAITING_CODE;
+    dec->num_zeros = 0;
 }
 
 /**
@@ -370,12 +397,13 @@ void COBSResetDecoder(cobs_decoder_t *dec)
  */
 void COBSDecode(const uint8_t in, cobs_decoder_t *dec)
 {
-    /* Check if the data fits the buffer. */
-    DecodedSizeFitsBuffer(1, dec);
-
     /* Parse the data based on the current state. */
     if ((dec->state == COBS_STATE_AWAITING_CODE) && (in != 0))
     {
+        /* A new block, so the zeros of the previous block are data. */
+        if (!AddPendingZeros(dec->num_zeros, dec))
+            return;
+
         /* Change state. */
         dec->state = COBS_STATE_AWAITING_DATA;
 
@@ -406,38 +434,22 @@ void COBSDecode(const uint8_t in, cobs_decoder_t *dec)
 
         /* Check if there is no data, only zeros. */
         if (dec->num_data == 0)
-        {
-            if (!DecodedSizeFitsBuffer(dec->num_zeros, dec))
-                return;
-
-            /* Add all zeros. */
-            while(dec->num_zeros-- > 0)
-                dec->generic_decoder.buffer[dec->generic_decoder.buffer_count++]
-                    = 0;
-
             dec->state = COBS_STATE_AWAITING_CODE;
-        }
     }
     else if ((dec->state == COBS_STATE_AWAITING_DATA) && (in != 0))
     {
+        if (!DecodedSizeFitsBuffer(1, dec))
+            return;
+
         /* Decrease the data counter. */
         dec->num_data--;
 
         /* While there are data bytes left, add it to the output. */
         dec->generic_decoder.buffer[dec->generic_decoder.buffer_count++] = in;
 
+        /* The block is done, its zeros are added with the next code. */
         if (dec->num_data == 0)
-        {
-            if (!DecodedSizeFitsBuffer(dec->num_zeros, dec))
-                return;
-
-            /* Add all zeros. */
-            while(dec->num_zeros-- > 0)
-                dec->generic_decoder.buffer[dec->generic_decoder.buffer_count++]
-                    = 0;
-
             dec->state = COBS_STATE_AWAITING_CODE;
-        }
     }
     else
     {
@@ -445,16 +457,21 @@ void COBSDecode(const uint8_t in, cobs_decoder_t *dec)
 
         if (dec->state == COBS_STATE_AWAITING_CODE)
         {
-            /* If there are data bytes in the buffer, remove the extra zero. */
-            if (dec->generic_decoder.buffer_count > 0)
+            /* If there are data bytes or zeros, drop the extra zero. */
+            if ((dec->generic_decoder.buffer_count > 0) ||
+                (dec->num_zeros > 0))
             {
-                dec->generic_decoder.buffer_count--;
+                if (dec->num_zeros > 0)
+                    dec->num_zeros--;
 
-                /* RX successful! Add statistics and call the parser. */
-                dec->generic_decoder.rx_success++;
+                if (AddPendingZeros(dec->num_zeros, dec))
+                {
+                    /* RX successful! Add statistics and call the parser. */
+                    dec->generic_decoder.rx_success++;
 
-                if (dec->generic_decoder.parser != NULL)
-                    dec->generic_decoder.parser(&dec->generic_decoder);
+                    if (dec->generic_decoder.parser != NULL)
+                        dec->generic_decoder.parser(&dec->generic_decoder);
+                }
             }
             else
             {
@@ -473,6 +490,7 @@ void COBSDecode(const uint8_t in, cobs_decoder_t *dec)
         /* Reset state and buffer. */
         dec->state = COBS_STATE_AWAITING_CODE;
         dec->generic_decoder.buffer_count = 0;
+        dec->num_zeros = 0;
     }
 }
 
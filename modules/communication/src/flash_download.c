@@ -0,0 +1,455 @@
+/* *
+ *
+ * Bulk read-out of the external flash over USB.
+ *
+ * A ReadFlash command switches the USB port to a raw binary stream until
+ * the requested region has been sent. The region is sent in chunks, each a
+ * header followed by the data and a CRC16 of the data. The data of each
+ * chunk is read through the external flash request queue, and the read of
+ * the next chunk into the second buffer is queued while waiting for the
+ * host.
+ *
+ * The host acknowledges chunks with ACK and the sequence number of the
+ * next chunk it expects, at most window chunks are in flight. A NAK, or no
+ * reply within the timeout, makes the stream go back to the first
+ * unacknowledged chunk. CAN aborts the download. The stream ends with a
+ * header with zero length.
+ *
+ * The download runs in its own thread, so the serial manager keeps serving
+ * the other ports. The serial manager leaves the USB alone while a download
+ * is active, and downloads are refused while the system is armed.
+ *
+ * */
+
+#include "ch.h"
+#include "hal.h"
+#include "usb_access.h"
+#include "ext_flash.h"
+#include "flash_save.h"
+#include "crc.h"
+#include "arming.h"
+#include "flash_download.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+#define FLASH_DOWNLOAD_SIZE     (M25PE40_NUM_PAGES * FLASH_PAGE_SIZE)
+#define FLASH_DOWNLOAD_EVENTMASK    EVENT_MASK(0)
+
+/**
+ * @brief   Replies from the host.
+ */
+typedef enum {
+    FLASH_DOWNLOAD_REPLY_ACK,
+    FLASH_DOWNLOAD_REPLY_NAK,
+    FLASH_DOWNLOAD_REPLY_CAN,
+    FLASH_DOWNLOAD_REPLY_TIMEOUT
+} flash_download_reply_t;
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Chunk buffers, chunk n is read into buffer n % 2.
+ */
+static uint8_t download_buffer[2][FLASH_DOWNLOAD_CHUNK_SIZE];
+
+/**
+ * @brief   Sequence number of the chunk read into each buffer, -1 if none.
+ */
+static int32_t download_buffer_sequence[2];
+
+/**
+ * @brief   Flash read request of each buffer.
+ */
+static ExternalFlashRequest download_read[2];
+
+/**
+ * @brief   Request being served by the download thread.
+ */
+static flash_download_request_t download_request;
+
+/**
+ * @brief   Set from the start of a download until it has finished.
+ */
+static volatile bool download_active = false;
+
+/* The download thread */
+static thread_t *download_thread = NULL;
+
+THD_WORKING_AREA(waThreadFlashDownload, 512);
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief                   Number of bytes in a chunk.
+ *
+ * @param[in] request       Download request.
+ * @param[in] sequence      Chunk sequence number.
+ * @return                  Number of bytes.
+ */
+static uint16_t FlashDownloadChunkLength(
+    const flash_download_request_t *request,
+    uint16_t sequence)
+{
+    uint32_t offset = (uint32_t)sequence * FLASH_DOWNLOAD_CHUNK_SIZE;
+
+    if ((request->length - offset) < FLASH_DOWNLOAD_CHUNK_SIZE)
+        return request->length - offset;
+    else
+        return FLASH_DOWNLOAD_CHUNK_SIZE;
+}
+
+/**
+ * @brief                   Queues the read of a chunk into its buffer, unless
+ *                          it is already there.
+ *
+ * @param[in] request       Download request.
+ * @param[in] sequence      Chunk sequence number.
+ */
+static void FlashDownloadPrefetch(const flash_download_request_t *request,
+                                  uint16_t sequence)
+{
+    ExternalFlashRequest *read = &download_read[sequence & 1];
+    int32_t *held = &download_buffer_sequence[sequence & 1];
+
+    if (*held == sequence)
+        return;
+
+    /* The previous read into the buffer must be done first. */
+    if (*held >= 0)
+        ExternalFlash_Wait(read);
+
+    read->operation = FLASH_REQUEST_READ;
+    read->address = request->address +
+                    (uint32_t)sequence * FLASH_DOWNLOAD_CHUNK_SIZE;
+    read->buffer = download_buffer[sequence & 1];
+    read->count = FlashDownloadChunkLength(request, sequence);
+    read->callback = NULL;
+    read->arg = NULL;
+
+    ExternalFlash_Submit(ptrGetExternalFlashConfig(), read);
+
+    *held = sequence;
+}
+
+/**
+ * @brief                   Get the data of a chunk, waits for it to be read
+ *                          from the flash.
+ *
+ * @param[in] request       Download request.
+ * @param[in] sequence      Chunk sequence number.
+ * @param[out] length       Number of bytes in the chunk.
+ * @return                  Pointer to the chunk data.
+ */
+static uint8_t *FlashDownloadGetChunk(const flash_download_request_t *request,
+                                      uint16_t sequence,
+                                      uint16_t *length)
+{
+    FlashDownloadPrefetch(request, sequence);
+    ExternalFlash_Wait(&download_read[sequence & 1]);
+
+    *length = FlashDownloadChunkLength(request, sequence);
+
+    return download_buffer[sequence & 1];
+}
+
+/**
+ * @brief                   Send a header over the USB.
+ *
+ * @param[in] sequence      Chunk sequence number.
+ * @param[in] address       Byte address of the chunk.
+ * @param[in] length        Number of data bytes in the chunk.
+ * @return                  True if the header was sent.
+ */
+static bool FlashDownloadSendHeader(uint16_t sequence,
+                                    uint32_t address,
+                                    uint16_t length)
+{
+    flash_download_header_t header;
+
+    header.sync = FLASH_DOWNLOAD_SYNC;
+    header.sequence = sequence;
+    header.address = address;
+    header.length = length;
+
+    return (USBSendData((uint8_t *)&header,
+                        sizeof(flash_download_header_t),
+                        MS2ST(FLASH_DOWNLOAD_ACK_TIMEOUT_MS)) ==
+            sizeof(flash_download_header_t));
+}
+
+/**
+ * @brief                   Send a chunk over the USB.
+ *
+ * @param[in] request       Download request.
+ * @param[in] sequence      Chunk sequence number.
+ * @return                  True if the chunk was sent.
+ */
+static bool FlashDownloadSendChunk(const flash_download_request_t *request,
+                                   uint16_t sequence)
+{
+    uint8_t *data;
+    uint16_t length, crc;
+
+    data = FlashDownloadGetChunk(request, sequence, &length);
+    crc = CRC16(data, length);
+
+    if (FlashDownloadSendHeader(sequence,
+                                request->address +
+                                    (uint32_t)sequence *
+                                    FLASH_DOWNLOAD_CHUNK_SIZE,
+                                length) == false)
+        return false;
+
+    if (USBSendData(data, length, MS2ST(FLASH_DOWNLOAD_ACK_TIMEOUT_MS)) !=
+        length)
+        return false;
+
+    return (USBSendData((uint8_t *)&crc,
+                        sizeof(uint16_t),
+                        MS2ST(FLASH_DOWNLOAD_ACK_TIMEOUT_MS)) ==
+            sizeof(uint16_t));
+}
+
+/**
+ * @brief                   Wait for a reply from the host, other bytes are
+ *                          ignored.
+ *
+ * @param[out] sequence     Sequence number of an ACK or NAK.
+ * @return                  The reply.
+ */
+static flash_download_reply_t FlashDownloadWaitReply(uint16_t *sequence)
+{
+    msg_t c, lsb, msb;
+
+    while (1)
+    {
+        c = (msg_t)USBReadByte(MS2ST(FLASH_DOWNLOAD_ACK_TIMEOUT_MS));
+
+        if (c < 0)
+            return FLASH_DOWNLOAD_REPLY_TIMEOUT;
+        else if (c == FLASH_DOWNLOAD_CAN)
+            return FLASH_DOWNLOAD_REPLY_CAN;
+        else if ((c == FLASH_DOWNLOAD_ACK) || (c == FLASH_DOWNLOAD_NAK))
+        {
+            lsb = (msg_t)USBReadByte(MS2ST(FLASH_DOWNLOAD_ACK_TIMEOUT_MS));
+            msb = (msg_t)USBReadByte(MS2ST(FLASH_DOWNLOAD_ACK_TIMEOUT_MS));
+
+            if ((lsb < 0) || (msb < 0))
+                return FLASH_DOWNLOAD_REPLY_TIMEOUT;
+
+            *sequence = (uint16_t)(lsb | (msb << 8));
+
+            if (c == FLASH_DOWNLOAD_ACK)
+                return FLASH_DOWNLOAD_REPLY_ACK;
+            else
+                return FLASH_DOWNLOAD_REPLY_NAK;
+        }
+    }
+}
+
+/**
+ * @brief                   Stream a region of the external flash over the
+ *                          USB.
+ * @note                    Must be the only reader of the USB, other USB
+ *                          transmissions are held back until the download
+ *                          has finished.
+ *
+ * @param[in] request       Download request, checked when started.
+ * @return                  True if the whole region was acknowledged.
+ */
+static bool FlashDownloadRun(const flash_download_request_t *request)
+{
+    flash_download_reply_t reply;
+    uint16_t num_chunks, base, next, sequence;
+    uint8_t window;
+    int retries;
+    bool success = true;
+
+    window = request->window;
+    if (window == 0)
+        window = 1;
+    else if (window > FLASH_DOWNLOAD_MAX_WINDOW)
+        window = FLASH_DOWNLOAD_MAX_WINDOW;
+
+    num_chunks = (request->length + FLASH_DOWNLOAD_CHUNK_SIZE - 1) /
+                 FLASH_DOWNLOAD_CHUNK_SIZE;
+    base = 0;
+    next = 0;
+    retries = 0;
+
+    /* The flash may have changed since the last download */
+    download_buffer_sequence[0] = -1;
+    download_buffer_sequence[1] = -1;
+
+    USBClaim();
+
+    while (base < num_chunks)
+    {
+        /* Fill the window */
+        while ((next < num_chunks) && ((uint16_t)(next - base) < window))
+        {
+            if (FlashDownloadSendChunk(request, next) == false)
+            {
+                /* The host is not reading */
+                success = false;
+                break;
+            }
+
+            next++;
+        }
+
+        if (success == false)
+            break;
+
+        /* Read the next chunk while the host catches up */
+        if (next < num_chunks)
+            FlashDownloadPrefetch(request, next);
+
+        reply = FlashDownloadWaitReply(&sequence);
+
+        if (reply == FLASH_DOWNLOAD_REPLY_ACK)
+        {
+            if ((sequence > base) && (sequence <= next))
+            {
+                base = sequence;
+                retries = 0;
+            }
+        }
+        else if (reply == FLASH_DOWNLOAD_REPLY_NAK)
+        {
+            if ((sequence >= base) && (sequence < next))
+            {
+                base = sequence;
+                next = sequence;
+                retries = 0;
+            }
+        }
+        else if (reply == FLASH_DOWNLOAD_REPLY_TIMEOUT)
+        {
+            if (++retries > FLASH_DOWNLOAD_MAX_RETRIES)
+            {
+                success = false;
+                break;
+            }
+
+            next = base;
+        }
+        else
+        {
+            success = false;
+            break;
+        }
+    }
+
+    if (success == true)
+        success = FlashDownloadSendHeader(num_chunks,
+                                          request->address + request->length,
+                                          0);
+
+    USBRelease();
+
+    /* No reads may be left in the flash queue. */
+    if (download_buffer_sequence[0] >= 0)
+        ExternalFlash_Wait(&download_read[0]);
+    if (download_buffer_sequence[1] >= 0)
+        ExternalFlash_Wait(&download_read[1]);
+
+    return success;
+}
+
+/**
+ * @brief           The download thread streams one request at a time.
+ *
+ * @param[in] arg   Input argument (unused).
+ */
+static THD_FUNCTION(ThreadFlashDownload, arg)
+{
+    (void)arg;
+
+    /* Set thread name */
+    chRegSetThreadName("Flash Download");
+
+    while (1)
+    {
+        chEvtWaitAny(FLASH_DOWNLOAD_EVENTMASK);
+
+        (void)FlashDownloadRun(&download_request);
+
+        download_active = false;
+    }
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Starts the download thread.
+ */
+void FlashDownloadInit(void)
+{
+    download_thread = chThdCreateStatic(waThreadFlashDownload,
+                                        sizeof(waThreadFlashDownload),
+                                        LOWPRIO,
+                                        ThreadFlashDownload,
+                                        NULL);
+}
+
+/**
+ * @brief                   Start streaming a region of the external flash
+ *                          over the USB in the download thread.
+ * @note                    Returns at once. Refused while armed, while
+ *                          another download is active or if the region is
+ *                          outside the flash.
+ *
+ * @param[in] request       Download request.
+ * @return                  True if the download was started.
+ */
+bool FlashDownload_Start(const flash_download_request_t *request)
+{
+    if ((request->length == 0) ||
+        (request->address >= FLASH_DOWNLOAD_SIZE) ||
+        (request->length > (FLASH_DOWNLOAD_SIZE - request->address)) ||
+        (isUSBActive() == false) ||
+        (bIsSystemArmed() == true) ||
+        (download_thread == NULL))
+        return false;
+
+    osalSysLock();
+
+    if (download_active == true)
+    {
+        osalSysUnlock();
+        return false;
+    }
+
+    download_active = true;
+    download_request = *request;
+
+    osalSysUnlock();
+
+    chEvtSignal(download_thread, FLASH_DOWNLOAD_EVENTMASK);
+
+    return true;
+}
+
+/**
+ * @brief                   Check if a download owns the USB.
+ *
+ * @return                  True from the start of a download until it has
+ *                          finished.
+ */
+bool FlashDownload_IsActive(void)
+{
+    return download_active;
+}
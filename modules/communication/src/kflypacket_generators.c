@@ -10,13 +10,22 @@
 #include "system_information.h"
 #include "serialmanager.h"
 #include "slip.h"
+#include "cobs.h"
 #include "crc.h"
 #include "pid.h"
 #include "sensor_read.h"
 #include "estimation.h"
 #include "control.h"
 #include "rc_input.h"
+#include "crsf.h"
+#include "rc_interpolation.h"
 #include "rc_output.h"
+#include "esc_telemetry.h"
+#include "blackbox.h"
+#include "mag_calibration.h"
+#include "accel_calibration.h"
+#include "sensor_health.h"
+#include "subscriptions.h"
 #include "kflypacket_parsers.h"
 #include "kflypacket_generators.h"
 
@@ -24,6 +33,9 @@
 /* Module local definitions.                                                 */
 /*===========================================================================*/
 
+/* Most chunks a message is generated from */
+#define FRAME_MAX_CHUNKS                    8
+
 static bool GenerateACK(circular_buffer_t *Cbuff);
 static bool GeneratePing(circular_buffer_t *Cbuff);
 static bool GenerateGetRunningMode(circular_buffer_t *Cbuff);
@@ -50,6 +62,19 @@ static bool GenerateGetEstimationVelocity(circular_buffer_t *Cbuff);
 static bool GenerateGetEstimationPosition(circular_buffer_t *Cbuff);
 static bool GenerateGetEstimationAllStates(circular_buffer_t *Cbuff);
 static bool GenerateGetControlFilters(circular_buffer_t *Cbuff);
+static bool GenerateGetOutputAllocation(circular_buffer_t *Cbuff);
+static bool GenerateGetThrustCurves(circular_buffer_t *Cbuff);
+static bool GenerateGetRCLinkStatistics(circular_buffer_t *Cbuff);
+static bool GenerateGetRCInterpolation(circular_buffer_t *Cbuff);
+static bool GenerateGetBlackboxSettings(circular_buffer_t *Cbuff);
+static bool GenerateGetBlackboxStatus(circular_buffer_t *Cbuff);
+static bool GenerateGetMagCalibrationStatus(circular_buffer_t *Cbuff);
+static bool GenerateGetAccelCalibrationStatus(circular_buffer_t *Cbuff);
+static bool GenerateGetSensorHealth(circular_buffer_t *Cbuff);
+static bool GenerateGetSubscriptionStatus(circular_buffer_t *Cbuff);
+static bool GenerateGetPortStatistics(circular_buffer_t *Cbuff);
+static bool GenerateGetSerialPortConfig(circular_buffer_t *Cbuff);
+static bool GenerateGetEscTelemetry(circular_buffer_t *Cbuff);
 // static uint32_t myStrlen(const uint8_t *str, const uint32_t max_length);
 
 /*===========================================================================*/
@@ -122,32 +147,32 @@ static const kfly_generator_t generator_lookup[128] = {
     NULL,                             /* 55:                                  */
     GenerateGetControlFilters,        /* 56:  Cmd_GetControlFilters           */
     NULL,                             /* 57:  Cmd_SetControlFilters           */
-    NULL,                             /* 58:                                  */
-    NULL,                             /* 59:                                  */
-    NULL,                             /* 60:                                  */
-    NULL,                             /* 61:                                  */
-    NULL,                             /* 62:                                  */
-    NULL,                             /* 63:                                  */
-    NULL,                             /* 64:                                  */
-    NULL,                             /* 65:                                  */
-    NULL,                             /* 66:                                  */
-    NULL,                             /* 67:                                  */
-    NULL,                             /* 68:                                  */
-    NULL,                             /* 69:                                  */
-    NULL,                             /* 70:                                  */
-    NULL,                             /* 71:                                  */
-    NULL,                             /* 72:                                  */
-    NULL,                             /* 73:                                  */
-    NULL,                             /* 74:                                  */
-    NULL,                             /* 75:                                  */
-    NULL,                             /* 76:                                  */
-    NULL,                             /* 77:                                  */
-    NULL,                             /* 78:                                  */
-    NULL,                             /* 79:                                  */
-    NULL,                             /* 80:                                  */
-    NULL,                             /* 81:                                  */
-    NULL,                             /* 82:                                  */
-    NULL,                             /* 83:                                  */
+    GenerateGetOutputAllocation,      /* 58:  Cmd_GetOutputAllocation         */
+    NULL,                             /* 59:  Cmd_SetOutputAllocation         */
+    GenerateGetThrustCurves,          /* 60:  Cmd_GetThrustCurves             */
+    NULL,                             /* 61:  Cmd_SetThrustCurves             */
+    NULL,                             /* 62:  Cmd_CalibrateThrustCurve        */
+    GenerateGetRCLinkStatistics,      /* 63:  Cmd_GetRCLinkStatistics         */
+    GenerateGetRCInterpolation,       /* 64:  Cmd_GetRCInterpolation          */
+    NULL,                             /* 65:  Cmd_SetRCInterpolation          */
+    GenerateGetBlackboxSettings,      /* 66:  Cmd_GetBlackboxSettings         */
+    NULL,                             /* 67:  Cmd_SetBlackboxSettings         */
+    GenerateGetBlackboxStatus,        /* 68:  Cmd_GetBlackboxStatus           */
+    NULL,                             /* 69:  Cmd_EraseBlackbox               */
+    NULL,                             /* 70:  Cmd_ReadFlash                   */
+    GenerateGetMagCalibrationStatus,  /* 71:  Cmd_GetMagCalibrationStatus     */
+    NULL,                             /* 72:  Cmd_ManageMagCalibration        */
+    GenerateGetAccelCalibrationStatus,/* 73:  Cmd_GetAccelCalibrationStatus   */
+    NULL,                             /* 74:  Cmd_ManageAccelCalibration      */
+    GenerateGetSensorHealth,          /* 75:  Cmd_GetSensorHealth             */
+    GenerateGetSubscriptionStatus,    /* 76:  Cmd_GetSubscriptionStatus       */
+    GenerateGetPortStatistics,        /* 77:  Cmd_GetPortStatistics           */
+    GenerateGetSerialPortConfig,      /* 78:  Cmd_GetSerialPortConfig         */
+    NULL,                             /* 79:  Cmd_SetSerialPortConfig         */
+    GenerateGetEscTelemetry,          /* 80:  Cmd_GetEscTelemetry             */
+    NULL,                             /* 81:  Cmd_GetParameterInfo            */
+    NULL,                             /* 82:  Cmd_GetParameters               */
+    NULL,                             /* 83:  Cmd_SetParameters               */
     NULL,                             /* 84:                                  */
     NULL,                             /* 85:                                  */
     NULL,                             /* 86:                                  */
@@ -194,10 +219,122 @@ static const kfly_generator_t generator_lookup[128] = {
     NULL                              /* 127:                                 */
 };
 
+/**
+ * @brief   Telemetry frames are generated here first, so their size is known
+ *          before older telemetry is dropped to make room. Twice the largest
+ *          frame, as a circular buffer holds one byte less than its size.
+ */
+static uint8_t telemetry_scratch_data[2 * SERIAL_TELEMETRY_FRAME_SIZE];
+static circular_buffer_t telemetry_scratch;
+static link_framing_t telemetry_scratch_framing;
+static MUTEX_DECL(telemetry_scratch_lock);
+
 /*===========================================================================*/
 /* Module local functions.                                                   */
 /*===========================================================================*/
 
+/**
+ * @brief               Link layer framing of the port a circular buffer
+ *                      belongs to, or of the port the telemetry scratch
+ *                      buffer is in use for.
+ *
+ * @param[in] Cbuff     Pointer to the circular buffer.
+ * @return              Framing to use.
+ */
+static link_framing_t GetFraming(circular_buffer_t *Cbuff)
+{
+    if (Cbuff == &telemetry_scratch)
+        return telemetry_scratch_framing;
+
+    return SerialManager_GetFramingFromCircularBuffer(Cbuff);
+}
+
+/**
+ * @brief               Frames multiple chunks of data with the link layer
+ *                      framing of the port the circular buffer belongs to.
+ *
+ * @param[in]  ptr_list     Pointer to the list of pointers, pointing to data
+ *                          chunks.
+ * @param[in]  length_list  List of lengths for each chunk.
+ * @param[in]  size         Size of the lists, at most FRAME_MAX_CHUNKS.
+ * @param[out] Cbuff        Pointer to the circular buffer where the data will
+ *                          be stored.
+ * @return                  HAL_FAILED if the message didn't fit or HAL_SUCCESS
+ *                          if it did fit.
+ */
+static bool GenerateFrame_MultiChunk(uint8_t *ptr_list[],
+                                     uint32_t length_list[],
+                                     const uint32_t size,
+                                     circular_buffer_t *Cbuff)
+{
+    const uint8_t *cobs_ptr_list[FRAME_MAX_CHUNKS];
+    size_t cobs_length_list[FRAME_MAX_CHUNKS];
+    cobs_encoder_t enc;
+    uint32_t i;
+
+    if (GetFraming(Cbuff) != LINK_FRAMING_COBS)
+        return GenerateSLIP_MultiChunk(ptr_list, length_list, size, Cbuff);
+
+    if (size > FRAME_MAX_CHUNKS)
+        return HAL_FAILED;
+
+    for (i = 0; i < size; i++)
+    {
+        cobs_ptr_list[i] = ptr_list[i];
+        cobs_length_list[i] = length_list[i];
+    }
+
+    return COBSEncode_MultiChunk(cobs_ptr_list, cobs_length_list, size,
+                                 Cbuff, &enc);
+}
+
+/**
+ * @brief               Frames a header, body and tail with the link layer
+ *                      framing of the port the circular buffer belongs to.
+ *
+ * @param[in]   head    Pointer to the data to be encoded.
+ * @param[in]   h_size  Size of the data.
+ * @param[in]   body    Pointer to the data to be encoded, may be NULL.
+ * @param[in]   b_size  Size of the data.
+ * @param[in]   tail    Pointer to the data to be encoded.
+ * @param[in]   t_size  Size of the data.
+ * @param[out]  Cbuff   Pointer to the circular buffer where the data will be
+ *                      stored.
+ * @return              HAL_FAILED if the message didn't fit or HAL_SUCCESS
+ *                      if it did fit.
+ */
+static bool GenerateFrame_HBT(uint8_t *head,
+                              const uint32_t h_size,
+                              uint8_t *body,
+                              const uint32_t b_size,
+                              uint8_t *tail,
+                              const uint32_t t_size,
+                              circular_buffer_t *Cbuff)
+{
+    const uint8_t *ptr_list[3];
+    size_t length_list[3];
+    cobs_encoder_t enc;
+    uint32_t size = 0;
+
+    if (GetFraming(Cbuff) != LINK_FRAMING_COBS)
+        return GenerateSLIP_HBT(head, h_size, body, b_size, tail, t_size,
+                                Cbuff);
+
+    ptr_list[size] = head;
+    length_list[size++] = h_size;
+
+    if (body != NULL)
+    {
+        ptr_list[size] = body;
+        length_list[size++] = b_size;
+    }
+
+    ptr_list[size] = tail;
+    length_list[size++] = t_size;
+
+    return COBSEncode_MultiChunk(ptr_list, length_list, size, Cbuff, &enc);
+}
+
 /**
  * @brief                   Generates a message for the transmission of PI
  *                          controller data.
@@ -240,7 +377,7 @@ static bool GenerateGenericGetControllerData(kfly_command_t command,
     for (uint32_t i = 0; i < size - 1; i++)
         crc16 = CRC16_chunk(ptr_list[i], len_list[i], crc16);
 
-    return GenerateSLIP_MultiChunk(ptr_list, len_list, size, Cbuff);
+    return GenerateFrame_MultiChunk(ptr_list, len_list, size, Cbuff);
 }
 
 /**
@@ -261,9 +398,9 @@ static bool GenerateHeaderOnlyCommand(kfly_command_t command,
     /* Calculate the CRC. */
     crc16 = CRC16(header, 2);
 
-    /* Apply SLIP encoding on the fly and return the result. */
-    return GenerateSLIP_HBT(header, 2, NULL, 0, (uint8_t *)&crc16, 2,
-                            Cbuff);
+    /* Apply the framing on the fly and return the result. */
+    return GenerateFrame_HBT(header, 2, NULL, 0, (uint8_t *)&crc16, 2,
+                             Cbuff);
 }
 
 /**
@@ -294,9 +431,9 @@ static bool GenerateGenericCommand(kfly_command_t command,
         crc16 = CRC16_step(data[i], crc16);
 
 
-    /* Apply SLIP encoding on the fly and return the result. */
-    return GenerateSLIP_HBT(header, 2, data, size, (uint8_t *)&crc16, 2,
-                            Cbuff);
+    /* Apply the framing on the fly and return the result. */
+    return GenerateFrame_HBT(header, 2, data, size, (uint8_t *)&crc16, 2,
+                             Cbuff);
 }
 
 
@@ -714,6 +851,251 @@ static bool GenerateGetControlFilters(circular_buffer_t *Cbuff)
                                   Cbuff);
 }
 
+/**
+ * @brief               Generates the message for sending the output
+ *                      allocation settings.
+ *
+ * @param[out] Cbuff    Pointer to the circular buffer to put the data in.
+ * @return              HAL_FAILED if the message didn't fit or HAL_SUCCESS
+ *                      if it did fit.
+ */
+static bool GenerateGetOutputAllocation(circular_buffer_t *Cbuff)
+{
+    return GenerateGenericCommand(Cmd_GetOutputAllocation,
+                                  (uint8_t *)ptrGetOutputAllocation(),
+                                  OUTPUT_ALLOCATION_SIZE,
+                                  Cbuff);
+}
+
+/**
+ * @brief               Generates the message for sending the thrust curves.
+ *
+ * @param[out] Cbuff    Pointer to the circular buffer to put the data in.
+ * @return              HAL_FAILED if the message didn't fit or HAL_SUCCESS
+ *                      if it did fit.
+ */
+static bool GenerateGetThrustCurves(circular_buffer_t *Cbuff)
+{
+    return GenerateGenericCommand(Cmd_GetThrustCurves,
+                                  (uint8_t *)ptrGetThrustCurves(),
+                                  THRUST_CURVE_SETTINGS_SIZE,
+                                  Cbuff);
+}
+
+/**
+ * @brief               Generates the message for sending the RC link
+ *                      statistics.
+ *
+ * @param[out] Cbuff    Pointer to the circular buffer to put the data in.
+ * @return              HAL_FAILED if the message didn't fit or HAL_SUCCESS
+ *                      if it did fit.
+ */
+static bool GenerateGetRCLinkStatistics(circular_buffer_t *Cbuff)
+{
+    return GenerateGenericCommand(Cmd_GetRCLinkStatistics,
+                                  (uint8_t *)ptrGetCRSFStatistics(),
+                                  CRSF_STATISTICS_SIZE,
+                                  Cbuff);
+}
+
+/**
+ * @brief               Generates the message for sending the RC
+ *                      interpolation settings.
+ *
+ * @param[out] Cbuff    Pointer to the circular buffer to put the data in.
+ * @return              HAL_FAILED if the message didn't fit or HAL_SUCCESS
+ *                      if it did fit.
+ */
+static bool GenerateGetRCInterpolation(circular_buffer_t *Cbuff)
+{
+    return GenerateGenericCommand(Cmd_GetRCInterpolation,
+                                  (uint8_t *)ptrGetRCInterpolationSettings(),
+                                  RCINTERPOLATION_SETTINGS_SIZE,
+                                  Cbuff);
+}
+
+/**
+ * @brief               Generates the message for sending the blackbox
+ *                      settings.
+ *
+ * @param[out] Cbuff    Pointer to the circular buffer to put the data in.
+ * @return              HAL_FAILED if the message didn't fit or HAL_SUCCESS
+ *                      if it did fit.
+ */
+static bool GenerateGetBlackboxSettings(circular_buffer_t *Cbuff)
+{
+    return GenerateGenericCommand(Cmd_GetBlackboxSettings,
+                                  (uint8_t *)ptrGetBlackboxSettings(),
+                                  BLACKBOX_SETTINGS_SIZE,
+                                  Cbuff);
+}
+
+/**
+ * @brief               Generates the message for sending the blackbox
+ *                      status.
+ *
+ * @param[out] Cbuff    Pointer to the circular buffer to put the data in.
+ * @return              HAL_FAILED if the message didn't fit or HAL_SUCCESS
+ *                      if it did fit.
+ */
+static bool GenerateGetBlackboxStatus(circular_buffer_t *Cbuff)
+{
+    return GenerateGenericCommand(Cmd_GetBlackboxStatus,
+                                  (uint8_t *)ptrGetBlackboxStatus(),
+                                  BLACKBOX_STATUS_SIZE,
+                                  Cbuff);
+}
+
+/**
+ * @brief               Generates the message for sending the magnetometer
+ *                      calibration status.
+ *
+ * @param[out] Cbuff    Pointer to the circular buffer to put the data in.
+ * @return              HAL_FAILED if the message didn't fit or HAL_SUCCESS
+ *                      if it did fit.
+ */
+static bool GenerateGetMagCalibrationStatus(circular_buffer_t *Cbuff)
+{
+    /* Temporary status holder */
+    static mag_calibration_status_t status;
+
+    GetMagCalibrationStatus(&status);
+
+    return GenerateGenericCommand(Cmd_GetMagCalibrationStatus,
+                                  (uint8_t *)&status,
+                                  MAG_CALIBRATION_STATUS_SIZE,
+                                  Cbuff);
+}
+
+/**
+ * @brief               Generates the message for sending the accelerometer
+ *                      calibration status.
+ *
+ * @param[out] Cbuff    Pointer to the circular buffer to put the data in.
+ * @return              HAL_FAILED if the message didn't fit or HAL_SUCCESS
+ *                      if it did fit.
+ */
+static bool GenerateGetAccelCalibrationStatus(circular_buffer_t *Cbuff)
+{
+    /* Temporary status holder */
+    static accel_calibration_status_t status;
+
+    GetAccelCalibrationStatus(&status);
+
+    return GenerateGenericCommand(Cmd_GetAccelCalibrationStatus,
+                                  (uint8_t *)&status,
+                                  ACCEL_CALIBRATION_STATUS_SIZE,
+                                  Cbuff);
+}
+
+/**
+ * @brief               Generates the message for sending the sensor health
+ *                      statistics.
+ *
+ * @param[out] Cbuff    Pointer to the circular buffer to put the data in.
+ * @return              HAL_FAILED if the message didn't fit or HAL_SUCCESS
+ *                      if it did fit.
+ */
+static bool GenerateGetSensorHealth(circular_buffer_t *Cbuff)
+{
+    /* Temporary health holder */
+    static sensor_health_t health;
+
+    GetSensorHealth(&health);
+
+    return GenerateGenericCommand(Cmd_GetSensorHealth,
+                                  (uint8_t *)&health,
+                                  SENSOR_HEALTH_SIZE,
+                                  Cbuff);
+}
+
+/**
+ * @brief               Generates the message for sending the status of the
+ *                      active subscriptions.
+ *
+ * @param[out] Cbuff    Pointer to the circular buffer to put the data in.
+ * @return              HAL_FAILED if the message didn't fit or HAL_SUCCESS
+ *                      if it did fit.
+ */
+static bool GenerateGetSubscriptionStatus(circular_buffer_t *Cbuff)
+{
+    /* Temporary status holder */
+    static subscription_status_t status[MAX_NUMBER_OF_SUBSCRIPTIONS];
+    uint32_t count;
+
+    count = GetSubscriptionStatus(status);
+
+    return GenerateGenericCommand(Cmd_GetSubscriptionStatus,
+                                  (uint8_t *)status,
+                                  count * SUBSCRIPTION_STATUS_SIZE,
+                                  Cbuff);
+}
+
+/**
+ * @brief               Generates the message for sending the transmit
+ *                      statistics of all ports.
+ *
+ * @param[out] Cbuff    Pointer to the circular buffer to put the data in.
+ * @return              HAL_FAILED if the message didn't fit or HAL_SUCCESS
+ *                      if it did fit.
+ */
+static bool GenerateGetPortStatistics(circular_buffer_t *Cbuff)
+{
+    /* Temporary statistics holder */
+    static serial_port_statistics_t stats[SERIAL_NUMBER_OF_PORTS];
+
+    SerialManager_GetStatistics(stats);
+
+    return GenerateGenericCommand(Cmd_GetPortStatistics,
+                                  (uint8_t *)stats,
+                                  SERIAL_NUMBER_OF_PORTS *
+                                  SERIAL_PORT_STATISTICS_SIZE,
+                                  Cbuff);
+}
+
+/**
+ * @brief               Generates the message for sending the configuration
+ *                      of all serial ports.
+ *
+ * @param[out] Cbuff    Pointer to the circular buffer to put the data in.
+ * @return              HAL_FAILED if the message didn't fit or HAL_SUCCESS
+ *                      if it did fit.
+ */
+static bool GenerateGetSerialPortConfig(circular_buffer_t *Cbuff)
+{
+    /* Temporary configuration holder */
+    static serial_port_config_t config[SERIAL_NUMBER_OF_PORTS];
+
+    SerialManager_GetConfig(config);
+
+    return GenerateGenericCommand(Cmd_GetSerialPortConfig,
+                                  (uint8_t *)config,
+                                  SERIAL_NUMBER_OF_PORTS *
+                                  SERIAL_PORT_CONFIG_SIZE,
+                                  Cbuff);
+}
+
+/**
+ * @brief               Generates the message for sending the latest ESC
+ *                      telemetry.
+ *
+ * @param[out] Cbuff    Pointer to the circular buffer to put the data in.
+ * @return              HAL_FAILED if the message didn't fit or HAL_SUCCESS
+ *                      if it did fit.
+ */
+static bool GenerateGetEscTelemetry(circular_buffer_t *Cbuff)
+{
+    /* Temporary telemetry holder */
+    static esc_telemetry_t telemetry;
+
+    GetEscTelemetry(&telemetry);
+
+    return GenerateGenericCommand(Cmd_GetEscTelemetry,
+                                  (uint8_t *)&telemetry,
+                                  ESC_TELEMETRY_SIZE,
+                                  Cbuff);
+}
+
 /**
  * @brief                   Calculates the length of a string but with
  *                          maximum length termination.
@@ -733,13 +1115,113 @@ static bool GenerateGetControlFilters(circular_buffer_t *Cbuff)
 //     return (s - str);
 // }
 
+/**
+ * @brief               Generates a message into a circular buffer, either
+ *                      from the lookup table or from custom data.
+ *
+ * @param[in] command   The command to generate a message for.
+ * @param[in] data      Pointer to custom data, NULL to use the generator in
+ *                      the lookup table.
+ * @param[in] size      Size of the custom data.
+ * @param[out] Cbuff    Pointer to the circular buffer to put the data in.
+ * @return              HAL_FAILED if the message didn't fit or HAL_SUCCESS
+ *                      if it did fit.
+ */
+static bool GenerateIntoBuffer(kfly_command_t command,
+                               uint8_t *data,
+                               uint16_t size,
+                               circular_buffer_t *Cbuff)
+{
+    if (data != NULL)
+        return GenerateGenericCommand(command, data, size, Cbuff);
+    else
+        return generator_lookup[command](Cbuff);
+}
+
+/**
+ * @brief               Queues a response in the transmit buffer of a port.
+ *                      If the buffer is full the data pump is given up to
+ *                      SERIAL_RESPONSE_TIMEOUT_MS to make room, after which
+ *                      the response is dropped. From the serial manager
+ *                      thread the port is only transmitted once without
+ *                      waiting. ACKs may use the reserve of the buffer and
+ *                      are never held up.
+ *
+ * @param[in] command   The command to generate a message for.
+ * @param[in] data      Pointer to custom data, NULL to use the generator in
+ *                      the lookup table.
+ * @param[in] size      Size of the custom data.
+ * @param[in] port      Which port to send the data.
+ * @return              HAL_FAILED if the message was dropped or HAL_SUCCESS
+ *                      if it was queued.
+ */
+static bool QueueResponse(kfly_command_t command,
+                          uint8_t *data,
+                          uint16_t size,
+                          external_port_t port)
+{
+    const systime_t start = chVTGetSystemTimeX();
+    circular_buffer_t *Cbuff = NULL;
+    size_t head, reserved, queued = 0;
+    bool status, may_wait = true;
+
+    Cbuff = SerialManager_GetCircularBufferFromPort(port);
+
+    /* Check so the circular buffer address is valid and in use */
+    if ((Cbuff == NULL) || (Cbuff->size == 0))
+        return HAL_FAILED;
+
+    while (1)
+    {
+        /* Claim the circular buffer for writing */
+        CircularBuffer_Claim(Cbuff);
+        {
+            reserved = Cbuff->reserved;
+
+            if (command == Cmd_ACK)
+                CircularBuffer_SetReserved(Cbuff, 0);
+
+            head = Cbuff->head;
+            status = GenerateIntoBuffer(command, data, size, Cbuff);
+            queued = (Cbuff->head - head) & Cbuff->mask;
+
+            CircularBuffer_SetReserved(Cbuff, reserved);
+        }
+        /* Release the circular buffer */
+        CircularBuffer_Release(Cbuff);
+
+        /* If it was successful then start the transmission */
+        if (status == HAL_SUCCESS)
+        {
+            SerialManager_CountQueued(port, queued);
+            SerialManager_StartTransmission(port);
+
+            return HAL_SUCCESS;
+        }
+
+        if ((command == Cmd_ACK) || (may_wait == false) ||
+            ((chVTGetSystemTimeX() - start) >=
+             MS2ST(SERIAL_RESPONSE_TIMEOUT_MS)))
+        {
+            SerialManager_CountDropped(port, 0, false);
+
+            return HAL_FAILED;
+        }
+
+        /* Wait for the serial manager to make room */
+        may_wait = SerialManager_WaitForSpace(port, MS2ST(1));
+    }
+}
+
 /*===========================================================================*/
 /* Module exported functions.                                                */
 /*===========================================================================*/
 
  /**
-  * @brief              Generate a message for the ports based on the
-  *                     generators in the lookup table.
+  * @brief              Generate a response for the ports based on the
+  *                     generators in the lookup table. Blocks up to
+  *                     SERIAL_RESPONSE_TIMEOUT_MS if the transmit buffer is
+  *                     full.
   *
   * @param[in] command  The command to generate a message for.
   * @param[in] port     Which port to send the data.
@@ -748,39 +1230,103 @@ static bool GenerateGetControlFilters(circular_buffer_t *Cbuff)
   */
 bool GenerateMessage(kfly_command_t command, external_port_t port)
 {
-    bool status;
-    circular_buffer_t *Cbuff = NULL;
+    /* Check so there is an available Generator function for this command */
+    if (generator_lookup[command] == NULL)
+        return HAL_FAILED;
 
-    Cbuff = SerialManager_GetCircularBufferFromPort(port);
+    return QueueResponse(command, NULL, 0, port);
+}
 
-    /* Check so the circular buffer address is valid */
-    if (Cbuff == NULL)
+ /**
+  * @brief              Generate a telemetry message for the ports based on
+  *                     the generators in the lookup table. If the telemetry
+  *                     queue is full the oldest telemetry is dropped to make
+  *                     room, this never blocks on the data pump.
+  *
+  * @param[in] command  The command to generate a message for.
+  * @param[in] port     Which port to send the data.
+  * @param[out] size    Number of bytes put in the telemetry queue.
+  * @return             HAL_FAILED if the message didn't fit or HAL_SUCCESS
+  *                     if it did fit.
+  */
+bool GenerateTelemetryMessage(kfly_command_t command,
+                              external_port_t port,
+                              size_t *size)
+{
+    bool status = HAL_FAILED;
+    size_t start;
+    circular_buffer_t *Tbuff = NULL;
+
+    *size = 0;
+
+    Tbuff = SerialManager_GetTelemetryBufferFromPort(port);
+
+    /* Check so the circular buffer address is valid and that there is an
+       available Generator function for this command */
+    if ((Tbuff == NULL) || (generator_lookup[command] == NULL))
         return HAL_FAILED;
 
-    /* Check so there is an available Generator function for this command */
-    if (generator_lookup[command] != NULL)
+    chMtxLock(&telemetry_scratch_lock);
+
+    /* Generate the frame first, the data pump can not transmit frames larger
+       than its staging so these are rejected without dropping anything */
+    CircularBuffer_Init(&telemetry_scratch,
+                        telemetry_scratch_data,
+                        sizeof(telemetry_scratch_data));
+    telemetry_scratch_framing = SerialManager_GetFraming(port);
+
+    if ((generator_lookup[command](&telemetry_scratch) == HAL_SUCCESS) &&
+        (CircularBuffer_Count(&telemetry_scratch) <=
+         SERIAL_TELEMETRY_FRAME_SIZE))
     {
+        *size = CircularBuffer_Count(&telemetry_scratch);
+
         /* Claim the circular buffer for writing */
-        CircularBuffer_Claim(Cbuff);
+        CircularBuffer_Claim(Tbuff);
         {
-            status = generator_lookup[command](Cbuff);
+            /* Drop the oldest telemetry until the new frame fits */
+            while ((CircularBuffer_SpaceLeft(Tbuff) <
+                    CIRCULAR_BUFFER_FRAME_PREFIX + *size) &&
+                   (CircularBuffer_Count(Tbuff) > 0))
+                SerialManager_CountDropped(port,
+                                           CircularBuffer_DropFrame(Tbuff),
+                                           true);
+
+            if ((CircularBuffer_SpaceLeft(Tbuff) >=
+                 CIRCULAR_BUFFER_FRAME_PREFIX + *size) &&
+                (CircularBuffer_BeginFrame(Tbuff, &start) == HAL_SUCCESS))
+            {
+                CircularBuffer_WriteChunk(Tbuff,
+                                          telemetry_scratch_data,
+                                          *size);
+                CircularBuffer_EndFrame(Tbuff, start);
+                status = HAL_SUCCESS;
+            }
         }
         /* Release the circular buffer */
-        CircularBuffer_Release(Cbuff);
+        CircularBuffer_Release(Tbuff);
+    }
 
-        /* If it was successful then start the transmission */
-        if (status == HAL_SUCCESS)
-            SerialManager_StartTransmission(port);
+    chMtxUnlock(&telemetry_scratch_lock);
+
+    /* If it was successful then start the transmission */
+    if (status == HAL_SUCCESS)
+    {
+        SerialManager_CountQueued(port, *size);
+        SerialManager_StartTransmission(port);
     }
     else
-        status = HAL_FAILED;
+    {
+        *size = 0;
+        SerialManager_CountDropped(port, 0, true);
+    }
 
     return status;
 }
 
  /**
-  * @brief              Generate a message for the ports based on the
-  *                     generators in the lookup table.
+  * @brief              Generate a response with custom data, with the same
+  *                     blocking as GenerateMessage.
   *
   * @param[in] command  The command to generate a custom message for.
   * @param[in] data     Pointer to the data to be sent.
@@ -794,31 +1340,10 @@ bool GenerateCustomMessage(kfly_command_t command,
                            uint16_t size,
                            external_port_t port)
 {
-    bool status;
-    circular_buffer_t *Cbuff = NULL;
-
-    Cbuff = SerialManager_GetCircularBufferFromPort(port);
-
-    /* Check so the circular buffer address is valid */
-    if (Cbuff == NULL)
+    if (data == NULL)
         return HAL_FAILED;
 
-    /* Claim the circular buffer for writing */
-    CircularBuffer_Claim(Cbuff);
-    {
-        status = GenerateGenericCommand(command,
-                                        data,
-                                        size,
-                                        Cbuff);
-    }
-    /* Release the circular buffer */
-    CircularBuffer_Release(Cbuff);
-
-    /* If it was successful then start the transmission */
-    if (status == HAL_SUCCESS)
-        SerialManager_StartTransmission(port);
-
-    return status;
+    return QueueResponse(command, data, size, port);
 }
 
 
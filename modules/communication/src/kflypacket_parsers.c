@@ -13,17 +13,25 @@
 #include "flash_save.h"
 #include "system_information.h"
 #include "kflypacket_generators.h"
+#include "serialmanager.h"
 #include "slip2kflypacket.h"
 #include "subscriptions.h"
 #include "crc.h"
 #include "pid.h"
 #include "rc_input.h"
+#include "rc_interpolation.h"
 #include "rc_output.h"
 #include "sensor_read.h"
 #include "estimation.h"
 #include "control.h"
 #include "computer_control.h"
+#include "output_allocation.h"
 #include "motion_capture.h"
+#include "blackbox.h"
+#include "flash_download.h"
+#include "mag_calibration.h"
+#include "accel_calibration.h"
+#include "parameters.h"
 #include "kflypacket_parsers.h"
 
 /*===========================================================================*/
@@ -72,6 +80,32 @@ static void ParseGetEstimationAllStates(kfly_parser_t *pHolder);
 static void ParseResetEstimation(kfly_parser_t *pHolder);
 static void ParseGetControlFilters(kfly_parser_t *pHolder);
 static void ParseSetControlFilters(kfly_parser_t *pHolder);
+static void ParseGetOutputAllocation(kfly_parser_t *pHolder);
+static void ParseSetOutputAllocation(kfly_parser_t *pHolder);
+static void ParseGetThrustCurves(kfly_parser_t *pHolder);
+static void ParseSetThrustCurves(kfly_parser_t *pHolder);
+static void ParseCalibrateThrustCurve(kfly_parser_t *pHolder);
+static void ParseGetRCLinkStatistics(kfly_parser_t *pHolder);
+static void ParseGetRCInterpolation(kfly_parser_t *pHolder);
+static void ParseSetRCInterpolation(kfly_parser_t *pHolder);
+static void ParseGetBlackboxSettings(kfly_parser_t *pHolder);
+static void ParseSetBlackboxSettings(kfly_parser_t *pHolder);
+static void ParseGetBlackboxStatus(kfly_parser_t *pHolder);
+static void ParseEraseBlackbox(kfly_parser_t *pHolder);
+static void ParseReadFlash(kfly_parser_t *pHolder);
+static void ParseGetMagCalibrationStatus(kfly_parser_t *pHolder);
+static void ParseManageMagCalibration(kfly_parser_t *pHolder);
+static void ParseGetAccelCalibrationStatus(kfly_parser_t *pHolder);
+static void ParseManageAccelCalibration(kfly_parser_t *pHolder);
+static void ParseGetSensorHealth(kfly_parser_t *pHolder);
+static void ParseGetSubscriptionStatus(kfly_parser_t *pHolder);
+static void ParseGetPortStatistics(kfly_parser_t *pHolder);
+static void ParseGetSerialPortConfig(kfly_parser_t *pHolder);
+static void ParseSetSerialPortConfig(kfly_parser_t *pHolder);
+static void ParseGetEscTelemetry(kfly_parser_t *pHolder);
+static void ParseGetParameterInfo(kfly_parser_t *pHolder);
+static void ParseGetParameters(kfly_parser_t *pHolder);
+static void ParseSetParameters(kfly_parser_t *pHolder);
 static void ParseComputerControlReference(kfly_parser_t *pHolder);
 static void ParseMotionCaptureMeasurement(kfly_parser_t *pHolder);
 
@@ -147,32 +181,32 @@ static const kfly_data_parser_t parser_lookup[128] = {
     ParseResetEstimation,             /* 55:  Cmd_ResetEstimation             */
     ParseGetControlFilters,           /* 56:  Cmd_GetControlFilters           */
     ParseSetControlFilters,           /* 57:  Cmd_SetControlFilters           */
-    NULL,                             /* 58:                                  */
-    NULL,                             /* 59:                                  */
-    NULL,                             /* 60:                                  */
-    NULL,                             /* 61:                                  */
-    NULL,                             /* 62:                                  */
-    NULL,                             /* 63:                                  */
-    NULL,                             /* 64:                                  */
-    NULL,                             /* 65:                                  */
-    NULL,                             /* 66:                                  */
-    NULL,                             /* 67:                                  */
-    NULL,                             /* 68:                                  */
-    NULL,                             /* 69:                                  */
-    NULL,                             /* 70:                                  */
-    NULL,                             /* 71:                                  */
-    NULL,                             /* 72:                                  */
-    NULL,                             /* 73:                                  */
-    NULL,                             /* 74:                                  */
-    NULL,                             /* 75:                                  */
-    NULL,                             /* 76:                                  */
-    NULL,                             /* 77:                                  */
-    NULL,                             /* 78:                                  */
-    NULL,                             /* 79:                                  */
-    NULL,                             /* 80:                                  */
-    NULL,                             /* 81:                                  */
-    NULL,                             /* 82:                                  */
-    NULL,                             /* 83:                                  */
+    ParseGetOutputAllocation,         /* 58:  Cmd_GetOutputAllocation         */
+    ParseSetOutputAllocation,         /* 59:  Cmd_SetOutputAllocation         */
+    ParseGetThrustCurves,             /* 60:  Cmd_GetThrustCurves             */
+    ParseSetThrustCurves,             /* 61:  Cmd_SetThrustCurves             */
+    ParseCalibrateThrustCurve,        /* 62:  Cmd_CalibrateThrustCurve        */
+    ParseGetRCLinkStatistics,         /* 63:  Cmd_GetRCLinkStatistics         */
+    ParseGetRCInterpolation,          /* 64:  Cmd_GetRCInterpolation          */
+    ParseSetRCInterpolation,          /* 65:  Cmd_SetRCInterpolation          */
+    ParseGetBlackboxSettings,         /* 66:  Cmd_GetBlackboxSettings         */
+    ParseSetBlackboxSettings,         /* 67:  Cmd_SetBlackboxSettings         */
+    ParseGetBlackboxStatus,           /* 68:  Cmd_GetBlackboxStatus           */
+    ParseEraseBlackbox,               /* 69:  Cmd_EraseBlackbox               */
+    ParseReadFlash,                   /* 70:  Cmd_ReadFlash                   */
+    ParseGetMagCalibrationStatus,     /* 71:  Cmd_GetMagCalibrationStatus     */
+    ParseManageMagCalibration,        /* 72:  Cmd_ManageMagCalibration        */
+    ParseGetAccelCalibrationStatus,   /* 73:  Cmd_GetAccelCalibrationStatus   */
+    ParseManageAccelCalibration,      /* 74:  Cmd_ManageAccelCalibration      */
+    ParseGetSensorHealth,             /* 75:  Cmd_GetSensorHealth             */
+    ParseGetSubscriptionStatus,       /* 76:  Cmd_GetSubscriptionStatus       */
+    ParseGetPortStatistics,           /* 77:  Cmd_GetPortStatistics           */
+    ParseGetSerialPortConfig,         /* 78:  Cmd_GetSerialPortConfig         */
+    ParseSetSerialPortConfig,         /* 79:  Cmd_SetSerialPortConfig         */
+    ParseGetEscTelemetry,             /* 80:  Cmd_GetEscTelemetry             */
+    ParseGetParameterInfo,            /* 81:  Cmd_GetParameterInfo            */
+    ParseGetParameters,               /* 82:  Cmd_GetParameters               */
+    ParseSetParameters,               /* 83:  Cmd_SetParameters               */
     NULL,                             /* 84:                                  */
     NULL,                             /* 85:                                  */
     NULL,                             /* 86:                                  */
@@ -828,6 +862,452 @@ static void ParseSetControlFilters(kfly_parser_t *pHolder)
     }
 }
 
+/**
+ * @brief               Parses a GetOutputAllocation command.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseGetOutputAllocation(kfly_parser_t *pHolder)
+{
+    GenerateMessage(Cmd_GetOutputAllocation, pHolder->port);
+}
+
+/**
+ * @brief               Parses a SetOutputAllocation command.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseSetOutputAllocation(kfly_parser_t *pHolder)
+{
+    if (pHolder->data_length == OUTPUT_ALLOCATION_SIZE)
+    {
+        osalSysLock();
+
+        /* Save the data. */
+        memcpy(ptrGetOutputAllocation(), pHolder->buffer,
+               OUTPUT_ALLOCATION_SIZE);
+
+        /* Bound the new settings. */
+        OutputAllocationSettingsValidate(ptrGetOutputAllocation());
+
+        osalSysUnlock();
+    }
+}
+
+/**
+ * @brief               Parses a GetThrustCurves command.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseGetThrustCurves(kfly_parser_t *pHolder)
+{
+    GenerateMessage(Cmd_GetThrustCurves, pHolder->port);
+}
+
+/**
+ * @brief               Parses a SetThrustCurves command.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseSetThrustCurves(kfly_parser_t *pHolder)
+{
+    if (pHolder->data_length == THRUST_CURVE_SETTINGS_SIZE)
+    {
+        osalSysLock();
+
+        /* Save the data. */
+        memcpy(ptrGetThrustCurves(), pHolder->buffer,
+               THRUST_CURVE_SETTINGS_SIZE);
+
+        /* Disable invalid curves. */
+        ThrustCurveValidate(ptrGetThrustCurves());
+
+        osalSysUnlock();
+    }
+}
+
+/**
+ * @brief               Parses a CalibrateThrustCurve command, builds the
+ *                      thrust curve of a channel from bench measurements and
+ *                      enables it.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseCalibrateThrustCurve(kfly_parser_t *pHolder)
+{
+    thrust_curve_measurement_t meas;
+    uint16_t table[THRUST_CURVE_NUM_POINTS];
+
+    if (pHolder->data_length == THRUST_CURVE_MEASUREMENT_SIZE)
+    {
+        memcpy(&meas, pHolder->buffer, THRUST_CURVE_MEASUREMENT_SIZE);
+
+        if (meas.channel >= OUTPUT_ALLOCATION_NUM_OUTPUTS)
+            return;
+
+        /* The inversion is done outside the lock. */
+        if (bThrustCurveFromMeasurements(&meas, table) == false)
+            return;
+
+        osalSysLock();
+
+        memcpy(ptrGetThrustCurves()->command[meas.channel], table,
+               sizeof(table));
+        ptrGetThrustCurves()->enabled[meas.channel] = 1;
+
+        osalSysUnlock();
+    }
+}
+
+/**
+ * @brief               Parses a GetRCLinkStatistics command.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseGetRCLinkStatistics(kfly_parser_t *pHolder)
+{
+    GenerateMessage(Cmd_GetRCLinkStatistics, pHolder->port);
+}
+
+/**
+ * @brief               Parses a GetRCInterpolation command.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseGetRCInterpolation(kfly_parser_t *pHolder)
+{
+    GenerateMessage(Cmd_GetRCInterpolation, pHolder->port);
+}
+
+/**
+ * @brief               Parses a SetRCInterpolation command.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseSetRCInterpolation(kfly_parser_t *pHolder)
+{
+    if (pHolder->data_length == RCINTERPOLATION_SETTINGS_SIZE)
+    {
+        osalSysLock();
+
+        /* Save the data. */
+        memcpy(ptrGetRCInterpolationSettings(), pHolder->buffer,
+               RCINTERPOLATION_SETTINGS_SIZE);
+
+        /* Bound the new settings. */
+        RCInterpolationSettingsValidate(ptrGetRCInterpolationSettings());
+
+        osalSysUnlock();
+    }
+}
+
+/**
+ * @brief               Parses a GetBlackboxSettings command.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseGetBlackboxSettings(kfly_parser_t *pHolder)
+{
+    GenerateMessage(Cmd_GetBlackboxSettings, pHolder->port);
+}
+
+/**
+ * @brief               Parses a SetBlackboxSettings command.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseSetBlackboxSettings(kfly_parser_t *pHolder)
+{
+    if (pHolder->data_length == BLACKBOX_SETTINGS_SIZE)
+    {
+        osalSysLock();
+
+        /* Save the data. */
+        memcpy(ptrGetBlackboxSettings(), pHolder->buffer,
+               BLACKBOX_SETTINGS_SIZE);
+
+        /* Bound the new settings. */
+        BlackboxSettingsValidate(ptrGetBlackboxSettings());
+
+        osalSysUnlock();
+    }
+}
+
+/**
+ * @brief               Parses a GetBlackboxStatus command.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseGetBlackboxStatus(kfly_parser_t *pHolder)
+{
+    GenerateMessage(Cmd_GetBlackboxStatus, pHolder->port);
+}
+
+/**
+ * @brief               Parses an EraseBlackbox command.
+ * @note                The erase is done in the background.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseEraseBlackbox(kfly_parser_t *pHolder)
+{
+    (void)pHolder;
+
+    BlackboxRequestErase();
+}
+
+/**
+ * @brief               Parses a ReadFlash command.
+ * @note                The download runs in its own thread and the USB is
+ *                      not served by the serial manager until it has
+ *                      finished. Only available over the USB, not while
+ *                      armed.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseReadFlash(kfly_parser_t *pHolder)
+{
+    flash_download_request_t request;
+
+    if ((pHolder->port == PORT_USB) &&
+        (pHolder->data_length == FLASH_DOWNLOAD_REQUEST_SIZE))
+    {
+        memcpy(&request, pHolder->buffer, FLASH_DOWNLOAD_REQUEST_SIZE);
+        (void)FlashDownload_Start(&request);
+    }
+}
+
+/**
+ * @brief               Parses a GetMagCalibrationStatus command.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseGetMagCalibrationStatus(kfly_parser_t *pHolder)
+{
+    GenerateMessage(Cmd_GetMagCalibrationStatus, pHolder->port);
+}
+
+/**
+ * @brief               Parses a ManageMagCalibration command, the payload
+ *                      is one mag_calibration_action_t.
+ * @note                A commit applies the fit and saves the IMU
+ *                      calibration to flash in the background.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseManageMagCalibration(kfly_parser_t *pHolder)
+{
+    if (pHolder->data_length == sizeof(mag_calibration_action_t))
+        MagCalibrationRequest((mag_calibration_action_t)pHolder->buffer[0]);
+}
+
+/**
+ * @brief               Parses a GetAccelCalibrationStatus command.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseGetAccelCalibrationStatus(kfly_parser_t *pHolder)
+{
+    GenerateMessage(Cmd_GetAccelCalibrationStatus, pHolder->port);
+}
+
+/**
+ * @brief               Parses a ManageAccelCalibration command, the payload
+ *                      is one accel_calibration_action_t.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseManageAccelCalibration(kfly_parser_t *pHolder)
+{
+    if (pHolder->data_length == sizeof(accel_calibration_action_t))
+    {
+        /* Reset estimation if the calibration was changed */
+        if (AccelCalibrationRequest(
+                (accel_calibration_action_t)pHolder->buffer[0]) == true)
+            ResetEstimation();
+    }
+}
+
+/**
+ * @brief               Parses a GetSensorHealth command.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseGetSensorHealth(kfly_parser_t *pHolder)
+{
+    GenerateMessage(Cmd_GetSensorHealth, pHolder->port);
+}
+
+/**
+ * @brief               Parses a GetSubscriptionStatus command.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseGetSubscriptionStatus(kfly_parser_t *pHolder)
+{
+    GenerateMessage(Cmd_GetSubscriptionStatus, pHolder->port);
+}
+
+/**
+ * @brief               Parses a GetPortStatistics command.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseGetPortStatistics(kfly_parser_t *pHolder)
+{
+    GenerateMessage(Cmd_GetPortStatistics, pHolder->port);
+}
+
+/**
+ * @brief               Parses a GetSerialPortConfig command.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseGetSerialPortConfig(kfly_parser_t *pHolder)
+{
+    GenerateMessage(Cmd_GetSerialPortConfig, pHolder->port);
+}
+
+/**
+ * @brief               Parses a SetSerialPortConfig command, the payload is
+ *                      one serial_port_config_t per port.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseSetSerialPortConfig(kfly_parser_t *pHolder)
+{
+    static serial_port_config_t config[SERIAL_NUMBER_OF_PORTS];
+
+    if (pHolder->data_length ==
+        SERIAL_NUMBER_OF_PORTS * SERIAL_PORT_CONFIG_SIZE)
+    {
+        memcpy(config, pHolder->buffer, sizeof(config));
+        SerialManager_SetConfig(config);
+    }
+}
+
+/**
+ * @brief               Parses a GetEscTelemetry command.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseGetEscTelemetry(kfly_parser_t *pHolder)
+{
+    GenerateMessage(Cmd_GetEscTelemetry, pHolder->port);
+}
+
+/**
+ * @brief               Parses a GetParameterInfo command, the payload is a
+ *                      parameter_request_t. Responds with the description of
+ *                      the parameters in the range.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseGetParameterInfo(kfly_parser_t *pHolder)
+{
+    static uint8_t response[PARAMETERS_MAX_PAYLOAD];
+    parameter_request_t request;
+    size_t size;
+
+    if (pHolder->data_length == PARAMETER_REQUEST_SIZE)
+    {
+        memcpy(&request, pHolder->buffer, PARAMETER_REQUEST_SIZE);
+        size = ParametersGetInfo(request.first, request.count, response);
+
+        GenerateCustomMessage(Cmd_GetParameterInfo,
+                              response,
+                              size,
+                              pHolder->port);
+    }
+}
+
+/**
+ * @brief               Parses a GetParameters command, the payload is a
+ *                      parameter_request_t. Responds with the values of the
+ *                      parameters in the range, a count of zero gives only
+ *                      the size and checksum of the table.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseGetParameters(kfly_parser_t *pHolder)
+{
+    static uint8_t response[PARAMETERS_MAX_PAYLOAD];
+    parameter_request_t request;
+    size_t size;
+
+    if (pHolder->data_length == PARAMETER_REQUEST_SIZE)
+    {
+        memcpy(&request, pHolder->buffer, PARAMETER_REQUEST_SIZE);
+        size = ParametersGetValues(request.first, request.count, response);
+
+        GenerateCustomMessage(Cmd_GetParameters,
+                              response,
+                              size,
+                              pHolder->port);
+    }
+}
+
+/**
+ * @brief               Parses a SetParameters command, the payload is a
+ *                      parameter_request_t followed by the values. Responds
+ *                      as GetParameters with the bounded values and the new
+ *                      checksum.
+ *
+ * @param[in] pHolder   Message holder containing information
+ *                      about the transmission.
+ */
+static void ParseSetParameters(kfly_parser_t *pHolder)
+{
+    static uint8_t response[PARAMETERS_MAX_PAYLOAD];
+    parameter_request_t request;
+    size_t size;
+
+    if (pHolder->data_length < PARAMETER_REQUEST_SIZE)
+        return;
+
+    memcpy(&request, pHolder->buffer, PARAMETER_REQUEST_SIZE);
+
+    if (pHolder->data_length == PARAMETER_REQUEST_SIZE +
+                                request.count * PARAMETERS_VALUE_SIZE)
+    {
+        ParametersSetValues(request.first,
+                            request.count,
+                            &pHolder->buffer[PARAMETER_REQUEST_SIZE]);
+
+        size = ParametersGetValues(request.first, request.count, response);
+
+        GenerateCustomMessage(Cmd_GetParameters,
+                              response,
+                              size,
+                              pHolder->port);
+    }
+}
+
 /**
  * @brief               Parses a Computer Control command.
  *
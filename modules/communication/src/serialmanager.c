@@ -3,15 +3,28 @@
  * OS layer for Serial Communication.
  * Handles package coding/decoding.
  *
+ * All ports are described by a table and served by one thread, which waits
+ * for events from the channels of the ports and for transmit requests. The
+ * role of a port selects what is done with the received bytes, only ports
+ * with the KFly role transmit.
+ *
  * */
 
+#include <string.h>
 #include "ch.h"
 #include "hal.h"
 #include "usb_access.h"
 #include "slip.h"
+#include "cobs.h"
 #include "slip2kflypacket.h"
 #include "kflypacket_generators.h"
 #include "crc.h"
+#include "flash_save.h"
+#include "flash_download.h"
+#include "parameters.h"
+#include "rc_input.h"
+#include "crsf.h"
+#include "esc_telemetry.h"
 #include "serialmanager.h"
 #include "subscriptions.h"
 
@@ -19,15 +32,30 @@
 /* Module local definitions.                                                 */
 /*===========================================================================*/
 
-#define START_TRANSMISSION_EVENT            EVENT_MASK(0)
+/* Event of each port, signalled by its channel and to start transmission */
+#define PORT_EVENT(port)                    EVENT_MASK(port)
+#define RECONFIGURE_EVENT                   EVENT_MASK(SERIAL_NUMBER_OF_PORTS)
+
+/* Channel events the serial manager wakes up on */
+#define PORT_CHANNEL_FLAGS                  (CHN_INPUT_AVAILABLE |            \
+                                             CHN_OUTPUT_EMPTY |               \
+                                             CHN_CONNECTED)
+
+#define ROLE_MASK(role)                     (1 << (role))
+
+/* Role, framing and baudrate of a port in the parameter table, the roles
+   the port can take are checked when the table is written */
+#define PORT_PARAMETERS(port)                                                 \
+    {PARAMETER_TYPE_UINT8, &port_config[port].role,                           \
+     SERIAL_ROLE_NONE, SERIAL_ROLE_ESC_TELEMETRY},                            \
+    {PARAMETER_TYPE_UINT8, &port_config[port].framing,                        \
+     LINK_FRAMING_SLIP, LINK_FRAMING_COBS},                                   \
+    {PARAMETER_TYPE_UINT32, &port_config[port].baudrate,                      \
+     SERIAL_MIN_BAUDRATE, SERIAL_MAX_BAUDRATE}
 
 #define AUX1_SERIAL_DRIVER                  SD3
 #define AUX2_SERIAL_DRIVER                  SD5
-#define AUX3_SERIAL_DRIVER                  SD4
-
-static bool USBTransmitCircularBuffer(circular_buffer_t *Cbuff);
-static bool AuxTransmitCircularBuffer(SerialDriver *sdp,
-                                      circular_buffer_t *Cbuff);
+/* AUX3 (UART4) is used by the CRSF receiver, see crsf.c. */
 
 /*===========================================================================*/
 /* Module exported variables.                                                */
@@ -38,370 +66,754 @@ static bool AuxTransmitCircularBuffer(SerialDriver *sdp,
 /*===========================================================================*/
 
 /**
- * @brief   Holder of the necessary information for the data pump threads.
+ * @brief   Transmit counters of a port.
+ */
+typedef struct
+{
+    /**
+     * @brief   Statistics, the waiting bytes are filled in when read.
+     */
+    serial_port_statistics_t stats;
+    /**
+     * @brief   Start of the throughput window.
+     */
+    systime_t window_start;
+    /**
+     * @brief   Bytes transmitted in the throughput window.
+     */
+    uint32_t window_bytes;
+} serial_port_counters_t;
+
+/**
+ * @brief   Receive state of a port which can have the KFly role.
+ */
+typedef struct
+{
+    /**
+     * @brief   SLIP decoder.
+     */
+    slip_parser_t slip;
+    /**
+     * @brief   COBS decoder, shares the buffer with the SLIP decoder as only
+     *          one of them is in use.
+     */
+    cobs_decoder_t cobs;
+    /**
+     * @brief   KFly packet parser.
+     */
+    kfly_parser_t kfly;
+    /**
+     * @brief   Decoded packet buffer.
+     */
+    uint8_t buffer[SERIAL_RECIEVE_BUFFER_SIZE];
+} serial_port_rx_t;
+
+/**
+ * @brief   Port description and state.
  */
 typedef struct
 {
     /**
-     * @brief   Pointer to the USB data pump thread.
+     * @brief   Channel of the port, NULL if it is not a serial channel.
      */
-    thread_t *ptrUSBDataPump;
+    BaseAsynchronousChannel *channel;
     /**
-     * @brief   USB data pump circular transmit buffer.
+     * @brief   Serial driver of the port, NULL if the port is not a UART
+     *          driven by the serial driver.
      */
-    circular_buffer_t USBTransmitBuffer;
+    SerialDriver *sdp;
     /**
-     * @brief   Pointer to the AUX1 data pump thread.
+     * @brief   Roles the port can have, bit n for role n.
      */
-    thread_t *ptrAUX1DataPump;
+    uint8_t roles;
     /**
-     * @brief   AUX1 data pump circular transmit buffer.
+     * @brief   Receive state, NULL if the port can not have the KFly role.
      */
-    circular_buffer_t AUX1TransmitBuffer;
+    serial_port_rx_t *rx;
     /**
-     * @brief   Pointer to the AUX2 data pump thread.
+     * @brief   Transmit buffer for responses and ACKs.
      */
-    thread_t *ptrAUX2DataPump;
+    circular_buffer_t transmit;
     /**
-     * @brief   AUX2 data pump circular transmit buffer.
+     * @brief   Transmit queue for telemetry, each frame has a length prefix
+     *          so the oldest frame can be dropped for a newer one.
      */
-    circular_buffer_t AUX2TransmitBuffer;
+    circular_buffer_t telemetry;
     /**
-     * @brief   Pointer to the AUX3 data pump thread.
+     * @brief   Telemetry being transmitted, copied out of the queue.
      */
-    thread_t *ptrAUX3DataPump;
+    uint8_t *staging;
+    size_t staging_length;
+    size_t staging_sent;
     /**
-     * @brief   AUX3 data pump circular transmit buffer.
+     * @brief   Active configuration.
      */
-    circular_buffer_t AUX3TransmitBuffer;
+    serial_port_config_t config;
     /**
-     * @brief   Pointer to the AUX4 data pump thread.
+     * @brief   Serial driver configuration of the active role.
      */
-    thread_t *ptrAUX4DataPump;
+    SerialConfig sd_config;
     /**
-     * @brief   AUX4 data pump circular transmit buffer.
+     * @brief   Listener of the channel events.
      */
-    circular_buffer_t AUX4TransmitBuffer;
-} serial_datapump_holder_t;
-
-/* Instance of the data pump holder structure */
-serial_datapump_holder_t data_pumps = {
-    .ptrUSBDataPump = NULL,
-    .ptrAUX1DataPump = NULL,
-    .ptrAUX2DataPump = NULL,
-    .ptrAUX3DataPump = NULL,
-    .ptrAUX4DataPump = NULL
+    event_listener_t listener;
+    /**
+     * @brief   Transmit counters.
+     */
+    serial_port_counters_t counters;
+} serial_port_t;
+
+/* Receive state of the ports which can have the KFly role */
+static serial_port_rx_t usb_rx;
+static serial_port_rx_t aux1_rx;
+static serial_port_rx_t aux2_rx;
+
+/* Port table, indexed by external_port_t */
+static serial_port_t ports[SERIAL_NUMBER_OF_PORTS] = {
+    [PORT_USB] = {
+        .channel = (BaseAsynchronousChannel *)&SDU1,
+        .sdp = NULL,
+        .roles = ROLE_MASK(SERIAL_ROLE_KFLY),
+        .rx = &usb_rx
+    },
+    [PORT_AUX1] = {
+        .channel = (BaseAsynchronousChannel *)&AUX1_SERIAL_DRIVER,
+        .sdp = &AUX1_SERIAL_DRIVER,
+        .roles = ROLE_MASK(SERIAL_ROLE_NONE) |
+                 ROLE_MASK(SERIAL_ROLE_KFLY) |
+                 ROLE_MASK(SERIAL_ROLE_SBUS) |
+                 ROLE_MASK(SERIAL_ROLE_ESC_TELEMETRY),
+        .rx = &aux1_rx
+    },
+    [PORT_AUX2] = {
+        .channel = (BaseAsynchronousChannel *)&AUX2_SERIAL_DRIVER,
+        .sdp = &AUX2_SERIAL_DRIVER,
+        .roles = ROLE_MASK(SERIAL_ROLE_NONE) |
+                 ROLE_MASK(SERIAL_ROLE_KFLY) |
+                 ROLE_MASK(SERIAL_ROLE_SBUS) |
+                 ROLE_MASK(SERIAL_ROLE_ESC_TELEMETRY),
+        .rx = &aux2_rx
+    },
+    [PORT_AUX3] = {
+        .channel = NULL,
+        .sdp = NULL,
+        .roles = ROLE_MASK(SERIAL_ROLE_NONE) |
+                 ROLE_MASK(SERIAL_ROLE_CRSF),
+        .rx = NULL
+    },
+    [PORT_AUX4] = {
+        .channel = NULL,
+        .sdp = NULL,
+        .roles = ROLE_MASK(SERIAL_ROLE_NONE),
+        .rx = NULL
+    }
 };
 
-/* Temporary settings until serial is settable through the USB */
-static const SerialConfig aux1_config =
-{
-  115200,
-  0,
-  USART_CR2_STOP1_BITS,
-  0
+/* Configuration at start, indexed by external_port_t */
+static const serial_port_config_t default_config[SERIAL_NUMBER_OF_PORTS] = {
+    {SERIAL_USB_ROLE,  SERIAL_USB_FRAMING,  0, SERIAL_AUX_BAUDRATE},
+    {SERIAL_AUX1_ROLE, SERIAL_AUX1_FRAMING, 0, SERIAL_AUX_BAUDRATE},
+    {SERIAL_AUX2_ROLE, SERIAL_AUX2_FRAMING, 0, SERIAL_AUX_BAUDRATE},
+    {SERIAL_AUX3_ROLE, SERIAL_AUX3_FRAMING, 0, SERIAL_AUX_BAUDRATE},
+    {SERIAL_AUX4_ROLE, SERIAL_AUX4_FRAMING, 0, SERIAL_AUX_BAUDRATE}
+};
+
+/* Requested configuration, saved to flash and applied by the serial
+   manager thread */
+static serial_port_config_t port_config[SERIAL_NUMBER_OF_PORTS];
+
+/* Port configuration in the parameter table, saved in the "SERP" record */
+static const parameter_t port_parameter_table[] = {
+    PORT_PARAMETERS(PORT_USB),
+    PORT_PARAMETERS(PORT_AUX1),
+    PORT_PARAMETERS(PORT_AUX2),
+    PORT_PARAMETERS(PORT_AUX3),
+    PORT_PARAMETERS(PORT_AUX4)
+};
+
+static void PortParametersChanged(void);
+
+static const parameter_group_t port_parameter_group = {
+    PARAMETER_MODULE_SERIAL,
+    PARAMETER_ID(PARAMETER_MODULE_SERIAL, 0),
+    FLASHSAVE_ID('S', 'E', 'R', 'P'),
+    port_parameter_table,
+    sizeof(port_parameter_table) / sizeof(parameter_t),
+    PortParametersChanged
 };
 
+/* The serial manager thread */
+static thread_t *serial_manager_thread = NULL;
 
 /*===================================================*/
-/* Working area for the data pump                    */
-/* and data decode threads.                          */
+/* Working area for the serial manager thread.       */
 /*===================================================*/
 
-THD_WORKING_AREA(waUSBSerialManagerTask, 512);
-THD_WORKING_AREA(waUSBDataPumpTask, 256);
-
-THD_WORKING_AREA(waAux1SerialManagerTask, 512);
-THD_WORKING_AREA(waAux1DataPumpTask, 256);
-/* TODO: Add for the rest of the communication interfaces */
+THD_WORKING_AREA(waSerialManagerTask, 1024);
 
 /*===========================================================================*/
 /* Module local functions.                                                   */
 /*===========================================================================*/
 
-/*===================================================*/
-/* USB Communication threads.                        */
-/*===================================================*/
+/**
+ * @brief               Updates the throughput of a port when its window has
+ *                      passed.
+ * @note                Must be called from a locked state.
+ *
+ * @param[in/out] c     Pointer to the counters of the port.
+ */
+static void UpdateThroughput(serial_port_counters_t *c)
+{
+    const systime_t elapsed = chVTGetSystemTimeX() - c->window_start;
+
+    if (elapsed >= MS2ST(SERIAL_THROUGHPUT_WINDOW_MS))
+    {
+        c->stats.throughput = (uint32_t)(((uint64_t)c->window_bytes *
+                                          CH_CFG_ST_FREQUENCY) / elapsed);
+        c->window_start += elapsed;
+        c->window_bytes = 0;
+    }
+}
 
 /**
- * @brief           The USB Serial Manager task will handle incoming
- *                  data and direct it for decode and processing.
+ * @brief               Counts the bytes waiting in the transmit queues of a
+ *                      port.
  *
- * @param[in] arg   Input argument (unused).
+ * @param[in] port      Pointer to the port.
+ * @return              Number of bytes waiting.
  */
-static THD_FUNCTION(USBSerialManagerTask, arg)
+static size_t BytesWaiting(serial_port_t *port)
 {
-    (void)arg;
+    return CircularBuffer_Count(&port->transmit) +
+           CircularBuffer_Count(&port->telemetry) +
+           (port->staging_length - port->staging_sent);
+}
 
-    /* Name for debug */
-    chRegSetThreadName("USB Serial Manager");
+/**
+ * @brief               Counts bytes transmitted on a port.
+ *
+ * @param[in] port      Pointer to the port.
+ * @param[in] bytes     Number of bytes.
+ */
+static void CountSent(serial_port_t *port, size_t bytes)
+{
+    serial_port_counters_t *c = &port->counters;
 
-    /* Data structure for communication */
-    static slip_parser_t slip_data_holder;
-    static kfly_parser_t kfly_data_holder;
+    osalSysLock();
 
-    /* Anonymous function for connecting the SLIP parser to the KFly parser. */
-    void bind(slip_parser_t *p)
-    {
-        ParseKFlyPacketFromSLIP(p, &kfly_data_holder);
-    }
+    c->stats.bytes_sent += bytes;
+    c->window_bytes += bytes;
+    UpdateThroughput(c);
 
-    /* Buffer for parsing serial USB commands */
-    static uint8_t USB_in_buffer[SERIAL_RECIEVE_BUFFER_SIZE];
+    osalSysUnlock();
+}
 
-    /* Initialize data structures */
-    InitSLIPParser(&slip_data_holder,
-                   USB_in_buffer,
-                   SERIAL_RECIEVE_BUFFER_SIZE,
-                   bind);
+/**
+ * @brief               Initializes the transmit buffers of a port.
+ *
+ * @param[in] port      Pointer to the port.
+ * @param[in] buffer    Response buffer, SERIAL_TRANSMIT_BUFFER_SIZE bytes.
+ * @param[in] telemetry Telemetry buffer, SERIAL_TELEMETRY_BUFFER_SIZE bytes.
+ * @param[in] staging   Staging buffer, SERIAL_TELEMETRY_FRAME_SIZE bytes.
+ */
+static void InitTransmitBuffers(serial_port_t *port,
+                                uint8_t *buffer,
+                                uint8_t *telemetry,
+                                uint8_t *staging)
+{
+    CircularBuffer_Init(&port->transmit, buffer, SERIAL_TRANSMIT_BUFFER_SIZE);
+    CircularBuffer_InitMutex(&port->transmit);
+    CircularBuffer_SetReserved(&port->transmit, SERIAL_ACK_RESERVE);
+
+    CircularBuffer_Init(&port->telemetry,
+                        telemetry,
+                        SERIAL_TELEMETRY_BUFFER_SIZE);
+    CircularBuffer_InitMutex(&port->telemetry);
+
+    port->staging = staging;
+    port->staging_length = 0;
+    port->staging_sent = 0;
+}
 
-    /* Cut away the header. */
-    InitKFlyPacketParser(&kfly_data_holder, PORT_USB, &USB_in_buffer[2]);
+/**
+ * @brief               Connects the SLIP decoder of a port to its KFly
+ *                      parser.
+ *
+ * @param[in] p         Pointer to the SLIP decoder.
+ */
+static void BindSLIP(slip_parser_t *p)
+{
+    external_port_t port;
 
-    while(1)
+    for (port = PORT_USB; port <= PORT_AUX4; port++)
     {
-        /* Check so the USB is available, else wait a little */
-        while (isUSBActive() == false)
-            chThdSleepMilliseconds(200);
-
-        /* Pump data into the SLIP parser. */
-        ParseSLIP(USBReadByte(TIME_INFINITE), &slip_data_holder);
+        if ((ports[port].rx != NULL) && (&ports[port].rx->slip == p))
+            ParseKFlyPacketFromSLIP(p, &ports[port].rx->kfly);
     }
 }
 
 /**
- * @brief           Transmits the content of the USB circular buffer over USB.
+ * @brief               Connects the COBS decoder of a port to its KFly
+ *                      parser.
  *
- * @param[in] arg   Input argument (unused).
+ * @param[in] p         Pointer to the generic part of the COBS decoder.
  */
-static THD_FUNCTION(USBDataPumpTask, arg)
+static void BindCOBS(communication_decoder_t *p)
 {
-    (void)arg;
+    external_port_t port;
 
-    /* Name for debug */
-    chRegSetThreadName("USB Data Pump");
+    for (port = PORT_USB; port <= PORT_AUX4; port++)
+    {
+        if ((ports[port].rx != NULL) &&
+            (&ports[port].rx->cobs.generic_decoder == p))
+            ParseKFlyPacketFromCOBS(p, &ports[port].rx->kfly);
+    }
+}
 
-    /* Buffer for transmitting serial USB commands */
-    static uint8_t USB_out_buffer[SERIAL_TRANSMIT_BUFFER_SIZE];
+/**
+ * @brief               Initializes the receive state of a port.
+ *
+ * @param[in] port      Port to initialize.
+ */
+static void InitReceive(external_port_t port)
+{
+    serial_port_rx_t *rx = ports[port].rx;
 
-    /* Initialize the USB transmit circular buffer */
-    CircularBuffer_Init(&data_pumps.USBTransmitBuffer,
-                        USB_out_buffer,
-                        SERIAL_TRANSMIT_BUFFER_SIZE);
-    CircularBuffer_InitMutex(&data_pumps.USBTransmitBuffer);
+    InitSLIPParser(&rx->slip,
+                   rx->buffer,
+                   SERIAL_RECIEVE_BUFFER_SIZE,
+                   BindSLIP);
 
-    /* Put the USB data pump thread into the list of available data pumps */
-    data_pumps.ptrUSBDataPump = chThdGetSelfX();
+    COBSInitDecoder(rx->buffer,
+                    SERIAL_RECIEVE_BUFFER_SIZE,
+                    BindCOBS,
+                    &rx->cobs);
 
-    while(1)
-    {
-        /* Wait for a start transmission event */
-        chEvtWaitAny(START_TRANSMISSION_EVENT);
+    /* Cut away the header. */
+    InitKFlyPacketParser(&rx->kfly, port, &rx->buffer[2]);
+}
 
-        /* We will only get here is a request to send data has been received */
-        USBTransmitCircularBuffer(&data_pumps.USBTransmitBuffer);
-    }
+/**
+ * @brief               Passes a received byte to the decoder of the framing
+ *                      selected for the port. Both decoders resynchronize on
+ *                      their frame delimiter, so the framing may be changed
+ *                      at any time.
+ *
+ * @param[in] data      Received byte.
+ * @param[in] port      Pointer to the port the byte was received on.
+ */
+static inline void DecodeByte(uint8_t data, serial_port_t *port)
+{
+    if (port->config.framing == LINK_FRAMING_COBS)
+        COBSDecode(data, &port->rx->cobs);
+    else
+        ParseSLIP(data, &port->rx->slip);
 }
 
-/*===================================================*/
-/* AUX1 Communication threads.                       */
-/*===================================================*/
+/**
+ * @brief               Check if a port is handed over to a flash download.
+ *
+ * @param[in] id        Port to check.
+ * @return              True if the serial manager must leave the port alone.
+ */
+static bool PortIsPaused(external_port_t id)
+{
+    return ((id == PORT_USB) && (FlashDownload_IsActive() == true));
+}
 
 /**
- * @brief           The Aux1 Serial Manager task will handle incoming
- *                  data and direct it for decode and processing.
+ * @brief               Reads everything received on a port and passes it on
+ *                      according to the role of the port.
  *
- * @param[in] arg   Input argument (unused).
+ * @param[in] id        Port to read.
  */
-static THD_FUNCTION(Aux1SerialManagerTask, arg)
+static void PortReceive(external_port_t id)
 {
-    (void)arg;
+    serial_port_t *port = &ports[id];
+    uint8_t data[SERIAL_RECEIVE_CHUNK_SIZE];
+    size_t count, i;
+
+    if (port->channel == NULL)
+        return;
+
+    if ((id == PORT_USB) && (isUSBActive() == false))
+        return;
+
+    /* Stop as soon as a parsed command starts a flash download, the
+     * download thread reads the replies from the host. */
+    while ((PortIsPaused(id) == false) &&
+           ((count = chnReadTimeout(port->channel,
+                                    data,
+                                    SERIAL_RECEIVE_CHUNK_SIZE,
+                                    TIME_IMMEDIATE)) > 0))
+    {
+        switch (port->config.role)
+        {
+            case SERIAL_ROLE_KFLY:
+                for (i = 0; i < count; i++)
+                    DecodeByte(data[i], port);
+                break;
+
+            case SERIAL_ROLE_SBUS:
+                for (i = 0; i < count; i++)
+                    RCInputParseSBUSByte(data[i]);
+                break;
+
+            case SERIAL_ROLE_ESC_TELEMETRY:
+                for (i = 0; i < count; i++)
+                    EscTelemetryParseByte(data[i]);
+                break;
+
+            default:
+                break;
+        }
+    }
+}
 
-    /* Name for debug */
-    chRegSetThreadName("Aux1 Serial Manager");
+/**
+ * @brief               Transmits the queues of a port with the KFly role.
+ *                      Responses go first, telemetry is copied out a few
+ *                      frames at a time so the rest of the telemetry queue
+ *                      can still be dropped for newer frames. A frame which
+ *                      is started is always finished before the next.
+ *
+ * @param[in] id        Port to transmit.
+ * @param[in] timeout   Time to wait for room in the channel for each write,
+ *                      TIME_IMMEDIATE to transmit only what fits.
+ */
+static void PortTransmit(external_port_t id, systime_t timeout)
+{
+    serial_port_t *port = &ports[id];
+    uint8_t *read_pointer;
+    size_t read_size, sent;
 
-    /* Data structure for communication */
-    static slip_parser_t slip_data_holder;
-    static kfly_parser_t kfly_data_holder;
+    if ((port->channel == NULL) ||
+        (port->config.role != SERIAL_ROLE_KFLY) ||
+        (port->transmit.size == 0))
+        return;
 
-    /* Anonymous function for connecting the SLIP parser to the KFly parser. */
-    void bind(slip_parser_t *p)
+    if (id == PORT_USB)
     {
-        ParseKFlyPacketFromSLIP(p, &kfly_data_holder);
+        if (isUSBActive() == false)
+            return;
+
+        /* Claim the USB bus during the entire transfer */
+        USBClaim();
     }
 
-    /* Buffer for parsing serial commands */
-    static uint8_t AUX1_in_buffer[SERIAL_RECIEVE_BUFFER_SIZE];
+    while (1)
+    {
+        /* Finish the telemetry being transmitted */
+        if (port->staging_sent < port->staging_length)
+        {
+            sent = chnWriteTimeout(port->channel,
+                                   &port->staging[port->staging_sent],
+                                   port->staging_length - port->staging_sent,
+                                   timeout);
+            port->staging_sent += sent;
+            CountSent(port, sent);
+
+            if (port->staging_sent < port->staging_length)
+                break;
+        }
 
-    /* Initialize data structures */
-    InitSLIPParser(&slip_data_holder,
-                   AUX1_in_buffer,
-                   SERIAL_RECIEVE_BUFFER_SIZE,
-                   bind);
+        /* Then responses and ACKs */
+        read_pointer = CircularBuffer_GetReadPointer(&port->transmit,
+                                                     &read_size);
 
-    /* Cut away the header. */
-    InitKFlyPacketParser(&kfly_data_holder, PORT_AUX1, &AUX1_in_buffer[2]);
+        if (read_size > 0)
+        {
+            sent = chnWriteTimeout(port->channel,
+                                   read_pointer,
+                                   read_size,
+                                   timeout);
+            CircularBuffer_IncrementTail(&port->transmit, sent);
+            CountSent(port, sent);
+
+            if (sent < read_size)
+                break;
+            else
+                continue;
+        }
 
-    while(1)
-    {
-        /* Pump data into the SLIP parser. */
-        ParseSLIP(sdGet(&AUX1_SERIAL_DRIVER), &slip_data_holder);
+        /* Then the oldest telemetry */
+        CircularBuffer_Claim(&port->telemetry);
+        port->staging_length = CircularBuffer_ReadFrames(
+                &port->telemetry,
+                port->staging,
+                SERIAL_TELEMETRY_FRAME_SIZE);
+        CircularBuffer_Release(&port->telemetry);
+        port->staging_sent = 0;
+
+        if (port->staging_length == 0)
+            break;
     }
+
+    /* Release the USB bus */
+    if (id == PORT_USB)
+        USBRelease();
 }
 
 /**
- * @brief           Transmits the content of the Aux1 circular buffer over Aux1.
+ * @brief               Empties the transmit queues of a port.
  *
- * @param[in] arg   Input argument (unused).
+ * @param[in] port      Pointer to the port.
  */
-static THD_FUNCTION(Aux1DataPumpTask, arg)
+static void PortFlushTransmit(serial_port_t *port)
 {
-    (void)arg;
-
-    /* Name for debug */
-    chRegSetThreadName("Aux1 Data Pump");
+    CircularBuffer_Claim(&port->transmit);
+    CircularBuffer_IncrementTail(&port->transmit,
+                                 CircularBuffer_Count(&port->transmit));
+    CircularBuffer_Release(&port->transmit);
+
+    CircularBuffer_Claim(&port->telemetry);
+    CircularBuffer_IncrementTail(&port->telemetry,
+                                 CircularBuffer_Count(&port->telemetry));
+    CircularBuffer_Release(&port->telemetry);
+
+    port->staging_length = 0;
+    port->staging_sent = 0;
+}
 
-    /* Buffer for transmitting serial Aux1 commands */
-    static uint8_t AUX1_out_buffer[SERIAL_TRANSMIT_BUFFER_SIZE];
+/**
+ * @brief               Transmits the replies queued on a serial port and
+ *                      waits for the driver to send them, at most
+ *                      SERIAL_RECONFIGURE_FLUSH_MS. Telemetry is left for
+ *                      PortFlushTransmit to drop.
+ *
+ * @param[in] id        Port to flush.
+ */
+static void PortFlushPending(external_port_t id)
+{
+    serial_port_t *port = &ports[id];
+    const systime_t start = chVTGetSystemTimeX();
+    bool empty;
 
-    /* Initialize the Aux1 transmit circular buffer */
-    CircularBuffer_Init(&data_pumps.AUX1TransmitBuffer,
-                        AUX1_out_buffer,
-                        SERIAL_TRANSMIT_BUFFER_SIZE);
-    CircularBuffer_InitMutex(&data_pumps.AUX1TransmitBuffer);
+    while ((chVTGetSystemTimeX() - start) <
+           MS2ST(SERIAL_RECONFIGURE_FLUSH_MS))
+    {
+        PortTransmit(id, TIME_IMMEDIATE);
 
-    /* Put the Aux1 data pump thread into the list of available data pumps */
-    data_pumps.ptrAUX1DataPump = chThdGetSelfX();
+        osalSysLock();
+        empty = ((CircularBuffer_Count(&port->transmit) == 0) &&
+                 (oqIsEmptyI(&port->sdp->oqueue) == true));
+        osalSysUnlock();
 
-    while(1)
-    {
-        /* Wait for a start transmission event */
-        chEvtWaitAny(START_TRANSMISSION_EVENT);
+        /* Leave time for the last character in the shift register */
+        chThdSleep(MS2ST(1));
 
-        /* We will only get here is a request to send data has been received */
-        AuxTransmitCircularBuffer(&AUX1_SERIAL_DRIVER,
-                                  &data_pumps.AUX1TransmitBuffer);
+        if (empty == true)
+            break;
     }
 }
 
-/*===================================================*/
-/* AUX2 Communication threads.                       */
-/*===================================================*/
-
-/* To be added */
+/**
+ * @brief               Bounds a port configuration to what the port can do.
+ *
+ * @param[in] id        Port of the configuration.
+ * @param[in/out] config    Configuration to bound.
+ */
+static void ValidatePortConfig(external_port_t id, serial_port_config_t *config)
+{
+    if ((config->role > SERIAL_ROLE_ESC_TELEMETRY) ||
+        ((ports[id].roles & ROLE_MASK(config->role)) == 0))
+        config->role = default_config[id].role;
 
+    if ((config->framing != LINK_FRAMING_SLIP) &&
+        (config->framing != LINK_FRAMING_COBS))
+        config->framing = LINK_FRAMING_SLIP;
 
-/*===================================================*/
-/* AUX3 Communication threads.                       */
-/*===================================================*/
+    if ((config->baudrate < SERIAL_MIN_BAUDRATE) ||
+        (config->baudrate > SERIAL_MAX_BAUDRATE))
+        config->baudrate = SERIAL_AUX_BAUDRATE;
 
-/* To be added */
+    config->reserved = 0;
+}
 
+/**
+ * @brief               Bounds the requested configuration after it has been
+ *                      written through the parameter table and signals the
+ *                      serial manager thread to apply it.
+ */
+static void PortParametersChanged(void)
+{
+    serial_port_config_t config;
+    external_port_t port;
 
-/*===================================================*/
-/* AUX4 Communication threads.                       */
-/*===================================================*/
+    for (port = PORT_USB; port <= PORT_AUX4; port++)
+    {
+        osalSysLock();
+        config = port_config[port];
+        osalSysUnlock();
 
-/* To be added */
+        ValidatePortConfig(port, &config);
 
+        osalSysLock();
+        port_config[port] = config;
+        osalSysUnlock();
+    }
 
-/*===================================================*/
-/* RF Communication threads.                         */
-/*===================================================*/
+    if (serial_manager_thread != NULL)
+        chEvtSignal(serial_manager_thread, RECONFIGURE_EVENT);
+}
 
-/* To be added */
+/**
+ * @brief               Starts the serial driver of a port.
+ *
+ * @param[in] port      Pointer to the port.
+ * @param[in] baudrate  Baudrate.
+ * @param[in] cr1       USART CR1 bits.
+ * @param[in] cr2       USART CR2 bits.
+ */
+static void PortStartDriver(serial_port_t *port,
+                            uint32_t baudrate,
+                            uint16_t cr1,
+                            uint16_t cr2)
+{
+    port->sd_config.speed = baudrate;
+    port->sd_config.cr1 = cr1;
+    port->sd_config.cr2 = cr2;
+    port->sd_config.cr3 = 0;
 
+    sdStart(port->sdp, &port->sd_config);
+}
 
 /**
- * @brief               Transmits a circular buffer over the USB interface.
+ * @brief               Applies a configuration to a port. The hardware is
+ *                      only restarted if the role or baudrate changes, the
+ *                      framing can change at any time.
+ * @note                Must be called from the serial manager thread. The
+ *                      replies already queued, e.g. to the command changing
+ *                      the port itself, are sent before the driver restarts.
  *
- * @param[in] Cbuff     Circular buffer to transmit.
- * @return              Returns HAL_FAILED if it did not succeed to transmit
- *                      the buffer, else HAL_SUCCESS is returned.
+ * @param[in] id        Port to configure.
+ * @param[in] config    New configuration, validated.
  */
-static bool USBTransmitCircularBuffer(circular_buffer_t *Cbuff)
+static void ApplyPortConfig(external_port_t id,
+                            const serial_port_config_t *config)
 {
-    uint8_t *read_pointer;
-    size_t read_size;
+    serial_port_t *port = &ports[id];
 
-    if ((isUSBActive() == true) && (Cbuff != NULL))
+    if ((config->role == port->config.role) &&
+        (config->baudrate == port->config.baudrate))
     {
-        /* Read out the number of bytes to send and the pointer to the
-           first byte */
-        read_pointer = CircularBuffer_GetReadPointer(Cbuff, &read_size);
+        port->config.framing = config->framing;
+        return;
+    }
 
-        /* Claim the USB bus during the entire transfer */
-        USBClaim();
-        while (read_size > 0)
-        {
-            /* Send the data from the circular buffer */
-            USBSendData(read_pointer, read_size, TIME_INFINITE);
+    /* Stop the old role */
+    if ((port->sdp != NULL) && (port->config.role == SERIAL_ROLE_KFLY))
+        PortFlushPending(id);
 
-            /* Increment the circular buffer tail */
-            CircularBuffer_IncrementTail(Cbuff, read_size);
+    if ((port->sdp != NULL) && (port->config.role != SERIAL_ROLE_NONE))
+        sdStop(port->sdp);
+    else if (port->config.role == SERIAL_ROLE_CRSF)
+        CRSFStop();
 
-            /* Get the read size again in case new data is available or if
-               we reached the end of the buffer (to make sure the entire
-               buffer is sent) */
-            read_pointer = CircularBuffer_GetReadPointer(Cbuff, &read_size);
+    port->config = *config;
 
-            /* If the USB has been removed during the transfer: abort */
-            if (isUSBActive() == false)
-                return HAL_FAILED;
-        }
-        /* Release the USB bus */
-        USBRelease();
+    /* Start the new role */
+    switch (config->role)
+    {
+        case SERIAL_ROLE_KFLY:
+            PortFlushTransmit(port);
+            InitReceive(id);
+
+            if (port->sdp != NULL)
+            {
+                PortStartDriver(port, config->baudrate, 0,
+                                USART_CR2_STOP1_BITS);
+
+                /* Leave a fifth of the link for responses */
+                vSetSubscriptionBudget(id, config->baudrate / 10 * 8 / 10);
+            }
+            break;
+
+        case SERIAL_ROLE_SBUS:
+            /* 1 start + 8 data + 1 parity + 2 stop (8E2) at 100000 bit/s */
+            PortStartDriver(port, 100000, USART_CR1_PCE, USART_CR2_STOP2_BITS);
+            break;
+
+        case SERIAL_ROLE_ESC_TELEMETRY:
+            PortStartDriver(port, ESC_TELEMETRY_BAUDRATE, 0,
+                            USART_CR2_STOP1_BITS);
+            break;
+
+        case SERIAL_ROLE_CRSF:
+            CRSFStart();
+            break;
+
+        default:
+            break;
+    }
+}
 
-        /* Transfer finished successfully */
-        return HAL_SUCCESS;
+/**
+ * @brief               Applies the requested configuration to all ports.
+ */
+static void ApplyRequestedConfig(void)
+{
+    serial_port_config_t config;
+    external_port_t port;
+
+    for (port = PORT_USB; port <= PORT_AUX4; port++)
+    {
+        osalSysLock();
+        config = port_config[port];
+        osalSysUnlock();
+
+        ApplyPortConfig(port, &config);
     }
-    else /* Some error occurred */
-        return HAL_FAILED;
 }
 
 /**
- * @brief               Transmits a circular buffer over the UART (Aux)
- *                      interface.
+ * @brief           The Serial Manager task receives and transmits on all
+ *                  ports. It wakes on channel events, transmit requests and
+ *                  at least every SERIAL_POLL_MS.
  *
- * @param[in] sdp       Pointer to the Serial Driver to transmit the data over.
- * @param[in] Cbuff     Circular buffer to transmit.
- * @return              Returns HAL_FAILED if it did not succeed to transmit
- *                      the buffer, else HAL_SUCCESS is returned.
+ * @param[in] arg   Input argument (unused).
  */
-static bool AuxTransmitCircularBuffer(SerialDriver *sdp,
-                                      circular_buffer_t *Cbuff)
+static THD_FUNCTION(SerialManagerTask, arg)
 {
-    uint8_t *read_pointer;
-    size_t read_size;
+    (void)arg;
+
+    eventmask_t events;
+    external_port_t port;
 
-    if ((sdp != NULL) && (Cbuff != NULL))
+    /* Name for debug */
+    chRegSetThreadName("Serial Manager");
+
+    for (port = PORT_USB; port <= PORT_AUX4; port++)
     {
-        /* Read out the number of bytes to send and the pointer to the
-           first byte */
-        read_pointer = CircularBuffer_GetReadPointer(Cbuff, &read_size);
+        if (ports[port].channel != NULL)
+            chEvtRegisterMaskWithFlags(chnGetEventSource(ports[port].channel),
+                                       &ports[port].listener,
+                                       PORT_EVENT(port),
+                                       PORT_CHANNEL_FLAGS);
+    }
+
+    ApplyRequestedConfig();
 
-        while (read_size > 0)
+    while(1)
+    {
+        events = chEvtWaitAnyTimeout(ALL_EVENTS, MS2ST(SERIAL_POLL_MS));
+
+        if (events & RECONFIGURE_EVENT)
+            ApplyRequestedConfig();
+
+        for (port = PORT_USB; port <= PORT_AUX4; port++)
         {
-            /* Send the data from the circular buffer */
-            sdWrite(sdp, read_pointer, read_size);
+            if ((ports[port].channel == NULL) || (PortIsPaused(port) == true))
+                continue;
 
-            /* Increment the circular buffer tail */
-            CircularBuffer_IncrementTail(Cbuff, read_size);
+            (void)chEvtGetAndClearFlags(&ports[port].listener);
 
-            /* Get the read size again in case new data is available or if
-               we reached the end of the buffer (to make sure the entire
-               buffer is sent) */
-            read_pointer = CircularBuffer_GetReadPointer(Cbuff, &read_size);
+            PortReceive(port);
+            PortTransmit(port, TIME_IMMEDIATE);
         }
-
-        /* Transfer finished successfully */
-        return HAL_SUCCESS;
     }
-    else /* Some error occurred */
-        return HAL_FAILED;
 }
 
-
 /*===========================================================================*/
 /* Module exported functions.                                                */
 /*===========================================================================*/
@@ -411,41 +823,66 @@ static bool AuxTransmitCircularBuffer(SerialDriver *sdp,
  */
 void vSerialManagerInit(void)
 {
+    /* Buffers for transmitting serial commands and telemetry */
+    static uint8_t usb_transmit[SERIAL_TRANSMIT_BUFFER_SIZE];
+    static uint8_t usb_telemetry[SERIAL_TELEMETRY_BUFFER_SIZE];
+    static uint8_t usb_staging[SERIAL_TELEMETRY_FRAME_SIZE];
+    static uint8_t aux1_transmit[SERIAL_TRANSMIT_BUFFER_SIZE];
+    static uint8_t aux1_telemetry[SERIAL_TELEMETRY_BUFFER_SIZE];
+    static uint8_t aux1_staging[SERIAL_TELEMETRY_FRAME_SIZE];
+    static uint8_t aux2_transmit[SERIAL_TRANSMIT_BUFFER_SIZE];
+    static uint8_t aux2_telemetry[SERIAL_TELEMETRY_BUFFER_SIZE];
+    static uint8_t aux2_staging[SERIAL_TELEMETRY_FRAME_SIZE];
+
+    external_port_t port;
+
     /* Initialize the USB mutex */
     USBMutexInit();
 
     /* Initialize the subscription subsystem */
     vSubscriptionsInit();
 
-    /* Start the USB communication tasks */
+    InitTransmitBuffers(&ports[PORT_USB],
+                        usb_transmit, usb_telemetry, usb_staging);
+    InitTransmitBuffers(&ports[PORT_AUX1],
+                        aux1_transmit, aux1_telemetry, aux1_staging);
+    InitTransmitBuffers(&ports[PORT_AUX2],
+                        aux2_transmit, aux2_telemetry, aux2_staging);
 
-    chThdCreateStatic(waUSBSerialManagerTask,
-                      sizeof(waUSBSerialManagerTask),
-                      NORMALPRIO,
-                      USBSerialManagerTask,
-                      NULL);
+    /* Read the port configuration from flash */
+    memcpy(port_config, default_config, sizeof(port_config));
 
-    chThdCreateStatic(waUSBDataPumpTask,
-                      sizeof(waUSBDataPumpTask),
-                      NORMALPRIO,
-                      USBDataPumpTask,
-                      NULL);
+    FlashSave_Read(FlashSave_STR2ID("SERP"),
+                   (uint8_t *)port_config,
+                   sizeof(port_config));
 
-    /* Start the Aux1 communication tasks */
+    for (port = PORT_USB; port <= PORT_AUX4; port++)
+    {
+        ValidatePortConfig(port, &port_config[port]);
+
+        /* The hardware is started by the serial manager thread */
+        ports[port].config.role = SERIAL_ROLE_NONE;
+        ports[port].config.framing = port_config[port].framing;
+    }
 
-    sdStart(&AUX1_SERIAL_DRIVER, &aux1_config);
+    /* Register the configuration for saving to flash */
+    FlashSave_Register(FlashSave_STR2ID("SERP"),
+                       port_config,
+                       sizeof(port_config),
+                       NULL);
 
-    chThdCreateStatic(waAux1SerialManagerTask,
-                      sizeof(waAux1SerialManagerTask),
-                      NORMALPRIO,
-                      Aux1SerialManagerTask,
-                      NULL);
+    /* Register the configuration in the parameter table */
+    ParametersRegister(&port_parameter_group);
 
-    chThdCreateStatic(waAux1DataPumpTask,
-                      sizeof(waAux1DataPumpTask),
-                      NORMALPRIO,
-                      Aux1DataPumpTask,
-                      NULL);
+    /* Start the flash download thread */
+    FlashDownloadInit();
+
+    /* Start the serial manager */
+    serial_manager_thread = chThdCreateStatic(waSerialManagerTask,
+                                              sizeof(waSerialManagerTask),
+                                              NORMALPRIO,
+                                              SerialManagerTask,
+                                              NULL);
 }
 
 /**
@@ -454,48 +891,259 @@ void vSerialManagerInit(void)
  *
  * @param[in] port      Port parameter.
  * @return              Returns the pointer to the corresponding port's
- *                      circular buffer.
+ *                      circular buffer, NULL if the port does not have the
+ *                      KFly role.
  */
 circular_buffer_t *SerialManager_GetCircularBufferFromPort(external_port_t port)
 {
-    if (port == PORT_USB)
-        return &data_pumps.USBTransmitBuffer;
+    if ((isPort(port) == true) &&
+        (ports[port].config.role == SERIAL_ROLE_KFLY) &&
+        (ports[port].transmit.size > 0))
+        return &ports[port].transmit;
+    else
+        return NULL;
+}
 
-    else if (port == PORT_AUX1)
-        return &data_pumps.AUX1TransmitBuffer;
+/**
+ * @brief               Signal the serial manager to start transmission.
+ *
+ * @param[in] port      Port parameter.
+ */
+void SerialManager_StartTransmission(external_port_t port)
+{
+    if ((isPort(port) == true) && (serial_manager_thread != NULL))
+        chEvtSignal(serial_manager_thread, PORT_EVENT(port));
+}
+
+/**
+ * @brief               Returns the link layer framing of a port.
+ *
+ * @param[in] port      Port parameter.
+ * @return              Framing of the port.
+ */
+link_framing_t SerialManager_GetFraming(external_port_t port)
+{
+    if ((isPort(port) == true) &&
+        (ports[port].config.framing == LINK_FRAMING_COBS))
+        return LINK_FRAMING_COBS;
+    else
+        return LINK_FRAMING_SLIP;
+}
+
+/**
+ * @brief               Sets the link layer framing of a port, used for both
+ *                      directions.
+ *
+ * @param[in] port      Port parameter.
+ * @param[in] framing   New framing.
+ */
+void SerialManager_SetFraming(external_port_t port, link_framing_t framing)
+{
+    if ((isPort(port) == true) &&
+        ((framing == LINK_FRAMING_SLIP) || (framing == LINK_FRAMING_COBS)))
+    {
+        port_config[port].framing = framing;
+        ports[port].config.framing = framing;
+    }
+}
 
-    else if (port == PORT_AUX2)
-        return &data_pumps.AUX2TransmitBuffer;
+/**
+ * @brief               Returns the link layer framing of the port a transmit
+ *                      circular buffer belongs to, used by the generators.
+ *
+ * @param[in] Cbuff     Transmit circular buffer of a port.
+ * @return              Framing of the port, SLIP if the buffer is unknown.
+ */
+link_framing_t SerialManager_GetFramingFromCircularBuffer(
+        circular_buffer_t *Cbuff)
+{
+    external_port_t port;
 
-    else if (port == PORT_AUX3)
-        return &data_pumps.AUX3TransmitBuffer;
+    for (port = PORT_USB; port <= PORT_AUX4; port++)
+    {
+        if ((&ports[port].transmit == Cbuff) ||
+            (&ports[port].telemetry == Cbuff))
+            return SerialManager_GetFraming(port);
+    }
 
-    else if (port == PORT_AUX4)
-        return &data_pumps.AUX4TransmitBuffer;
+    return LINK_FRAMING_SLIP;
+}
 
+/**
+ * @brief               Return the telemetry circular buffer of corresponding
+ *                      communication port. Each telemetry frame is stored
+ *                      with a length prefix, see CircularBuffer_BeginFrame.
+ *
+ * @param[in] port      Port parameter.
+ * @return              Returns the pointer to the corresponding port's
+ *                      telemetry circular buffer, NULL if the port does not
+ *                      have the KFly role.
+ */
+circular_buffer_t *SerialManager_GetTelemetryBufferFromPort(
+        external_port_t port)
+{
+    if ((isPort(port) == true) &&
+        (ports[port].config.role == SERIAL_ROLE_KFLY) &&
+        (ports[port].telemetry.size > 0))
+        return &ports[port].telemetry;
     else
         return NULL;
 }
 
 /**
- * @brief               Signal the data pump thread to start transmission.
+ * @brief               Counts bytes put in the transmit queues of a port.
  *
  * @param[in] port      Port parameter.
+ * @param[in] bytes     Number of bytes.
  */
-void SerialManager_StartTransmission(external_port_t port)
+void SerialManager_CountQueued(external_port_t port, size_t bytes)
+{
+    serial_port_counters_t *c;
+    size_t waiting;
+
+    if (isPort(port) == false)
+        return;
+
+    c = &ports[port].counters;
+    waiting = BytesWaiting(&ports[port]);
+
+    osalSysLock();
+
+    c->stats.bytes_queued += bytes;
+
+    if (waiting > c->stats.peak_waiting)
+        c->stats.peak_waiting = waiting;
+
+    osalSysUnlock();
+}
+
+/**
+ * @brief               Counts a message dropped on a port.
+ *
+ * @param[in] port      Port parameter.
+ * @param[in] bytes     Size of the message if it was queued, else 0.
+ * @param[in] telemetry True for telemetry, false for responses and ACKs.
+ */
+void SerialManager_CountDropped(external_port_t port,
+                                size_t bytes,
+                                bool telemetry)
 {
-    if ((port == PORT_USB) && (data_pumps.ptrUSBDataPump != NULL))
-        chEvtSignal(data_pumps.ptrUSBDataPump, START_TRANSMISSION_EVENT);
+    serial_port_counters_t *c;
+
+    if (isPort(port) == false)
+        return;
 
-    else if ((port == PORT_AUX1) && (data_pumps.ptrAUX1DataPump != NULL))
-        chEvtSignal(data_pumps.ptrAUX1DataPump, START_TRANSMISSION_EVENT);
+    c = &ports[port].counters;
 
-    else if ((port == PORT_AUX2) && (data_pumps.ptrAUX2DataPump != NULL))
-        chEvtSignal(data_pumps.ptrAUX2DataPump, START_TRANSMISSION_EVENT);
+    osalSysLock();
 
-    else if ((port == PORT_AUX3) && (data_pumps.ptrAUX3DataPump != NULL))
-        chEvtSignal(data_pumps.ptrAUX3DataPump, START_TRANSMISSION_EVENT);
+    c->stats.bytes_dropped += bytes;
+
+    if (telemetry == true)
+        c->stats.telemetry_dropped++;
+    else
+        c->stats.responses_dropped++;
+
+    osalSysUnlock();
+}
+
+/**
+ * @brief               Reads the transmit statistics of all ports.
+ *
+ * @param[out] stats    Statistics, indexed by external_port_t.
+ */
+void SerialManager_GetStatistics(
+        serial_port_statistics_t stats[SERIAL_NUMBER_OF_PORTS])
+{
+    external_port_t port;
+    size_t waiting;
+
+    for (port = PORT_USB; port <= PORT_AUX4; port++)
+    {
+        waiting = BytesWaiting(&ports[port]);
+
+        osalSysLock();
+
+        UpdateThroughput(&ports[port].counters);
+        stats[port] = ports[port].counters.stats;
+        stats[port].bytes_waiting = waiting;
+
+        osalSysUnlock();
+    }
+}
+
+/**
+ * @brief               Waits for room in the transmit buffer of a port. The
+ *                      serial manager thread, i.e. a KFly parser, can not
+ *                      wait for itself and must not hold up the other
+ *                      ports, so it only transmits what fits in the channel
+ *                      right now.
+ *
+ * @param[in] port      Port parameter.
+ * @param[in] timeout   Time to wait.
+ * @return              True if the caller may wait again, false if it is the
+ *                      serial manager thread and the room made now is all
+ *                      there will be.
+ */
+bool SerialManager_WaitForSpace(external_port_t port, systime_t timeout)
+{
+    if (isPort(port) == false)
+        return false;
+
+    if (chThdGetSelfX() == serial_manager_thread)
+    {
+        /* A flash download holds the USB */
+        if (PortIsPaused(port) == false)
+            PortTransmit(port, TIME_IMMEDIATE);
+
+        return false;
+    }
+    else
+    {
+        SerialManager_StartTransmission(port);
+        chThdSleep(timeout);
+
+        return true;
+    }
+}
+
+/**
+ * @brief               Reads the requested configuration of all ports.
+ *
+ * @param[out] config   Configuration, indexed by external_port_t.
+ */
+void SerialManager_GetConfig(
+        serial_port_config_t config[SERIAL_NUMBER_OF_PORTS])
+{
+    osalSysLock();
+    memcpy(config, port_config, sizeof(port_config));
+    osalSysUnlock();
+}
+
+/**
+ * @brief               Sets the configuration of all ports. It is bounded to
+ *                      what each port can do and applied by the serial
+ *                      manager thread. It is saved to flash with the other
+ *                      settings.
+ *
+ * @param[in] config    Configuration, indexed by external_port_t.
+ */
+void SerialManager_SetConfig(
+        const serial_port_config_t config[SERIAL_NUMBER_OF_PORTS])
+{
+    serial_port_config_t validated;
+    external_port_t port;
+
+    for (port = PORT_USB; port <= PORT_AUX4; port++)
+    {
+        validated = config[port];
+        ValidatePortConfig(port, &validated);
+
+        osalSysLock();
+        port_config[port] = validated;
+        osalSysUnlock();
+    }
 
-    else if ((port == PORT_AUX4) && (data_pumps.ptrAUX4DataPump != NULL))
-        chEvtSignal(data_pumps.ptrAUX4DataPump, START_TRANSMISSION_EVENT);
+    if (serial_manager_thread != NULL)
+        chEvtSignal(serial_manager_thread, RECONFIGURE_EVENT);
 }
@@ -7,8 +7,9 @@
  * Serial Communication Protocol
  * -----------------------------
  * The KFly is using a packet structure encoded inside a Serial Line Internet
- * Protocol (SLIP) to transfer data packets. The packet structure used inside
- * the SLIP packet is described bellow.
+ * Protocol (SLIP) or a Consistent Overhead Byte Stuffing (COBS) frame, selected
+ * per port, to transfer data packets. The packet structure used inside the
+ * frame is described bellow.
  *
  * Protocol:
  *      HEADER | DATA | CRC16
@@ -54,51 +55,34 @@
 
 /*===========================================================================*/
 /* Module local variables and types.                                         */
-/*===========================================================================*/
-
- /*===========================================================================*/
-/* Module local functions.                                                   */
 /*===========================================================================*/
 
 /*===========================================================================*/
-/* Module exported functions.                                                */
+/* Module local functions.                                                   */
 /*===========================================================================*/
 
 /**
- * @brief                   Initializes the data holder structure.
+ * @brief                   Parses a decoded frame to asess if it is a valid
+ *                          KFly packet and then passes it on to the usage
+ *                          parser.
  *
+ * @param[in]     buffer    Pointer to the decoded frame.
+ * @param[in]     size      Size of the decoded frame.
  * @param[in/out] p         Pointer to kfly_parser_t structure.
- * @param[in]     port      Port used for data transfers.
- * @param[in]     buffer    Buffer where the data is saved (from the SLIP),
- *                          without header.
  */
-void InitKFlyPacketParser(kfly_parser_t *p,
-                          external_port_t port,
-                          uint8_t *buffer)
-{
-    p->port = port;
-    p->buffer = buffer;
-    p->parser = NULL;
-    p->rx_cmd_error = 0;
-    p->rx_size_error = 0;
-    p->rx_crc_error = 0;
-    p->rx_success = 0;
-}
-
-/**
- * @brief                   Parses the data in a SLIP package to asess if it is
- *                          a valid KFly packet and then passes it on to the
- *                          usage parser.
- *
- * @param[in/out] slip      Pointer to slip_parser_t structure.
- * @param[in/out] p         Pointer to kfly_parser_t structure.
- */
-void ParseKFlyPacketFromSLIP(slip_parser_t *slip, kfly_parser_t *p)
+static void ParseKFlyPacket(uint8_t *buffer,
+                            const uint16_t size,
+                            kfly_parser_t *p)
 {
     uint8_t cmd;
     uint16_t crc16;
-    const uint16_t size = slip->buffer_count;
-    uint8_t *buffer = slip->buffer;
+
+    /* Header and CRC are needed before anything can be checked. */
+    if (size < 4)
+    {
+        p->rx_size_error++;
+        return;
+    }
 
     /*
      * Check the CRC.
@@ -145,7 +129,7 @@ void ParseKFlyPacketFromSLIP(slip_parser_t *slip, kfly_parser_t *p)
      * Save the size and run parsers.
      */
 
-    if ((size >= 4) && ((size - 4) == buffer[1]))
+    if ((size - 4) == buffer[1])
     {
         /* Receive success! Increment statistics counter. */
         p->data_length = size - 4;
@@ -166,3 +150,53 @@ void ParseKFlyPacketFromSLIP(slip_parser_t *slip, kfly_parser_t *p)
     }
 }
 
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief                   Initializes the data holder structure.
+ *
+ * @param[in/out] p         Pointer to kfly_parser_t structure.
+ * @param[in]     port      Port used for data transfers.
+ * @param[in]     buffer    Buffer where the data is saved (from the SLIP or
+ *                          COBS decoder), without header.
+ */
+void InitKFlyPacketParser(kfly_parser_t *p,
+                          external_port_t port,
+                          uint8_t *buffer)
+{
+    p->port = port;
+    p->buffer = buffer;
+    p->parser = NULL;
+    p->rx_cmd_error = 0;
+    p->rx_size_error = 0;
+    p->rx_crc_error = 0;
+    p->rx_success = 0;
+}
+
+/**
+ * @brief                   Parses the data in a SLIP package to asess if it is
+ *                          a valid KFly packet and then passes it on to the
+ *                          usage parser.
+ *
+ * @param[in/out] slip      Pointer to slip_parser_t structure.
+ * @param[in/out] p         Pointer to kfly_parser_t structure.
+ */
+void ParseKFlyPacketFromSLIP(slip_parser_t *slip, kfly_parser_t *p)
+{
+    ParseKFlyPacket(slip->buffer, slip->buffer_count, p);
+}
+
+/**
+ * @brief                   Parses the data in a COBS frame to asess if it is
+ *                          a valid KFly packet and then passes it on to the
+ *                          usage parser.
+ *
+ * @param[in/out] dec       Pointer to the generic decoder of the COBS decoder.
+ * @param[in/out] p         Pointer to kfly_parser_t structure.
+ */
+void ParseKFlyPacketFromCOBS(communication_decoder_t *dec, kfly_parser_t *p)
+{
+    ParseKFlyPacket(dec->buffer, dec->buffer_count, p);
+}
@@ -4,6 +4,7 @@
  *
  * */
 
+#include <stddef.h>
 #include "ch.h"
 #include "hal.h"
 #include "kflypacket_generators.h"
@@ -13,8 +14,7 @@
 /* Module local definitions.                                                 */
 /*===========================================================================*/
 
-#define MAX_NUMBER_OF_SUBSCRIPTIONS         10
-#define SUBSCRIPTION_MAILBOX_SIZE           (MAX_NUMBER_OF_SUBSCRIPTIONS * 2)
+#define SUBSCRIPTION_NUMBER_OF_PORTS        (PORT_AUX4 + 1)
 
 /*===========================================================================*/
 /* Module exported variables.                                                */
@@ -25,7 +25,7 @@
 /*===========================================================================*/
 
 /* Working area for the subscriptions task. */
-THD_WORKING_AREA(waSubscriptionsTask, 128);
+THD_WORKING_AREA(waSubscriptionsTask, 256);
 
 /**
  * @brief   Holder of the necessary information for each
@@ -33,113 +33,306 @@ THD_WORKING_AREA(waSubscriptionsTask, 128);
  */
 typedef struct
 {
-    /**
-     * @brief   Virtual timer taking care of the periodicity of the message.
-     */
-    virtual_timer_t vt;
     /**
      * @brief   Time between messages in milliseconds.
      */
     uint32_t delay_ms;
     /**
-     * @brief   The command to be sent at each timeout.
+     * @brief   Time left to the next message in milliseconds.
+     */
+    uint32_t countdown_ms;
+    /**
+     * @brief   The command to be sent, Cmd_None if the slot is free.
      */
     kfly_command_t command;
     /**
      * @brief   The port for the message to be sent on.
      */
     external_port_t port;
+    /**
+     * @brief   Priority class of the subscription.
+     */
+    subscription_priority_t priority;
+    /**
+     * @brief   Current decimation of the requested rate.
+     */
+    uint8_t decimation;
+    /**
+     * @brief   Size of the last framed message, the expected cost in budget
+     *          of the next.
+     */
+    uint32_t size;
+    /**
+     * @brief   Messages sent in the current rate window.
+     */
+    uint32_t window_sent;
+    /**
+     * @brief   Achieved rate over the last window, in 0.1 Hz.
+     */
+    uint16_t rate;
+    /**
+     * @brief   Messages dropped since the subscription was made.
+     */
+    uint32_t dropped;
 } subscription_slot_t;
 
 /**
- * @brief   Subscriptions structure. Contains the subscription slots and
- *          the mailboxes.
+ * @brief   Transmission budget of a port, a token bucket in milli-bytes so
+ *          each tick of 1 ms adds the budget in bytes per second.
  */
 typedef struct
 {
     /**
-     * @brief   Pointer to message transmission mailbox.
+     * @brief   Budget in bytes per second, 0 for unlimited.
      */
-    mailbox_t *mb;
+    uint32_t budget;
     /**
-     * @brief   Mailbox message holder.
+     * @brief   Available budget in milli-bytes.
      */
-    msg_t box[SUBSCRIPTION_MAILBOX_SIZE];
+    uint32_t tokens;
+} subscription_port_t;
+
+/**
+ * @brief   Subscriptions structure. Contains the subscription slots and the
+ *          budgets of the ports.
+ */
+typedef struct
+{
     /**
      * @brief   Subscription slots.
      */
     subscription_slot_t slot[MAX_NUMBER_OF_SUBSCRIPTIONS];
+    /**
+     * @brief   Budgets, indexed by external_port_t.
+     */
+    subscription_port_t port[SUBSCRIPTION_NUMBER_OF_PORTS];
 } subscription_t;
 
 /*===================================================*/
-/* Subscription mailbox and data holders             */
+/* Subscription data holders                         */
 /*===================================================*/
 subscription_t subscriptions;
-MAILBOX_DECL(subscription_mailbox,
-             subscriptions.box,
-             SUBSCRIPTION_MAILBOX_SIZE);
 
 /*===========================================================================*/
 /* Module local functions.                                                   */
 /*===========================================================================*/
 
-/*===================================================*/
-/* Message Subscription thread.                      */
-/*===================================================*/
+/**
+ * @brief               Returns the size of the budget burst of a port.
+ *
+ * @param[in] port      Pointer to the port budget.
+ * @return              Burst size in milli-bytes.
+ */
+static inline uint32_t SubscriptionBurst(const subscription_port_t *port)
+{
+    return port->budget * SUBSCRIPTION_BURST_MS;
+}
 
 /**
- * @brief           Keeps track of the current subscriptions.
+ * @brief               Returns the budget a priority class must leave for
+ *                      the classes above it, a quarter of the burst per
+ *                      class.
  *
- * @param[in] arg   Input argument (unused).
+ * @param[in] port      Pointer to the port budget.
+ * @param[in] priority  Priority class.
+ * @return              Reserved budget in milli-bytes.
  */
-static THD_FUNCTION(SubscriptionsTask, arg)
+static inline uint32_t SubscriptionReserve(const subscription_port_t *port,
+                                           subscription_priority_t priority)
 {
-    (void)arg;
+    return (SubscriptionBurst(port) / 4) * (uint32_t)priority;
+}
 
-    msg_t message;
-    subscription_slot_t *slot;
+/**
+ * @brief               Refills the budget of each port with one tick.
+ */
+static void SubscriptionsRefillBudgets(void)
+{
+    subscription_port_t *port;
+    int i;
 
-    /* Name for debug */
-    chRegSetThreadName("Subscriptions");
+    osalSysLock();
 
-    while(1)
+    for (i = 0; i < SUBSCRIPTION_NUMBER_OF_PORTS; i++)
+    {
+        port = &subscriptions.port[i];
+        port->tokens += port->budget * SUBSCRIPTION_TICK_MS;
+
+        if (port->tokens > SubscriptionBurst(port))
+            port->tokens = SubscriptionBurst(port);
+    }
+
+    osalSysUnlock();
+}
+
+/**
+ * @brief               Transmits a subscription if it is due and the port
+ *                      has budget for it, above the reserve of the higher
+ *                      priority classes. A stream short of budget, or
+ *                      finding the transmit buffer full, is delayed if it
+ *                      has high priority and else dropped and decimated.
+ *                      Streams with budget to spare recover their rate.
+ *
+ * @param[in] slot      Pointer to the subscription slot.
+ * @param[in] priority  Priority class being served.
+ */
+static void SubscriptionServe(subscription_slot_t *slot,
+                              subscription_priority_t priority)
+{
+    subscription_port_t *port;
+    kfly_command_t command;
+    external_port_t port_id;
+    size_t size;
+    bool sent = false;
+
+    osalSysLock();
+
+    if ((slot->command == Cmd_None) || (slot->priority != priority))
     {
-        /* Wait for a new message */
-        chMBFetch(subscriptions.mb, &message, TIME_INFINITE);
-        slot = (subscription_slot_t *)message;
+        osalSysUnlock();
+        return;
+    }
 
-        /* Transmit the message */
-        if (GenerateMessage(slot->command, slot->port) != HAL_SUCCESS)
+    if (slot->countdown_ms > SUBSCRIPTION_TICK_MS)
+    {
+        slot->countdown_ms -= SUBSCRIPTION_TICK_MS;
+        osalSysUnlock();
+        return;
+    }
+
+    command = slot->command;
+    port_id = slot->port;
+    port = &subscriptions.port[port_id];
+
+    if ((port->budget == 0) ||
+        (port->tokens >= slot->size * 1000 +
+                         SubscriptionReserve(port, priority)))
+    {
+        /* Generating the message claims the telemetry queue */
+        osalSysUnlock();
+        sent = (GenerateTelemetryMessage(command, port_id, &size) ==
+                HAL_SUCCESS);
+        osalSysLock();
+    }
+
+    /* The subscription may have changed while transmitting */
+    if ((slot->command != command) || (slot->port != port_id))
+    {
+        osalSysUnlock();
+        return;
+    }
+
+    if (sent == true)
+    {
+        slot->size = size;
+        slot->window_sent++;
+
+        if (port->budget != 0)
         {
-            /* Transmission buffer full */
+            if (port->tokens > size * 1000)
+                port->tokens -= size * 1000;
+            else
+                port->tokens = 0;
         }
+
+        /* Recover the rate while there is budget to spare */
+        if ((slot->decimation > 1) &&
+            ((port->budget == 0) ||
+             (port->tokens >= SubscriptionBurst(port) / 2)))
+            slot->decimation--;
+
+        slot->countdown_ms = slot->delay_ms * slot->decimation;
+    }
+    else if (slot->priority == SUBSCRIPTION_PRIORITY_HIGH)
+    {
+        /* Try again at the next tick */
+        slot->countdown_ms = SUBSCRIPTION_TICK_MS;
+    }
+    else
+    {
+        slot->dropped++;
+
+        if (slot->decimation < SUBSCRIPTION_MAX_DECIMATION / 2)
+            slot->decimation *= 2;
+        else
+            slot->decimation = SUBSCRIPTION_MAX_DECIMATION;
+
+        slot->countdown_ms = slot->delay_ms * slot->decimation;
     }
+
+    osalSysUnlock();
 }
 
 /**
- * @brief           Subscription virtual timer callback.
- *
- * @param[in] p     Pointer to the subscription structure that requested
- *                  the callback.
+ * @brief               Updates the achieved rate of each subscription at the
+ *                      end of a rate window.
  */
-static void SubscriptionCallback(void *p)
+static void SubscriptionsUpdateRates(void)
 {
-    osalSysLockFromISR();
+    subscription_slot_t *slot;
+    uint32_t rate;
+    int i;
 
-    /* Restart the virtual timer for the next message */
-    chVTSetI(&((subscription_slot_t *)p)->vt,
-             MS2ST(((subscription_slot_t *)p)->delay_ms),
-             SubscriptionCallback,
-             p);
+    osalSysLock();
 
-    /* Send the message to the transmission thread */
-    if (chMBPostI(subscriptions.mb, (msg_t)p) == MSG_TIMEOUT)
+    for (i = 0; i < MAX_NUMBER_OF_SUBSCRIPTIONS; i++)
     {
-        /* Error! Mailbox is full. Disable all subscriptions. */
-        vUnsubscribeFromAllI();
+        slot = &subscriptions.slot[i];
+
+        rate = (slot->window_sent * 10000) / SUBSCRIPTION_RATE_WINDOW_MS;
+        slot->rate = (rate > 0xffff) ? 0xffff : rate;
+        slot->window_sent = 0;
     }
 
-    osalSysUnlockFromISR();
+    osalSysUnlock();
+}
+
+/*===================================================*/
+/* Message Subscription thread.                      */
+/*===================================================*/
+
+/**
+ * @brief           Transmits the subscriptions, the priority classes are
+ *                  served in order each tick.
+ *
+ * @param[in] arg   Input argument (unused).
+ */
+static THD_FUNCTION(SubscriptionsTask, arg)
+{
+    (void)arg;
+
+    systime_t time;
+    uint32_t window_ms = 0;
+    int priority, i;
+
+    /* Name for debug */
+    chRegSetThreadName("Subscriptions");
+
+    time = chVTGetSystemTimeX();
+
+    while(1)
+    {
+        /* Wait for the next tick */
+        time = chThdSleepUntilWindowed(time,
+                                       time + MS2ST(SUBSCRIPTION_TICK_MS));
+
+        SubscriptionsRefillBudgets();
+
+        for (priority = 0; priority < SUBSCRIPTION_PRIORITY_CLASSES;
+             priority++)
+        {
+            for (i = 0; i < MAX_NUMBER_OF_SUBSCRIPTIONS; i++)
+                SubscriptionServe(&subscriptions.slot[i],
+                                  (subscription_priority_t)priority);
+        }
+
+        window_ms += SUBSCRIPTION_TICK_MS;
+        if (window_ms >= SUBSCRIPTION_RATE_WINDOW_MS)
+        {
+            SubscriptionsUpdateRates();
+            window_ms = 0;
+        }
+    }
 }
 
 /*===========================================================================*/
@@ -153,19 +346,20 @@ void vSubscriptionsInit(void)
 {
     int i;
 
-    /* Link the mailbox to its pointer */
-    subscriptions.mb = &subscription_mailbox;
-
-    /* Initialize the mailbox that passes the requested messages */
-    chMBObjectInit(subscriptions.mb,
-                   subscriptions.box,
-                   SUBSCRIPTION_MAILBOX_SIZE);
-
     /* Initialize the subscription array */
     for (i = 0; i < MAX_NUMBER_OF_SUBSCRIPTIONS; i++)
-    {
-        chVTObjectInit(&subscriptions.slot[i].vt);
         subscriptions.slot[i].command = Cmd_None;
+
+    /* Initialize the port budgets */
+    for (i = 0; i < SUBSCRIPTION_NUMBER_OF_PORTS; i++)
+    {
+        if (i == PORT_USB)
+            subscriptions.port[i].budget = SUBSCRIPTION_USB_BUDGET;
+        else
+            subscriptions.port[i].budget = SUBSCRIPTION_AUX_BUDGET;
+
+        subscriptions.port[i].tokens =
+            SubscriptionBurst(&subscriptions.port[i]);
     }
 
     /* Start the subscriptions task */
@@ -182,16 +376,20 @@ void vSubscriptionsInit(void)
  * @param[in] command   Command to subscribe to.
  * @param[in] port      Port to transmit the subscription on.
  * @param[in] delay_ms  Time between transmits.
+ * @param[in] priority  Priority class of the subscription.
  * @return              Return true if there was a free slot, else false.
  */
 bool bSubscribeToCommandI(kfly_command_t command,
                           external_port_t port,
-                          uint32_t delay_ms)
+                          uint32_t delay_ms,
+                          subscription_priority_t priority)
 {
+    subscription_slot_t *slot = NULL;
     int i;
 
     /* Sanity check */
-    if (delay_ms == 0)
+    if ((delay_ms == 0) || (isPort(port) == false) ||
+        (priority >= SUBSCRIPTION_PRIORITY_CLASSES))
       return false;
 
     /* Look if the subscription already exists */
@@ -200,41 +398,38 @@ bool bSubscribeToCommandI(kfly_command_t command,
         if ((subscriptions.slot[i].command == command) &&
             (subscriptions.slot[i].port == port))
         {
-            /* The subscription already exists. Change the current timebase
-               to the new subscription. */
-            subscriptions.slot[i].delay_ms = delay_ms;
-
-            chVTSetI(&subscriptions.slot[i].vt,
-                     MS2ST(delay_ms),
-                     SubscriptionCallback,
-                     &subscriptions.slot[i]);
-
-            return true;
+            slot = &subscriptions.slot[i];
+            break;
         }
     }
 
-    /* Look for a free subscription slot */
-    for (i = 0; i < MAX_NUMBER_OF_SUBSCRIPTIONS; i++)
+    /* Else look for a free subscription slot */
+    for (i = 0; (slot == NULL) && (i < MAX_NUMBER_OF_SUBSCRIPTIONS); i++)
     {
         if (subscriptions.slot[i].command == Cmd_None)
         {
-            /* Free subscription slot! Set the structure and initialize
-               the virtual timer. */
-            subscriptions.slot[i].command = command;
-            subscriptions.slot[i].port = port;
-            subscriptions.slot[i].delay_ms = delay_ms;
-
-            chVTSetI(&subscriptions.slot[i].vt,
-                     MS2ST(delay_ms),
-                     SubscriptionCallback,
-                     &subscriptions.slot[i]);
-
-            return true;
+            slot = &subscriptions.slot[i];
+
+            slot->command = command;
+            slot->port = port;
+            slot->size = 0;
+            slot->window_sent = 0;
+            slot->rate = 0;
+            slot->dropped = 0;
         }
     }
 
     /* No free subscription slots */
-    return false;
+    if (slot == NULL)
+        return false;
+
+    /* Start at the requested rate */
+    slot->delay_ms = delay_ms;
+    slot->countdown_ms = delay_ms;
+    slot->priority = priority;
+    slot->decimation = 1;
+
+    return true;
 }
 
 /**
@@ -256,8 +451,7 @@ bool bUnsubscribeFromCommandI(kfly_command_t command, external_port_t port)
         if ((subscriptions.slot[i].command == command) &&
             (subscriptions.slot[i].port == port))
         {
-            /* Disable the timer and reset the command */
-            chVTResetI(&subscriptions.slot[i].vt);
+            /* Free the slot */
             subscriptions.slot[i].command = Cmd_None;
 
             return true;
@@ -277,11 +471,64 @@ void vUnsubscribeFromAllI(void)
 
     /* Delete all subscriptions */
     for (i = 0; i < MAX_NUMBER_OF_SUBSCRIPTIONS; i++)
-    {
-        /* Disable the timer and reset the command */
-        chVTResetI(&subscriptions.slot[i].vt);
         subscriptions.slot[i].command = Cmd_None;
+}
+
+/**
+ * @brief               Sets the transmission budget of a port.
+ *
+ * @param[in] port          Port to set the budget of.
+ * @param[in] bytes_per_s   Budget in bytes per second, 0 for unlimited.
+ */
+void vSetSubscriptionBudget(external_port_t port, uint32_t bytes_per_s)
+{
+    if (isPort(port) == false)
+        return;
+
+    osalSysLock();
+
+    subscriptions.port[port].budget = bytes_per_s;
+    subscriptions.port[port].tokens =
+            SubscriptionBurst(&subscriptions.port[port]);
+
+    osalSysUnlock();
+}
+
+/**
+ * @brief               Copies the status of the active subscriptions.
+ *
+ * @param[out] status   Destination, room for all subscriptions.
+ * @return              Number of active subscriptions copied.
+ */
+uint32_t GetSubscriptionStatus(
+        subscription_status_t status[MAX_NUMBER_OF_SUBSCRIPTIONS])
+{
+    subscription_slot_t *slot;
+    uint32_t count = 0;
+    int i;
+
+    osalSysLock();
+
+    for (i = 0; i < MAX_NUMBER_OF_SUBSCRIPTIONS; i++)
+    {
+        slot = &subscriptions.slot[i];
+
+        if (slot->command == Cmd_None)
+            continue;
+
+        status[count].command = slot->command;
+        status[count].port = slot->port;
+        status[count].priority = slot->priority;
+        status[count].decimation = slot->decimation;
+        status[count].rate = slot->rate;
+        status[count].dropped = (slot->dropped > 0xffff) ? 0xffff :
+                                                           slot->dropped;
+        count++;
     }
+
+    osalSysUnlock();
+
+    return count;
 }
 
 /**
@@ -298,12 +545,19 @@ void vParseManageSubscription(const uint8_t *data,
     /* Parsing structure for the data */
     subscription_parser_t *p;
 
+    /* Priority class, optional at the end of the message */
+    subscription_priority_t priority = SUBSCRIPTION_PRIORITY_NORMAL;
+
     /* Check so the length of the message is correct */
-    if (size == sizeof(subscription_parser_t))
+    if ((size == sizeof(subscription_parser_t)) ||
+        (size == offsetof(subscription_parser_t, priority)))
     {
         /* Cast the message to the parser structure */
         p = (subscription_parser_t *)data;
 
+        if (size == sizeof(subscription_parser_t))
+            priority = p->priority;
+
         /* Check for valid port */
         if ((isPort(p->port) == true) || ((uint8_t)p->port == 0xff))
         {
@@ -328,13 +582,15 @@ void vParseManageSubscription(const uint8_t *data,
                     /* Port is the one the command came on */
                     bSubscribeToCommand(p->command,
                                         reception_port,
-                                        p->delta_time);
+                                        p->delta_time,
+                                        priority);
 
                 else
                     /* Port is is specified in the message */
                     bSubscribeToCommand(p->command,
                                         p->port,
-                                        p->delta_time);
+                                        p->delta_time,
+                                        priority);
             }
         }
     }
@@ -0,0 +1,554 @@
+/* *
+ *
+ * Host harness of the link layer framing in slip.c and cobs.c.
+ *
+ * Round trips COBS and SLIP frames through the encoders and the streaming
+ * decoders, with zero-free runs around the block lengths of the COBS
+ * variant (209 explicit bytes per code) and of plain COBS (254 bytes), and
+ * whole KFly packets through ParseKFlyPacketFromSLIP and
+ * ParseKFlyPacketFromCOBS with the receive buffer of the serial manager.
+ * Then compares the bytes on the wire and the cost of both framings on the
+ * telemetry messages.
+ *
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ch.h"
+#include "hal.h"
+#include "crc.h"
+#include "circularbuffer.h"
+#include "slip.h"
+#include "cobs.h"
+#include "slip2kflypacket.h"
+#include "kflypacket_parsers.h"
+#include "kflypacket_generators.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/* Transmit buffer, a power of two as required by the circular buffer */
+#define TEST_TX_SIZE            2048
+
+/* Largest payload of the raw round trips */
+#define TEST_MAX_PAYLOAD        600
+
+#define FUZZ_FRAMES             20000
+#define BENCH_REPEATS           20000
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Layout of imu_data_t in sensor_read.h.
+ */
+typedef struct PACKED_VAR
+{
+    float accelerometer[3];
+    float gyroscope[3];
+    float magnetometer[3];
+    float temperature;
+    float pressure;
+    int64_t acc_gyro_time_ns;
+} test_imu_data_t;
+
+/**
+ * @brief   Layout of imu_raw_data_t in sensor_read.h.
+ */
+typedef struct PACKED_VAR
+{
+    int16_t accelerometer[3];
+    int16_t gyroscope[3];
+    int16_t magnetometer[3];
+    int16_t temperature;
+    uint32_t pressure;
+    int64_t acc_gyro_time_ns;
+} test_imu_raw_data_t;
+
+/**
+ * @brief   Layout of attitude_states_t in attitude_ekf.h.
+ */
+typedef struct
+{
+    float q[4];
+    float w[3];
+    float wb[3];
+} test_attitude_states_t;
+
+static uint8_t tx_data[TEST_TX_SIZE];
+static circular_buffer_t tx;
+static uint8_t wire[TEST_TX_SIZE];
+
+static uint8_t decoded[TEST_MAX_PAYLOAD];
+static size_t decoded_size;
+static int decoded_frames;
+
+static kfly_parser_t kfly;
+static int kfly_messages;
+static uint8_t kfly_length;
+
+static int failures;
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief               Monotonic time in seconds.
+ */
+static double Now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief               Keeps a decoded SLIP frame.
+ */
+static void SLIPSink(slip_parser_t *p)
+{
+    memcpy(decoded, p->buffer, p->buffer_count);
+    decoded_size = p->buffer_count;
+    decoded_frames++;
+}
+
+/**
+ * @brief               Keeps a decoded COBS frame.
+ */
+static void COBSSink(communication_decoder_t *p)
+{
+    memcpy(decoded, p->buffer, p->buffer_count);
+    decoded_size = p->buffer_count;
+    decoded_frames++;
+}
+
+/**
+ * @brief               Counts the KFly messages passed to the usage parser.
+ */
+static void KFlySink(kfly_parser_t *p)
+{
+    kfly_messages++;
+    kfly_length = p->data_length;
+}
+
+/**
+ * @brief               Hands a decoded SLIP frame to the packet parser, as
+ *                      BindSLIP in serialmanager.c does.
+ */
+static void BindSLIP(slip_parser_t *p)
+{
+    ParseKFlyPacketFromSLIP(p, &kfly);
+}
+
+/**
+ * @brief               Hands a decoded COBS frame to the packet parser, as
+ *                      BindCOBS in serialmanager.c does.
+ */
+static void BindCOBS(communication_decoder_t *p)
+{
+    ParseKFlyPacketFromCOBS(p, &kfly);
+}
+
+/**
+ * @brief               Encodes a frame in the transmit buffer, starting at
+ *                      offset so the frame can wrap, and copies it out.
+ *
+ * @return              Size of the frame on the wire, 0 if it did not fit.
+ */
+static size_t Encode(link_framing_t framing,
+                     const uint8_t *data,
+                     size_t size,
+                     size_t offset)
+{
+    cobs_encoder_t enc;
+    size_t n;
+    bool status;
+
+    tx.head = tx.tail = offset & tx.mask;
+
+    if (framing == LINK_FRAMING_COBS)
+        status = COBSEncode(data, size, &tx, &enc);
+    else
+        status = GenerateSLIP((uint8_t *)data, size, &tx);
+
+    if (status != HAL_SUCCESS)
+        return 0;
+
+    n = CircularBuffer_Count(&tx);
+    CircularBuffer_ReadChunk(&tx, wire, n);
+
+    return n;
+}
+
+/**
+ * @brief               Feeds a frame from the wire to a decoder.
+ */
+static void Decode(link_framing_t framing,
+                   const uint8_t *frame,
+                   size_t size,
+                   slip_parser_t *slip,
+                   cobs_decoder_t *cobs)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        if (framing == LINK_FRAMING_COBS)
+            COBSDecode(frame[i], cobs);
+        else
+            ParseSLIP(frame[i], slip);
+    }
+}
+
+/**
+ * @brief               Encodes and decodes a payload, true if exactly the
+ *                      payload came back.
+ */
+static bool RoundTrip(link_framing_t framing,
+                      const uint8_t *data,
+                      size_t size,
+                      size_t offset)
+{
+    static uint8_t rx_data[TEST_MAX_PAYLOAD + 2];
+    slip_parser_t slip;
+    cobs_decoder_t cobs;
+    size_t n;
+
+    InitSLIPParser(&slip, rx_data, sizeof(rx_data), SLIPSink);
+    COBSInitDecoder(rx_data, sizeof(rx_data), COBSSink, &cobs);
+
+    n = Encode(framing, data, size, offset);
+    if (n == 0)
+        return false;
+
+    if ((framing == LINK_FRAMING_COBS) && (n > COBSGetMaxEncodedSize(size)))
+        return false;
+
+    decoded_frames = 0;
+    Decode(framing, wire, n, &slip, &cobs);
+
+    return (decoded_frames == 1) && (decoded_size == size) &&
+           (memcmp(decoded, data, size) == 0);
+}
+
+/**
+ * @brief               Builds a KFly packet the way GenerateGenericCommand
+ *                      does, header, data and CRC16 LSB first.
+ *
+ * @return              Size of the packet.
+ */
+static size_t MakeKFlyPacket(kfly_command_t cmd,
+                             const void *data,
+                             uint8_t size,
+                             uint8_t *packet)
+{
+    uint16_t crc16;
+
+    packet[0] = (uint8_t)cmd;
+    packet[1] = size;
+    memcpy(&packet[2], data, size);
+
+    crc16 = CRC16(packet, size + 2);
+    packet[size + 2] = (uint8_t)crc16;
+    packet[size + 3] = (uint8_t)(crc16 >> 8);
+
+    return size + 4;
+}
+
+/**
+ * @brief               COBS and SLIP round trips of zero-free runs and of
+ *                      runs broken by zeros, at every position of the
+ *                      transmit buffer wrap.
+ */
+static void TestRuns(void)
+{
+    static const size_t runs[] = {1, 2, 207, 208, 209, 210, 211, 253, 254,
+                                  255, 256, 417, 418, 419, 509, 510};
+    static uint8_t data[TEST_MAX_PAYLOAD];
+    size_t r, i, offset, size;
+    int trips = 0;
+
+    for (r = 0; r < sizeof(runs) / sizeof(runs[0]); r++)
+    {
+        /* Zero-free run alone, then with a zero on either side and a pair
+           of zeros after, which hit the zero pair and zero run codes */
+        for (i = 0; i < 4; i++)
+        {
+            size_t k, n = 0;
+
+            if ((i == 1) || (i == 3))
+                data[n++] = 0;
+
+            for (k = 0; k < runs[r]; k++)
+                data[n++] = (uint8_t)(1 + (k % 255));
+
+            if (i >= 2)
+                data[n++] = 0;
+            if (i == 3)
+                data[n++] = 0;
+
+            size = n;
+
+            for (offset = TEST_TX_SIZE - size - 4; offset < TEST_TX_SIZE;
+                 offset += 3)
+            {
+                if (RoundTrip(LINK_FRAMING_COBS, data, size, offset) ==
+                        false ||
+                    RoundTrip(LINK_FRAMING_SLIP, data, size, offset) ==
+                        false)
+                {
+                    printf("run %zu variant %zu offset %zu  FAIL\n",
+                           runs[r], i, offset);
+                    failures++;
+                    break;
+                }
+
+                trips++;
+            }
+        }
+    }
+
+    printf("zero-free runs 1 to 510 bytes: %d round trips\n", trips);
+}
+
+/**
+ * @brief               Random payloads with different zero densities.
+ */
+static void TestFuzz(void)
+{
+    static uint8_t data[TEST_MAX_PAYLOAD];
+    size_t i, size;
+    int k, zeros;
+
+    for (k = 0; k < FUZZ_FRAMES; k++)
+    {
+        size = 1 + rand() % (TEST_MAX_PAYLOAD - 1);
+        zeros = rand() % 5;
+
+        for (i = 0; i < size; i++)
+            data[i] = (rand() % 4 < zeros) ? 0 : (uint8_t)rand();
+
+        if (RoundTrip(LINK_FRAMING_COBS, data, size, rand()) == false ||
+            RoundTrip(LINK_FRAMING_SLIP, data, size, rand()) == false)
+        {
+            printf("fuzz frame %d size %zu  FAIL\n", k, size);
+            failures++;
+            return;
+        }
+    }
+
+    printf("fuzz: %d random frames\n", FUZZ_FRAMES);
+}
+
+/**
+ * @brief               Whole KFly packets through both decoders with the
+ *                      receive buffer of the serial manager, with zero-free
+ *                      data. Both framings must fit the same packets.
+ */
+static void TestKFlyPackets(void)
+{
+    static uint8_t rx_data[SERIAL_RECIEVE_BUFFER_SIZE];
+    static uint8_t data[255], packet[259];
+    slip_parser_t slip;
+    cobs_decoder_t cobs;
+    size_t i, size, n, largest[2] = {0, 0};
+    uint32_t success, overrun;
+    int f;
+
+    for (i = 0; i < sizeof(data); i++)
+        data[i] = (uint8_t)(0x55 + i) | 1;
+
+    InitKFlyPacketParser(&kfly, PORT_USB, &rx_data[2]);
+
+    for (f = 0; f < 2; f++)
+    {
+        const link_framing_t framing = (f == 0) ? LINK_FRAMING_SLIP :
+                                                  LINK_FRAMING_COBS;
+
+        for (size = 0; size <= 255; size++)
+        {
+            n = Encode(framing,
+                       packet,
+                       MakeKFlyPacket(Cmd_Ping, data, size, packet),
+                       0);
+
+            InitSLIPParser(&slip, rx_data, sizeof(rx_data), BindSLIP);
+            COBSInitDecoder(rx_data, sizeof(rx_data), BindCOBS, &cobs);
+            kfly_messages = 0;
+            Decode(framing, wire, n, &slip, &cobs);
+
+            if (framing == LINK_FRAMING_COBS)
+            {
+                success = cobs.generic_decoder.rx_success;
+                overrun = cobs.generic_decoder.buffer_overrun;
+            }
+            else
+            {
+                success = slip.rx_success;
+                overrun = slip.buffer_overrun;
+            }
+
+            if ((success == 1) && (kfly_messages == 1) &&
+                (kfly_length == size) &&
+                (memcmp(kfly.buffer, data, size) == 0))
+            {
+                largest[f] = size;
+            }
+            else if ((success != 0) || (overrun == 0))
+            {
+                printf("KFly packet with %zu data bytes  FAIL\n", size);
+                failures++;
+                return;
+            }
+        }
+    }
+
+    printf("KFly packets in the %d byte receive buffer: up to %zu data "
+           "bytes with SLIP, %zu with COBS\n",
+           SERIAL_RECIEVE_BUFFER_SIZE, largest[0], largest[1]);
+
+    if (largest[1] != largest[0])
+    {
+        printf("COBS and SLIP fit different packets  FAIL\n");
+        failures++;
+    }
+}
+
+/**
+ * @brief               Bytes on the wire and host time per frame of both
+ *                      framings on the telemetry messages, and on the worst
+ *                      cases of each.
+ */
+static void Benchmark(void)
+{
+    static const char *names[] = {"IMU data", "raw IMU", "estimation",
+                                  "SLIP worst", "COBS worst", "random"};
+    static uint8_t packets[6][259];
+    static uint8_t data[255];
+    static uint8_t rx_data[TEST_MAX_PAYLOAD + 2];
+    static uint8_t frame[TEST_TX_SIZE];
+    size_t sizes[6];
+    test_imu_data_t imu = {{0.012f, -0.031f, 0.998f},
+                           {0.0021f, -0.0004f, 0.0f},
+                           {0.21f, -0.03f, 0.44f},
+                           31.5f, 101325.0f, 1234567890123};
+    test_imu_raw_data_t raw = {{12, -40, 2048}, {3, -2, 0}, {210, -30, 440},
+                               1200, 5412345, 1234567890123};
+    test_attitude_states_t states = {{0.9998f, 0.01f, -0.02f, 0.003f},
+                                     {0.002f, -0.001f, 0.0f},
+                                     {0.0001f, 0.0f, -0.0002f}};
+    slip_parser_t slip;
+    cobs_decoder_t cobs;
+    double t0, t[2][2];
+    size_t k, i, n[2];
+    int f, r;
+
+    sizes[0] = MakeKFlyPacket(Cmd_GetIMUData, &imu, sizeof(imu),
+                              packets[0]);
+    sizes[1] = MakeKFlyPacket(Cmd_GetRawIMUData, &raw, sizeof(raw),
+                              packets[1]);
+    sizes[2] = MakeKFlyPacket(Cmd_GetEstimationAllStates, &states,
+                              sizeof(states), packets[2]);
+
+    for (i = 0; i < 251; i++)
+        data[i] = (i & 1) ? 0xC0 : 0xDB;
+    sizes[3] = MakeKFlyPacket(Cmd_DebugMessage, data, 251, packets[3]);
+
+    for (i = 0; i < 251; i++)
+        data[i] = (uint8_t)(1 + i);
+    sizes[4] = MakeKFlyPacket(Cmd_DebugMessage, data, 251, packets[4]);
+
+    for (i = 0; i < 251; i++)
+        data[i] = (uint8_t)rand();
+    sizes[5] = MakeKFlyPacket(Cmd_DebugMessage, data, 251, packets[5]);
+
+    printf("%-11s %6s %6s %6s   %-15s %-15s\n", "packet", "size", "SLIP",
+           "COBS", "SLIP enc/dec ns", "COBS enc/dec ns");
+
+    for (k = 0; k < 6; k++)
+    {
+        for (f = 0; f < 2; f++)
+        {
+            const link_framing_t framing = (f == 0) ? LINK_FRAMING_SLIP :
+                                                      LINK_FRAMING_COBS;
+
+            n[f] = Encode(framing, packets[k], sizes[k], 0);
+            memcpy(frame, wire, n[f]);
+
+            t0 = Now();
+            for (r = 0; r < BENCH_REPEATS; r++)
+                Encode(framing, packets[k], sizes[k], r);
+            t[f][0] = (Now() - t0) / BENCH_REPEATS * 1e9;
+
+            InitSLIPParser(&slip, rx_data, sizeof(rx_data), SLIPSink);
+            COBSInitDecoder(rx_data, sizeof(rx_data), COBSSink, &cobs);
+
+            t0 = Now();
+            for (r = 0; r < BENCH_REPEATS; r++)
+                Decode(framing, frame, n[f], &slip, &cobs);
+            t[f][1] = (Now() - t0) / BENCH_REPEATS * 1e9;
+        }
+
+        printf("%-11s %6zu %6zu %6zu   %6.0f/%-8.0f %6.0f/%-8.0f\n",
+               names[k], sizes[k], n[0], n[1], t[0][0], t[0][1], t[1][0],
+               t[1][1]);
+
+        if (n[1] > COBSGetMaxEncodedSize(sizes[k]))
+        {
+            printf("COBS frame above %zu bytes  FAIL\n",
+                   COBSGetMaxEncodedSize(sizes[k]));
+            failures++;
+        }
+    }
+
+    printf("worst case on the wire for n bytes: SLIP 2n + 2, "
+           "COBS n + n/208 + 2\n");
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief               ACK generation of the packet parser, not used as no
+ *                      test packet requests an ACK.
+ */
+bool GenerateMessage(kfly_command_t command, external_port_t port)
+{
+    (void)command;
+    (void)port;
+
+    return HAL_SUCCESS;
+}
+
+/**
+ * @brief               Usage parser lookup of the packet parser.
+ */
+kfly_data_parser_t GetParser(kfly_command_t command)
+{
+    (void)command;
+
+    return KFlySink;
+}
+
+int main(void)
+{
+    srand(1);
+
+    CircularBuffer_Init(&tx, tx_data, TEST_TX_SIZE);
+    CircularBuffer_InitMutex(&tx);
+
+    TestRuns();
+    TestFuzz();
+    TestKFlyPackets();
+    Benchmark();
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,37 @@
+/* *
+ *
+ * Host stand-in for the parts of ChibiOS used by the framing code, the
+ * tests are single threaded so the mutexes do nothing.
+ *
+ * */
+
+#ifndef __HOST_CH_H
+#define __HOST_CH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PACKED_VAR              __attribute__((packed))
+
+typedef struct
+{
+    int unused;
+} mutex_t;
+
+static inline void chMtxObjectInit(mutex_t *mp)
+{
+    (void)mp;
+}
+
+static inline void chMtxLock(mutex_t *mp)
+{
+    (void)mp;
+}
+
+static inline void chMtxUnlock(mutex_t *mp)
+{
+    (void)mp;
+}
+
+#endif
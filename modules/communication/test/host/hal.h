@@ -0,0 +1,13 @@
+/* *
+ *
+ * Host stand-in for the parts of the ChibiOS HAL used by the framing code.
+ *
+ * */
+
+#ifndef __HOST_HAL_H
+#define __HOST_HAL_H
+
+#define HAL_SUCCESS             false
+#define HAL_FAILED              true
+
+#endif
@@ -3,7 +3,8 @@ CONTROL_SRCS = $(MODULE_DIR)/control/src/control.c \
                $(MODULE_DIR)/control/src/control_reference.c \
                $(MODULE_DIR)/control/src/computer_control.c \
                $(MODULE_DIR)/control/src/arming.c \
-               $(MODULE_DIR)/control/src/pid.c
+               $(MODULE_DIR)/control/src/pid.c \
+               $(MODULE_DIR)/control/src/output_allocation.c
 
 # Required include directories
 CONTROL_INC = $(MODULE_DIR)/control/inc
@@ -105,13 +105,16 @@ static inline void vAttitudeControlEuler(const vector3f_t *ref,
     const float x_ref = bound(angle_limits[0], -angle_limits[0], ref->x);
     const float y_ref = bound(angle_limits[1], -angle_limits[1], ref->y);
 
-    err.x = x_ref - atan2f(2.0f * (attitude_m->w * attitude_m->x +
-                                    attitude_m->y * attitude_m->z),
-                            1.0f - 2.0f * (attitude_m->x * attitude_m->x +
-                                           attitude_m->y * attitude_m->y));
-
-    err.y = y_ref - asinf(2.0f * (attitude_m->w * attitude_m->y -
-                                   attitude_m->x * attitude_m->z));
+    err.x = x_ref - fast_atan2(2.0f * (attitude_m->w * attitude_m->x +
+                                        attitude_m->y * attitude_m->z),
+                                1.0f - 2.0f * (attitude_m->x * attitude_m->x +
+                                               attitude_m->y * attitude_m->y),
+                                FASTMATH_TIER_MEDIUM);
+
+    /* Saturates if the quaternion is slightly off unit length */
+    err.y = y_ref - fast_asin(2.0f * (attitude_m->w * attitude_m->y -
+                                       attitude_m->x * attitude_m->z),
+                              FASTMATH_TIER_MEDIUM);
 
     /* Update controllers, send bounded control signal to the next step */
     out->x = fPIDUpdate_BC(&attitude_controller[0],
@@ -74,6 +74,8 @@ control_reference_t *ptrGetControlReferences(void);
 control_data_t *ptrGetControlData(void);
 control_limits_t *ptrGetControlLimits(void);
 output_mixer_t *ptrGetOutputMixer(void);
+output_allocation_settings_t *ptrGetOutputAllocation(void);
+thrust_curve_settings_t *ptrGetThrustCurves(void);
 control_filter_settings_t *ptrGetControlFilters(void);
 void GetControlParameters(control_parameters_t *param);
 void SetControlParameters(const control_parameters_t *param);
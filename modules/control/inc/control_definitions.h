@@ -12,6 +12,14 @@
 /*===========================================================================*/
 
 #define OUTPUT_MIXER_SIZE                       (sizeof(output_mixer_t))
+#define OUTPUT_ALLOCATION_SIZE                                                \
+    (sizeof(output_allocation_settings_t))
+#define THRUST_CURVE_SETTINGS_SIZE                                            \
+    (sizeof(thrust_curve_settings_t))
+#define THRUST_CURVE_MEASUREMENT_SIZE                                         \
+    (sizeof(thrust_curve_measurement_t))
+#define THRUST_CURVE_NUM_POINTS                 9
+#define THRUST_CURVE_MAX_MEASUREMENTS           16
 #define CONTROL_ARM_SIZE                        (sizeof(control_arm_settings_t))
 #define CONTROL_LIMITS_SIZE                     (sizeof(control_limits_t))
 #define CONTROL_REFERENCE_SIZE                  (sizeof(control_reference_t))
@@ -108,6 +116,84 @@ typedef struct
     float offset[8];
 } output_mixer_t;
 
+/**
+ * @brief   Output allocation modes.
+ */
+typedef enum PACKED_VAR
+{
+    /**
+     * @brief   Plain linear mixing, each output is clipped on its own.
+     */
+    OUTPUT_ALLOCATION_LINEAR = 0,
+    /**
+     * @brief   Saturation aware allocation, collective thrust is only allowed
+     *          to be lowered to regain attitude authority.
+     */
+    OUTPUT_ALLOCATION_PRIORITIZED = 1,
+    /**
+     * @brief   Saturation aware allocation, collective thrust is allowed to
+     *          be both lowered and raised to regain attitude authority.
+     */
+    OUTPUT_ALLOCATION_AIRMODE = 2
+} output_allocation_mode_t;
+
+/**
+ * @brief   Output allocation settings.
+ */
+typedef struct PACKED_VAR
+{
+    /**
+     * @brief   Allocation mode.
+     */
+    output_allocation_mode_t mode;
+    /**
+     * @brief   Motor thrust linearization, 0.0 gives a linear command to
+     *          thrust relation and 1.0 a purely quadratic relation.
+     */
+    float thrust_linearization;
+} output_allocation_settings_t;
+
+/**
+ * @brief   Per channel thrust to command lookup tables.
+ */
+typedef struct PACKED_VAR
+{
+    /**
+     * @brief   Switch for enabling the lookup table of a channel, 1 for
+     *          enabled and 0 for disabled. An enabled table overrides the
+     *          thrust linearization coefficient.
+     */
+    uint8_t enabled[8];
+    /**
+     * @brief   Command (0 to 65535 for 0.0 to 1.0) giving the relative thrust
+     *          i / (THRUST_CURVE_NUM_POINTS - 1) at point i.
+     */
+    uint16_t command[8][THRUST_CURVE_NUM_POINTS];
+} thrust_curve_settings_t;
+
+/**
+ * @brief   Bench measurements for calibrating the thrust curve of a channel.
+ */
+typedef struct PACKED_VAR
+{
+    /**
+     * @brief   Output channel the measurements belong to.
+     */
+    uint8_t channel;
+    /**
+     * @brief   Number of valid measurements.
+     */
+    uint8_t count;
+    /**
+     * @brief   Applied commands in 0.0 to 1.0, strictly increasing.
+     */
+    float command[THRUST_CURVE_MAX_MEASUREMENTS];
+    /**
+     * @brief   Measured thrust in any unit.
+     */
+    float thrust[THRUST_CURVE_MAX_MEASUREMENTS];
+} thrust_curve_measurement_t;
+
 /*
  * Data transfer structures
  */
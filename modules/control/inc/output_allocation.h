@@ -0,0 +1,75 @@
+#ifndef __OUTPUT_ALLOCATION_H
+#define __OUTPUT_ALLOCATION_H
+
+#include "control_definitions.h"
+
+/*===========================================================================*/
+/* Module global definitions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Number of outputs handled by the allocator.
+ */
+#define OUTPUT_ALLOCATION_NUM_OUTPUTS           8
+
+/**
+ * @brief   Maximum thrust linearization coefficient (purely quadratic).
+ */
+#define OUTPUT_ALLOCATION_MAX_LINEARIZATION     1.0f
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/**
+ * @brief               Looks up the command for a relative thrust by linear
+ *                      interpolation in a uniformly spaced thrust curve.
+ *
+ * @param[in] curves    Thrust curves.
+ * @param[in] channel   Output channel.
+ * @param[in] t         Relative thrust, bounded to 0.0 to 1.0.
+ * @return              Command in 0.0 to 1.0.
+ */
+static inline float ThrustCurveLookup(const thrust_curve_settings_t *curves,
+                                      const int channel,
+                                      float t)
+{
+    t = bound(1.0f, 0.0f, t) * (float)(THRUST_CURVE_NUM_POINTS - 1);
+
+    int i = (int)t;
+    if (i > THRUST_CURVE_NUM_POINTS - 2)
+        i = THRUST_CURVE_NUM_POINTS - 2;
+
+    const float frac = t - (float)i;
+    const float c0 = (float)curves->command[channel][i];
+    const float c1 = (float)curves->command[channel][i + 1];
+
+    return (c0 + frac * (c1 - c0)) * (1.0f / 65535.0f);
+}
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+void OutputAllocationSettingsValidate(output_allocation_settings_t *settings);
+void ThrustCurveReset(thrust_curve_settings_t *curves);
+void ThrustCurveValidate(thrust_curve_settings_t *curves);
+bool bThrustCurveFromMeasurements(
+                        const thrust_curve_measurement_t *meas,
+                        uint16_t table[THRUST_CURVE_NUM_POINTS]);
+void vAllocateOutputs(const output_mixer_t *mixer,
+                      const output_allocation_settings_t *settings,
+                      const thrust_curve_settings_t *curves,
+                      const float throttle,
+                      const vector3f_t *torque,
+                      float output[OUTPUT_ALLOCATION_NUM_OUTPUTS]);
+
+#endif
@@ -33,11 +33,39 @@
 #include "rate_loop.h"
 #include "attitude_loop.h"
 #include "sensor_read.h"
+#include "blackbox.h"
+#include "output_allocation.h"
+#include "parameters.h"
 
 /*===========================================================================*/
 /* Module local definitions.                                                 */
 /*===========================================================================*/
 
+/* Bounds of the parameters in the parameter table */
+#define CONTROL_MAX_GAIN                    100.0f
+#define CONTROL_MAX_RATE                    (4.0f * 3.14159265f)
+#define CONTROL_MAX_ANGLE                   (0.5f * 3.14159265f)
+#define CONTROL_MAX_VELOCITY                50.0f
+
+/* The P, I and D gains of a PID controller in the parameter table */
+#define CONTROL_PID_PARAMETERS(pid)                                           \
+    {PARAMETER_TYPE_FLOAT, &(pid).gains.P, 0.0f, CONTROL_MAX_GAIN},           \
+    {PARAMETER_TYPE_FLOAT, &(pid).gains.I, 0.0f, CONTROL_MAX_GAIN},           \
+    {PARAMETER_TYPE_FLOAT, &(pid).gains.D, 0.0f, CONTROL_MAX_GAIN}
+
+/* A non-negative float in the parameter table */
+#define CONTROL_FLOAT_PARAMETER(var, max)                                     \
+    {PARAMETER_TYPE_FLOAT, &(var), 0.0f, (max)}
+
+/* The D-term filter of an axis in the parameter table */
+#define CONTROL_DTERM_CUTOFF_PARAMETER(axis)                                  \
+    {PARAMETER_TYPE_FLOAT, &control_filters.settings.dterm_cutoff[axis],      \
+     1.0f, SENSOR_ACCGYRO_HZ / 2.0f}
+#define CONTROL_DTERM_MODE_PARAMETER(axis)                                    \
+    {PARAMETER_TYPE_UNSIGNED_OF(biquad_mode_t),                               \
+     &control_filters.settings.dterm_filter_mode[axis],                       \
+     BIQUAD_MODE_BIQUAD, BIQUAD_MODE_PT1}
+
 /*===========================================================================*/
 /* Module exported variables.                                                */
 /*===========================================================================*/
@@ -49,11 +77,72 @@ control_reference_t control_reference;
 control_data_t control_data;
 control_limits_t control_limits;
 output_mixer_t output_mixer;
+output_allocation_settings_t output_allocation;
+thrust_curve_settings_t thrust_curves;
 control_parameters_t flash_save_control_parameters;
 control_filters_t control_filters;
 
 THD_WORKING_AREA(waThreadControl, 256);
-THD_WORKING_AREA(waThreadControlFlashSave, 256);
+
+/* Controller gains and D-term filters, saved in the "CONP" record */
+static const parameter_t control_parameter_table[] = {
+    CONTROL_PID_PARAMETERS(control_data.attitude_controller[0]),
+    CONTROL_PID_PARAMETERS(control_data.attitude_controller[1]),
+    CONTROL_PID_PARAMETERS(control_data.attitude_controller[2]),
+    CONTROL_PID_PARAMETERS(control_data.rate_controller[0]),
+    CONTROL_PID_PARAMETERS(control_data.rate_controller[1]),
+    CONTROL_PID_PARAMETERS(control_data.rate_controller[2]),
+    CONTROL_DTERM_CUTOFF_PARAMETER(0),
+    CONTROL_DTERM_CUTOFF_PARAMETER(1),
+    CONTROL_DTERM_CUTOFF_PARAMETER(2),
+    CONTROL_DTERM_MODE_PARAMETER(0),
+    CONTROL_DTERM_MODE_PARAMETER(1),
+    CONTROL_DTERM_MODE_PARAMETER(2)
+};
+
+/* Control limits, saved in the "CONL" record */
+static const parameter_t control_limits_table[] = {
+    CONTROL_FLOAT_PARAMETER(control_limits.max_rate.max_rate.x,
+                            CONTROL_MAX_RATE),
+    CONTROL_FLOAT_PARAMETER(control_limits.max_rate.max_rate.y,
+                            CONTROL_MAX_RATE),
+    CONTROL_FLOAT_PARAMETER(control_limits.max_rate.max_rate.z,
+                            CONTROL_MAX_RATE),
+    CONTROL_FLOAT_PARAMETER(control_limits.max_rate.center_rate.x,
+                            CONTROL_MAX_RATE),
+    CONTROL_FLOAT_PARAMETER(control_limits.max_rate.center_rate.y,
+                            CONTROL_MAX_RATE),
+    CONTROL_FLOAT_PARAMETER(control_limits.max_rate.center_rate.z,
+                            CONTROL_MAX_RATE),
+    CONTROL_FLOAT_PARAMETER(control_limits.max_angle.roll,
+                            CONTROL_MAX_ANGLE),
+    CONTROL_FLOAT_PARAMETER(control_limits.max_angle.pitch,
+                            CONTROL_MAX_ANGLE),
+    CONTROL_FLOAT_PARAMETER(control_limits.max_velocity.horizontal,
+                            CONTROL_MAX_VELOCITY),
+    CONTROL_FLOAT_PARAMETER(control_limits.max_velocity.vertical,
+                            CONTROL_MAX_VELOCITY)
+};
+
+static void vControlParametersChanged(void);
+
+static const parameter_group_t control_parameter_group = {
+    PARAMETER_MODULE_CONTROL,
+    PARAMETER_ID(PARAMETER_MODULE_CONTROL, 0),
+    FLASHSAVE_ID('C', 'O', 'N', 'P'),
+    control_parameter_table,
+    sizeof(control_parameter_table) / sizeof(parameter_t),
+    vControlParametersChanged
+};
+
+static const parameter_group_t control_limits_group = {
+    PARAMETER_MODULE_CONTROL,
+    PARAMETER_ID(PARAMETER_MODULE_CONTROL, 32),
+    FLASHSAVE_ID('C', 'O', 'N', 'L'),
+    control_limits_table,
+    sizeof(control_limits_table) / sizeof(parameter_t),
+    NULL
+};
 
 /*===========================================================================*/
 /* Module local functions.                                                   */
@@ -91,62 +180,69 @@ static THD_FUNCTION(ThreadControl, arg)
 
         /* Run control. */
         vUpdateControlAction(&states->q, &states->w, SENSOR_ACCGYRO_DT);
+
+        /* Log the control step. */
+        BlackboxLogControlStep();
     }
 }
 
 /**
- * @brief           Thread for the flash save operation.
+ * @brief           Copies the current control parameters for saving.
  *
- * @param[in] arg   Unused.
- * @return          Unused.
+ * @param[out] data Pointer to the control parameters to save.
  */
-static THD_FUNCTION(ThreadControlFlashSave, arg)
+static void vControlParametersSnapshot(void *data)
 {
-    (void)arg;
+    GetControlParameters((control_parameters_t *)data);
+}
 
-    /* Event registration for flash save event. */
-    event_listener_t el;
+/**
+ * @brief   Recalculates the D-term filters after the control parameters have
+ *          been changed through the parameter table.
+ */
+static void vControlParametersChanged(void)
+{
+    osalSysLock();
 
-    /* Set thread name. */
-    chRegSetThreadName("Control FlashSave");
+    ControlFiltersInit();
 
-    /* Register to flash save event. */
-    chEvtRegisterMask(ptrGetFlashSaveEventSource(),
-                      &el,
-                      FLASHSAVE_SAVE_EVENTMASK);
+    osalSysUnlock();
+}
 
-    while (1)
-    {
-        /* Wait for flash save event. */
-        chEvtWaitOne(FLASHSAVE_SAVE_EVENTMASK);
-
-        /* Save Control Parameters. */
-        FlashSave_Write(FlashSave_STR2ID("CONA"),
-                        true,
-                        (uint8_t *)ptrGetControlArmSettings(),
-                        CONTROL_ARM_SIZE);
-
-        /* Get the current control parameters. */
-        GetControlParameters(&flash_save_control_parameters);
-
-        /* Save Control Parameters. */
-        FlashSave_Write(FlashSave_STR2ID("CONP"),
-                        true,
-                        (uint8_t *)&flash_save_control_parameters,
-                        CONTROL_PARAMETERS_SIZE);
-
-        /* Save Control Limits. */
-        FlashSave_Write(FlashSave_STR2ID("CONL"),
-                        true,
-                        (uint8_t *)&control_limits,
-                        CONTROL_LIMITS_SIZE);
-
-        /* Save Output Mixer. */
-        FlashSave_Write(FlashSave_STR2ID("CONM"),
-                        true,
-                        (uint8_t *)&output_mixer,
-                        OUTPUT_MIXER_SIZE);
-    }
+/**
+ * @brief   Registers all control parameters for saving to flash.
+ */
+static void vRegisterControlParametersFlashSave(void)
+{
+    FlashSave_Register(FlashSave_STR2ID("CONA"),
+                       ptrGetControlArmSettings(),
+                       CONTROL_ARM_SIZE,
+                       NULL);
+
+    FlashSave_Register(FlashSave_STR2ID("CONP"),
+                       &flash_save_control_parameters,
+                       CONTROL_PARAMETERS_SIZE,
+                       vControlParametersSnapshot);
+
+    FlashSave_Register(FlashSave_STR2ID("CONL"),
+                       &control_limits,
+                       CONTROL_LIMITS_SIZE,
+                       NULL);
+
+    FlashSave_Register(FlashSave_STR2ID("CONM"),
+                       &output_mixer,
+                       OUTPUT_MIXER_SIZE,
+                       NULL);
+
+    FlashSave_Register(FlashSave_STR2ID("CONO"),
+                       &output_allocation,
+                       OUTPUT_ALLOCATION_SIZE,
+                       NULL);
+
+    FlashSave_Register(FlashSave_STR2ID("CONT"),
+                       &thrust_curves,
+                       THRUST_CURVE_SETTINGS_SIZE,
+                       NULL);
 }
 
 /**
@@ -179,42 +275,35 @@ static void vReadControlParametersFromFlash(void)
     FlashSave_Read(FlashSave_STR2ID("CONM"),
                    (uint8_t *)&output_mixer,
                    OUTPUT_MIXER_SIZE);
+
+    /* Read Output Allocation settings. */
+    FlashSave_Read(FlashSave_STR2ID("CONO"),
+                   (uint8_t *)&output_allocation,
+                   OUTPUT_ALLOCATION_SIZE);
+
+    OutputAllocationSettingsValidate(&output_allocation);
+
+    /* Read Thrust Curves. */
+    FlashSave_Read(FlashSave_STR2ID("CONT"),
+                   (uint8_t *)&thrust_curves,
+                   THRUST_CURVE_SETTINGS_SIZE);
+
+    ThrustCurveValidate(&thrust_curves);
 }
 
 /**
  * @brief   Calculates the control signals based on the output weighting
- *          matrix and the desired torque around each axis plus throttle.
+ *          matrix and the desired torque around each axis plus throttle,
+ *          resolving saturation according to the output allocation settings.
  */
 static void vUpdateOutputs(void)
 {
-    float sum;
-    int i;
-
-    /* Calculate the control signal for each PWM output. */
-    for (i = 0; i < 8; i++)
-    {
-        /* Add the throttle weight. */
-        sum =  control_reference.actuator_desired.throttle *
-               output_mixer.weights[i][0];
-
-        /* Add the roll (around x) weight. */
-        sum += control_reference.actuator_desired.torque.x *
-               output_mixer.weights[i][1];
-
-        /* Add the pitch (around y) weight. */
-        sum += control_reference.actuator_desired.torque.y *
-               output_mixer.weights[i][2];
-
-        /* Add the yaw (around z) weight. */
-        sum += control_reference.actuator_desired.torque.z *
-               output_mixer.weights[i][3];
-
-        /* Add the channel offset. */
-        sum += output_mixer.offset[i];
-
-        /* Save the control command. */
-        control_reference.output[i] = sum;
-    }
+    vAllocateOutputs(&output_mixer,
+                     &output_allocation,
+                     &thrust_curves,
+                     control_reference.actuator_desired.throttle,
+                     &control_reference.actuator_desired.torque,
+                     control_reference.output);
 }
 
 /**
@@ -281,6 +370,12 @@ void ControlInit(void)
     /* Initialize the mixer's weights to 0. */
     memset((uint8_t *)&output_mixer, 0, OUTPUT_MIXER_SIZE);
 
+    /* Initialize the output allocation to plain linear mixing. */
+    memset((uint8_t *)&output_allocation, 0, OUTPUT_ALLOCATION_SIZE);
+
+    /* Initialize the thrust curves to linear and disabled. */
+    ThrustCurveReset(&thrust_curves);
+
     /* Initializing computer control. */
     ComputerControlInit();
 
@@ -293,6 +388,13 @@ void ControlInit(void)
     /* Read data from flash (if available). */
     vReadControlParametersFromFlash();
 
+    /* Register the parameters for saving to flash. */
+    vRegisterControlParametersFlashSave();
+
+    /* Register the parameters in the parameter table. */
+    ParametersRegister(&control_parameter_group);
+    ParametersRegister(&control_limits_group);
+
     /* Initialize control filter */
     ControlFiltersInit();
 
@@ -305,13 +407,6 @@ void ControlInit(void)
                       HIGHPRIO - 2,
                       ThreadControl,
                       NULL);
-
-    /* Initialize control flash save thread. */
-    chThdCreateStatic(waThreadControlFlashSave,
-                      sizeof(waThreadControlFlashSave),
-                      NORMALPRIO,
-                      ThreadControlFlashSave,
-                      NULL);
 }
 
 /**
@@ -537,6 +632,26 @@ output_mixer_t *ptrGetOutputMixer(void)
     return &output_mixer;
 }
 
+/**
+ * @brief       Return the pointer to the output allocation settings.
+ *
+ * @return      Pointer to the output allocation settings.
+ */
+output_allocation_settings_t *ptrGetOutputAllocation(void)
+{
+    return &output_allocation;
+}
+
+/**
+ * @brief       Return the pointer to the thrust curves.
+ *
+ * @return      Pointer to the thrust curves.
+ */
+thrust_curve_settings_t *ptrGetThrustCurves(void)
+{
+    return &thrust_curves;
+}
+
 /**
  * @brief       Return the pointer to the control filters structure.
  *
@@ -64,6 +64,8 @@ static inline float ApplyRateLimitsAndExponentials(const float center_rate,
  * @brief       Converts RC inputs to control action depending on the current
  *              flight mode.
  * @note        Only for usage in manual control mode.
+ * @note        The sticks are interpolated to the current time, according to
+ *              the RC interpolation settings.
  *
  * @param[out] ref          Reference output.
  * @param[in] rate_lim      Rate limits around roll (x), pitch (y) and yaw (z).
@@ -77,7 +79,7 @@ void RCInputsToControlAction(control_reference_t *ref,
 
     /* Read out the throttle reference and check if it is bellow the minimum
      * throttle. Used to indicate an armed system by rotating the propellers. */
-    float throttle = RCInputGetInputLevel(RCINPUT_ROLE_THROTTLE);
+    float throttle = RCInputGetInterpolatedLevel(RCINPUT_ROLE_THROTTLE);
 
     if (throttle < fGetArmedMinThrottle())
     {
@@ -92,25 +94,27 @@ void RCInputsToControlAction(control_reference_t *ref,
     {
       ref->rate_reference.x = ApplyRateLimitsAndExponentials(
           lim->max_rate.center_rate.x, lim->max_rate.max_rate.x,
-          RCInputGetInputLevel(RCINPUT_ROLE_ROLL));
+          RCInputGetInterpolatedLevel(RCINPUT_ROLE_ROLL));
       ref->rate_reference.y = ApplyRateLimitsAndExponentials(
           lim->max_rate.center_rate.y, lim->max_rate.max_rate.y,
-          RCInputGetInputLevel(RCINPUT_ROLE_PITCH));
+          RCInputGetInterpolatedLevel(RCINPUT_ROLE_PITCH));
       ref->rate_reference.z = ApplyRateLimitsAndExponentials(
           lim->max_rate.center_rate.z, lim->max_rate.max_rate.z,
-          RCInputGetInputLevel(RCINPUT_ROLE_YAW));
+          RCInputGetInterpolatedLevel(RCINPUT_ROLE_YAW));
 
       ref->actuator_desired.throttle = throttle;
     }
     else if (ref->mode == FLIGHTMODE_ATTITUDE_EULER)
     {
         ref->attitude_reference_euler.x =
-            lim->max_angle.roll * RCInputGetInputLevel(RCINPUT_ROLE_ROLL);
+            lim->max_angle.roll *
+            RCInputGetInterpolatedLevel(RCINPUT_ROLE_ROLL);
         ref->attitude_reference_euler.y =
-            lim->max_angle.pitch * RCInputGetInputLevel(RCINPUT_ROLE_PITCH);
+            lim->max_angle.pitch *
+            RCInputGetInterpolatedLevel(RCINPUT_ROLE_PITCH);
         ref->rate_reference.z = ApplyRateLimitsAndExponentials(
             lim->max_rate.center_rate.z, lim->max_rate.max_rate.z,
-            RCInputGetInputLevel(RCINPUT_ROLE_YAW));
+            RCInputGetInterpolatedLevel(RCINPUT_ROLE_YAW));
 
         ref->actuator_desired.throttle = throttle;
     }
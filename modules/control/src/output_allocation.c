@@ -0,0 +1,367 @@
+/* *
+ *
+ * Saturation aware control allocation.
+ *
+ * The linear mixer gives each output as:
+ *
+ *   output[i] = throttle * w0 + roll * w1 + pitch * w2 + yaw * w3 + offset
+ *
+ * which, when clipped channel by channel, loses attitude authority at high
+ * and low throttle. The allocator splits the motor outputs (outputs with a
+ * positive throttle weight) into collective, roll/pitch and yaw parts and
+ * resolves saturation in priority order:
+ *
+ *   1. Shift the collective thrust to fit the differential part.
+ *   2. If the differential part spans more than the output range, scale
+ *      yaw until roll/pitch fits.
+ *   3. If roll/pitch alone spans more than the output range, drop yaw and
+ *      scale roll/pitch.
+ *
+ * Outputs with zero throttle weight (servos etc.) are mixed linearly. In
+ * linear mode the motors are only clipped, as the plain mixer does, but the
+ * thrust linearization is still applied.
+ *
+ * Last, the relative thrust of each output is converted to a command, either
+ * through the channel's thrust curve lookup table, when enabled, or through
+ * the quadratic linearization for motors.
+ *
+ * The cost is linear in the number of outputs with at most one division and
+ * one square root per motor, a few microseconds for all 8 outputs.
+ *
+ * */
+
+#include "output_allocation.h"
+#include "trigonometry.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/**
+ * @brief   Minimum throttle weight for an output to count as a motor.
+ */
+#define MOTOR_WEIGHT_THRESHOLD      (1e-3f)
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief           Converts a desired relative thrust to a motor command
+ *                  based on the model thrust = (1 - a) * u + a * u^2.
+ *
+ * @param[in] a     Linearization coefficient in 0.0 to 1.0.
+ * @param[in] t     Desired relative thrust in 0.0 to 1.0.
+ * @return          Motor command in 0.0 to 1.0.
+ */
+static inline float ThrustToCommand(const float a, const float t)
+{
+    const float b = 1.0f - a;
+
+    return (sqrtf(b * b + 4.0f * a * t) - b) / (2.0f * a);
+}
+
+/**
+ * @brief               Converts the relative thrust of the outputs to
+ *                      commands, through the thrust curve of a channel when
+ *                      enabled or else the thrust linearization of motors.
+ *
+ * @param[in] mixer     Output mixer weights and offsets.
+ * @param[in] settings  Allocation settings.
+ * @param[in] curves    Per channel thrust curves, may be NULL.
+ * @param[in/out] output    Relative thrust in, commands out.
+ */
+static void vApplyThrustCurves(const output_mixer_t *mixer,
+                               const output_allocation_settings_t *settings,
+                               const thrust_curve_settings_t *curves,
+                               float output[OUTPUT_ALLOCATION_NUM_OUTPUTS])
+{
+    int i;
+
+    for (i = 0; i < OUTPUT_ALLOCATION_NUM_OUTPUTS; i++)
+    {
+        if (curves != NULL && curves->enabled[i])
+            output[i] = ThrustCurveLookup(curves, i, output[i]);
+        else if (settings->thrust_linearization > 0.0f &&
+                 mixer->weights[i][0] >= MOTOR_WEIGHT_THRESHOLD)
+            output[i] = ThrustToCommand(settings->thrust_linearization,
+                                        output[i]);
+    }
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief               Bounds the allocation settings to valid values.
+ *
+ * @param[in/out] settings  Settings to validate.
+ */
+void OutputAllocationSettingsValidate(output_allocation_settings_t *settings)
+{
+    if (settings->mode != OUTPUT_ALLOCATION_LINEAR &&
+        settings->mode != OUTPUT_ALLOCATION_PRIORITIZED &&
+        settings->mode != OUTPUT_ALLOCATION_AIRMODE)
+        settings->mode = OUTPUT_ALLOCATION_LINEAR;
+
+    /* Catches NaN as well. */
+    if (!(settings->thrust_linearization >= 0.0f))
+        settings->thrust_linearization = 0.0f;
+    else if (settings->thrust_linearization >
+             OUTPUT_ALLOCATION_MAX_LINEARIZATION)
+        settings->thrust_linearization = OUTPUT_ALLOCATION_MAX_LINEARIZATION;
+}
+
+/**
+ * @brief               Resets all thrust curves to linear and disables them.
+ *
+ * @param[out] curves   Thrust curves to reset.
+ */
+void ThrustCurveReset(thrust_curve_settings_t *curves)
+{
+    int i, j;
+
+    for (i = 0; i < OUTPUT_ALLOCATION_NUM_OUTPUTS; i++)
+    {
+        curves->enabled[i] = 0;
+
+        for (j = 0; j < THRUST_CURVE_NUM_POINTS; j++)
+            curves->command[i][j] = (uint16_t)((65535UL * j) /
+                                               (THRUST_CURVE_NUM_POINTS - 1));
+    }
+}
+
+/**
+ * @brief               Disables thrust curves which are not monotonically
+ *                      increasing.
+ *
+ * @param[in/out] curves    Thrust curves to validate.
+ */
+void ThrustCurveValidate(thrust_curve_settings_t *curves)
+{
+    int i, j;
+
+    for (i = 0; i < OUTPUT_ALLOCATION_NUM_OUTPUTS; i++)
+    {
+        /* Only 0 and 1 are valid, anything else comes from bad data. */
+        if (curves->enabled[i] > 1)
+            curves->enabled[i] = 0;
+
+        for (j = 1; j < THRUST_CURVE_NUM_POINTS; j++)
+            if (curves->command[i][j] < curves->command[i][j - 1])
+                curves->enabled[i] = 0;
+    }
+}
+
+/**
+ * @brief               Bench calibration of a thrust curve. Inverts measured
+ *                      (command, thrust) pairs into a thrust to command
+ *                      lookup table.
+ * @note                The thrust is normalized to the largest measured
+ *                      thrust. If the first command is above zero with
+ *                      non-zero thrust, a (0, 0) point is assumed.
+ *
+ * @param[in] meas      Bench measurements.
+ * @param[out] table    Resulting lookup table.
+ * @return              True if the measurements were valid.
+ */
+bool bThrustCurveFromMeasurements(const thrust_curve_measurement_t *meas,
+                                  uint16_t table[THRUST_CURVE_NUM_POINTS])
+{
+    float cmd[THRUST_CURVE_MAX_MEASUREMENTS + 1];
+    float thrust[THRUST_CURVE_MAX_MEASUREMENTS + 1];
+    int n = 0, i, j;
+
+    if (meas->count < 2 || meas->count > THRUST_CURVE_MAX_MEASUREMENTS)
+        return false;
+
+    if (meas->command[0] > 0.0f && meas->thrust[0] > 0.0f)
+    {
+        cmd[0] = 0.0f;
+        thrust[0] = 0.0f;
+        n = 1;
+    }
+
+    /* Copy while checking the commands and enforcing a monotonic thrust, as
+     * measurement noise must not fold the inverse. */
+    for (i = 0; i < meas->count; i++, n++)
+    {
+        cmd[n] = meas->command[i];
+        thrust[n] = meas->thrust[i];
+
+        if (!(cmd[n] >= 0.0f && cmd[n] <= 1.0f))
+            return false;
+
+        if (n > 0)
+        {
+            if (cmd[n] <= cmd[n - 1])
+                return false;
+
+            thrust[n] = fmaxf(thrust[n], thrust[n - 1]);
+        }
+    }
+
+    const float thrust_min = thrust[0];
+    const float thrust_span = thrust[n - 1] - thrust_min;
+
+    if (!(thrust_span > 0.0f))
+        return false;
+
+    /* Walk the measurements once, as the grid points are increasing. */
+    for (i = 0, j = 0; i < THRUST_CURVE_NUM_POINTS; i++)
+    {
+        const float target = thrust_min + thrust_span * (float)i /
+                             (float)(THRUST_CURVE_NUM_POINTS - 1);
+        float c;
+
+        while (j < n - 2 && thrust[j + 1] < target)
+            j++;
+
+        if (thrust[j + 1] > thrust[j])
+            c = cmd[j] + (cmd[j + 1] - cmd[j]) * (target - thrust[j]) /
+                (thrust[j + 1] - thrust[j]);
+        else
+            c = cmd[j];
+
+        table[i] = (uint16_t)(bound(1.0f, 0.0f, c) * 65535.0f + 0.5f);
+    }
+
+    return true;
+}
+
+/**
+ * @brief               Allocates throttle and torque requests to the outputs.
+ *
+ * @param[in] mixer     Output mixer weights and offsets.
+ * @param[in] settings  Allocation settings.
+ * @param[in] curves    Per channel thrust curves.
+ * @param[in] throttle  Desired collective throttle.
+ * @param[in] torque    Desired torque around roll (x), pitch (y), yaw (z).
+ * @param[out] output   Resulting output commands, motors within 0.0 to 1.0.
+ */
+void vAllocateOutputs(const output_mixer_t *mixer,
+                      const output_allocation_settings_t *settings,
+                      const thrust_curve_settings_t *curves,
+                      const float throttle,
+                      const vector3f_t *torque,
+                      float output[OUTPUT_ALLOCATION_NUM_OUTPUTS])
+{
+    float rp[OUTPUT_ALLOCATION_NUM_OUTPUTS];
+    float yaw[OUTPUT_ALLOCATION_NUM_OUTPUTS];
+    float rp_min = 0.0f, rp_max = 0.0f;
+    float rpy_min = 0.0f, rpy_max = 0.0f;
+    float rp_gain = 1.0f, yaw_gain = 1.0f;
+    float lo = -1e6f, hi = 1e6f, shift;
+    bool has_motors = false;
+    int i;
+
+    /* Split each output into collective, roll/pitch and yaw parts. */
+    for (i = 0; i < OUTPUT_ALLOCATION_NUM_OUTPUTS; i++)
+    {
+        rp[i]  = torque->x * mixer->weights[i][1] +
+                 torque->y * mixer->weights[i][2];
+        yaw[i] = torque->z * mixer->weights[i][3];
+
+        output[i] = throttle * mixer->weights[i][0] + mixer->offset[i];
+
+        if (mixer->weights[i][0] < MOTOR_WEIGHT_THRESHOLD)
+        {
+            /* Non-motor output: mix linearly. */
+            output[i] += rp[i] + yaw[i];
+        }
+        else
+        {
+            const float rpy = rp[i] + yaw[i];
+
+            if (has_motors == false)
+            {
+                rp_min = rp_max = rp[i];
+                rpy_min = rpy_max = rpy;
+                has_motors = true;
+            }
+            else
+            {
+                rp_min = fminf(rp_min, rp[i]);
+                rp_max = fmaxf(rp_max, rp[i]);
+                rpy_min = fminf(rpy_min, rpy);
+                rpy_max = fmaxf(rpy_max, rpy);
+            }
+        }
+    }
+
+    if (has_motors == false)
+    {
+        vApplyThrustCurves(mixer, settings, curves, output);
+        return;
+    }
+
+    /* Scale yaw, and roll/pitch if needed, so the differential part fits in
+     * the output range. As the span is convex, a linear blend of the yaw
+     * contribution with gain k has a span of at most
+     * (1 - k) * span(rp) + k * span(rp + yaw). */
+    const float rp_span = rp_max - rp_min;
+    const float rpy_span = rpy_max - rpy_min;
+
+    if (settings->mode != OUTPUT_ALLOCATION_LINEAR && rpy_span > 1.0f)
+    {
+        if (rp_span < 1.0f)
+        {
+            yaw_gain = (1.0f - rp_span) / (rpy_span - rp_span);
+        }
+        else
+        {
+            yaw_gain = 0.0f;
+            rp_gain = 1.0f / rp_span;
+        }
+    }
+
+    /* Apply the differential part and find the allowed collective shift,
+     * expressed in throttle units so each motor moves by its own weight. */
+    for (i = 0; i < OUTPUT_ALLOCATION_NUM_OUTPUTS; i++)
+    {
+        const float w0 = mixer->weights[i][0];
+
+        if (w0 < MOTOR_WEIGHT_THRESHOLD)
+            continue;
+
+        output[i] += rp_gain * rp[i] + yaw_gain * yaw[i];
+
+        const float inv_w0 = 1.0f / w0;
+        lo = fmaxf(lo, -output[i] * inv_w0);
+        hi = fminf(hi, (1.0f - output[i]) * inv_w0);
+    }
+
+    /* Shift the collective as little as possible, prioritizing the upper
+     * limit if both cannot be satisfied (only possible for unequal motor
+     * weights). */
+    if (settings->mode == OUTPUT_ALLOCATION_LINEAR)
+        shift = 0.0f;
+    else if (lo > hi)
+        shift = hi;
+    else
+        shift = bound(hi, lo, 0.0f);
+
+    /* Only airmode is allowed to add thrust. */
+    if (settings->mode != OUTPUT_ALLOCATION_AIRMODE && shift > 0.0f)
+        shift = 0.0f;
+
+    /* Apply the shift and bound the motors. */
+    for (i = 0; i < OUTPUT_ALLOCATION_NUM_OUTPUTS; i++)
+    {
+        const float w0 = mixer->weights[i][0];
+
+        if (w0 >= MOTOR_WEIGHT_THRESHOLD)
+            output[i] = bound(1.0f, 0.0f, output[i] + w0 * shift);
+    }
+
+    vApplyThrustCurves(mixer, settings, curves, output);
+}
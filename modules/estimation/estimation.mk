@@ -1,7 +1,8 @@
 # List of all the module's related files.
 ESTIMATION_SRCS = $(MODULE_DIR)/estimation/src/attitude_ekf.c \
                   $(MODULE_DIR)/estimation/src/estimation.c \
-                  $(MODULE_DIR)/estimation/src/motion_capture_estimator.c
+                  $(MODULE_DIR)/estimation/src/motion_capture_estimator.c \
+                  $(MODULE_DIR)/estimation/src/vertical_estimator.c
 
 # Required include directories
 ESTIMATION_INC = $(MODULE_DIR)/estimation/inc
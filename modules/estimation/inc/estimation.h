@@ -2,6 +2,7 @@
 #define __ESTIMATION_H
 
 #include "attitude_ekf.h"
+#include "vertical_estimator.h"
 
 /*===========================================================================*/
 /* Module global definitions.                                                */
@@ -27,6 +28,7 @@
 void EstimationInit(void);
 void ResetEstimation(void);
 attitude_states_t *ptrGetAttitudeEstimationStates(void);
+vertical_states_t *ptrGetVerticalEstimationStates(void);
 event_source_t *ptrGetEstimationEventSource(void);
 quaternion_t MadgwickAHRSupdateIMU(vector3f_t g,
 								   vector3f_t a,
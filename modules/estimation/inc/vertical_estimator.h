@@ -0,0 +1,78 @@
+#ifndef __VERTICAL_ESTIMATOR_H
+#define __VERTICAL_ESTIMATOR_H
+
+#include <math.h>
+#include "quaternion.h"
+#include "linear_algebra.h"
+#include "sensor_read.h"
+
+/*===========================================================================*/
+/* Module global definitions.                                                */
+/*===========================================================================*/
+#define VERTICAL_ESTIMATOR_GRAVITY          (9.80665f)
+
+/* Time constant of the complementary filter in seconds, the barometer is
+   trusted below 1 / tau rad/s and the accelerometer above */
+#define VERTICAL_ESTIMATOR_TAU              (2.0f)
+
+/* Gains of the third order complementary filter, critically damped with
+   all three poles at -1 / tau */
+#define VERTICAL_ESTIMATOR_K1               (3.0f / VERTICAL_ESTIMATOR_TAU)
+#define VERTICAL_ESTIMATOR_K2               (3.0f / (VERTICAL_ESTIMATOR_TAU * \
+                                                    VERTICAL_ESTIMATOR_TAU))
+#define VERTICAL_ESTIMATOR_K3               (1.0f / (VERTICAL_ESTIMATOR_TAU * \
+                                                    VERTICAL_ESTIMATOR_TAU * \
+                                                    VERTICAL_ESTIMATOR_TAU))
+
+/* Longest barometer sample time used, longer gaps are clamped */
+#define VERTICAL_ESTIMATOR_MAX_BARO_DT      (0.1f)
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Vertical channel estimation states, positive up.
+ */
+typedef struct
+{
+    /**
+     * @brief   Altitude in m above the reference pressure.
+     */
+    float altitude;
+    /**
+     * @brief   Climb rate in m/s.
+     */
+    float climb_rate;
+    /**
+     * @brief   Vertical accelerometer bias in m/s^2.
+     */
+    float acc_bias;
+    /**
+     * @brief   Pressure at zero altitude in Pa, 0 until the first barometer
+     *          sample.
+     */
+    float reference_pressure;
+} vertical_states_t;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+void vInitializeVerticalEstimator(vertical_states_t *states);
+void vPredictVerticalEstimator(vertical_states_t *states,
+                               const imu_data_t *imu_data,
+                               const quaternion_t q,
+                               const float imu_dt);
+void vInnovateVerticalEstimator(vertical_states_t *states,
+                                const float pressure,
+                                const float baro_dt);
+
+#endif /* __VERTICAL_ESTIMATOR_H */
@@ -5,6 +5,7 @@
 
 #include <math.h>
 #include "attitude_ekf.h"
+#include "linear_algebra_fixed.h"
 
 /*===========================================================================*/
 /* Module local definitions.                                                 */
@@ -94,16 +95,21 @@ void GenerateStartingGuess(vector3f_t *acc,
                            vector3f_t *mag,
                            quaternion_t *attitude_guess)
 {
-    float pitch, roll, yaw;
+    float pitch, roll, yaw, sp, cp, sr, cr;
 
     /* Generate pitch and roll from the accelerometer reading */
-    roll  = -atan2f(-acc->y, acc->z);
-    pitch = -atan2f(acc->x, sqrtf(acc->y * acc->y + acc->z * acc->z));
+    roll  = -fast_atan2(-acc->y, acc->z, FASTMATH_TIER_HIGH);
+    pitch = -fast_atan2(acc->x,
+                        sqrtf(acc->y * acc->y + acc->z * acc->z),
+                        FASTMATH_TIER_HIGH);
+
+    fast_sincos(roll, &sr, &cr, FASTMATH_TIER_HIGH);
+    fast_sincos(pitch, &sp, &cp, FASTMATH_TIER_HIGH);
 
     /* Generate yaw by compensating for the pitch and roll */
-    yaw = atan2f(mag->y * fast_cos(roll) + mag->z * fast_sin(roll),
-                 (mag->x * fast_cos(pitch) + mag->y * fast_sin(pitch) *
-                  fast_sin(roll) - mag->z * fast_sin(pitch) * fast_cos(roll)));
+    yaw = fast_atan2(mag->y * cr + mag->z * sr,
+                     mag->x * cp + mag->y * sp * sr - mag->z * sp * cr,
+                     FASTMATH_TIER_HIGH);
 
     /* Convert angles into quaternion */
     euler2quat(roll, pitch, yaw, attitude_guess);
@@ -165,8 +171,8 @@ void InnovateAttitudeEKF(attitude_states_t *states,
     {
         dtheta = 0.5f * w_norm * dt;
 
-        sdtheta = fast_sin(dtheta);
-        cdtheta = fast_cos(dtheta);
+        /* The step is integrated, keep the sine accurate for small steps */
+        fast_sincos(dtheta, &sdtheta, &cdtheta, FASTMATH_TIER_HIGH);
 
         /* Calculate the integrated quaternion */
         dq_int.w = cdtheta;
@@ -266,7 +272,7 @@ void InnovateAttitudeEKF(attitude_states_t *states,
     T1[4][5] = 0.0f;
 
     /* Perform the QR decomposition: Sp_k|k-1 = QR([F_k * Sp_k-1|k-1, Sq]^T) */
-    qr_decomp_tria(&Sp[0][0], 6);
+    qr_decomp_tria_6(&Sp[0][0]);
 
 
     /****************************
@@ -301,9 +307,9 @@ void InnovateAttitudeEKF(attitude_states_t *states,
      * division go towards infinity. This should not happen after
      * convergence, but is an added security.
      */
-    y.x = fastatan2(-acc_F.y, acc_F.z);
-    y.y = fastatan2( acc_F.x, acc_F.z);
-    y.z = fastatan2( mag_F.y, mag_F.x);
+    y.x = fast_atan2(-acc_F.y, acc_F.z, FASTMATH_TIER_MEDIUM);
+    y.y = fast_atan2( acc_F.x, acc_F.z, FASTMATH_TIER_MEDIUM);
+    y.z = fast_atan2( mag_F.y, mag_F.x, FASTMATH_TIER_MEDIUM);
 
 
     /*
@@ -331,11 +337,11 @@ void InnovateAttitudeEKF(attitude_states_t *states,
     T2[1][2] = 0.0f;
 
     /* Perform the QR decomposition : Ss_k = QR([H_k * Sp_k|k-1, Sr]^T) */
-    qr_decomp_tria(&Ss[0][0], 3);
+    qr_decomp_tria_3(&Ss[0][0]);
 
     /* Invert Ss, since we only need the inverted
        version for future calculations */
-    u_inv(&Ss[0][0], 3);
+    u_inv_3(&Ss[0][0]);
 
     /* Create T3 = Ss^-1 * H * Sp */
     t1 = R[0][0] * Ss[0][0];
@@ -429,13 +435,13 @@ void InnovateAttitudeEKF(attitude_states_t *states,
 
     /* Perform the Cholesky downdate with each column of T3
        as the downdating vector */
-    chol_downdate(&T1[0][0], &T3[0][0], 6);
-    chol_downdate(&T1[0][0], &T3[1][0], 6);
-    chol_downdate(&T1[0][0], &T3[2][0], 6);
+    chol_downdate_6(&T1[0][0], &T3[0][0]);
+    chol_downdate_6(&T1[0][0], &T3[1][0]);
+    chol_downdate_6(&T1[0][0], &T3[2][0]);
 
     /* Create the updated error covariance matrix Sp = T1 * Sp (the
        chol_downdate creates an upper triangular matrix, no transpose needed) */
-    uu_mul(&T1[0][0], &Sp[0][0], 6);
+    uu_mul_6(&T1[0][0], &Sp[0][0]);
 
 
     /*
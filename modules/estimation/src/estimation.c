@@ -8,6 +8,7 @@
 #include "estimation.h"
 #include "sensor_read.h"
 #include "motion_capture_estimator.h"
+#include "vertical_estimator.h"
 
 /*===========================================================================*/
 /* Module local definitions.                                                 */
@@ -22,6 +23,7 @@
 /*===========================================================================*/
 THD_WORKING_AREA(waThreadEstimation, 1024);
 attitude_states_t states;
+vertical_states_t vertical_states;
 attitude_matrices_t data;
 imu_data_t imu_data;
 EVENTSOURCE_DECL(estimation_events_es);
@@ -66,6 +68,10 @@ static THD_FUNCTION(ThreadEstimation, arg)
 
     //AttitudeEstimationInit(&states, &data, &q_init, &wb_init);
     vInitializeMotionCaptureEstimator(&states);
+    vInitializeVerticalEstimator(&vertical_states);
+
+    /* Time of the latest barometer sample */
+    systime_t baro_time = chVTGetSystemTimeX();
 
     while(1)
     {
@@ -98,6 +104,11 @@ static THD_FUNCTION(ThreadEstimation, arg)
                                             SENSOR_ACCGYRO_DT,
                                             0.0007f);
 
+            vPredictVerticalEstimator(&vertical_states,
+                                      &imu_data,
+                                      states.q,
+                                      SENSOR_ACCGYRO_DT);
+
             /*InnovateAttitudeEKF(&states,
                                 &data,
                                 imu_data.gyroscope,
@@ -126,6 +137,20 @@ static THD_FUNCTION(ThreadEstimation, arg)
                                 ESTIMATION_NEW_ESTIMATION_EVENTMASK);
 
         }
+
+        if (flags & BARO_DATA_AVAILABLE_EVENTMASK)
+        {
+            systime_t now = chVTGetSystemTimeX();
+
+            /* Get sensor data */
+            GetIMUData(&imu_data);
+
+            vInnovateVerticalEstimator(&vertical_states,
+                                       imu_data.pressure,
+                                       (float)(now - baro_time) /
+                                            (float)CH_CFG_ST_FREQUENCY);
+            baro_time = now;
+        }
     }
 }
 
@@ -169,6 +194,16 @@ attitude_states_t *ptrGetAttitudeEstimationStates(void)
     return &states;
 }
 
+/**
+ * @brief Returns the pointer to the vertical estimation states.
+ *
+ * @return Pointer to the vertical estimation states.
+ */
+vertical_states_t *ptrGetVerticalEstimationStates(void)
+{
+    return &vertical_states;
+}
+
 /**
  * @brief Returns the pointer to the estimation event source.
  *
@@ -0,0 +1,129 @@
+/* *
+ *
+ * Vertical channel estimator, fuses barometric altitude with the vertical
+ * acceleration in a third order complementary filter
+ *
+ * */
+
+#include "ch.h"
+#include "hal.h"
+#include "vertical_estimator.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief               Converts pressure to altitude with the international
+ *                      standard atmosphere.
+ *
+ * @param[in] pressure  Pressure in Pa.
+ * @param[in] reference Pressure at zero altitude in Pa.
+ * @return              Altitude in m.
+ */
+static float PressureToAltitude(const float pressure, const float reference)
+{
+    return 44330.0f * (1.0f - powf(pressure / reference, 0.190295f));
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief               Initialization for the vertical estimator, the
+ *                      reference pressure is set by the next barometer
+ *                      sample.
+ *
+ * @param[out] states   Vertical states to initialize.
+ */
+void vInitializeVerticalEstimator(vertical_states_t *states)
+{
+    states->altitude = 0.0f;
+    states->climb_rate = 0.0f;
+    states->acc_bias = 0.0f;
+    states->reference_pressure = 0.0f;
+}
+
+/**
+ * @brief               Predicts the vertical states with the accelerometer,
+ *                      run for each IMU sample.
+ * @note                The attitude quaternion rotates the body frame to a
+ *                      world frame with z up.
+ *
+ * @param[in/out] states    Vertical states to be updated.
+ * @param[in] imu_data      Latest IMU measurement, acceleration in g.
+ * @param[in] q             Attitude estimate.
+ * @param[in] imu_dt        Sampling time of the IMU data.
+ */
+void vPredictVerticalEstimator(vertical_states_t *states,
+                               const imu_data_t *imu_data,
+                               const quaternion_t q,
+                               const float imu_dt)
+{
+    vector3f_t acc_body, acc_world;
+    float acc_up;
+
+    if (states->reference_pressure == 0.0f)
+        return;
+
+    acc_body.x = imu_data->accelerometer[0];
+    acc_body.y = imu_data->accelerometer[1];
+    acc_body.z = imu_data->accelerometer[2];
+
+    /* The accelerometer measures the specific force, 1 g up at rest */
+    acc_world = qrotvector(q, acc_body);
+    acc_up = (acc_world.z - 1.0f) * VERTICAL_ESTIMATOR_GRAVITY -
+             states->acc_bias;
+
+    states->altitude += imu_dt * (states->climb_rate + 0.5f * imu_dt * acc_up);
+    states->climb_rate += imu_dt * acc_up;
+}
+
+/**
+ * @brief               Corrects the vertical states with a barometer sample.
+ *
+ * @param[in/out] states    Vertical states to be updated.
+ * @param[in] pressure      Barometer pressure in Pa.
+ * @param[in] baro_dt       Time since the last barometer sample.
+ */
+void vInnovateVerticalEstimator(vertical_states_t *states,
+                                const float pressure,
+                                const float baro_dt)
+{
+    float err, dt;
+
+    if (pressure <= 0.0f)
+        return;
+
+    /* The first sample sets zero altitude */
+    if (states->reference_pressure == 0.0f)
+    {
+        states->reference_pressure = pressure;
+        states->altitude = 0.0f;
+        states->climb_rate = 0.0f;
+        return;
+    }
+
+    dt = (baro_dt < VERTICAL_ESTIMATOR_MAX_BARO_DT) ?
+            baro_dt : VERTICAL_ESTIMATOR_MAX_BARO_DT;
+
+    err = PressureToAltitude(pressure, states->reference_pressure) -
+          states->altitude;
+
+    states->altitude += VERTICAL_ESTIMATOR_K1 * dt * err;
+    states->climb_rate += VERTICAL_ESTIMATOR_K2 * dt * err;
+    states->acc_bias -= VERTICAL_ESTIMATOR_K3 * dt * err;
+}
@@ -36,10 +36,98 @@
 
 #define FLASH_DUMMY_BYTE        0xFF
 
+/* Number of requests that can wait in the queue */
+#define FLASH_REQUEST_QUEUE_SIZE        8
+
+/* Largest read done in one SPI transaction, the SPI bus is released between
+   transactions to let other users of the bus in */
+#define FLASH_REQUEST_MAX_BURST         256
+
+/* Status polling intervals while the flash is busy */
+#define FLASH_POLL_PROGRAM_US           200
+#define FLASH_POLL_PAGE_ERASE_MS        2
+#define FLASH_POLL_SECTOR_ERASE_MS      20
+#define FLASH_POLL_BULK_ERASE_MS        100
+
 /*===========================================================================*/
 /* Driver data structures and types.                                         */
 /*===========================================================================*/
 
+/**
+ * @brief   External Flash request operations.
+ */
+typedef enum
+{
+    /**
+     * @brief   Read count bytes into buffer.
+     */
+    FLASH_REQUEST_READ = 0,
+    /**
+     * @brief   Program count bytes (max one page) from buffer.
+     */
+    FLASH_REQUEST_PROGRAM,
+    /**
+     * @brief   Erase the page at address.
+     */
+    FLASH_REQUEST_ERASE_PAGE,
+    /**
+     * @brief   Erase the sector at address.
+     */
+    FLASH_REQUEST_ERASE_SECTOR,
+    /**
+     * @brief   Erase the entire flash.
+     */
+    FLASH_REQUEST_ERASE_BULK
+} ExternalFlashOperation;
+
+typedef struct ExternalFlashRequest ExternalFlashRequest;
+
+/**
+ * @brief   External Flash request completion callback, called from the
+ *          External Flash thread.
+ */
+typedef void (*ExternalFlashCallback)(ExternalFlashRequest *request);
+
+/**
+ * @brief   External Flash request, owned by the queue from submission until
+ *          it is done.
+ */
+struct ExternalFlashRequest
+{
+    /**
+     * @brief   Operation to perform.
+     */
+    ExternalFlashOperation operation;
+    /**
+     * @brief   Byte address in the flash.
+     */
+    uint32_t address;
+    /**
+     * @brief   Data buffer for reads and programs.
+     */
+    uint8_t *buffer;
+    /**
+     * @brief   Number of bytes to read or program.
+     */
+    uint16_t count;
+    /**
+     * @brief   Called when the request is done, can be NULL.
+     */
+    ExternalFlashCallback callback;
+    /**
+     * @brief   User argument for the callback.
+     */
+    void *arg;
+    /**
+     * @brief   Set when the request is done.
+     */
+    volatile bool done;
+    /**
+     * @brief   Thread waiting for the request to be done.
+     */
+    thread_reference_t waiter;
+};
+
 /**
  * @brief   External Flash temporary data holder.
  */
@@ -53,6 +141,14 @@ typedef struct
      * @brief   External Flash mutex.
      */
     mutex_t flash_mutex;
+    /**
+     * @brief   Request queue.
+     */
+    mailbox_t queue;
+    /**
+     * @brief   Request queue storage.
+     */
+    msg_t queue_buffer[FLASH_REQUEST_QUEUE_SIZE];
 } ExternalFlashData;
 
 /**
@@ -90,7 +186,8 @@ typedef struct
 /* Driver macros.                                                            */
 /*===========================================================================*/
 
-/* Claim and release macros for external flash memory */
+/* Claim and release macros for external flash memory, used to make a
+   sequence of requests atomic with respect to other users of the flash */
 #define ExternalFlash_Claim(config)   chMtxLock(&(config)->data->flash_mutex)
 #define ExternalFlash_Release(config) chMtxUnlock(&(config)->data->flash_mutex)
 
@@ -104,6 +201,11 @@ typedef struct
 /* External declarations.                                                    */
 /*===========================================================================*/
 msg_t ExternalFlashInit(const ExternalFlashConfig *config);
+void ExternalFlash_Submit(const ExternalFlashConfig *config,
+                          ExternalFlashRequest *request);
+void ExternalFlash_Wait(ExternalFlashRequest *request);
+void ExternalFlash_Execute(const ExternalFlashConfig *config,
+                           ExternalFlashRequest *request);
 void ExternalFlash_EraseBulk(const ExternalFlashConfig *config);
 void ExternalFlash_EraseSector(const ExternalFlashConfig *config,
                                uint32_t address);
@@ -126,8 +228,6 @@ void ExternalFlash_ReadBuffer(const ExternalFlashConfig *config,
 							  uint32_t address,
                               uint8_t *buffer, 
                               uint16_t count);
-void ExternalFlash_WaitForWriteEnd(const ExternalFlashConfig *config,
-                                   uint32_t delay_ms);
 void ExternalFlash_WriteEnable(const ExternalFlashConfig *config);
 
 #endif
@@ -7,8 +7,39 @@
 /* Module global definitions.                                                */
 /*===========================================================================*/
 #define FLASHSAVE_UNALLOCATED       0xFFFFFFFF
-#define FLASHSAVE_HEADER_OFFSET     5
 #define FLASHSAVE_SAVE_EVENTMASK    EVENT_MASK(0)
+#define FLASHSAVE_GC_EVENTMASK      EVENT_MASK(1)
+#define FLASHSAVE_INDEX_SIZE        64
+#define FLASHSAVE_REGISTRY_SIZE     16
+
+/**
+ * @brief   Size of the buffer the registered records are copied to before
+ *          saving, the sum of the registered sizes.
+ */
+#define FLASHSAVE_STAGING_SIZE      2048
+
+/**
+ * @brief   Pages used by the log, the first two sectors of the flash.
+ */
+#define FLASHSAVE_NUM_PAGES         512
+
+/**
+ * @brief   Maximum number of pages of one record.
+ */
+#define FLASHSAVE_MAX_RECORD_PAGES  8
+#define FLASHSAVE_MAX_DATA_SIZE     (FLASHSAVE_MAX_RECORD_PAGES *             \
+                                     FLASH_PAGE_SIZE -                        \
+                                     sizeof(flashsave_record_header_t))
+
+/**
+ * @brief   Pages kept free from live records in front of the head of the log
+ *          by the garbage collector.
+ */
+#define FLASHSAVE_GC_RESERVE_PAGES  (4 * FLASHSAVE_MAX_RECORD_PAGES)
+
+#define FLASHSAVE_RECORD_MAGIC          0x5AA5C33C
+#define FLASHSAVE_RECORD_UNCOMMITTED    0xFFFF
+#define FLASHSAVE_RECORD_COMMITTED      0x0000
 
 /*===========================================================================*/
 /* Module data structures and types.                                         */
@@ -45,10 +76,107 @@ typedef enum
     FLASHSAVE_FLASH_FULL = 5,
 } FlashSave_Status;
 
+/**
+ * @brief   Callback copying the current settings of a module to the buffer
+ *          which is saved.
+ */
+typedef void (*flashsave_snapshot_t)(void *data);
+
+/**
+ * @brief   Registered record, saved on the save to flash event.
+ */
+typedef struct
+{
+    /**
+     * @brief   UID of the record.
+     */
+    uint32_t uid;
+    /**
+     * @brief   Pointer to the data to save.
+     */
+    void *data;
+    /**
+     * @brief   Size of the data.
+     */
+    uint16_t size;
+    /**
+     * @brief   Snapshot callback, or NULL if the data is saved directly.
+     */
+    flashsave_snapshot_t snapshot;
+} flashsave_registry_entry_t;
+
+/**
+ * @brief   Header of a record in the log.
+ */
+typedef struct PACKED_VAR
+{
+    /**
+     * @brief   Marks the start of a record, FLASHSAVE_RECORD_MAGIC.
+     */
+    uint32_t magic;
+    /**
+     * @brief   UID of the record.
+     */
+    uint32_t uid;
+    /**
+     * @brief   Sequence number, the highest is the newest version.
+     */
+    uint32_t sequence;
+    /**
+     * @brief   Size of the saved data.
+     */
+    uint16_t size;
+    /**
+     * @brief   CRC16 of the saved data.
+     */
+    uint16_t data_crc;
+    /**
+     * @brief   CRC16 of the fields above.
+     */
+    uint16_t header_crc;
+    /**
+     * @brief   Programmed to FLASHSAVE_RECORD_COMMITTED after the data is
+     *          written.
+     */
+    uint16_t commit;
+} flashsave_record_header_t;
+
+/**
+ * @brief   RAM index entry of the newest version of a record.
+ */
+typedef struct
+{
+    /**
+     * @brief   UID of the record.
+     */
+    uint32_t uid;
+    /**
+     * @brief   First page of the record.
+     */
+    uint16_t page;
+    /**
+     * @brief   Size of the saved data.
+     */
+    uint16_t size;
+    /**
+     * @brief   Sequence number of the record.
+     */
+    uint32_t sequence;
+} flashsave_index_entry_t;
+
 /*===========================================================================*/
 /* Module macros.                                                            */
 /*===========================================================================*/
 
+/**
+ * @brief   Converts four characters to a 32-bit ID, as FlashSave_STR2ID but
+ *          usable in constant initializers.
+ */
+#define FLASHSAVE_ID(c0, c1, c2, c3)        (((uint32_t)(c0) << 0)  |         \
+                                             ((uint32_t)(c1) << 8)  |         \
+                                             ((uint32_t)(c2) << 16) |         \
+                                             ((uint32_t)(c3) << 24))
+
 /*===========================================================================*/
 /* Module inline functions.                                                  */
 /*===========================================================================*/
@@ -104,16 +232,22 @@ static inline uint32_t FlashSave_Swap32(uint32_t swap)
 /* External declarations.                                                    */
 /*===========================================================================*/
 void FlashSaveInit(void);
-bool FlashSave_Seek(uint32_t uid, int16_t *page_number, uint8_t *size);
+void FlashSave_Register(uint32_t uid,
+                        void *data,
+                        uint16_t size,
+                        flashsave_snapshot_t snapshot);
+bool FlashSave_Seek(uint32_t uid, int16_t *page_number, uint16_t *size);
 FlashSave_Status FlashSave_Write(uint32_t uid,
                                  bool overwrite,
                                  uint8_t *data,
                                  uint16_t count);
 FlashSave_Status FlashSave_Read(uint32_t uid,
                                 uint8_t *data,
-                                uint8_t requested_size);
+                                uint16_t requested_size);
 void vFlashSave_EraseAll(void);
 void vBroadcastFlashSaveEvent(void);
+FlashSave_Status FlashSave_GetLastSaveStatus(void);
 event_source_t *ptrGetFlashSaveEventSource(void);
+const ExternalFlashConfig *ptrGetExternalFlashConfig(void);
 
 #endif /* __FLASH_SAVE_H */
@@ -20,43 +20,80 @@
 /* Driver local variables and types.                                         */
 /*===========================================================================*/
 
-/*===========================================================================*/
-/* Driver local functions.                                                   */
-/*===========================================================================*/
+/*
+ * Working area for the request queue thread, one external flash is
+ * supported.
+ */
+THD_WORKING_AREA(waThreadExternalFlash, 256);
 
 /*===========================================================================*/
-/* Driver exported functions.                                                */
+/* Driver local functions.                                                   */
 /*===========================================================================*/
 
 /**
- * @brief               Initializes the External Flash and checks
- *                      for correct ID.
+ * @brief               Sends an erase instruction, without waiting for the
+ *                      erase to finish.
  *
  * @param[in] config    Pointer to External Flash config.
- * @return              Returns MSG_OK if the initialization was successful.
+ * @param[in] command   Erase instruction.
+ * @param[in] address   Address to the flash page or sector, unused for bulk
+ *                      erase.
  */
-msg_t ExternalFlashInit(const ExternalFlashConfig *config)
+static void ExternalFlashStartErase(const ExternalFlashConfig *config,
+                                    uint8_t command,
+                                    uint32_t address)
 {
-    /* Initialize External Flash mutex */
-    chMtxObjectInit(&config->data->flash_mutex);
+#if SPI_USE_MUTUAL_EXCLUSION
+    /* Claim the SPI bus */
+    spiAcquireBus(config->spip);
+#endif /* SPI_USE_MUTUAL_EXCLUSION */
 
-    /* Check flash JEDEC ID */
-    if (ExternalFlash_ReadID(config) != config->jedec_id)
-        return MSG_RESET;
-    else
-        return MSG_OK;
+    /* Enable the write access to the External Flash */
+    ExternalFlash_WriteEnable(config);
+
+    /* Select the External Flash: Chip Select low */
+    ExternalFlash_Select(config);
+
+    /* Send Erase instruction  */
+    spiPolledExchange(config->spip, command);
+
+    if (command != FLASH_CMD_BE)
+    {
+        /* Send address high nibbles */
+        spiPolledExchange(config->spip, (address & 0xFF0000) >> 16);
+        spiPolledExchange(config->spip, (address & 0xFF00) >> 8);
+        spiPolledExchange(config->spip, address & 0xFF);
+    }
+
+    /* Deselect the External Flash: Chip Select high */
+    ExternalFlash_Unselect(config);
+
+#if SPI_USE_MUTUAL_EXCLUSION
+    /* Release the SPI bus */
+    spiReleaseBus(config->spip);
+#endif /* SPI_USE_MUTUAL_EXCLUSION */
 }
 
 /**
- * @brief               Erases the entire External Flash.
- * @note                This function call does not lock the flash from access
- *                      by other threads, it is up to the user to use the Claim
- *                      and Release macros to make flash access thread safe.
+ * @brief               Starts writing data to a Flash page using DMA, without
+ *                      waiting for the write to finish.
+ * @note                This assumes that the page to be written to has been
+ *                      erased prior to the call to this function.
  *
  * @param[in] config    Pointer to External Flash config.
+ * @param[in] address   Where in the Flash to save the data.
+ * @param[in] buffer    Pointer to the buffer holding the data.
+ * @param[in] count     Number of bytes to write (max 256 bytes).
  */
-void ExternalFlash_EraseBulk(const ExternalFlashConfig *config)
+static void ExternalFlashStartWritePage(const ExternalFlashConfig *config,
+                                        uint32_t address,
+                                        uint8_t *buffer,
+                                        uint16_t count)
 {
+    /* Error check. */
+    if (count > FLASH_PAGE_SIZE)
+        osalSysHalt("Page write size too big");
+
 #if SPI_USE_MUTUAL_EXCLUSION
     /* Claim the SPI bus */
     spiAcquireBus(config->spip);
@@ -68,8 +105,18 @@ void ExternalFlash_EraseBulk(const ExternalFlashConfig *config)
     /* Select the External Flash: Chip Select low */
     ExternalFlash_Select(config);
 
-    /* Send Bulk Erase instruction  */
-    spiPolledExchange(config->spip, FLASH_CMD_BE);
+    /* Load the command and address data */
+    config->data->flash_tmp[0] = (uint8_t)FLASH_CMD_PAGE_PROGRAM;
+    config->data->flash_tmp[1] = (uint8_t)((address & 0xFF0000) >> 16);
+    config->data->flash_tmp[2] = (uint8_t)((address & 0xFF00) >> 8);
+    config->data->flash_tmp[3] = (uint8_t)(address & 0xFF);
+
+    /* Send "Write to Memory" instruction and send address nibbles
+       from address to read from */
+    spiSend(config->spip, 4, config->data->flash_tmp);
+
+    /* Send the data to memory */
+    spiSend(config->spip, count, buffer);
 
     /* Deselect the External Flash: Chip Select high */
     ExternalFlash_Unselect(config);
@@ -78,42 +125,43 @@ void ExternalFlash_EraseBulk(const ExternalFlashConfig *config)
     /* Release the SPI bus */
     spiReleaseBus(config->spip);
 #endif /* SPI_USE_MUTUAL_EXCLUSION */
-
-    /* Wait the end of Flash writing */
-    ExternalFlash_WaitForWriteEnd(config, 100);
 }
 
 /**
- * @brief               Erases a sector on the External Flash.
- * @note                This function call does not lock the flash from access
- *                      by other threads, it is up to the user to use the Claim
- *                      and Release macros to make flash access thread safe.
+ * @brief               Read a block of data from the External Flash using DMA
+ *                      in one SPI transaction.
  *
  * @param[in] config    Pointer to External Flash config.
- * @param[in] address   Address to the flash sector.
+ * @param[in] address   Where in the Flash to read the data.
+ * @param[in] buffer    Pointer to the buffer saving the data.
+ * @param[in] count     Number of bytes to read.
  */
-void ExternalFlash_EraseSector(const ExternalFlashConfig *config,
-                               uint32_t address)
+static void ExternalFlashRead(const ExternalFlashConfig *config,
+                              uint32_t address,
+                              uint8_t *buffer,
+                              uint16_t count)
 {
 #if SPI_USE_MUTUAL_EXCLUSION
     /* Claim the SPI bus */
     spiAcquireBus(config->spip);
 #endif /* SPI_USE_MUTUAL_EXCLUSION */
 
-    /* Enable the write access to the External Flash */
-    ExternalFlash_WriteEnable(config);
-
     /* Select the External Flash: Chip Select low */
     ExternalFlash_Select(config);
 
-    /* Send Sector Erase instruction  */
-    spiPolledExchange(config->spip, FLASH_CMD_SE);
-    
-    /* Send address high nibbles */
-    spiPolledExchange(config->spip, (address & 0xFF0000) >> 16);
-    spiPolledExchange(config->spip, (address & 0xFF00) >> 8);
-    spiPolledExchange(config->spip, address & 0xFF);
-    
+    /* Load the command and address data */
+    config->data->flash_tmp[0] = (uint8_t)FLASH_CMD_READ;
+    config->data->flash_tmp[1] = (uint8_t)((address & 0xFF0000) >> 16);
+    config->data->flash_tmp[2] = (uint8_t)((address & 0xFF00) >> 8);
+    config->data->flash_tmp[3] = (uint8_t)(address & 0xFF);
+
+    /* Send "Read from Memory" instruction and send address nibbles
+       from address to read from */
+    spiSend(config->spip, 4, config->data->flash_tmp);
+
+    /* Read the requested data from memory */
+    spiReceive(config->spip, count, buffer);
+
     /* Deselect the External Flash: Chip Select high */
     ExternalFlash_Unselect(config);
 
@@ -121,42 +169,32 @@ void ExternalFlash_EraseSector(const ExternalFlashConfig *config,
     /* Release the SPI bus */
     spiReleaseBus(config->spip);
 #endif /* SPI_USE_MUTUAL_EXCLUSION */
-
-    /* Wait the end of Flash writing */
-    ExternalFlash_WaitForWriteEnd(config, 100);
 }
 
 /**
- * @brief               Erases a page on the External Flash.
- * @note                This function call does not lock the flash from access
- *                      by other threads, it is up to the user to use the Claim
- *                      and Release macros to make flash access thread safe.
+ * @brief               Reads the Write In Progress (WIP) flag in the External
+ *                      Flash's status register.
  *
  * @param[in] config    Pointer to External Flash config.
- * @param[in] address   Address to the flash page.
+ * @return              True if a write operation is in progress.
  */
-void ExternalFlash_ErasePage(const ExternalFlashConfig *config,
-                             uint32_t address)
+static bool ExternalFlashIsBusy(const ExternalFlashConfig *config)
 {
+    uint8_t wip;
+
 #if SPI_USE_MUTUAL_EXCLUSION
     /* Claim the SPI bus */
     spiAcquireBus(config->spip);
 #endif /* SPI_USE_MUTUAL_EXCLUSION */
 
-    /* Enable the write access to the External Flash */
-    ExternalFlash_WriteEnable(config);
-
     /* Select the External Flash: Chip Select low */
     ExternalFlash_Select(config);
 
-    /* Send Page Erase instruction  */
-    spiPolledExchange(config->spip, FLASH_CMD_PE);
-    
-    /* Send address high nibbles */
-    spiPolledExchange(config->spip, (address & 0xFF0000) >> 16);
-    spiPolledExchange(config->spip, (address & 0xFF00) >> 8);
-    spiPolledExchange(config->spip, address & 0xFF);
-    
+    /* Send "Read Status Register" instruction */
+    spiPolledExchange(config->spip, FLASH_CMD_RDSR);
+
+    wip = spiPolledExchange(config->spip, FLASH_DUMMY_BYTE);
+
     /* Deselect the External Flash: Chip Select high */
     ExternalFlash_Unselect(config);
 
@@ -165,12 +203,292 @@ void ExternalFlash_ErasePage(const ExternalFlashConfig *config,
     spiReleaseBus(config->spip);
 #endif /* SPI_USE_MUTUAL_EXCLUSION */
 
-    /* Wait the end of Flash writing */
-    ExternalFlash_WaitForWriteEnd(config, 10);
+    return (wip & FLASH_WIP_FLAG) != 0;
+}
+
+/**
+ * @brief               Sleeps until the write or erase in progress has
+ *                      finished, checking the status register each interval.
+ * @note                The SPI bus is free for other users while sleeping.
+ *
+ * @param[in] config    Pointer to External Flash config.
+ * @param[in] interval  Time between status checks.
+ */
+static void ExternalFlashSleepWhileBusy(const ExternalFlashConfig *config,
+                                        systime_t interval)
+{
+    do
+    {
+        chThdSleep(interval);
+    } while (ExternalFlashIsBusy(config));
+}
+
+/**
+ * @brief               Performs a request, returns when the flash is idle.
+ *
+ * @param[in] config    Pointer to External Flash config.
+ * @param[in] request   Request to perform.
+ */
+static void ExternalFlashServe(const ExternalFlashConfig *config,
+                               ExternalFlashRequest *request)
+{
+    uint32_t address = request->address;
+    uint8_t *buffer = request->buffer;
+    uint16_t count = request->count;
+    uint16_t burst;
+
+    switch (request->operation)
+    {
+        case FLASH_REQUEST_READ:
+
+            /* Read in bursts, releasing the SPI bus in between */
+            while (count > 0)
+            {
+                burst = count;
+                if (burst > FLASH_REQUEST_MAX_BURST)
+                    burst = FLASH_REQUEST_MAX_BURST;
+
+                ExternalFlashRead(config, address, buffer, burst);
+
+                address += burst;
+                buffer += burst;
+                count -= burst;
+            }
+            break;
+
+        case FLASH_REQUEST_PROGRAM:
+            ExternalFlashStartWritePage(config, address, buffer, count);
+            ExternalFlashSleepWhileBusy(config,
+                                        US2ST(FLASH_POLL_PROGRAM_US));
+            break;
+
+        case FLASH_REQUEST_ERASE_PAGE:
+            ExternalFlashStartErase(config, FLASH_CMD_PE, address);
+            ExternalFlashSleepWhileBusy(config,
+                                        MS2ST(FLASH_POLL_PAGE_ERASE_MS));
+            break;
+
+        case FLASH_REQUEST_ERASE_SECTOR:
+            ExternalFlashStartErase(config, FLASH_CMD_SE, address);
+            ExternalFlashSleepWhileBusy(config,
+                                        MS2ST(FLASH_POLL_SECTOR_ERASE_MS));
+            break;
+
+        case FLASH_REQUEST_ERASE_BULK:
+            ExternalFlashStartErase(config, FLASH_CMD_BE, 0);
+            ExternalFlashSleepWhileBusy(config,
+                                        MS2ST(FLASH_POLL_BULK_ERASE_MS));
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief               Thread performing the queued requests in order.
+ *
+ * @param[in] arg       Pointer to External Flash config.
+ */
+static THD_FUNCTION(ThreadExternalFlash, arg)
+{
+    const ExternalFlashConfig *config = (const ExternalFlashConfig *)arg;
+    ExternalFlashRequest *request;
+    msg_t msg;
+
+    /* Set thread name */
+    chRegSetThreadName("External Flash");
+
+    while (1)
+    {
+        chMBFetch(&config->data->queue, &msg, TIME_INFINITE);
+        request = (ExternalFlashRequest *)msg;
+
+        ExternalFlashServe(config, request);
+
+        if (request->callback != NULL)
+            request->callback(request);
+
+        /* The owner may reuse the request as soon as it is done. */
+        chSysLock();
+        request->done = true;
+        chThdResumeS(&request->waiter, MSG_OK);
+        chSysUnlock();
+    }
+}
+
+/**
+ * @brief               Builds and performs a request, waiting for it to be
+ *                      done.
+ *
+ * @param[in] config    Pointer to External Flash config.
+ * @param[in] operation Operation to perform.
+ * @param[in] address   Byte address in the flash.
+ * @param[in] buffer    Data buffer, NULL for erase.
+ * @param[in] count     Number of bytes.
+ */
+static void ExternalFlashExecute(const ExternalFlashConfig *config,
+                                 ExternalFlashOperation operation,
+                                 uint32_t address,
+                                 uint8_t *buffer,
+                                 uint16_t count)
+{
+    ExternalFlashRequest request;
+
+    request.operation = operation;
+    request.address = address;
+    request.buffer = buffer;
+    request.count = count;
+    request.callback = NULL;
+    request.arg = NULL;
+
+    ExternalFlash_Execute(config, &request);
+}
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief               Initializes the External Flash, starts the request
+ *                      queue and checks for correct ID.
+ *
+ * @param[in] config    Pointer to External Flash config.
+ * @return              Returns MSG_OK if the initialization was successful.
+ */
+msg_t ExternalFlashInit(const ExternalFlashConfig *config)
+{
+    /* Initialize External Flash mutex */
+    chMtxObjectInit(&config->data->flash_mutex);
+
+    /* Initialize the request queue */
+    chMBObjectInit(&config->data->queue,
+                   config->data->queue_buffer,
+                   FLASH_REQUEST_QUEUE_SIZE);
+
+    chThdCreateStatic(waThreadExternalFlash,
+                      sizeof(waThreadExternalFlash),
+                      NORMALPRIO,
+                      ThreadExternalFlash,
+                      (void *)config);
+
+    /* Check flash JEDEC ID */
+    if (ExternalFlash_ReadID(config) != config->jedec_id)
+        return MSG_RESET;
+    else
+        return MSG_OK;
+}
+
+/**
+ * @brief               Queues a request to the External Flash and returns
+ *                      immediately.
+ * @note                The request and its buffer must stay valid until the
+ *                      request is done, the callback is called from the
+ *                      External Flash thread when it is.
+ * @note                Requests are performed in the order they are submitted.
+ *                      This function call does not lock the flash from access
+ *                      by other threads, it is up to the user to use the Claim
+ *                      and Release macros to make a sequence of requests
+ *                      atomic.
+ *
+ * @param[in] config    Pointer to External Flash config.
+ * @param[in] request   Request to queue.
+ */
+void ExternalFlash_Submit(const ExternalFlashConfig *config,
+                          ExternalFlashRequest *request)
+{
+    request->done = false;
+    request->waiter = NULL;
+
+    chMBPost(&config->data->queue, (msg_t)request, TIME_INFINITE);
+}
+
+/**
+ * @brief               Waits for a submitted request to be done.
+ * @note                Only one thread may wait for a request.
+ *
+ * @param[in] request   Request to wait for.
+ */
+void ExternalFlash_Wait(ExternalFlashRequest *request)
+{
+    chSysLock();
+
+    if (request->done == false)
+        chThdSuspendS(&request->waiter);
+
+    chSysUnlock();
+}
+
+/**
+ * @brief               Queues a request to the External Flash and waits for
+ *                      it to be done.
+ * @note                This function call does not lock the flash from access
+ *                      by other threads, it is up to the user to use the Claim
+ *                      and Release macros to make flash access thread safe.
+ *
+ * @param[in] config    Pointer to External Flash config.
+ * @param[in] request   Request to perform.
+ */
+void ExternalFlash_Execute(const ExternalFlashConfig *config,
+                           ExternalFlashRequest *request)
+{
+    ExternalFlash_Submit(config, request);
+    ExternalFlash_Wait(request);
+}
+
+/**
+ * @brief               Erases the entire External Flash.
+ * @note                Performed by the request queue, the calling thread
+ *                      sleeps until it is done.
+ * @note                This function call does not lock the flash from access
+ *                      by other threads, it is up to the user to use the Claim
+ *                      and Release macros to make flash access thread safe.
+ *
+ * @param[in] config    Pointer to External Flash config.
+ */
+void ExternalFlash_EraseBulk(const ExternalFlashConfig *config)
+{
+    ExternalFlashExecute(config, FLASH_REQUEST_ERASE_BULK, 0, NULL, 0);
+}
+
+/**
+ * @brief               Erases a sector on the External Flash.
+ * @note                Performed by the request queue, the calling thread
+ *                      sleeps until it is done.
+ * @note                This function call does not lock the flash from access
+ *                      by other threads, it is up to the user to use the Claim
+ *                      and Release macros to make flash access thread safe.
+ *
+ * @param[in] config    Pointer to External Flash config.
+ * @param[in] address   Address to the flash sector.
+ */
+void ExternalFlash_EraseSector(const ExternalFlashConfig *config,
+                               uint32_t address)
+{
+    ExternalFlashExecute(config, FLASH_REQUEST_ERASE_SECTOR, address, NULL, 0);
+}
+
+/**
+ * @brief               Erases a page on the External Flash.
+ * @note                Performed by the request queue, the calling thread
+ *                      sleeps until it is done.
+ * @note                This function call does not lock the flash from access
+ *                      by other threads, it is up to the user to use the Claim
+ *                      and Release macros to make flash access thread safe.
+ *
+ * @param[in] config    Pointer to External Flash config.
+ * @param[in] address   Address to the flash page.
+ */
+void ExternalFlash_ErasePage(const ExternalFlashConfig *config,
+                             uint32_t address)
+{
+    ExternalFlashExecute(config, FLASH_REQUEST_ERASE_PAGE, address, NULL, 0);
 }
 
 /**
  * @brief               Gets the ID of the External Flash.
+ * @note                Bypasses the request queue, only used at
+ *                      initialization.
  *
  * @param[in] config    Pointer to External Flash config.
  * @return              External Flash ID.
@@ -216,6 +534,8 @@ uint32_t ExternalFlash_ReadID(const ExternalFlashConfig *config)
  * @brief               Writes data to a Flash page using polling.
  * @note                This assumes that the page to be written to has been
  *                      erased prior to the call to this function.
+ * @note                Bypasses the request queue, must not be used while
+ *                      requests are pending.
  * @note                This function call does not lock the flash from access
  *                      by other threads, it is up to the user to use the Claim
  *                      and Release macros to make flash access thread safe.
@@ -266,13 +586,15 @@ void ExternalFlash_WritePagePolling(const ExternalFlashConfig *config,
 #endif /* SPI_USE_MUTUAL_EXCLUSION */
 
     /* Wait the end of Flash writing */
-    ExternalFlash_WaitForWriteEnd(config, 1);
+    ExternalFlashSleepWhileBusy(config, US2ST(FLASH_POLL_PROGRAM_US));
 }
 
 /**
  * @brief               Writes data to a Flash page using DMA.
  * @note                This assumes that the page to be written to has been
  *                      erased prior to the call to this function.
+ * @note                Performed by the request queue, the calling thread
+ *                      sleeps until it is done.
  * @note                This function call does not lock the flash from access
  *                      by other threads, it is up to the user to use the Claim
  *                      and Release macros to make flash access thread safe.
@@ -287,48 +609,13 @@ void ExternalFlash_WritePage(const ExternalFlashConfig *config,
                              uint8_t *buffer,
                              uint16_t count)
 {
-    /* Error check. */
-    if (count > FLASH_PAGE_SIZE)
-        osalSysHalt("Page write size too big");
-
-#if SPI_USE_MUTUAL_EXCLUSION
-    /* Claim the SPI bus */
-    spiAcquireBus(config->spip);
-#endif /* SPI_USE_MUTUAL_EXCLUSION */
-
-    /* Enable the write access to the External Flash */
-    ExternalFlash_WriteEnable(config);
-
-    /* Select the External Flash: Chip Select low */
-    ExternalFlash_Select(config);
-
-    /* Load the command and address data */
-    config->data->flash_tmp[0] = (uint8_t)FLASH_CMD_PAGE_PROGRAM;
-    config->data->flash_tmp[1] = (uint8_t)((address & 0xFF0000) >> 16);
-    config->data->flash_tmp[2] = (uint8_t)((address & 0xFF00) >> 8);
-    config->data->flash_tmp[3] = (uint8_t)(address & 0xFF);
-
-    /* Send "Write to Memory" instruction and send address nibbles
-       from address to read from */
-    spiSend(config->spip, 4, config->data->flash_tmp);
-
-    /* Send the data to memory */
-    spiSend(config->spip, count, buffer);
-
-    /* Deselect the External Flash: Chip Select high */
-    ExternalFlash_Unselect(config);
-
-#if SPI_USE_MUTUAL_EXCLUSION
-    /* Release the SPI bus */
-    spiReleaseBus(config->spip);
-#endif /* SPI_USE_MUTUAL_EXCLUSION */
-
-    /* Wait the end of Flash writing */
-    ExternalFlash_WaitForWriteEnd(config, 1);
+    ExternalFlashExecute(config, FLASH_REQUEST_PROGRAM, address, buffer, count);
 }
 
 /**
  * @brief               Read a block of data from the External Flash by polling.
+ * @note                Bypasses the request queue, must not be used while
+ *                      requests are pending.
  * @note                This function call does not lock the flash from access
  *                      by other threads, it is up to the user to use the Claim
  *                      and Release macros to make flash access thread safe.
@@ -373,6 +660,8 @@ void ExternalFlash_ReadBufferPolling(const ExternalFlashConfig *config,
 
 /**
  * @brief               Read a block of data from the External Flash using DMA.
+ * @note                Performed by the request queue, the calling thread
+ *                      sleeps until it is done.
  * @note                This function call does not lock the flash from access
  *                      by other threads, it is up to the user to use the Claim
  *                      and Release macros to make flash access thread safe.
@@ -387,81 +676,7 @@ void ExternalFlash_ReadBuffer(const ExternalFlashConfig *config,
                               uint8_t *buffer,  
                               uint16_t count)
 {
-#if SPI_USE_MUTUAL_EXCLUSION
-    /* Claim the SPI bus */
-    spiAcquireBus(config->spip);
-#endif /* SPI_USE_MUTUAL_EXCLUSION */
-
-    /* Select the External Flash: Chip Select low */
-    ExternalFlash_Select(config);
-
-    /* Load the command and address data */
-    config->data->flash_tmp[0] = (uint8_t)FLASH_CMD_READ;
-    config->data->flash_tmp[1] = (uint8_t)((address & 0xFF0000) >> 16);
-    config->data->flash_tmp[2] = (uint8_t)((address & 0xFF00) >> 8);
-    config->data->flash_tmp[3] = (uint8_t)(address & 0xFF);
-
-    /* Send "Read from Memory" instruction and send address nibbles
-       from address to read from */
-    spiSend(config->spip, 4, config->data->flash_tmp);
-
-    /* Read the requested data from memory */
-    spiReceive(config->spip, count, buffer);
-
-    /* Deselect the External Flash: Chip Select high */
-    ExternalFlash_Unselect(config);
-
-#if SPI_USE_MUTUAL_EXCLUSION
-    /* Release the SPI bus */
-    spiReleaseBus(config->spip);
-#endif /* SPI_USE_MUTUAL_EXCLUSION */
-}
-
-/**
- * @brief               Polls the status of the Write In Progress (WIP) flag in
- *                      the External Flash's status register until write
- *                      operation has completed.
- * @note                This function call does not lock the flash from access
- *                      by other threads, it is up to the user to use the Claim
- *                      and Release macros to make flash access thread safe.
- *                      
- * @param[in] config    Pointer to External Flash config.
- * @param[in] delay_ms  Delay between checks in ms. 0 indicates continuous
- *                      polling without and delay (blocking).
- */
-void ExternalFlash_WaitForWriteEnd(const ExternalFlashConfig *config,
-                                   uint32_t delay_ms)
-{
-    uint8_t wip;
-
-    /* Loop as long as the memory is busy with a write cycle */
-    do
-    {
-        /* If a delay was specified: wait */
-        if (delay_ms != 0)
-            osalThreadSleepMilliseconds(delay_ms);
-
-#if SPI_USE_MUTUAL_EXCLUSION
-        /* Claim the SPI bus */
-        spiAcquireBus(config->spip);
-#endif /* SPI_USE_MUTUAL_EXCLUSION */
-        
-        /* Select the External Flash: Chip Select low */
-        ExternalFlash_Select(config);
-
-        /* Send "Read Status Register" instruction */
-        spiPolledExchange(config->spip, FLASH_CMD_RDSR);
-
-        wip = spiPolledExchange(config->spip, FLASH_DUMMY_BYTE);
-
-        /* Deselect the External Flash: Chip Select high */
-        ExternalFlash_Unselect(config);
-
-#if SPI_USE_MUTUAL_EXCLUSION
-        /* Release the SPI bus */
-        spiReleaseBus(config->spip); 
-#endif /* SPI_USE_MUTUAL_EXCLUSION */
-    } while (wip & FLASH_WIP_FLAG);
+    ExternalFlashExecute(config, FLASH_REQUEST_READ, address, buffer, count);
 }
 
 /**
@@ -5,34 +5,57 @@
  * */
 
  /* Structure of the external flash:
+  *
+  * The settings are stored as an append-only log in the first
+  * FLASHSAVE_NUM_PAGES pages of the external flash. A new version of a record
+  * is always written to fresh pages at the head of the log, and the old
+  * version is left in place until the log wraps around to it.
   *  __________ __________  _  _  _  __________
   * |          |          |         |          |
-  * |  Save 1  |  Save 2  | -  -  - |  Save N  |
+  * | Record 1 | Record 2 | -  -  - | Record N | -> head, free pages
   * |__________|__________| _  _  _ |__________|
   *                                /            \
-  *    _ _ _ _ _ _ _ _ _ _ _ _ _ _/              \_ _ _ _ _
-  *  /                                                     \
-  * /__________________________ _____________ ______________\
-  * |                          |             |              |
-  * |  32-bit Unique ID (UID)  |  Data size  |  Saved Data  |
-  * |__________________________|_____________|______________|
-  *            4 bytes              1 byte      1-250 bytes
-  *
-  * Each block can only span one page as maximum limiting the saved data to be
-  * maximum 250 bytes.
+  *    _ _ _ _ _ _ _ _ _ _ _ _ _ _/              \_ _ _ _ _ _ _ _ _ _
+  *  /                                                               \
+  * /________________________________________________ _______________\
+  * |                                                |                |
+  * | Header: magic, UID, sequence, size, data CRC,  |  Saved Data    |
+  * |         header CRC, commit                     |                |
+  * |________________________________________________|________________|
+  *                      20 bytes                       1 - 2028 bytes
   *
-  * - The worst case time to complete a save is approximately 50 ms.
-  * - The worst case time to complete a read is approximately 35 ms.
+  * - A record spans one or more consecutive pages, it never wraps around the
+  *   end of the log.
+  * - The commit field is programmed from 0xffff to 0x0000 after all data is
+  *   written, a record is only valid if committed and both CRCs match. A
+  *   power loss during a save leaves the previous version as the newest.
+  * - At boot the log is scanned and the valid record with the highest
+  *   sequence number is used for each UID.
+  * - The garbage collector keeps FLASHSAVE_GC_RESERVE_PAGES pages in front of
+  *   the head free from live records by copying them to the head, in the
+  *   background after each save.
+  * - Modules register their records with FlashSave_Register, and all are
+  *   saved by one thread in a single transaction on the save to flash event.
+  *   The records are first copied to a staging buffer, so each is a
+  *   consistent snapshot while the flash is written.
+  * - As all pages are used in turn the wear is spread over the whole log.
+  * - Logs in the old format (UID + size header, one page per record) are
+  *   migrated at the first boot.
   */
 
 #include "ch.h"
 #include "hal.h"
+#include "crc.h"
 #include "flash_save.h"
 
 /*===========================================================================*/
 /* Module local definitions.                                                 */
 /*===========================================================================*/
 
+#define FLASHSAVE_RECORD_HEADER_SIZE    (sizeof(flashsave_record_header_t))
+#define FLASHSAVE_OLD_HEADER_SIZE       5
+#define FLASHSAVE_OLD_MAX_SIZE          250
+
 /*===========================================================================*/
 /* Module exported variables.                                                */
 /*===========================================================================*/
@@ -56,72 +79,681 @@ static const ExternalFlashConfig flashcfg = {
 
 EVENTSOURCE_DECL(save_to_flash_es);
 
+/**
+ * @brief   UID -> newest valid record index.
+ */
+static flashsave_index_entry_t flashsave_index[FLASHSAVE_INDEX_SIZE];
+
+/**
+ * @brief   Number of records in the index.
+ */
+static uint16_t flashsave_index_count;
+
+/**
+ * @brief   Page where the next record will be written.
+ */
+static uint16_t flashsave_head;
+
+/**
+ * @brief   Sequence number of the next record.
+ */
+static uint32_t flashsave_sequence;
+
+/**
+ * @brief   Page buffer for reading and writing records.
+ */
+static uint8_t flashsave_page_buffer[FLASH_PAGE_SIZE];
+
+/**
+ * @brief   Pipelined page writes, one page is prepared while the other is
+ *          erased and programmed.
+ */
+static uint8_t flashsave_write_buffer[2][FLASH_PAGE_SIZE];
+static ExternalFlashRequest flashsave_erase_request[2];
+static ExternalFlashRequest flashsave_program_request[2];
+
+/**
+ * @brief   Registered records, saved on the save to flash event.
+ */
+static flashsave_registry_entry_t flashsave_registry[FLASHSAVE_REGISTRY_SIZE];
+static uint32_t flashsave_registry_count;
+
+/**
+ * @brief   Copies of the registered records taken before the flash is
+ *          claimed, and the space used by them.
+ */
+static uint8_t flashsave_staging[FLASHSAVE_STAGING_SIZE];
+static uint32_t flashsave_staging_used;
+
+/**
+ * @brief   Status of the last save of the registered records.
+ */
+static FlashSave_Status flashsave_last_status;
+
+/**
+ * @brief   Thread saving the registered records and collecting garbage.
+ */
+static thread_t *flashsave_thread;
+
+THD_WORKING_AREA(waThreadFlashSave, 512);
+
 /*===========================================================================*/
 /* Module local functions.                                                   */
 /*===========================================================================*/
 
 /**
- * @brief               Writes data to a Flash page using DMA.
- * @note                This assumes that the page to be written to has been
- *                      erased prior to the call to this function.
+ * @brief               Number of pages used by a record.
  *
- * @param[in] config    Pointer to External Flash config.
- * @param[in] address   Where in the Flash to save the data.
- * @param[in] uid       The unique ID.
- * @param[in] buffer    Pointer to the buffer holding the data.
- * @param[in] count     Number of bytes to write (max 256 bytes).
- */
-static void FlashSave_WritePage(const ExternalFlashConfig *config,
-                                uint32_t address,
-                                uint32_t uid,
-                                uint8_t *buffer,
-                                uint16_t count)
+ * @param[in] size      Size of the record data.
+ * @return              Number of pages.
+ */
+static inline uint16_t FlashSave_RecordPages(const uint16_t size)
 {
-    /* Error check. */
-    if (count > FLASH_PAGE_SIZE)
-        osalSysHalt("Page write size too big");
-
-#if SPI_USE_MUTUAL_EXCLUSION
-    /* Claim the SPI bus */
-    spiAcquireBus(config->spip);
-#endif /* SPI_USE_MUTUAL_EXCLUSION */
-
-    /* Enable the write access to the External Flash */
-    ExternalFlash_WriteEnable(config);
-
-    /* Select the External Flash: Chip Select low */
-    ExternalFlash_Select(config);
-
-    /* Load the command and address data */
-    config->data->flash_tmp[0] = (uint8_t)FLASH_CMD_PAGE_PROGRAM;
-    config->data->flash_tmp[1] = (uint8_t)((address & 0xFF0000) >> 16);
-    config->data->flash_tmp[2] = (uint8_t)((address & 0xFF00) >> 8);
-    config->data->flash_tmp[3] = (uint8_t)(address & 0xFF);
-
-    /* Send "Write to Memory" instruction and send address nibbles
-       from address to read from */
-    spiSend(config->spip, 4, config->data->flash_tmp);
-
-    /* Send the header consisting of UID + size (5 bytes) */
-    spiPolledExchange(config->spip, (uint8_t)(uid & 0x000000FF));
-    spiPolledExchange(config->spip, (uint8_t)((uid & 0x0000FF00) >> 8));
-    spiPolledExchange(config->spip, (uint8_t)((uid & 0x00FF0000) >> 16));
-    spiPolledExchange(config->spip, (uint8_t)((uid & 0xFF000000) >> 24));
-    spiPolledExchange(config->spip, (uint8_t)count);
-
-    /* Send the data to memory using DMA */
-    spiSend(config->spip, count, buffer);
-
-    /* Deselect the External Flash: Chip Select high */
-    ExternalFlash_Unselect(config);
-
-#if SPI_USE_MUTUAL_EXCLUSION
-    /* Release the SPI bus */
-    spiReleaseBus(config->spip);
-#endif /* SPI_USE_MUTUAL_EXCLUSION */
-
-    /* Wait the end of Flash writing */
-    ExternalFlash_WaitForWriteEnd(config, 1);
+    return (FLASHSAVE_RECORD_HEADER_SIZE + size + FLASH_PAGE_SIZE - 1) /
+           FLASH_PAGE_SIZE;
+}
+
+/**
+ * @brief               Calculates the CRC of a record header.
+ *
+ * @param[in] header    Pointer to the header.
+ * @return              CRC over all fields before the header CRC.
+ */
+static inline uint16_t FlashSave_HeaderCRC(flashsave_record_header_t *header)
+{
+    return CRC16((uint8_t *)header,
+                 offsetof(flashsave_record_header_t, header_crc));
+}
+
+/**
+ * @brief               Calculates the CRC of data in the flash.
+ *
+ * @param[in] address   Start address of the data.
+ * @param[in] size      Size of the data.
+ * @return              CRC16 of the data.
+ */
+static uint16_t FlashSave_FlashCRC(uint32_t address, uint16_t size)
+{
+    uint16_t crc = CRC16_START_VALUE;
+    uint16_t chunk;
+
+    while (size > 0)
+    {
+        chunk = (size > FLASH_PAGE_SIZE) ? FLASH_PAGE_SIZE : size;
+
+        ExternalFlash_ReadBuffer(&flashcfg,
+                                 address,
+                                 flashsave_page_buffer,
+                                 chunk);
+
+        crc = CRC16_chunk(flashsave_page_buffer, chunk, crc);
+        address += chunk;
+        size -= chunk;
+    }
+
+    return crc;
+}
+
+/**
+ * @brief               Looks up a UID in the index.
+ *
+ * @param[in] uid       UID to look for.
+ * @return              Pointer to the index entry, or NULL if not found.
+ */
+static flashsave_index_entry_t *FlashSave_IndexFind(uint32_t uid)
+{
+    int i;
+
+    for (i = 0; i < flashsave_index_count; i++)
+        if (flashsave_index[i].uid == uid)
+            return &flashsave_index[i];
+
+    return NULL;
+}
+
+/**
+ * @brief               Finds the live record closest to the start of a page
+ *                      range, wrapping around the end of the log.
+ *
+ * @param[in] start     First page of the range.
+ * @param[in] count     Number of pages in the range.
+ * @return              Pointer to the index entry of the record, or NULL if
+ *                      the range is free from live records.
+ */
+static flashsave_index_entry_t *FlashSave_LiveRecordIn(uint16_t start,
+                                                       uint16_t count)
+{
+    flashsave_index_entry_t *closest = NULL;
+    uint16_t ahead, behind, distance, closest_distance = 0xffff;
+    int i;
+
+    for (i = 0; i < flashsave_index_count; i++)
+    {
+        ahead = (flashsave_index[i].page + FLASHSAVE_NUM_PAGES - start) %
+                FLASHSAVE_NUM_PAGES;
+        behind = (start + FLASHSAVE_NUM_PAGES - flashsave_index[i].page) %
+                 FLASHSAVE_NUM_PAGES;
+
+        /* Starts in the range, or starts before and reaches into it. */
+        if (ahead < count)
+            distance = ahead;
+        else if (behind < FlashSave_RecordPages(flashsave_index[i].size))
+            distance = 0;
+        else
+            continue;
+
+        if (distance < closest_distance)
+        {
+            closest = &flashsave_index[i];
+            closest_distance = distance;
+        }
+    }
+
+    return closest;
+}
+
+/**
+ * @brief               Counts the pages used by live records.
+ *
+ * @param[in] exclude   UID of a record not to count.
+ * @return              Number of pages.
+ */
+static uint16_t FlashSave_LivePages(uint32_t exclude)
+{
+    uint16_t pages = 0;
+    int i;
+
+    for (i = 0; i < flashsave_index_count; i++)
+        if (flashsave_index[i].uid != exclude)
+            pages += FlashSave_RecordPages(flashsave_index[i].size);
+
+    return pages;
+}
+
+/**
+ * @brief               Returns the page where a record will be written.
+ *
+ * @param[in] pages     Number of pages of the record.
+ * @return              First page of the record.
+ */
+static inline uint16_t FlashSave_TargetPage(const uint16_t pages)
+{
+    /* Records do not wrap around the end of the log. */
+    if (flashsave_head + pages > FLASHSAVE_NUM_PAGES)
+        return 0;
+    else
+        return flashsave_head;
+}
+
+/**
+ * @brief               Queues the erase and program of a page from one of the
+ *                      write buffers.
+ *
+ * @param[in] slot      Write buffer.
+ * @param[in] page      Page to write.
+ * @param[in] count     Number of bytes to program.
+ */
+static void FlashSave_QueuePage(uint32_t slot, uint16_t page, uint16_t count)
+{
+    ExternalFlashRequest *erase = &flashsave_erase_request[slot];
+    ExternalFlashRequest *program = &flashsave_program_request[slot];
+
+    erase->operation = FLASH_REQUEST_ERASE_PAGE;
+    erase->address = page * FLASH_PAGE_SIZE;
+    erase->buffer = NULL;
+    erase->count = 0;
+    erase->callback = NULL;
+    erase->arg = NULL;
+
+    program->operation = FLASH_REQUEST_PROGRAM;
+    program->address = page * FLASH_PAGE_SIZE;
+    program->buffer = flashsave_write_buffer[slot];
+    program->count = count;
+    program->callback = NULL;
+    program->arg = NULL;
+
+    ExternalFlash_Submit(&flashcfg, erase);
+    ExternalFlash_Submit(&flashcfg, program);
+}
+
+/**
+ * @brief               Appends a record at the head of the log.
+ * @note                The external flash must be claimed and the target
+ *                      pages must be free from live records.
+ * @note                Page writes are queued, the next page is prepared
+ *                      while the previous one is written.
+ *
+ * @param[in] uid       UID of the record.
+ * @param[in] data      Pointer to the data in RAM, or NULL to copy the data
+ *                      from the flash.
+ * @param[in] address   Flash address of the data if data is NULL.
+ * @param[in] size      Size of the data.
+ * @param[in] data_crc  CRC16 of the data.
+ */
+static void FlashSave_Append(uint32_t uid,
+                             const uint8_t *data,
+                             uint32_t address,
+                             uint16_t size,
+                             uint16_t data_crc)
+{
+    flashsave_record_header_t header;
+    flashsave_index_entry_t *entry;
+    const uint16_t pages = FlashSave_RecordPages(size);
+    const uint16_t start = FlashSave_TargetPage(pages);
+    uint16_t page, offset, chunk, written = 0;
+    uint32_t slot;
+
+    header.magic = FLASHSAVE_RECORD_MAGIC;
+    header.uid = uid;
+    header.sequence = flashsave_sequence++;
+    header.size = size;
+    header.data_crc = data_crc;
+    header.header_crc = FlashSave_HeaderCRC(&header);
+    header.commit = FLASHSAVE_RECORD_UNCOMMITTED;
+
+    for (page = start; page < start + pages; page++)
+    {
+        slot = (page - start) & 1;
+        offset = 0;
+
+        /* The buffer is free when its previous page has been written. */
+        if (page - start >= 2)
+            ExternalFlash_Wait(&flashsave_program_request[slot]);
+
+        if (page == start)
+        {
+            memcpy(flashsave_write_buffer[slot], &header,
+                   FLASHSAVE_RECORD_HEADER_SIZE);
+            offset = FLASHSAVE_RECORD_HEADER_SIZE;
+        }
+
+        chunk = FLASH_PAGE_SIZE - offset;
+        if (chunk > size - written)
+            chunk = size - written;
+
+        if (data != NULL)
+            memcpy(&flashsave_write_buffer[slot][offset],
+                   &data[written],
+                   chunk);
+        else
+            ExternalFlash_ReadBuffer(&flashcfg,
+                                     address + written,
+                                     &flashsave_write_buffer[slot][offset],
+                                     chunk);
+
+        FlashSave_QueuePage(slot, page, offset + chunk);
+
+        written += chunk;
+    }
+
+    /* Wait for the last pages, requests are performed in order. */
+    ExternalFlash_Wait(&flashsave_program_request[(pages - 1) & 1]);
+
+    /* Commit the record, programming can only clear bits. */
+    header.commit = FLASHSAVE_RECORD_COMMITTED;
+    memcpy(flashsave_page_buffer, &header.commit, sizeof(header.commit));
+    ExternalFlash_WritePage(&flashcfg,
+                            start * FLASH_PAGE_SIZE +
+                                offsetof(flashsave_record_header_t, commit),
+                            flashsave_page_buffer,
+                            sizeof(header.commit));
+
+    flashsave_head = (start + pages) % FLASHSAVE_NUM_PAGES;
+
+    /* Update the index to the new version. */
+    entry = FlashSave_IndexFind(uid);
+
+    if (entry == NULL)
+        entry = &flashsave_index[flashsave_index_count++];
+
+    entry->uid = uid;
+    entry->page = start;
+    entry->size = size;
+    entry->sequence = header.sequence;
+}
+
+/**
+ * @brief               Moves the live record closest to the head, if it is
+ *                      within the reserved pages, to the head of the log.
+ * @note                The external flash must be claimed.
+ *
+ * @return              True if a record was moved.
+ */
+static bool FlashSave_CollectStep(void)
+{
+    flashsave_record_header_t header;
+    flashsave_index_entry_t *entry;
+    uint16_t pages;
+
+    entry = FlashSave_LiveRecordIn(flashsave_head, FLASHSAVE_GC_RESERVE_PAGES);
+
+    if (entry == NULL)
+        return false;
+
+    /* The copy must not overwrite its own source. */
+    pages = FlashSave_RecordPages(entry->size);
+    if (FlashSave_LiveRecordIn(FlashSave_TargetPage(pages), pages) == entry)
+        return false;
+
+    /* The data CRC is unchanged, read it from the old header. */
+    ExternalFlash_ReadBuffer(&flashcfg,
+                             entry->page * FLASH_PAGE_SIZE,
+                             (uint8_t *)&header,
+                             FLASHSAVE_RECORD_HEADER_SIZE);
+
+    FlashSave_Append(entry->uid,
+                     NULL,
+                     entry->page * FLASH_PAGE_SIZE +
+                        FLASHSAVE_RECORD_HEADER_SIZE,
+                     entry->size,
+                     header.data_crc);
+
+    return true;
+}
+
+/**
+ * @brief               Restores the reserved free pages in front of the head.
+ * @note                The external flash must be claimed.
+ *
+ * @return              False if the reserved pages could not be freed, the
+ *                      log is full.
+ */
+static bool FlashSave_Collect(void)
+{
+    uint32_t moved = 0;
+
+    /* Moving each record once is enough, else the log is full. */
+    while (FlashSave_CollectStep() == true)
+    {
+        if (++moved > FLASHSAVE_INDEX_SIZE)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief               Writes a new version of a record to the log.
+ * @note                The external flash must be claimed.
+ *
+ * @param[in] uid       UID of the record.
+ * @param[in] overwrite True to overwrite old data.
+ * @param[in] data      Pointer to the data to write.
+ * @param[in] count     Number of bytes to write.
+ * @return              Returns the status of the operation.
+ */
+static FlashSave_Status FlashSave_WriteRecord(uint32_t uid,
+                                              bool overwrite,
+                                              uint8_t *data,
+                                              uint16_t count)
+{
+    const uint16_t pages = FlashSave_RecordPages(count);
+
+    /*  Check if the data is within correct size */
+    if ((count == 0) || (count > FLASHSAVE_MAX_DATA_SIZE))
+        return FLASHSAVE_OVERSIZE;
+
+    if (FlashSave_IndexFind(uid) != NULL)
+    {
+        if (overwrite == false)
+            return FLASHSAVE_NO_OVERWRITE;
+    }
+    else if (flashsave_index_count >= FLASHSAVE_INDEX_SIZE)
+        return FLASHSAVE_FLASH_FULL;
+
+    /* The reserved pages must fit next to the live records. */
+    if (FlashSave_LivePages(uid) + pages + FLASHSAVE_GC_RESERVE_PAGES >
+        FLASHSAVE_NUM_PAGES)
+        return FLASHSAVE_FLASH_FULL;
+
+    /* Make sure the pages are free, if the collector has not finished. */
+    if ((FlashSave_LiveRecordIn(FlashSave_TargetPage(pages), pages) != NULL) &&
+        ((FlashSave_Collect() == false) ||
+         (FlashSave_LiveRecordIn(FlashSave_TargetPage(pages), pages) != NULL)))
+        return FLASHSAVE_FLASH_FULL;
+
+    FlashSave_Append(uid, data, 0, count, CRC16(data, count));
+
+    return FLASHSAVE_OK;
+}
+
+/**
+ * @brief               Saves all registered records in one transaction.
+ *
+ * @return              FLASHSAVE_OK, or the first error of the records.
+ */
+static FlashSave_Status FlashSave_SaveRegistered(void)
+{
+    FlashSave_Status status, result = FLASHSAVE_OK;
+    uint32_t i, offset;
+
+    /* Take the snapshots and copy all records first, so the saved records
+     * can not be changed half way through and the flash is claimed as short
+     * as possible. */
+    offset = 0;
+    for (i = 0; i < flashsave_registry_count; i++)
+    {
+        if (flashsave_registry[i].snapshot != NULL)
+            flashsave_registry[i].snapshot(flashsave_registry[i].data);
+
+        osalSysLock();
+        memcpy(&flashsave_staging[offset],
+               flashsave_registry[i].data,
+               flashsave_registry[i].size);
+        osalSysUnlock();
+
+        offset += flashsave_registry[i].size;
+    }
+
+    ExternalFlash_Claim(&flashcfg);
+
+    offset = 0;
+    for (i = 0; i < flashsave_registry_count; i++)
+    {
+        status = FlashSave_WriteRecord(flashsave_registry[i].uid,
+                                       true,
+                                       &flashsave_staging[offset],
+                                       flashsave_registry[i].size);
+
+        if ((status != FLASHSAVE_OK) && (result == FLASHSAVE_OK))
+            result = status;
+
+        offset += flashsave_registry[i].size;
+    }
+
+    ExternalFlash_Release(&flashcfg);
+
+    return result;
+}
+
+/**
+ * @brief           Thread for saving the registered records and the
+ *                  background garbage collection.
+ *
+ * @param[in] arg   Unused.
+ * @return          Unused.
+ */
+static THD_FUNCTION(ThreadFlashSave, arg)
+{
+    (void)arg;
+    event_listener_t el;
+    eventmask_t events;
+    bool moved;
+    int i;
+
+    /* Set thread name */
+    chRegSetThreadName("FlashSave");
+
+    /* Register to flash save event */
+    chEvtRegisterMask(&save_to_flash_es, &el, FLASHSAVE_SAVE_EVENTMASK);
+
+    /* Restore the free pages after boot */
+    events = FLASHSAVE_GC_EVENTMASK;
+
+    while (1)
+    {
+        if (events & FLASHSAVE_SAVE_EVENTMASK)
+            flashsave_last_status = FlashSave_SaveRegistered();
+
+        /* One record at a time, so saves are not blocked for long. Moving
+         * each record once is enough, else the log is full. */
+        for (i = 0; i < FLASHSAVE_INDEX_SIZE; i++)
+        {
+            ExternalFlash_Claim(&flashcfg);
+            moved = FlashSave_CollectStep();
+            ExternalFlash_Release(&flashcfg);
+
+            if (moved == false)
+                break;
+        }
+
+        events = chEvtWaitAny(FLASHSAVE_SAVE_EVENTMASK |
+                              FLASHSAVE_GC_EVENTMASK);
+    }
+}
+
+/**
+ * @brief               Migrates records in the old format (UID + size header,
+ *                      one page per record, starting at page 0) to the log.
+ * @note                The external flash must be claimed and the log empty.
+ */
+static void FlashSave_MigrateOldFormat(void)
+{
+    uint8_t header[FLASHSAVE_OLD_HEADER_SIZE];
+    uint16_t page, old_pages;
+    uint32_t uid;
+
+    /* Find the end of the old records. */
+    for (old_pages = 0; old_pages < FLASHSAVE_NUM_PAGES; old_pages++)
+    {
+        ExternalFlash_ReadBuffer(&flashcfg,
+                                 old_pages * FLASH_PAGE_SIZE,
+                                 header,
+                                 FLASHSAVE_OLD_HEADER_SIZE);
+
+        uid = FlashSave_BYTES2ID(header[0], header[1], header[2], header[3]);
+
+        if ((uid == FLASHSAVE_UNALLOCATED) ||
+            (header[4] > FLASHSAVE_OLD_MAX_SIZE))
+            break;
+    }
+
+    if ((old_pages == 0) ||
+        (old_pages * 2 + FLASHSAVE_GC_RESERVE_PAGES > FLASHSAVE_NUM_PAGES))
+        return;
+
+    /* Append each old record after the old pages, which are then left as
+     * garbage for the log to overwrite. */
+    flashsave_head = old_pages;
+
+    for (page = 0; page < old_pages; page++)
+    {
+        ExternalFlash_ReadBuffer(&flashcfg,
+                                 page * FLASH_PAGE_SIZE,
+                                 header,
+                                 FLASHSAVE_OLD_HEADER_SIZE);
+
+        uid = FlashSave_BYTES2ID(header[0], header[1], header[2], header[3]);
+
+        if ((FlashSave_IndexFind(uid) != NULL) ||
+            (flashsave_index_count >= FLASHSAVE_INDEX_SIZE))
+            continue;
+
+        FlashSave_Append(uid,
+                         NULL,
+                         page * FLASH_PAGE_SIZE + FLASHSAVE_OLD_HEADER_SIZE,
+                         header[4],
+                         FlashSave_FlashCRC(page * FLASH_PAGE_SIZE +
+                                                FLASHSAVE_OLD_HEADER_SIZE,
+                                            header[4]));
+    }
+}
+
+/**
+ * @brief               Scans the log and builds the index of the newest
+ *                      valid version of each record.
+ * @note                The external flash must be claimed.
+ */
+static void FlashSave_Recover(void)
+{
+    flashsave_record_header_t header;
+    flashsave_index_entry_t *entry;
+    uint32_t highest_sequence = 0;
+    bool found_header = false;
+    bool found_data = false;
+    uint16_t page = 0, pages;
+
+    flashsave_index_count = 0;
+    flashsave_head = 0;
+    flashsave_sequence = 0;
+
+    while (page < FLASHSAVE_NUM_PAGES)
+    {
+        ExternalFlash_ReadBuffer(&flashcfg,
+                                 page * FLASH_PAGE_SIZE,
+                                 (uint8_t *)&header,
+                                 FLASHSAVE_RECORD_HEADER_SIZE);
+
+        if (header.magic != FLASHSAVE_RECORD_MAGIC)
+        {
+            if (header.magic != FLASHSAVE_UNALLOCATED)
+                found_data = true;
+
+            page++;
+            continue;
+        }
+
+        if ((FlashSave_HeaderCRC(&header) != header.header_crc) ||
+            (header.size > FLASHSAVE_MAX_DATA_SIZE))
+        {
+            page++;
+            continue;
+        }
+
+        pages = FlashSave_RecordPages(header.size);
+
+        /* The head follows the last written record, even if not committed,
+         * and sequence numbers are never reused. */
+        if ((found_header == false) || (header.sequence >= highest_sequence))
+        {
+            highest_sequence = header.sequence;
+            flashsave_head = (page + pages) % FLASHSAVE_NUM_PAGES;
+            flashsave_sequence = header.sequence + 1;
+            found_header = true;
+        }
+
+        if (header.commit == FLASHSAVE_RECORD_COMMITTED)
+        {
+            entry = FlashSave_IndexFind(header.uid);
+
+            /* Only check the data of records which would be the newest. */
+            if (((entry == NULL) || (header.sequence > entry->sequence)) &&
+                (FlashSave_FlashCRC(page * FLASH_PAGE_SIZE +
+                                        FLASHSAVE_RECORD_HEADER_SIZE,
+                                    header.size) == header.data_crc))
+            {
+                if (entry == NULL)
+                {
+                    if (flashsave_index_count < FLASHSAVE_INDEX_SIZE)
+                        entry = &flashsave_index[flashsave_index_count++];
+                }
+
+                if (entry != NULL)
+                {
+                    entry->uid = header.uid;
+                    entry->page = page;
+                    entry->size = header.size;
+                    entry->sequence = header.sequence;
+                }
+            }
+        }
+
+        page += pages;
+    }
+
+    /* No log but other data, check for the old format. */
+    if ((found_header == false) && (found_data == true))
+        FlashSave_MigrateOldFormat();
 }
 
 /*===========================================================================*/
@@ -139,69 +771,76 @@ void FlashSaveInit(void)
     /* Initialize external flash */
     if (ExternalFlashInit(&flashcfg) != MSG_OK)
         osalSysHalt("External Flash ID error.");
+
+    /* Find the newest version of each record */
+    ExternalFlash_Claim(&flashcfg);
+    FlashSave_Recover();
+    ExternalFlash_Release(&flashcfg);
+
+    /* Start the saver and garbage collector */
+    flashsave_thread = chThdCreateStatic(waThreadFlashSave,
+                                         sizeof(waThreadFlashSave),
+                                         LOWPRIO,
+                                         ThreadFlashSave,
+                                         NULL);
+}
+
+/**
+ * @brief       Registers a record to be saved on the save to flash event.
+ * @note        Must be called during initialization.
+ *
+ * @param[in] uid       UID of the record.
+ * @param[in] data      Pointer to the data to save.
+ * @param[in] size      Size of the data.
+ * @param[in] snapshot  Callback copying the current settings to data before
+ *                      saving, or NULL if data is saved directly.
+ */
+void FlashSave_Register(uint32_t uid,
+                        void *data,
+                        uint16_t size,
+                        flashsave_snapshot_t snapshot)
+{
+    if ((flashsave_registry_count >= FLASHSAVE_REGISTRY_SIZE) ||
+        (size > FLASHSAVE_MAX_DATA_SIZE) ||
+        (flashsave_staging_used + size > FLASHSAVE_STAGING_SIZE))
+        osalSysHalt("FlashSave registration error.");
+
+    flashsave_registry[flashsave_registry_count].uid = uid;
+    flashsave_registry[flashsave_registry_count].data = data;
+    flashsave_registry[flashsave_registry_count].size = size;
+    flashsave_registry[flashsave_registry_count].snapshot = snapshot;
+    flashsave_registry_count++;
+    flashsave_staging_used += size;
 }
 
 /**
- * @brief       Seek the flash memory for the requested UID and reports back
- *              the page number and size of the saved data.
+ * @brief       Seek the index for the requested UID and reports back the page
+ *              number and size of the newest saved data.
  *
  * @param[in]  uid          UID to search for.
  * @param[out] page_number  Pointer to saving variable for page number.
  * @param[out] size         Pointer to saving variable for data size.
  * @return      Returns true if there was a match.
  */
-bool FlashSave_Seek(uint32_t uid, int16_t *page_number, uint8_t *size)
+bool FlashSave_Seek(uint32_t uid, int16_t *page_number, uint16_t *size)
 {
-    uint16_t current_page = 0;
-
-    /* Union to format raw data from the flash memory */
-    union {
-        struct {
-            uint32_t id;
-            uint8_t size;
-        } formated_seek;
-        uint8_t raw_data[5];
-    } seek_union;
-
-    /* Search each page for the correct UID or until the end of allocated
-       memory is reached. */
-    do {
-        ExternalFlash_ReadBufferPolling(&flashcfg,
-                                        (current_page * FLASH_PAGE_SIZE),
-                                        seek_union.raw_data,
-                                        5);
-
-        current_page++;
-    } while((seek_union.formated_seek.id != uid) &&
-            (seek_union.formated_seek.id != FLASHSAVE_UNALLOCATED) &&
-            (current_page <= flashcfg.num_pages));
-
-    /* Return the page number */
+    flashsave_index_entry_t *entry = FlashSave_IndexFind(uid);
+
+    if (entry == NULL)
+        return false;
+
     if (page_number != NULL)
-    {
-        /* If the flash is full return -1 */
-        if (current_page >= flashcfg.num_pages)
-            *page_number = -1;
-        else
-            *page_number = current_page - 1;
-    }
+        *page_number = entry->page;
 
-    /* If there was a match return the size */
-    if (seek_union.formated_seek.id == uid)
-    {
-        if (size != NULL)
-            *size = seek_union.formated_seek.size;
+    if (size != NULL)
+        *size = entry->size;
 
-        return true;
-    }
-    else
-        return false;
+    return true;
 }
 
 /**
- * @brief       Writes data to a location with the correct UID, or saved at a
- *              new location if the UID was not already written.
- * @note        Max write size is 250 bytes.
+ * @brief       Writes a new version of the data with the UID to the log.
+ * @note        Max write size is FLASHSAVE_MAX_DATA_SIZE bytes.
  *
  * @param[in] uid       UID to write at.
  * @param[in] overwrite True to overwrite old data.
@@ -214,57 +853,21 @@ FlashSave_Status FlashSave_Write(uint32_t uid,
                                  uint8_t *data,
                                  uint16_t count)
 {
-    bool result;
-    int16_t page_number;
-    uint8_t size;
+    FlashSave_Status status;
 
     /* Claim external flash */
     ExternalFlash_Claim(&flashcfg);
 
-    /*  Check if the data is within correct size */
-    if (count > 250)
-        return FLASHSAVE_OVERSIZE;
-
-    result = FlashSave_Seek(uid, &page_number, &size);
-
-    /* Check if the external flash is full */
-    if (page_number == -1)
-        return FLASHSAVE_FLASH_FULL;
-
-    if (result == false)
-    {
-        /* No previous data, save at the end of the flash memory.
-           Just in case erase the page. */
-        ExternalFlash_ErasePage(&flashcfg, page_number * FLASH_PAGE_SIZE);
-        FlashSave_WritePage(&flashcfg,
-                            page_number * FLASH_PAGE_SIZE,
-                            uid,
-                            data,
-                            count);
-    }
-    else
-    {
-        /* Previous data available */
-        if (overwrite == true)
-        {
-            /* Overwrite old data */
-            ExternalFlash_ErasePage(&flashcfg, page_number * FLASH_PAGE_SIZE);
-            FlashSave_WritePage(&flashcfg,
-                                page_number * FLASH_PAGE_SIZE,
-                                uid,
-                                data,
-                                count);
-
-            ExternalFlash_Release(&flashcfg);
-
-            return FLASHSAVE_NO_OVERWRITE;
-        }
-    }
+    status = FlashSave_WriteRecord(uid, overwrite, data, count);
 
     /* Release external flash */
     ExternalFlash_Release(&flashcfg);
 
-    return FLASHSAVE_OK;
+    /* Restore the free pages in the background */
+    if (status == FLASHSAVE_OK)
+        chEvtSignal(flashsave_thread, FLASHSAVE_GC_EVENTMASK);
+
+    return status;
 }
 
 /**
@@ -272,20 +875,20 @@ FlashSave_Status FlashSave_Write(uint32_t uid,
  *
  * @param[in] uid               UID to read from.
  * @param[in] data              Pointer to the save location of the data.
- * @param[in] requested_size    Number of bytes to write.
+ * @param[in] requested_size    Number of bytes to read.
  * @return      Returns the status of the operation.
  */
 FlashSave_Status FlashSave_Read(uint32_t uid,
                                 uint8_t *data,
-                                uint8_t requested_size)
+                                uint16_t requested_size)
 {
     int16_t page_number;
-    uint8_t size;
+    uint16_t size;
 
     /* Claim external flash */
     ExternalFlash_Claim(&flashcfg);
 
-    /* Look for the specified UID in the external memory */
+    /* Look for the specified UID in the index */
     bool result = FlashSave_Seek(uid, &page_number, &size);
 
     if (result == true)
@@ -296,7 +899,7 @@ FlashSave_Status FlashSave_Read(uint32_t uid,
             /* The requested data is available, read it */
             ExternalFlash_ReadBuffer(&flashcfg,
                                      page_number * FLASH_PAGE_SIZE +
-                                     FLASHSAVE_HEADER_OFFSET,
+                                     FLASHSAVE_RECORD_HEADER_SIZE,
                                      data,
                                      size);
 
@@ -333,6 +936,11 @@ void vFlashSave_EraseAll(void)
     /* Erase. */
     ExternalFlash_EraseBulk(&flashcfg);
 
+    /* Clear the index */
+    flashsave_index_count = 0;
+    flashsave_head = 0;
+    flashsave_sequence = 0;
+
     /* Release external flash */
     ExternalFlash_Release(&flashcfg);
 }
@@ -347,6 +955,16 @@ void vBroadcastFlashSaveEvent(void)
     chEvtBroadcastFlags(&save_to_flash_es, FLASHSAVE_SAVE_EVENTMASK);
 }
 
+/**
+ * @brief       Returns the status of the last save of the registered records.
+ *
+ * @return      FLASHSAVE_OK, or the first error of the last save.
+ */
+FlashSave_Status FlashSave_GetLastSaveStatus(void)
+{
+    return flashsave_last_status;
+}
+
 /**
  * @brief       Returns the pointer to the Flash Save event source.
  *
@@ -356,3 +974,14 @@ event_source_t *ptrGetFlashSaveEventSource(void)
 {
     return &save_to_flash_es;
 }
+
+/**
+ * @brief       Returns the pointer to the External Flash configuration, for
+ *              modules using the flash outside of the settings log.
+ *
+ * @return      Pointer to the External Flash configuration.
+ */
+const ExternalFlashConfig *ptrGetExternalFlashConfig(void)
+{
+    return &flashcfg;
+}
@@ -0,0 +1,185 @@
+#ifndef __FIR_DECIMATE_H
+#define __FIR_DECIMATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*===========================================================================*/
+/* Module global definitions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Maximum number of filter taps, must be even.
+ */
+#define FIR_DECIMATE_MAX_TAPS           32
+
+/**
+ * @brief   Maximum decimation factor.
+ */
+#define FIR_DECIMATE_MAX_FACTOR         8
+
+/**
+ * @brief   Scale from the output of FIRDecimateQ15Push to the unit of the
+ *          input samples.
+ */
+#define FIR_DECIMATE_OUTPUT_SCALE       (1.0f / 32768.0f)
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Decimating FIR filter coefficients, shared by all channels with
+ *          the same filter.
+ */
+typedef struct
+{
+    /**
+     * @brief   Taps in Q15, in the order of the samples from oldest to
+     *          newest. The taps sum to exactly 1.0 for unity DC gain.
+     */
+    int16_t taps[FIR_DECIMATE_MAX_TAPS];
+    /**
+     * @brief   Number of taps in use, even.
+     */
+    uint16_t num_taps;
+    /**
+     * @brief   One output for every factor input samples.
+     */
+    uint16_t factor;
+} fir_decimate_coeffs_t;
+
+/**
+ * @brief   Decimating FIR filter state of one channel.
+ */
+typedef struct
+{
+    /**
+     * @brief   The last num_taps - 1 samples, followed by the samples since
+     *          the last output.
+     */
+    int16_t history[FIR_DECIMATE_MAX_TAPS + FIR_DECIMATE_MAX_FACTOR];
+    /**
+     * @brief   Number of samples since the last output.
+     */
+    uint16_t count;
+} fir_decimate_state_t;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/**
+ * @brief               Dual 16 x 16 multiply-accumulate, acc + x.lo * y.lo +
+ *                      x.hi * y.hi, which is a single SMLAD on the M4.
+ *
+ * @param[in] x         Two packed Q15 values.
+ * @param[in] y         Two packed Q15 values.
+ * @param[in] acc       Accumulator.
+ * @return              The new accumulator.
+ */
+static inline int32_t smlad(const uint32_t x, const uint32_t y, int32_t acc)
+{
+#if defined(__ARM_FEATURE_DSP)
+    __asm__ ("smlad %0, %1, %2, %3" : "=r" (acc) : "r" (x), "r" (y), "r" (acc));
+    return acc;
+#else
+    return acc + (int32_t)(int16_t)x * (int16_t)y +
+                 (int32_t)(int16_t)(x >> 16) * (int16_t)(y >> 16);
+#endif
+}
+
+/**
+ * @brief               Initializes the state of a channel.
+ *
+ * @param[out] state    Channel state.
+ */
+static inline void FIRDecimateInitState(fir_decimate_state_t *state)
+{
+    memset(state->history, 0, sizeof(state->history));
+    state->count = 0;
+}
+
+/**
+ * @brief               Adds a sample to a channel and calculates the next
+ *                      output every factor samples.
+ * @details             The taps and samples are read in pairs, so the dot
+ *                      product takes num_taps / 2 SMLADs.
+ *
+ * @param[in] coeffs    Filter coefficients.
+ * @param[in/out] state Channel state.
+ * @param[in] sample    Input sample.
+ * @param[out] out      Output in input units times 2^15, written when an
+ *                      output is available.
+ * @return              True if an output was calculated.
+ */
+static inline bool FIRDecimateQ15Push(const fir_decimate_coeffs_t *coeffs,
+                                      fir_decimate_state_t *state,
+                                      const int16_t sample,
+                                      int32_t *out)
+{
+    const int16_t *x;
+    uint32_t xp, hp;
+    int32_t acc = 0;
+    int i;
+
+    state->history[coeffs->num_taps - 1 + state->count] = sample;
+
+    if (++state->count < coeffs->factor)
+        return false;
+
+    /* The newest num_taps samples, unaligned pairs are fine on the M4 */
+    x = &state->history[coeffs->factor];
+
+    for (i = 0; i < coeffs->num_taps; i += 2)
+    {
+        memcpy(&xp, &x[i], sizeof(uint32_t));
+        memcpy(&hp, &coeffs->taps[i], sizeof(uint32_t));
+        acc = smlad(xp, hp, acc);
+    }
+
+    /* Keep the samples needed for the next output */
+    memmove(state->history,
+            x,
+            (coeffs->num_taps - 1) * sizeof(int16_t));
+    state->count = 0;
+
+    *out = acc;
+
+    return true;
+}
+
+/**
+ * @brief               Rounds an output of FIRDecimateQ15Push back to the
+ *                      unit of the input samples, for a following stage.
+ *
+ * @param[in] out       Output in input units times 2^15.
+ * @return              Rounded output, saturated to 16 bits.
+ */
+static inline int16_t FIRDecimateQ15ToSample(const int32_t out)
+{
+    const int32_t x = (out + (1 << 14)) >> 15;
+
+    if (x > INT16_MAX)
+        return INT16_MAX;
+    else if (x < INT16_MIN)
+        return INT16_MIN;
+    else
+        return (int16_t)x;
+}
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+bool FIRDecimateDesignLPF(fir_decimate_coeffs_t *coeffs,
+                          uint16_t num_taps,
+                          uint16_t factor,
+                          float cutoff);
+
+#endif
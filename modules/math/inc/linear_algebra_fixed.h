@@ -0,0 +1,45 @@
+/* *
+ *
+ * C interface to the fixed-size kernels in matrix.hpp, one function per
+ * size used by the estimators. The matrices use the same row-major layout
+ * as the functions in linear_algebra.h. The operations are the same, but
+ * with -ffast-math the results may differ by a few ULP, see
+ * modules/math/test.
+ *
+ * */
+
+#ifndef __LINEAR_ALGEBRA_FIXED_H
+#define __LINEAR_ALGEBRA_FIXED_H
+
+/*===========================================================================*/
+/* Module global definitions.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+void qr_decomp_tria_6(float *a);
+void qr_decomp_tria_3(float *a);
+void chol_downdate_6(float *a, float *x);
+void u_inv_3(float *a);
+void uu_mul_6(const float *a, float *b);
+#ifdef __cplusplus
+}
+#endif
+
+#endif
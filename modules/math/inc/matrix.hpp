@@ -0,0 +1,663 @@
+/* *
+ *
+ * Fixed-size matrix, vector and quaternion templates.
+ *
+ * All dimensions are template parameters and every loop is unrolled at
+ * compile time, so each kernel is specialised to its exact size. The
+ * decompositions follow the algorithms in linear_algebra.h one to one and
+ * give the same results. Matrices are stored row-major, the same layout as
+ * the float arrays used by the C modules.
+ *
+ * */
+
+#ifndef __MATRIX_HPP
+#define __MATRIX_HPP
+
+#include <cstddef>
+#include <cmath>
+#include <type_traits>
+
+namespace kfly
+{
+
+/*===========================================================================*/
+/* Module global definitions.                                                */
+/*===========================================================================*/
+
+#define KFLY_ALWAYS_INLINE      inline __attribute__((always_inline))
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Compile-time unrolled loop, calls f(0), f(1), ..., f(N - 1) with
+ *          the index as a std::integral_constant.
+ */
+template <std::size_t N>
+struct Unroll
+{
+    template <typename F>
+    static KFLY_ALWAYS_INLINE void run(F &&f)
+    {
+        Unroll<N - 1>::run(f);
+        f(std::integral_constant<std::size_t, N - 1>());
+    }
+};
+
+template <>
+struct Unroll<0>
+{
+    template <typename F>
+    static KFLY_ALWAYS_INLINE void run(F &&)
+    {
+    }
+};
+
+/**
+ * @brief   Fixed-size row-major matrix.
+ */
+template <std::size_t R, std::size_t C>
+struct Matrix
+{
+    static_assert(R > 0 && C > 0, "Empty matrix");
+
+    static constexpr std::size_t rows = R;
+    static constexpr std::size_t cols = C;
+
+    /**
+     * @brief   Elements, row-major.
+     */
+    float data[R][C];
+
+    KFLY_ALWAYS_INLINE float &operator()(std::size_t i, std::size_t j)
+    {
+        return data[i][j];
+    }
+
+    KFLY_ALWAYS_INLINE const float &operator()(std::size_t i,
+                                               std::size_t j) const
+    {
+        return data[i][j];
+    }
+
+    KFLY_ALWAYS_INLINE float &operator[](std::size_t i)
+    {
+        static_assert(C == 1, "Element indexing needs a column vector");
+        return data[i][0];
+    }
+
+    KFLY_ALWAYS_INLINE const float &operator[](std::size_t i) const
+    {
+        static_assert(C == 1, "Element indexing needs a column vector");
+        return data[i][0];
+    }
+
+    /**
+     * @brief   Views row-major float storage from C as a matrix.
+     */
+    static KFLY_ALWAYS_INLINE Matrix &map(float *p)
+    {
+        return *reinterpret_cast<Matrix *>(p);
+    }
+
+    static KFLY_ALWAYS_INLINE const Matrix &map(const float *p)
+    {
+        return *reinterpret_cast<const Matrix *>(p);
+    }
+
+    static KFLY_ALWAYS_INLINE Matrix zeros()
+    {
+        Matrix m;
+
+        Unroll<R>::run([&](auto i) {
+            Unroll<C>::run([&](auto j) {
+                m.data[i][j] = 0.0f;
+            });
+        });
+
+        return m;
+    }
+
+    static KFLY_ALWAYS_INLINE Matrix identity()
+    {
+        static_assert(R == C, "Identity needs a square matrix");
+        Matrix m;
+
+        Unroll<R>::run([&](auto i) {
+            Unroll<C>::run([&](auto j) {
+                m.data[i][j] = (i == j) ? 1.0f : 0.0f;
+            });
+        });
+
+        return m;
+    }
+
+    KFLY_ALWAYS_INLINE Matrix<C, R> transpose() const
+    {
+        Matrix<C, R> t;
+
+        Unroll<R>::run([&](auto i) {
+            Unroll<C>::run([&](auto j) {
+                t.data[j][i] = data[i][j];
+            });
+        });
+
+        return t;
+    }
+
+    KFLY_ALWAYS_INLINE Matrix operator+(const Matrix &b) const
+    {
+        Matrix m;
+
+        Unroll<R>::run([&](auto i) {
+            Unroll<C>::run([&](auto j) {
+                m.data[i][j] = data[i][j] + b.data[i][j];
+            });
+        });
+
+        return m;
+    }
+
+    KFLY_ALWAYS_INLINE Matrix operator-(const Matrix &b) const
+    {
+        Matrix m;
+
+        Unroll<R>::run([&](auto i) {
+            Unroll<C>::run([&](auto j) {
+                m.data[i][j] = data[i][j] - b.data[i][j];
+            });
+        });
+
+        return m;
+    }
+
+    KFLY_ALWAYS_INLINE Matrix operator*(const float s) const
+    {
+        Matrix m;
+
+        Unroll<R>::run([&](auto i) {
+            Unroll<C>::run([&](auto j) {
+                m.data[i][j] = data[i][j] * s;
+            });
+        });
+
+        return m;
+    }
+
+    template <std::size_t K>
+    KFLY_ALWAYS_INLINE Matrix<R, K> operator*(const Matrix<C, K> &b) const
+    {
+        Matrix<R, K> m;
+
+        Unroll<R>::run([&](auto i) {
+            Unroll<K>::run([&](auto j) {
+                float sum = 0.0f;
+
+                Unroll<C>::run([&](auto k) {
+                    sum += data[i][k] * b.data[k][j];
+                });
+
+                m.data[i][j] = sum;
+            });
+        });
+
+        return m;
+    }
+};
+
+/**
+ * @brief   Column vectors.
+ */
+template <std::size_t N>
+using Vector = Matrix<N, 1>;
+
+using Vector3 = Vector<3>;
+
+/**
+ * @brief   Quaternion in passive Hamilton notation, same layout as
+ *          quaternion_t.
+ */
+struct Quaternion
+{
+    float w, x, y, z;
+
+    static KFLY_ALWAYS_INLINE Quaternion unit()
+    {
+        return Quaternion{1.0f, 0.0f, 0.0f, 0.0f};
+    }
+
+    KFLY_ALWAYS_INLINE Quaternion operator*(const Quaternion &r) const
+    {
+        return Quaternion{w * r.w - x * r.x - y * r.y - z * r.z,
+                          w * r.x + x * r.w + y * r.z - z * r.y,
+                          w * r.y - x * r.z + y * r.w + z * r.x,
+                          w * r.z + x * r.y - y * r.x + z * r.w};
+    }
+
+    KFLY_ALWAYS_INLINE Quaternion conjugate() const
+    {
+        return Quaternion{w, -x, -y, -z};
+    }
+
+    KFLY_ALWAYS_INLINE float norm() const
+    {
+        return std::sqrt(w * w + x * x + y * y + z * z);
+    }
+
+    KFLY_ALWAYS_INLINE Quaternion normalized() const
+    {
+        const float inv = 1.0f / norm();
+
+        return Quaternion{w * inv, x * inv, y * inv, z * inv};
+    }
+
+    /**
+     * @brief   Rotation matrix of the quaternion, as q2dcm in quaternion.h.
+     */
+    KFLY_ALWAYS_INLINE Matrix<3, 3> dcm() const
+    {
+        Matrix<3, 3> R;
+        const float wsq = w * w;
+        const float xsq = x * x;
+        const float ysq = y * y;
+        const float zsq = z * z;
+
+        R(0, 0) = wsq + xsq - ysq - zsq;
+        R(0, 1) = 2.0f * (x * y - w * z);
+        R(0, 2) = 2.0f * (x * z + w * y);
+
+        R(1, 0) = 2.0f * (x * y + w * z);
+        R(1, 1) = wsq - xsq + ysq - zsq;
+        R(1, 2) = 2.0f * (y * z - w * x);
+
+        R(2, 0) = 2.0f * (x * z - w * y);
+        R(2, 1) = 2.0f * (y * z + w * x);
+        R(2, 2) = wsq - xsq - ysq + zsq;
+
+        return R;
+    }
+
+    /**
+     * @brief   Rotates a vector, as qrotvector in quaternion.h.
+     */
+    KFLY_ALWAYS_INLINE Vector3 rotate(const Vector3 &v) const
+    {
+        return dcm() * v;
+    }
+};
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+template <std::size_t N>
+KFLY_ALWAYS_INLINE float dot(const Vector<N> &a, const Vector<N> &b)
+{
+    float sum = 0.0f;
+
+    Unroll<N>::run([&](auto i) {
+        sum += a[i] * b[i];
+    });
+
+    return sum;
+}
+
+KFLY_ALWAYS_INLINE Vector3 cross(const Vector3 &a, const Vector3 &b)
+{
+    Vector3 c;
+
+    c[0] = a[1] * b[2] - a[2] * b[1];
+    c[1] = a[2] * b[0] - a[0] * b[2];
+    c[2] = a[0] * b[1] - a[1] * b[0];
+
+    return c;
+}
+
+template <std::size_t N>
+KFLY_ALWAYS_INLINE float norm(const Vector<N> &a)
+{
+    return std::sqrt(dot(a, a));
+}
+
+/**
+ * @brief               Solves L * X = B using forward substitution, as
+ *                      fwd_sub in linear_algebra.h.
+ *
+ * @param[in] a         Lower triangular matrix L.
+ * @param[in/out] b     Right hand side B, replaced by X.
+ */
+template <std::size_t M, std::size_t N>
+KFLY_ALWAYS_INLINE void fwd_sub(const Matrix<M, M> &a, Matrix<M, N> &b)
+{
+    Unroll<N>::run([&](auto i) {
+        Unroll<M>::run([&](auto j) {
+            float sum = b(j, i);
+
+            Unroll<M>::run([&](auto k) {
+                if (k < j)
+                    sum -= a(j, k) * b(k, i);
+            });
+
+            b(j, i) = sum / a(j, j);
+        });
+    });
+}
+
+/**
+ * @brief               Solves U * X = B using backward substitution, as
+ *                      bck_sub in linear_algebra.h.
+ *
+ * @param[in] a         Upper triangular matrix U.
+ * @param[in/out] b     Right hand side B, replaced by X.
+ */
+template <std::size_t M, std::size_t N>
+KFLY_ALWAYS_INLINE void bck_sub(const Matrix<M, M> &a, Matrix<M, N> &b)
+{
+    Unroll<N>::run([&](auto i) {
+        Unroll<M>::run([&](auto jj) {
+            const std::size_t j = M - 1 - jj;
+            float sum = b(j, i);
+
+            Unroll<M>::run([&](auto k) {
+                if (k > j)
+                    sum -= a(j, k) * b(k, i);
+            });
+
+            b(j, i) = sum / a(j, j);
+        });
+    });
+}
+
+/**
+ * @brief               Householder QR decomposition of tall matrices, as
+ *                      qr_decomp in linear_algebra.h.
+ *
+ * @param[in/out] a     Input matrix, R is returned in the top of the matrix.
+ */
+template <std::size_t M, std::size_t N>
+KFLY_ALWAYS_INLINE void qr_decomp(Matrix<M, N> &a)
+{
+    static_assert(M >= N, "QR needs a tall matrix");
+
+    Unroll<N>::run([&](auto k) {
+        float sum = 0.0f;
+
+        Unroll<M>::run([&](auto j) {
+            if (j >= k)
+                sum += a(j, k) * a(j, k);
+        });
+
+        const float norm = std::sqrt(sum);
+        const float sigma = (a(k, k) >= 0.0f) ? norm : -norm;
+        const float u1 = a(k, k) + sigma;
+
+        Unroll<M>::run([&](auto j) {
+            if (j > k)
+                a(j, k) /= u1;
+        });
+
+        a(k, k) = -sigma;
+        const float tau = u1 / sigma;
+
+        Unroll<N>::run([&](auto j) {
+            if (j > k)
+            {
+                float s = a(k, j);
+
+                Unroll<M>::run([&](auto i) {
+                    if (i > k)
+                        s += a(i, k) * a(i, j);
+                });
+
+                a(k, j) -= tau * s;
+
+                Unroll<M>::run([&](auto i) {
+                    if (i > k)
+                        a(i, j) -= tau * s * a(i, k);
+                });
+            }
+        });
+    });
+}
+
+/**
+ * @brief               QR decomposition of a 2N x N matrix whose last N rows
+ *                      are triangular, as qr_decomp_tria in linear_algebra.h.
+ *
+ * @param[in/out] a     Input matrix, R is returned in the top of the matrix.
+ */
+template <std::size_t M, std::size_t N>
+KFLY_ALWAYS_INLINE void qr_decomp_tria(Matrix<M, N> &a)
+{
+    static_assert(M == 2 * N, "QR of stacked triangular needs 2N x N");
+
+    Unroll<N>::run([&](auto k) {
+        float sum = 0.0f;
+
+        Unroll<M>::run([&](auto j) {
+            if ((j >= k) && (j < k + N + 1))
+                sum += a(j, k) * a(j, k);
+        });
+
+        const float norm = std::sqrt(sum);
+        const float sigma = (a(k, k) >= 0.0f) ? norm : -norm;
+        const float u1 = a(k, k) + sigma;
+        const float u2 = 1.0f / u1;
+
+        Unroll<M>::run([&](auto j) {
+            if ((j > k) && (j < k + N + 1))
+                a(j, k) *= u2;
+        });
+
+        a(k, k) = -sigma;
+        const float tau = u1 / sigma;
+
+        Unroll<N>::run([&](auto j) {
+            if (j > k)
+            {
+                float s = a(k, j);
+
+                Unroll<M>::run([&](auto i) {
+                    if ((i > k) && (i < k + N + 1))
+                        s += a(i, k) * a(i, j);
+                });
+
+                a(k, j) -= tau * s;
+
+                Unroll<M>::run([&](auto i) {
+                    if ((i > k) && (i < k + N + 1))
+                        a(i, j) -= tau * s * a(i, k);
+                });
+            }
+        });
+    });
+}
+
+/**
+ * @brief               Cholesky decomposition, L in the bottom of the matrix
+ *                      so that L * L' = A, as chol_decomp_lower in
+ *                      linear_algebra.h.
+ *
+ * @param[in/out] a     Input/output matrix.
+ */
+template <std::size_t N>
+KFLY_ALWAYS_INLINE void chol_decomp_lower(Matrix<N, N> &a)
+{
+    Unroll<N>::run([&](auto j) {
+        float sum = a(j, j);
+
+        Unroll<N>::run([&](auto k) {
+            if (k < j)
+                sum -= a(j, k) * a(j, k);
+        });
+
+        a(j, j) = std::sqrt(sum);
+
+        Unroll<N>::run([&](auto i) {
+            if (i > j)
+            {
+                float s = a(i, j);
+
+                Unroll<N>::run([&](auto k) {
+                    if (k < j)
+                        s -= a(i, k) * a(j, k);
+                });
+
+                a(i, j) = s / a(j, j);
+            }
+        });
+    });
+}
+
+/**
+ * @brief               Cholesky decomposition, U in the top of the matrix so
+ *                      that U' * U = A, as chol_decomp_upper in
+ *                      linear_algebra.h.
+ *
+ * @param[in/out] a     Input/output matrix.
+ */
+template <std::size_t N>
+KFLY_ALWAYS_INLINE void chol_decomp_upper(Matrix<N, N> &a)
+{
+    Unroll<N>::run([&](auto j) {
+        float sum = a(j, j);
+
+        Unroll<N>::run([&](auto k) {
+            if (k < j)
+                sum -= a(k, j) * a(k, j);
+        });
+
+        a(j, j) = std::sqrt(sum);
+
+        Unroll<N>::run([&](auto i) {
+            if (i > j)
+            {
+                float s = a(j, i);
+
+                Unroll<N>::run([&](auto k) {
+                    if (k < j)
+                        s -= a(k, i) * a(k, j);
+                });
+
+                a(j, i) = s / a(j, j);
+            }
+        });
+    });
+}
+
+/**
+ * @brief               Rank one update or downdate of an upper triangular
+ *                      Cholesky factor, A +- x * x', as chol_update and
+ *                      chol_downdate in linear_algebra.h.
+ *
+ * @param[in/out] a     Upper triangular factor.
+ * @param[in/out] x     Update vector, destroyed.
+ * @param[in] sign      1 for an update, -1 for a downdate.
+ */
+template <std::size_t N>
+KFLY_ALWAYS_INLINE void chol_rank1(Matrix<N, N> &a,
+                                   float *x,
+                                   const float sign)
+{
+    Unroll<N - 1>::run([&](auto i) {
+        float tmp = a(i, i);
+        const float r = std::sqrt(tmp * tmp + sign * x[i] * x[i]);
+        tmp = 1.0f / tmp;
+        const float c = r * tmp;
+        const float cinv = 1.0f / c;
+        const float s = x[i] * tmp;
+
+        a(i, i) = r;
+
+        Unroll<N>::run([&](auto j) {
+            if (j > i)
+            {
+                a(i, j) = (a(i, j) + sign * s * x[j]) * cinv;
+                x[j] = c * x[j] - s * a(i, j);
+            }
+        });
+    });
+
+    const float tmp = a(N - 1, N - 1);
+    a(N - 1, N - 1) = std::sqrt(tmp * tmp + sign * x[N - 1] * x[N - 1]);
+}
+
+template <std::size_t N>
+KFLY_ALWAYS_INLINE void chol_update(Matrix<N, N> &a, float *x)
+{
+    chol_rank1(a, x, 1.0f);
+}
+
+template <std::size_t N>
+KFLY_ALWAYS_INLINE void chol_downdate(Matrix<N, N> &a, float *x)
+{
+    chol_rank1(a, x, -1.0f);
+}
+
+/**
+ * @brief               Inverts an upper triangular matrix in place, as u_inv
+ *                      in linear_algebra.h.
+ *
+ * @param[in/out] a     Input/output matrix.
+ */
+template <std::size_t N>
+KFLY_ALWAYS_INLINE void u_inv(Matrix<N, N> &a)
+{
+    Unroll<N>::run([&](auto j) {
+        a(j, j) = 1.0f / a(j, j);
+    });
+
+    Unroll<N>::run([&](auto jj) {
+        const std::size_t j = N - 1 - jj;
+
+        Unroll<N>::run([&](auto ii) {
+            const std::size_t i = N - 1 - ii;
+
+            if (i < j)
+            {
+                float sum = 0.0f;
+
+                Unroll<N>::run([&](auto kk) {
+                    const std::size_t k = N - 1 - kk;
+
+                    if ((k <= j) && (k > i))
+                        sum -= a(i, k) * a(k, j);
+                });
+
+                a(i, j) = sum * a(i, i);
+            }
+        });
+    });
+}
+
+/**
+ * @brief               Multiplies two upper triangular matrices, B = A * B,
+ *                      as uu_mul in linear_algebra.h.
+ *
+ * @param[in] a         Upper triangular matrix A.
+ * @param[in/out] b     Upper triangular matrix B, replaced by the product.
+ */
+template <std::size_t N>
+KFLY_ALWAYS_INLINE void uu_mul(const Matrix<N, N> &a, Matrix<N, N> &b)
+{
+    Unroll<N>::run([&](auto i) {
+        Unroll<N>::run([&](auto j) {
+            if (j >= i)
+            {
+                float sum = 0.0f;
+
+                Unroll<N>::run([&](auto k) {
+                    if ((k >= i) && (k <= j))
+                        sum += a(i, k) * b(k, j);
+                });
+
+                b(i, j) = sum;
+            }
+        });
+    });
+}
+
+} /* namespace kfly */
+
+#endif
@@ -13,6 +13,7 @@
 
 #include <math.h>
 #include "vector3.h"
+#include "trigonometry.h"
 
 /*===========================================================================*/
 /* Module global definitions.                                                */
@@ -250,6 +251,7 @@ static inline quaternion_t qint(const quaternion_t q_curr,
                                 const float dt)
 {
     quaternion_t q_step;
+    float s;
 
     const vector3f_t dtheta = vector_scale(omega, 0.5f * dt);
     const float dtheta_norm = vector_norm(dtheta);
@@ -262,10 +264,10 @@ static inline quaternion_t qint(const quaternion_t q_curr,
         /* Integration according to Section 1.8.1 in
          * "Quaternion kinematics for the error-state KF" by Joan Sloá. */
 
-        q_step.w = cosf(dtheta_norm);
+        fast_sincos(dtheta_norm, &s, &q_step.w, FASTMATH_TIER_HIGH);
 
         *((vector3f_t *)&q_step.x) = /* Cast to vector to suppress error. */
-            vector_scale(dtheta, sinf(dtheta_norm) / dtheta_norm);
+            vector_scale(dtheta, s / dtheta_norm);
 
         return qmult(q_curr, q_step);
     }
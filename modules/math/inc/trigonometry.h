@@ -2,6 +2,7 @@
 #define __TRIGONOMETRY_H
 
 #include <math.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /*===========================================================================*/
@@ -9,10 +10,79 @@
 /*===========================================================================*/
 #define PI ( 3.14159265359f )
 
+/**
+ * @brief   pi/2 and ln(2) split in a high part with trailing zero bits and a
+ *          low part, k * HI is exact for |k| < 2^15 which keeps the argument
+ *          reduction of the fast_* functions accurate.
+ */
+#define FASTMATH_PIO2_HI    ( 1.5703125f )
+#define FASTMATH_PIO2_LO    ( 4.83826794897e-4f )
+#define FASTMATH_LN2_HI     ( 0.693145751953125f )
+#define FASTMATH_LN2_LO     ( 1.42860676533e-6f )
+
+/**
+ * @brief   Forces a float through a register, which keeps -ffast-math from
+ *          merging the two steps of the argument reduction back into one
+ *          multiplication with the rounded constant.
+ */
+#if defined(__arm__)
+#define FASTMATH_BARRIER(x)     __asm__ ("" : "+t" (x))
+#else
+#define FASTMATH_BARRIER(x)     __asm__ ("" : "+g" (x))
+#endif
+
 /*===========================================================================*/
 /* Module data structures and types.                                         */
 /*===========================================================================*/
 
+/**
+ * @brief   Accuracy tiers of the fast_* approximations. The tier is meant to
+ *          be a compile time constant, the unused tiers are then removed when
+ *          the function is inlined.
+ * @details Maximum errors from an exhaustive sweep of all float inputs in the
+ *          domain against double precision libm, with this header compiled
+ *          as the firmware (-O1 -ffast-math), fast_atan2 is swept on its
+ *          [0, 1] core and checked on random points in all quadrants. The
+ *          sweep and a benchmark are in modules/math/test/trigonometry_test.c,
+ *          run with make sweep.
+ *          Absolute errors in radians for the trigonometric functions and
+ *          relative errors for fast_invsqrt and fast_exp. The number of float
+ *          multiply-adds is in parenthesis, not counting the argument
+ *          reduction, the division of fast_atan2 and the square root of
+ *          fast_asin for |x| > 0.5.
+ *
+ *          Function      Domain          LOW          MEDIUM       HIGH
+ *          fast_sincos   |x| < 1e3       3.0e-4 (4)   1.2e-6 (6)   9.5e-8 (8)
+ *          fast_atan2    all             6.1e-4 (3)   1.2e-5 (5)   3.1e-7 (8)
+ *          fast_asin     [-1, 1]         7.5e-4 (2)   1.7e-6 (4)   1.6e-7 (6)
+ *          fast_invsqrt  [1e-37, 1e37]   1.8e-3 (5)   4.7e-6 (9)   2.7e-7 (*)
+ *          fast_exp      [-87, 88]       7.5e-5 (3)   2.7e-6 (4)   1.1e-7 (6)
+ *
+ *          (*) One square root and one division on the FPU.
+ *
+ *          The sine of fast_sincos also has these errors relative to the
+ *          angle for |x| < pi/4, 3.9e-4, 1.5e-6 and 9.4e-8. The older
+ *          fast_sin and fast_cos have an absolute error of 1.1e-3 and a
+ *          relative error of 1.3 % for small angles, fastatan2 has an error
+ *          of 7.1e-2 and fastexp a relative error of 6.9e-5.
+ */
+typedef enum
+{
+    /**
+     * @brief   About 1e-3, for signals that are noisier than that anyway.
+     */
+    FASTMATH_TIER_LOW = 0,
+    /**
+     * @brief   About 1e-5, below the noise of the attitude estimate.
+     */
+    FASTMATH_TIER_MEDIUM,
+    /**
+     * @brief   Within a few float ULP, for values that are integrated or used
+     *          once.
+     */
+    FASTMATH_TIER_HIGH
+} fastmath_tier_t;
+
 /*===========================================================================*/
 /* Module macros.                                                            */
 /*===========================================================================*/
@@ -158,6 +228,238 @@ static inline float fast_cos(float x)
     return y;
 }
 
+/*
+ * @brief               Sine and cosine of the same angle.
+ * @details             The angle is reduced to r in [-pi/4, pi/4] and
+ *                      quadrant k, sin(r) is approximated as r * P(r^2) and
+ *                      cos(r) as Q(r^2) with minimax polynomials. The sine
+ *                      keeps its relative accuracy for small angles.
+ *
+ * @param[in] x         Angle in radians, |x| < 1e3.
+ * @param[out] s        Sine of the angle.
+ * @param[out] c        Cosine of the angle.
+ * @param[in] tier      Accuracy tier.
+ */
+static inline void fast_sincos(const float x,
+                               float *s,
+                               float *c,
+                               const fastmath_tier_t tier)
+{
+    const int32_t k = (int32_t)(x * (2.0f / PI) + (x < 0.0f ? -0.5f : 0.5f));
+    float r, u, sr, cr;
+
+    r = x - (float)k * FASTMATH_PIO2_HI;
+    FASTMATH_BARRIER(r);
+    r = r - (float)k * FASTMATH_PIO2_LO;
+    u = r * r;
+
+    if (tier == FASTMATH_TIER_LOW)
+    {
+        sr = r * (9.996122718e-01f + u * -1.616010964e-01f);
+        cr = 9.999900460e-01f + u * (-4.997081459e-01f +
+                                     u * 4.039853439e-02f);
+    }
+    else if (tier == FASTMATH_TIER_MEDIUM)
+    {
+        sr = r * (9.999985695e-01f + u * (-1.666247994e-01f +
+                                          u * 8.151635528e-03f));
+        cr = 1.0f + u * (-4.999985695e-01f + u * (4.165502638e-02f +
+                                                  u * -1.358590904e-03f));
+    }
+    else
+    {
+        sr = r * (1.0f + u * (-1.666665077e-01f + u * (8.332036436e-03f +
+                                                     u * -1.950402220e-04f)));
+        cr = 1.0f + u * (-5.0e-01f + u * (4.166661575e-02f +
+                                          u * (-1.388661913e-03f +
+                                               u * 2.437992953e-05f)));
+    }
+
+    switch (k & 3)
+    {
+        case 0:
+            *s = sr;
+            *c = cr;
+            break;
+
+        case 1:
+            *s = cr;
+            *c = -sr;
+            break;
+
+        case 2:
+            *s = -sr;
+            *c = -cr;
+            break;
+
+        default:
+            *s = -cr;
+            *c = sr;
+            break;
+    }
+}
+
+/*
+ * @brief               Four quadrant arctangent of y/x.
+ * @details             atan(a) is approximated as a * P(a^2) on a in [0, 1],
+ *                      with a = min(|x|, |y|) / max(|x|, |y|), and the octant
+ *                      is restored from the signs and magnitudes.
+ *
+ * @param[in] y         Y coordinate.
+ * @param[in] x         X coordinate.
+ * @param[in] tier      Accuracy tier.
+ * @return              The angle in [-pi, pi], 0 if x and y are both zero.
+ */
+static inline float fast_atan2(const float y,
+                               const float x,
+                               const fastmath_tier_t tier)
+{
+    const float abs_x = fabsf(x);
+    const float abs_y = fabsf(y);
+    float a, u, angle;
+
+    if (abs_y > abs_x)
+        a = abs_x / abs_y;
+    else if (abs_x > 0.0f)
+        a = abs_y / abs_x;
+    else
+        return 0.0f;
+
+    u = a * a;
+
+    if (tier == FASTMATH_TIER_LOW)
+        angle = a * (9.953579307e-01f + u * (-2.886902392e-01f +
+                                             u * 7.933904231e-02f));
+    else if (tier == FASTMATH_TIER_MEDIUM)
+        angle = a * (9.998663068e-01f + u * (-3.303047717e-01f +
+                     u * (1.801593006e-01f + u * (-8.515635133e-02f +
+                     u * 2.084511332e-02f))));
+    else
+        angle = a * (9.999993443e-01f + u * (-3.332985938e-01f +
+                     u * (1.994656622e-01f + u * (-1.390862912e-01f +
+                     u * (9.642197192e-02f + u * (-5.591232702e-02f +
+                     u * (2.186295763e-02f + u * -4.054566845e-03f)))))));
+
+    if (abs_y > abs_x)
+        angle = 0.5f * PI - angle;
+
+    if (x < 0.0f)
+        angle = PI - angle;
+
+    return (y < 0.0f) ? -angle : angle;
+}
+
+/*
+ * @brief               Arcsine.
+ * @details             asin(x) is approximated as x * P(x^2) for |x| <= 0.5,
+ *                      and as pi/2 - 2 * asin(sqrt((1 - |x|) / 2)) above,
+ *                      which doubles the error of P close to +/-1.
+ *
+ * @param[in] x         Input value, saturated to [-1, 1].
+ * @param[in] tier      Accuracy tier.
+ * @return              The angle in [-pi/2, pi/2].
+ */
+static inline float fast_asin(const float x, const fastmath_tier_t tier)
+{
+    const float abs_x = fabsf(x);
+    float a, u, angle;
+
+    if (abs_x >= 1.0f)
+        return (x < 0.0f) ? -0.5f * PI : 0.5f * PI;
+    else if (abs_x > 0.5f)
+    {
+        u = 0.5f * (1.0f - abs_x);
+        a = sqrtf(u);
+    }
+    else
+    {
+        u = abs_x * abs_x;
+        a = abs_x;
+    }
+
+    if (tier == FASTMATH_TIER_LOW)
+        angle = a * (9.992495775e-01f + u * 1.887902021e-01f);
+    else if (tier == FASTMATH_TIER_MEDIUM)
+        angle = a * (9.999984503e-01f + u * (1.668547839e-01f +
+                     u * (7.145656645e-02f + u * 6.514055282e-02f)));
+    else
+        angle = a * (1.0f + u * (1.666679233e-01f + u * (7.494367659e-02f +
+                     u * (4.555769265e-02f + u * (2.382393740e-02f +
+                     u * 4.269030318e-02f)))));
+
+    if (abs_x > 0.5f)
+        angle = 0.5f * PI - 2.0f * angle;
+
+    return (x < 0.0f) ? -angle : angle;
+}
+
+/*
+ * @brief               Inverse square root.
+ * @details             The low and medium tiers are the exponent halving
+ *                      initial guess followed by one or two Newton steps, the
+ *                      high tier uses the FPU square root and division.
+ *
+ * @param[in] x         Input value in [1e-37, 1e37].
+ * @param[in] tier      Accuracy tier.
+ * @return              1 / sqrt(x).
+ */
+static inline float fast_invsqrt(const float x, const fastmath_tier_t tier)
+{
+    union { uint32_t i; float f; } v;
+    const float half_x = 0.5f * x;
+
+    if (tier == FASTMATH_TIER_HIGH)
+        return 1.0f / sqrtf(x);
+
+    v.f = x;
+    v.i = 0x5f3759df - (v.i >> 1);
+    v.f = v.f * (1.5f - half_x * v.f * v.f);
+
+    if (tier == FASTMATH_TIER_MEDIUM)
+        v.f = v.f * (1.5f - half_x * v.f * v.f);
+
+    return v.f;
+}
+
+/*
+ * @brief               Exponential function.
+ * @details             x is reduced to r in [-ln(2)/2, ln(2)/2] and k with
+ *                      x = k * ln(2) + r, e^r is approximated with a minimax
+ *                      polynomial and scaled by 2^k through the exponent bits.
+ *
+ * @param[in] x         Input value, saturated to [-87, 88].
+ * @param[in] tier      Accuracy tier.
+ * @return              e^x.
+ */
+static inline float fast_exp(float x, const fastmath_tier_t tier)
+{
+    union { uint32_t i; float f; } v;
+    int32_t k;
+    float r, p;
+
+    x = bound(88.0f, -87.0f, x);
+
+    k = (int32_t)(x * 1.442695041f + (x < 0.0f ? -0.5f : 0.5f));
+    r = x - (float)k * FASTMATH_LN2_HI;
+    FASTMATH_BARRIER(r);
+    r = r - (float)k * FASTMATH_LN2_LO;
+
+    if (tier == FASTMATH_TIER_LOW)
+        p = 9.999280572e-01f + r * (1.000164151e+00f + r * (5.049632788e-01f +
+                                    r * 1.656684279e-01f));
+    else if (tier == FASTMATH_TIER_MEDIUM)
+        p = 9.999992847e-01f + r * (9.999634027e-01f + r * (5.000435710e-01f +
+            r * (1.679090708e-01f + r * 4.145860672e-02f)));
+    else
+        p = 1.0f + r * (1.0f + r * (4.999999106e-01f + r * (1.666641980e-01f +
+            r * (4.166822508e-02f + r * (8.374815807e-03f +
+            r * 1.383684576e-03f)))));
+
+    v.i = (uint32_t)(k + 127) << 23;
+
+    return p * v.f;
+}
+
 /*
  * @brief               Evaluation of a polynomial using Horner's Rule.
  * @details             Given coeffs = [b0 b1 ... bN] the polynomial's
@@ -1,6 +1,9 @@
 # List of all the module's related files.
 MATH_SRCS = $(MODULE_DIR)/math/src/quaternion.c \
+						$(MODULE_DIR)/math/src/fir_decimate.c \
 						$(MODULE_DIR)/math/src/biquad.c
 
+MATH_CPPSRCS = $(MODULE_DIR)/math/src/linear_algebra_fixed.cpp
+
 # Required include directories
 MATH_INC = $(MODULE_DIR)/math/inc
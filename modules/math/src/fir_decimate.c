@@ -0,0 +1,98 @@
+
+/* *
+ *
+ * Design of the decimating FIR filters, the filtering itself is inline in
+ * fir_decimate.h.
+ *
+ * */
+
+#include <math.h>
+#include "fir_decimate.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief               Designs a linear phase low-pass decimation filter, a
+ *                      Hamming windowed sinc quantized to Q15.
+ * @details             The sinc has num_taps - 1 taps, which is odd to give a
+ *                      delay of (num_taps - 2) / 2 whole samples, and the last
+ *                      tap is zero. The quantization error of the DC gain is
+ *                      moved to the center tap.
+ *
+ * @param[out] coeffs   Coefficients to design.
+ * @param[in] num_taps  Number of taps, even and at least 4 and factor.
+ * @param[in] factor    Decimation factor, at least 2.
+ * @param[in] cutoff    Cutoff frequency relative to the input sampling
+ *                      frequency, in (0, 0.5 / factor).
+ * @return              False if the parameters are out of range.
+ */
+bool FIRDecimateDesignLPF(fir_decimate_coeffs_t *coeffs,
+                          uint16_t num_taps,
+                          uint16_t factor,
+                          float cutoff)
+{
+    float h[FIR_DECIMATE_MAX_TAPS];
+    float sum, t;
+    int32_t isum;
+    int i, n, center;
+
+    if ((num_taps > FIR_DECIMATE_MAX_TAPS) || ((num_taps & 1) != 0) ||
+        (num_taps < 4) || (num_taps < factor) || (factor < 2) ||
+        (factor > FIR_DECIMATE_MAX_FACTOR) ||
+        (cutoff <= 0.0f) || (cutoff >= 0.5f / (float)factor))
+        return false;
+
+    n = num_taps - 1;
+    center = (n - 1) / 2;
+    sum = 0.0f;
+
+    for (i = 0; i < n; i++)
+    {
+        t = (float)(i - center);
+
+        if (i == center)
+            h[i] = 2.0f * cutoff;
+        else
+            h[i] = sinf(2.0f * M_PI * cutoff * t) / (M_PI * t);
+
+        h[i] *= 0.54f - 0.46f * cosf(2.0f * M_PI * (float)i / (float)(n - 1));
+        sum += h[i];
+    }
+
+    isum = 0;
+
+    for (i = 0; i < n; i++)
+    {
+        coeffs->taps[i] = (int16_t)lrintf(32768.0f * h[i] / sum);
+        isum += coeffs->taps[i];
+    }
+
+    coeffs->taps[center] += (int16_t)(32768 - isum);
+    coeffs->taps[n] = 0;
+
+    for (i = num_taps; i < FIR_DECIMATE_MAX_TAPS; i++)
+        coeffs->taps[i] = 0;
+
+    coeffs->num_taps = num_taps;
+    coeffs->factor = factor;
+
+    return true;
+}
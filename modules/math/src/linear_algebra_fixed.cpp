@@ -0,0 +1,74 @@
+/* *
+ *
+ * C interface to the fixed-size kernels in matrix.hpp.
+ *
+ * */
+
+#include <type_traits>
+#include "matrix.hpp"
+#include "linear_algebra_fixed.h"
+
+using namespace kfly;
+
+static_assert(std::is_standard_layout<Matrix<12, 6>>::value &&
+              sizeof(Matrix<12, 6>) == 12 * 6 * sizeof(float),
+              "Matrix must have the layout of a float array");
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief               QR decomposition of a 12x6 matrix whose last 6 rows
+ *                      are triangular.
+ *
+ * @param[in/out] a     Input/output matrix, a points to the first element.
+ */
+void qr_decomp_tria_6(float *a)
+{
+    qr_decomp_tria(Matrix<12, 6>::map(a));
+}
+
+/**
+ * @brief               QR decomposition of a 6x3 matrix whose last 3 rows
+ *                      are triangular.
+ *
+ * @param[in/out] a     Input/output matrix, a points to the first element.
+ */
+void qr_decomp_tria_3(float *a)
+{
+    qr_decomp_tria(Matrix<6, 3>::map(a));
+}
+
+/**
+ * @brief               Downdates a 6x6 upper triangular Cholesky factor with
+ *                      the vector x.
+ *
+ * @param[in/out] a     Input/output matrix, a points to the first element.
+ * @param[in/out] x     Downdate vector, destroyed.
+ */
+void chol_downdate_6(float *a, float *x)
+{
+    chol_downdate(Matrix<6, 6>::map(a), x);
+}
+
+/**
+ * @brief               Inverts a 3x3 upper triangular matrix.
+ *
+ * @param[in/out] a     Input/output matrix, a points to the first element.
+ */
+void u_inv_3(float *a)
+{
+    u_inv(Matrix<3, 3>::map(a));
+}
+
+/**
+ * @brief               Multiplies two 6x6 upper triangular matrices, b = a * b.
+ *
+ * @param[in] a         Input matrix, a points to the first element.
+ * @param[in/out] b     Input/output matrix, b points to the first element.
+ */
+void uu_mul_6(const float *a, float *b)
+{
+    uu_mul(Matrix<6, 6>::map(a), Matrix<6, 6>::map(b));
+}
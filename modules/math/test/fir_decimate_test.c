@@ -0,0 +1,418 @@
+/* *
+ *
+ * Host harness of the Q15 decimating front-end in fir_decimate.h, with the
+ * two stages of the SPI IMU configuration: 8 kHz to 1 kHz with 32 taps and
+ * a 250 Hz cutoff, then 1 kHz to 200 Hz with 24 taps and an 80 Hz cutoff.
+ *
+ * The noise floor of the Q15 chain is compared with the same filters in
+ * float and double, and with the float path without the front-end, which
+ * samples at 200 Hz directly. The cost is compared with the float filters
+ * per input sample and channel.
+ *
+ * */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fir_decimate.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+#define TEST_RATE_HZ            8000.0
+#define TEST_SAMPLES            400000
+#define BENCH_REPEATS           20
+
+#define STAGE1_TAPS             32
+#define STAGE1_FACTOR           8
+#define STAGE1_CUTOFF_HZ        250.0f
+#define STAGE2_TAPS             24
+#define STAGE2_FACTOR           5
+#define STAGE2_CUTOFF_HZ        80.0f
+
+/* Total decimation of the chain */
+#define TEST_FACTOR             (STAGE1_FACTOR * STAGE2_FACTOR)
+
+/* White sensor noise in LSB rms, about the gyro of the MPU-6000 */
+#define TEST_SENSOR_NOISE       2.0
+
+/* Largest allowed arithmetic error of the Q15 chain in LSB rms, about the
+   rounding of the first stage output to 16 bits through the second stage */
+#define TEST_MAX_Q15_ERROR      0.2
+
+/* Least attenuation of tones aliasing into the output band, in dB */
+#define TEST_MIN_STOPBAND_DB    40.0
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Double FIR decimator with the taps of the Q15 filter, the
+ *          reference.
+ */
+typedef struct
+{
+    double taps[FIR_DECIMATE_MAX_TAPS];
+    double history[FIR_DECIMATE_MAX_TAPS + FIR_DECIMATE_MAX_FACTOR];
+    int num_taps;
+    int factor;
+    int count;
+} reference_fir_t;
+
+/**
+ * @brief   Float FIR decimator with the taps of the Q15 filter.
+ */
+typedef struct
+{
+    float taps[FIR_DECIMATE_MAX_TAPS];
+    float history[FIR_DECIMATE_MAX_TAPS + FIR_DECIMATE_MAX_FACTOR];
+    int num_taps;
+    int factor;
+    int count;
+} float_fir_t;
+
+static fir_decimate_coeffs_t stage1, stage2;
+static int16_t input[TEST_SAMPLES];
+static int failures;
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief               Normal distributed random number.
+ */
+static double Gauss(void)
+{
+    const double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    const double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/**
+ * @brief               Monotonic time in seconds.
+ */
+static double Now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static void ReferenceInit(reference_fir_t *f, const fir_decimate_coeffs_t *c)
+{
+    int i;
+
+    memset(f, 0, sizeof(reference_fir_t));
+
+    for (i = 0; i < c->num_taps; i++)
+        f->taps[i] = (double)c->taps[i] / 32768.0;
+
+    f->num_taps = c->num_taps;
+    f->factor = c->factor;
+}
+
+static bool ReferencePush(reference_fir_t *f, double x, double *out)
+{
+    double acc = 0.0;
+    int i;
+
+    f->history[f->num_taps - 1 + f->count] = x;
+
+    if (++f->count < f->factor)
+        return false;
+
+    for (i = 0; i < f->num_taps; i++)
+        acc += f->taps[i] * f->history[f->factor + i];
+
+    memmove(f->history, &f->history[f->factor],
+            (f->num_taps - 1) * sizeof(double));
+    f->count = 0;
+    *out = acc;
+
+    return true;
+}
+
+static void FloatInit(float_fir_t *f, const fir_decimate_coeffs_t *c)
+{
+    int i;
+
+    memset(f, 0, sizeof(float_fir_t));
+
+    for (i = 0; i < c->num_taps; i++)
+        f->taps[i] = (float)c->taps[i] / 32768.0f;
+
+    f->num_taps = c->num_taps;
+    f->factor = c->factor;
+}
+
+static bool FloatPush(float_fir_t *f, float x, float *out)
+{
+    float acc = 0.0f;
+    int i;
+
+    f->history[f->num_taps - 1 + f->count] = x;
+
+    if (++f->count < f->factor)
+        return false;
+
+    for (i = 0; i < f->num_taps; i++)
+        acc += f->taps[i] * f->history[f->factor + i];
+
+    memmove(f->history, &f->history[f->factor],
+            (f->num_taps - 1) * sizeof(float));
+    f->count = 0;
+    *out = acc;
+
+    return true;
+}
+
+/**
+ * @brief               Runs a sample through both Q15 stages, as the
+ *                      sensor read thread does.
+ */
+static inline bool Q15ChainPush(fir_decimate_state_t s[2],
+                                int16_t x,
+                                int32_t *out)
+{
+    int32_t mid;
+
+    return FIRDecimateQ15Push(&stage1, &s[0], x, &mid) &&
+           FIRDecimateQ15Push(&stage2, &s[1], FIRDecimateQ15ToSample(mid),
+                              out);
+}
+
+static inline bool FloatChainPush(float_fir_t f[2], float x, float *out)
+{
+    float mid;
+
+    return FloatPush(&f[0], x, &mid) && FloatPush(&f[1], mid, out);
+}
+
+static bool ReferenceChainPush(reference_fir_t f[2], double x, double *out)
+{
+    double mid;
+
+    return ReferencePush(&f[0], x, &mid) && ReferencePush(&f[1], mid, out);
+}
+
+/**
+ * @brief               Gyro like input: slow motion, a propeller vibration
+ *                      and white sensor noise.
+ */
+static void MakeInput(void)
+{
+    double t, v;
+    int i;
+
+    for (i = 0; i < TEST_SAMPLES; i++)
+    {
+        t = (double)i / TEST_RATE_HZ;
+        v = 3000.0 * sin(2.0 * M_PI * 3.0 * t) +
+            400.0 * sin(2.0 * M_PI * 25.0 * t) +
+            1500.0 * sin(2.0 * M_PI * 920.0 * t) +
+            TEST_SENSOR_NOISE * Gauss();
+
+        input[i] = (int16_t)lrint(v);
+    }
+}
+
+static void TestNoiseFloor(void)
+{
+    fir_decimate_state_t q[2];
+    float_fir_t f[2];
+    reference_fir_t r[2];
+    double e_q15 = 0.0, e_float = 0.0, noise = 0.0, ref;
+    bool has_q15, has_float, has_ref;
+    int32_t out_q15 = 0;
+    float out_float = 0.0f;
+    long n = 0, m = 0;
+    int i;
+
+    FIRDecimateInitState(&q[0]);
+    FIRDecimateInitState(&q[1]);
+    FloatInit(&f[0], &stage1);
+    FloatInit(&f[1], &stage2);
+    ReferenceInit(&r[0], &stage1);
+    ReferenceInit(&r[1], &stage2);
+
+    for (i = 0; i < TEST_SAMPLES; i++)
+    {
+        has_q15 = Q15ChainPush(q, input[i], &out_q15);
+        has_float = FloatChainPush(f, (float)input[i], &out_float);
+        has_ref = ReferenceChainPush(r, (double)input[i], &ref);
+
+        if (has_q15 && has_float && has_ref)
+        {
+            const double x = (double)out_q15 * FIR_DECIMATE_OUTPUT_SCALE;
+
+            e_q15 += (x - ref) * (x - ref);
+            e_float += ((double)out_float - ref) * ((double)out_float - ref);
+            n++;
+        }
+    }
+
+    e_q15 = sqrt(e_q15 / (double)n);
+    e_float = sqrt(e_float / (double)n);
+
+    /* The sensor noise alone through the filters */
+    ReferenceInit(&r[0], &stage1);
+    ReferenceInit(&r[1], &stage2);
+
+    for (i = 0; i < TEST_SAMPLES; i++)
+    {
+        if (ReferenceChainPush(r, TEST_SENSOR_NOISE * Gauss(), &ref))
+        {
+            noise += ref * ref;
+            m++;
+        }
+    }
+
+    noise = sqrt(noise / (double)m);
+
+    printf("outputs %ld at %.0f Hz\n", n, TEST_RATE_HZ / TEST_FACTOR);
+    printf("error vs double:  Q15 %.3f LSB rms, float %.2e LSB rms\n",
+           e_q15, e_float);
+    printf("sensor noise out: front-end %.2f LSB rms, direct 200 Hz "
+           "sampling %.2f LSB rms\n",
+           noise, TEST_SENSOR_NOISE);
+
+    if (e_q15 > TEST_MAX_Q15_ERROR)
+    {
+        printf("Q15 error above %.2f LSB rms  FAIL\n", TEST_MAX_Q15_ERROR);
+        failures++;
+    }
+}
+
+/**
+ * @brief               Gain of the Q15 chain for a tone, from the peak of
+ *                      the output after the filters have settled.
+ */
+static double ToneGainDB(double hz)
+{
+    fir_decimate_state_t q[2];
+    double peak = 0.0;
+    int32_t out;
+    long n = 0;
+    int i;
+
+    FIRDecimateInitState(&q[0]);
+    FIRDecimateInitState(&q[1]);
+
+    for (i = 0; i < TEST_SAMPLES / 4; i++)
+    {
+        const int16_t x = (int16_t)lrint(10000.0 *
+                                         cos(2.0 * M_PI * hz * i /
+                                             TEST_RATE_HZ));
+
+        if (Q15ChainPush(q, x, &out) && (++n > 100))
+            peak = fmax(peak, fabs((double)out * FIR_DECIMATE_OUTPUT_SCALE));
+    }
+
+    return 20.0 * log10(peak / 10000.0 + 1e-9);
+}
+
+static void TestResponse(void)
+{
+    static const double passband[] = {0.0, 10.0, 30.0};
+    static const double stopband[] = {150.0, 920.0, 1950.0, 3990.0};
+    double db;
+    unsigned i;
+
+    for (i = 0; i < sizeof(passband) / sizeof(passband[0]); i++)
+        printf("%6.0f Hz: %7.2f dB\n", passband[i], ToneGainDB(passband[i]));
+
+    for (i = 0; i < sizeof(stopband) / sizeof(stopband[0]); i++)
+    {
+        db = ToneGainDB(stopband[i]);
+        printf("%6.0f Hz: %7.2f dB", stopband[i], db);
+
+        if (db > -TEST_MIN_STOPBAND_DB)
+        {
+            printf("  FAIL");
+            failures++;
+        }
+
+        printf("\n");
+    }
+}
+
+static void Benchmark(void)
+{
+    fir_decimate_state_t q[2];
+    float_fir_t f[2];
+    volatile int32_t sink_q15 = 0;
+    volatile float sink_float = 0.0f;
+    double t0, t_q15, t_float;
+    int32_t out_q15;
+    float out_float;
+    int r, i;
+
+    t0 = Now();
+    for (r = 0; r < BENCH_REPEATS; r++)
+    {
+        FIRDecimateInitState(&q[0]);
+        FIRDecimateInitState(&q[1]);
+
+        for (i = 0; i < TEST_SAMPLES; i++)
+            if (Q15ChainPush(q, input[i], &out_q15))
+                sink_q15 += out_q15;
+    }
+    t_q15 = (Now() - t0) / BENCH_REPEATS / TEST_SAMPLES * 1e9;
+
+    t0 = Now();
+    for (r = 0; r < BENCH_REPEATS; r++)
+    {
+        FloatInit(&f[0], &stage1);
+        FloatInit(&f[1], &stage2);
+
+        for (i = 0; i < TEST_SAMPLES; i++)
+            if (FloatChainPush(f, (float)input[i], &out_float))
+                sink_float += out_float;
+    }
+    t_float = (Now() - t0) / BENCH_REPEATS / TEST_SAMPLES * 1e9;
+
+    (void)sink_q15;
+    (void)sink_float;
+
+    printf("per input sample and channel: %.2f SMLAD or %.2f float MAC\n",
+           (double)STAGE1_TAPS / 2.0 / STAGE1_FACTOR +
+               (double)STAGE2_TAPS / 2.0 / TEST_FACTOR,
+           (double)STAGE1_TAPS / STAGE1_FACTOR +
+               (double)STAGE2_TAPS / TEST_FACTOR);
+    printf("host time per input sample and channel: Q15 %.2f ns, "
+           "float %.2f ns\n", t_q15, t_float);
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+int main(void)
+{
+    srand(1);
+
+    if (!FIRDecimateDesignLPF(&stage1, STAGE1_TAPS, STAGE1_FACTOR,
+                              STAGE1_CUTOFF_HZ / TEST_RATE_HZ) ||
+        !FIRDecimateDesignLPF(&stage2, STAGE2_TAPS, STAGE2_FACTOR,
+                              STAGE2_CUTOFF_HZ * STAGE1_FACTOR /
+                              TEST_RATE_HZ))
+    {
+        printf("filter design FAIL\n");
+        return EXIT_FAILURE;
+    }
+
+    MakeInput();
+    TestNoiseFloor();
+    TestResponse();
+    Benchmark();
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,279 @@
+/* *
+ *
+ * Host parity test and benchmark of the fixed-size kernels against the
+ * generic functions in linear_algebra.h.
+ *
+ * With -ffast-math the compiler may contract and reorder the unrolled
+ * kernels differently from the loops, so the results are compared with a
+ * tolerance relative to the largest element instead of bitwise.
+ *
+ * */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "matrix.hpp"
+#include "linear_algebra_fixed.h"
+
+extern "C" {
+#include "linear_algebra.h"
+}
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+#define TEST_ITERATIONS         1000
+#define BENCH_ITERATIONS        200000
+
+/* Largest allowed difference relative to the largest element, a few ULP of
+   single precision accumulated over the kernel. */
+#define TEST_TOLERANCE          1e-5f
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+static int failures;
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief               Uniform random number in [-1, 1].
+ */
+static float Random(void)
+{
+    return (float)rand() / (float)RAND_MAX * 2.0f - 1.0f;
+}
+
+/**
+ * @brief               Compares two results and keeps the largest relative
+ *                      difference of a kernel.
+ *
+ * @param[in] a         Result of the generic function.
+ * @param[in] b         Result of the fixed-size kernel.
+ * @param[in] n         Number of elements.
+ * @param[in/out] worst Largest relative difference so far.
+ */
+static void Compare(const float *a, const float *b, int n, float *worst)
+{
+    float scale = 1.0f, diff = 0.0f;
+    int i;
+
+    for (i = 0; i < n; i++)
+        scale = fmaxf(scale, fabsf(a[i]));
+
+    for (i = 0; i < n; i++)
+        diff = fmaxf(diff, fabsf(a[i] - b[i]));
+
+    *worst = fmaxf(*worst, diff / scale);
+}
+
+/**
+ * @brief               Prints the result of a kernel and counts failures.
+ */
+static void Report(const char *name, float worst)
+{
+    const bool ok = (worst <= TEST_TOLERANCE);
+
+    printf("%-20s max rel diff %.2e  %s\n", name, worst, ok ? "ok" : "FAIL");
+
+    if (!ok)
+        failures++;
+}
+
+/**
+ * @brief               Random upper triangular matrix with a dominant
+ *                      diagonal.
+ */
+static void RandomUpper(float *a, int n, float diag, float off)
+{
+    int i, j;
+
+    for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++)
+            A(i, j) = (j < i) ? 0.0f : ((i == j) ? diag + 0.5f * Random() :
+                                                   off * Random());
+}
+
+/**
+ * @brief               Average time of a function in ns.
+ */
+template <class F>
+static double Bench(F f)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+        f();
+
+    std::chrono::duration<double, std::nano> t =
+        std::chrono::steady_clock::now() - start;
+
+    return t.count() / BENCH_ITERATIONS;
+}
+
+/**
+ * @brief               Keeps the compiler from removing a benchmarked result.
+ */
+static inline void Clobber(void *p)
+{
+    asm volatile("" : : "r"(p) : "memory");
+}
+
+static void TestParity(void)
+{
+    float w_qr6 = 0, w_qr3 = 0, w_down = 0, w_inv = 0, w_mul = 0;
+    float w_up = 0, w_fwd = 0, w_qr = 0, w_chol = 0;
+    int it, i;
+
+    for (it = 0; it < TEST_ITERATIONS; it++)
+    {
+        /* QR of a 12x6 matrix with triangular lower half */
+        float a[12 * 6], b[12 * 6];
+        for (i = 0; i < 12 * 6; i++)
+            a[i] = ((i / 6 >= 6) && (i % 6 < i / 6 - 6)) ? 0.0f : Random();
+        memcpy(b, a, sizeof(a));
+        qr_decomp_tria(a, 6);
+        qr_decomp_tria_6(b);
+        Compare(a, b, 12 * 6, &w_qr6);
+
+        /* QR of a 6x3 matrix */
+        float c[6 * 3], d[6 * 3];
+        for (i = 0; i < 6 * 3; i++)
+            c[i] = Random();
+        memcpy(d, c, sizeof(c));
+        qr_decomp_tria(c, 3);
+        qr_decomp_tria_3(d);
+        Compare(c, d, 6 * 3, &w_qr3);
+
+        /* Inverse of a 3x3 upper triangular matrix */
+        float u[3 * 3], v[3 * 3];
+        RandomUpper(u, 3, 2.0f, 1.0f);
+        memcpy(v, u, sizeof(u));
+        u_inv(u, 3);
+        u_inv_3(v);
+        Compare(u, v, 3 * 3, &w_inv);
+
+        /* Cholesky downdate of a 6x6 factor */
+        float t[6 * 6], t2[6 * 6], x[6], x2[6];
+        RandomUpper(t, 6, 3.0f, 0.3f);
+        for (i = 0; i < 6; i++)
+            x[i] = 0.3f * Random();
+        memcpy(t2, t, sizeof(t));
+        memcpy(x2, x, sizeof(x));
+        chol_downdate(t, x, 6);
+        chol_downdate_6(t2, x2);
+        Compare(t, t2, 6 * 6, &w_down);
+
+        /* Product of two 6x6 upper triangular matrices */
+        float p[6 * 6], q[6 * 6];
+        RandomUpper(p, 6, 1.0f, 1.0f);
+        memcpy(q, p, sizeof(p));
+        uu_mul(t, p, 6);
+        uu_mul_6(t, q);
+        Compare(p, q, 6 * 6, &w_mul);
+
+        /* Kernels without a C interface, through the templates directly */
+        float s[4 * 4], s2[4 * 4], y[4], y2[4];
+        RandomUpper(s, 4, 2.0f, 1.0f);
+        for (i = 0; i < 4; i++)
+            y[i] = Random();
+        memcpy(s2, s, sizeof(s));
+        memcpy(y2, y, sizeof(y));
+        chol_update(s, y, 4);
+        kfly::chol_update(kfly::Matrix<4, 4>::map(s2), y2);
+        Compare(s, s2, 4 * 4, &w_up);
+
+        float l[5 * 5], bb[5 * 2], bb2[5 * 2];
+        RandomUpper(l, 5, 2.0f, 1.0f);
+        for (i = 0; i < 5 * 2; i++)
+            bb[i] = Random();
+        memcpy(bb2, bb, sizeof(bb));
+        /* fwd_sub uses the lower triangle, transpose in place */
+        for (i = 0; i < 25; i++)
+            if (i / 5 < i % 5)
+            {
+                l[(i % 5) * 5 + i / 5] = l[i];
+                l[i] = 0.0f;
+            }
+        fwd_sub(l, bb, 5, 2);
+        kfly::fwd_sub(kfly::Matrix<5, 5>::map(l),
+                      kfly::Matrix<5, 2>::map(bb2));
+        Compare(bb, bb2, 5 * 2, &w_fwd);
+
+        float h[8 * 4], h2[8 * 4];
+        for (i = 0; i < 8 * 4; i++)
+            h[i] = Random();
+        memcpy(h2, h, sizeof(h));
+        qr_decomp(h, 8, 4);
+        kfly::qr_decomp(kfly::Matrix<8, 4>::map(h2));
+        Compare(h, h2, 8 * 4, &w_qr);
+
+        float k[4 * 4], k2[4 * 4];
+        /* Symmetric and diagonally dominant */
+        for (i = 0; i < 4 * 4; i++)
+            k[i] = (i / 4 == i % 4) ? 8.0f : 0.5f + 0.1f * Random();
+        for (i = 0; i < 4 * 4; i++)
+            if (i / 4 > i % 4)
+                k[i] = k[(i % 4) * 4 + i / 4];
+        memcpy(k2, k, sizeof(k));
+        chol_decomp_upper(k, 4);
+        kfly::chol_decomp_upper(kfly::Matrix<4, 4>::map(k2));
+        Compare(k, k2, 4 * 4, &w_chol);
+    }
+
+    Report("qr_decomp_tria 12x6", w_qr6);
+    Report("qr_decomp_tria 6x3", w_qr3);
+    Report("u_inv 3x3", w_inv);
+    Report("chol_downdate 6x6", w_down);
+    Report("uu_mul 6x6", w_mul);
+    Report("chol_update 4x4", w_up);
+    Report("fwd_sub 5x5x2", w_fwd);
+    Report("qr_decomp 8x4", w_qr);
+    Report("chol_decomp 4x4", w_chol);
+}
+
+static void Benchmark(void)
+{
+    static float a0[12 * 6], a[12 * 6];
+    static float t0[6 * 6], t[6 * 6], x0[6], x[6];
+    int i;
+
+    for (i = 0; i < 12 * 6; i++)
+        a0[i] = Random();
+
+    RandomUpper(t0, 6, 3.0f, 0.1f);
+    for (i = 0; i < 6; i++)
+        x0[i] = 0.2f;
+
+    printf("qr_decomp_tria 12x6: generic %.1f ns, fixed %.1f ns\n",
+           Bench([&] { memcpy(a, a0, sizeof(a));
+                       qr_decomp_tria(a, 6); Clobber(a); }),
+           Bench([&] { memcpy(a, a0, sizeof(a));
+                       qr_decomp_tria_6(a); Clobber(a); }));
+
+    printf("chol_downdate 6x6:   generic %.1f ns, fixed %.1f ns\n",
+           Bench([&] { memcpy(t, t0, sizeof(t)); memcpy(x, x0, sizeof(x));
+                       chol_downdate(t, x, 6); Clobber(t); }),
+           Bench([&] { memcpy(t, t0, sizeof(t)); memcpy(x, x0, sizeof(x));
+                       chol_downdate_6(t, x); Clobber(t); }));
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+int main(void)
+{
+    srand(1);
+
+    TestParity();
+    Benchmark();
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,395 @@
+/* *
+ *
+ * Host error sweep and benchmark of the fast_* approximations in
+ * trigonometry.h, which produce the error table in the header.
+ *
+ * Every stride-th float of each domain is compared with double precision
+ * libm, with the header built with the flags of the firmware. The default
+ * stride is quick, `trigonometry_test 1` sweeps all floats in the domains
+ * as the table was made, which takes about ten minutes. The maximum errors are
+ * checked against the table.
+ *
+ * */
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "trigonometry.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+#define TEST_DEFAULT_STRIDE     997
+#define TEST_RANDOM_POINTS      1000000
+#define BENCH_ITERATIONS        10000000
+
+/* Slack on the table, which is rounded to two digits */
+#define TEST_TABLE_SLACK        1.05
+
+#define NUM_TIERS               3
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Error of one approximation at x, in the unit of its table row.
+ */
+typedef double (*error_function_t)(float x, fastmath_tier_t tier);
+
+/**
+ * @brief   A row of the error table.
+ */
+typedef struct
+{
+    const char *name;
+    const char *domain;
+    float lo;
+    float hi;
+    error_function_t error;
+    double table[NUM_TIERS];
+} sweep_t;
+
+static unsigned stride = TEST_DEFAULT_STRIDE;
+static int failures;
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief               Largest absolute error of the sine and cosine of
+ *                      fast_sincos.
+ */
+static double SinCosError(float x, fastmath_tier_t tier)
+{
+    float s, c;
+
+    fast_sincos(x, &s, &c, tier);
+
+    return fmax(fabs(s - sin((double)x)), fabs(c - cos((double)x)));
+}
+
+/**
+ * @brief               Error of the sine of fast_sincos relative to the angle.
+ */
+static double SinRelativeError(float x, fastmath_tier_t tier)
+{
+    float s, c;
+
+    /* The sine of the smallest floats is a denormal, which -ffast-math
+       flushes to zero */
+    if (fabsf(x) < 1e-30f)
+        return 0.0;
+
+    fast_sincos(x, &s, &c, tier);
+
+    return fabs(s - sin((double)x)) / fabs((double)x);
+}
+
+/**
+ * @brief               Error of fast_atan2 on its [0, 1] core, the octants
+ *                      are exact reflections of it.
+ */
+static double Atan2Error(float a, fastmath_tier_t tier)
+{
+    return fabs(fast_atan2(a, 1.0f, tier) - atan((double)a));
+}
+
+/**
+ * @brief               Absolute error of fast_asin.
+ */
+static double AsinError(float x, fastmath_tier_t tier)
+{
+    return fabs(fast_asin(x, tier) - asin((double)x));
+}
+
+/**
+ * @brief               Relative error of fast_invsqrt.
+ */
+static double InvSqrtError(float x, fastmath_tier_t tier)
+{
+    const double ref = 1.0 / sqrt((double)x);
+
+    return fabs(fast_invsqrt(x, tier) - ref) / ref;
+}
+
+/**
+ * @brief               Relative error of fast_exp.
+ */
+static double ExpError(float x, fastmath_tier_t tier)
+{
+    const double ref = exp((double)x);
+
+    return fabs(fast_exp(x, tier) - ref) / ref;
+}
+
+/**
+ * @brief               Largest error over every stride-th float in
+ *                      [lo, hi], both signs are walked from zero outwards.
+ * @note                Denormals are skipped, -ffast-math flushes them to
+ *                      zero on the host.
+ */
+static double Sweep(error_function_t error,
+                    float lo,
+                    float hi,
+                    fastmath_tier_t tier)
+{
+    union { uint32_t i; float f; } v, end;
+    double worst = 0.0;
+    int sign;
+
+    for (sign = 0; sign < 2; sign++)
+    {
+        const float top = (sign == 0) ? hi : -lo;
+        const float bottom = (sign == 0) ? fmaxf(lo, FLT_MIN) :
+                                           fmaxf(-hi, FLT_MIN);
+
+        if (top <= bottom)
+            continue;
+
+        v.f = bottom;
+        end.f = top;
+
+        for (; v.i <= end.i; v.i += stride)
+        {
+            const float x = (sign == 0) ? v.f : -v.f;
+
+            if ((x < lo) || (x > hi))
+                continue;
+
+            worst = fmax(worst, error(x, tier));
+
+            if (end.i - v.i < stride)
+                break;
+        }
+    }
+
+    return worst;
+}
+
+/**
+ * @brief               Counts a failure if an error is above the table.
+ */
+static void Check(const char *name, int tier, double worst, double table)
+{
+    if (worst > table * TEST_TABLE_SLACK)
+    {
+        printf("%s tier %d: %.2e above the table %.1e  FAIL\n",
+               name, tier, worst, table);
+        failures++;
+    }
+}
+
+/**
+ * @brief               Sweeps the domains of the table for all tiers.
+ */
+static void TestTable(void)
+{
+    static const sweep_t rows[] = {
+        {"fast_sincos", "|x| < 1e3", -1e3f, 1e3f, SinCosError,
+         {3.0e-4, 1.2e-6, 9.5e-8}},
+        {"fast_atan2", "all", 0.0f, 1.0f, Atan2Error,
+         {6.1e-4, 1.2e-5, 3.1e-7}},
+        {"fast_asin", "[-1, 1]", -1.0f, 1.0f, AsinError,
+         {7.5e-4, 1.7e-6, 1.6e-7}},
+        {"fast_invsqrt", "[1e-37, 1e37]", 1e-37f, 1e37f, InvSqrtError,
+         {1.8e-3, 4.7e-6, 2.7e-7}},
+        {"fast_exp", "[-87, 88]", -87.0f, 88.0f, ExpError,
+         {7.5e-5, 2.7e-6, 1.1e-7}},
+        {"sine relative", "|x| < pi/4", -0.25f * PI, 0.25f * PI,
+         SinRelativeError, {3.9e-4, 1.5e-6, 9.4e-8}}
+    };
+    double worst;
+    unsigned r;
+    int t;
+
+    printf("stride %u\n", stride);
+    printf("%-14s %-15s %-10s %-10s %-10s\n",
+           "Function", "Domain", "LOW", "MEDIUM", "HIGH");
+
+    for (r = 0; r < sizeof(rows) / sizeof(rows[0]); r++)
+    {
+        printf("%-14s %-15s", rows[r].name, rows[r].domain);
+
+        for (t = 0; t < NUM_TIERS; t++)
+        {
+            worst = Sweep(rows[r].error, rows[r].lo, rows[r].hi,
+                          (fastmath_tier_t)t);
+            printf(" %-10.1e", worst);
+            Check(rows[r].name, t, worst, rows[r].table[t]);
+        }
+
+        printf("\n");
+    }
+}
+
+/**
+ * @brief               fast_atan2 on random points in all quadrants, against
+ *                      the error of its core.
+ */
+static void TestAtan2Quadrants(void)
+{
+    double worst[NUM_TIERS] = {0.0, 0.0, 0.0};
+    float x, y;
+    int i, t;
+
+    for (i = 0; i < TEST_RANDOM_POINTS; i++)
+    {
+        x = (float)rand() / (float)RAND_MAX * 200.0f - 100.0f;
+        y = (float)rand() / (float)RAND_MAX * 200.0f - 100.0f;
+
+        for (t = 0; t < NUM_TIERS; t++)
+            worst[t] = fmax(worst[t],
+                            fabs(fast_atan2(y, x, (fastmath_tier_t)t) -
+                                 atan2((double)y, (double)x)));
+    }
+
+    printf("%-14s %-15s", "fast_atan2", "random");
+    for (t = 0; t < NUM_TIERS; t++)
+        printf(" %-10.1e", worst[t]);
+    printf("\n");
+
+    Check("fast_atan2 random", 0, worst[0], 6.1e-4);
+    Check("fast_atan2 random", 1, worst[1], 1.2e-5);
+    Check("fast_atan2 random", 2, worst[2], 3.1e-7);
+}
+
+/**
+ * @brief               Errors of the older approximations, for the note
+ *                      under the table.
+ */
+static void TestLegacy(void)
+{
+    double e_sin = 0.0, e_rel = 0.0, e_atan = 0.0, e_exp = 0.0, ref;
+    float x, y;
+    int i;
+
+    for (i = 0; i <= TEST_RANDOM_POINTS; i++)
+    {
+        x = -PI + 2.0f * PI * (float)i / (float)TEST_RANDOM_POINTS;
+        e_sin = fmax(e_sin, fabs(fast_sin(x) - sin((double)x)));
+        e_sin = fmax(e_sin, fabs(fast_cos(x) - cos((double)x)));
+
+        /* Small angles from 1e-6 to 0.1 */
+        x = 1e-6f * powf(1e5f, (float)i / (float)TEST_RANDOM_POINTS);
+        e_rel = fmax(e_rel, fabs(fast_sin(x) - sin((double)x)) /
+                            sin((double)x));
+    }
+
+    for (i = 0; i < TEST_RANDOM_POINTS; i++)
+    {
+        x = (float)rand() / (float)RAND_MAX * 200.0f - 100.0f;
+        y = (float)rand() / (float)RAND_MAX * 200.0f - 100.0f;
+        e_atan = fmax(e_atan, fabs(fastatan2(y, x) -
+                                   atan2((double)y, (double)x)));
+
+        x = (float)rand() / (float)RAND_MAX * 175.0f - 87.0f;
+        ref = exp((double)x);
+        e_exp = fmax(e_exp, fabs(fastexp(x) - ref) / ref);
+    }
+
+    printf("fast_sin/cos abs %.1e, small angle rel %.1e, fastatan2 %.1e, "
+           "fastexp rel %.1e\n", e_sin, e_rel, e_atan, e_exp);
+}
+
+/**
+ * @brief               Average time of a function over a table of inputs
+ *                      in ns.
+ */
+#define BENCH(expr)                                                           \
+    ({                                                                        \
+        struct timespec t0, t1;                                               \
+        volatile float sink = 0.0f;                                           \
+        float x;                                                              \
+        int i;                                                                \
+        clock_gettime(CLOCK_MONOTONIC, &t0);                                  \
+        for (i = 0; i < BENCH_ITERATIONS; i++)                                \
+        {                                                                     \
+            x = input[i & 1023];                                              \
+            sink += (expr);                                                   \
+        }                                                                     \
+        clock_gettime(CLOCK_MONOTONIC, &t1);                                  \
+        (void)sink;                                                           \
+        ((double)(t1.tv_sec - t0.tv_sec) * 1e9 +                              \
+         (double)(t1.tv_nsec - t0.tv_nsec)) / BENCH_ITERATIONS;               \
+    })
+
+/**
+ * @brief               Sum of the sine and cosine, so the benchmark keeps
+ *                      both.
+ */
+static inline float SinCosSum(float x, fastmath_tier_t tier)
+{
+    float s, c;
+
+    fast_sincos(x, &s, &c, tier);
+
+    return s + c;
+}
+
+/**
+ * @brief               Host time per call of libm and the tiers.
+ */
+static void Benchmark(void)
+{
+    static float input[1024];
+    int i;
+
+    for (i = 0; i < 1024; i++)
+        input[i] = (float)rand() / (float)RAND_MAX * 1.8f - 0.9f;
+
+    printf("ns per call        libm    LOW     MEDIUM  HIGH\n");
+    printf("sincos           %6.2f  %6.2f  %6.2f  %6.2f\n",
+           BENCH(sinf(x) + cosf(x)),
+           BENCH(SinCosSum(x, FASTMATH_TIER_LOW)),
+           BENCH(SinCosSum(x, FASTMATH_TIER_MEDIUM)),
+           BENCH(SinCosSum(x, FASTMATH_TIER_HIGH)));
+    printf("atan2            %6.2f  %6.2f  %6.2f  %6.2f\n",
+           BENCH(atan2f(x, 0.7f)),
+           BENCH(fast_atan2(x, 0.7f, FASTMATH_TIER_LOW)),
+           BENCH(fast_atan2(x, 0.7f, FASTMATH_TIER_MEDIUM)),
+           BENCH(fast_atan2(x, 0.7f, FASTMATH_TIER_HIGH)));
+    printf("asin             %6.2f  %6.2f  %6.2f  %6.2f\n",
+           BENCH(asinf(x)),
+           BENCH(fast_asin(x, FASTMATH_TIER_LOW)),
+           BENCH(fast_asin(x, FASTMATH_TIER_MEDIUM)),
+           BENCH(fast_asin(x, FASTMATH_TIER_HIGH)));
+    printf("invsqrt          %6.2f  %6.2f  %6.2f  %6.2f\n",
+           BENCH(1.0f / sqrtf(x + 1.0f)),
+           BENCH(fast_invsqrt(x + 1.0f, FASTMATH_TIER_LOW)),
+           BENCH(fast_invsqrt(x + 1.0f, FASTMATH_TIER_MEDIUM)),
+           BENCH(fast_invsqrt(x + 1.0f, FASTMATH_TIER_HIGH)));
+    printf("exp              %6.2f  %6.2f  %6.2f  %6.2f\n",
+           BENCH(expf(x)),
+           BENCH(fast_exp(x, FASTMATH_TIER_LOW)),
+           BENCH(fast_exp(x, FASTMATH_TIER_MEDIUM)),
+           BENCH(fast_exp(x, FASTMATH_TIER_HIGH)));
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+        stride = (unsigned)strtoul(argv[1], NULL, 0);
+
+    if (stride == 0)
+        stride = 1;
+
+    srand(1);
+
+    TestTable();
+    TestAtan2Quadrants();
+    TestLegacy();
+    Benchmark();
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
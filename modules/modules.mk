@@ -2,6 +2,7 @@
 MODULE_DIR = ./modules
 
 # Imported source files and paths from modules
+include $(MODULE_DIR)/blackbox/blackbox.mk
 include $(MODULE_DIR)/communication/communication.mk
 include $(MODULE_DIR)/control/control.mk
 include $(MODULE_DIR)/crc/crc.mk
@@ -14,10 +15,12 @@ include $(MODULE_DIR)/sensors/sensors.mk
 include $(MODULE_DIR)/usb/usb.mk
 include $(MODULE_DIR)/system_information/system_information.mk
 include $(MODULE_DIR)/motion_capture/motion_capture.mk
+include $(MODULE_DIR)/parameters/parameters.mk
 include $(MODULE_DIR)/spectral_estimation/spectral_estimation.mk
 
 # List of all the module related files.
-MODULES_SRC = $(COMMUNICATION_SRCS) \
+MODULES_SRC = $(BLACKBOX_SRCS) \
+              $(COMMUNICATION_SRCS) \
               $(CONTROL_SRCS) \
               $(CRC_SRCS) \
               $(ESTIMATION_SRCS) \
@@ -29,10 +32,15 @@ MODULES_SRC = $(COMMUNICATION_SRCS) \
               $(USB_SRCS) \
               $(SYSTEMINFO_SRCS) \
               $(MOTION_CAPTURE_SRCS) \
+              $(PARAMETERS_SRCS) \
               $(SESTIMATION_SRCS)
 
+# List of all the module related C++ files.
+MODULES_CPPSRC = $(MATH_CPPSRCS)
+
 # Required include directories
-MODULES_INC = $(COMMUNICATION_INC) \
+MODULES_INC = $(BLACKBOX_INC) \
+              $(COMMUNICATION_INC) \
               $(CONTROL_INC) \
               $(CRC_INC) \
               $(ESTIMATION_INC) \
@@ -44,4 +52,5 @@ MODULES_INC = $(COMMUNICATION_INC) \
               $(USB_INC) \
               $(SYSTEMINFO_INC) \
               $(MOTION_CAPTURE_INC) \
+              $(PARAMETERS_INC) \
               $(SESTIMATION_INC)
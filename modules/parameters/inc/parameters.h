@@ -0,0 +1,235 @@
+#ifndef __PARAMETERS_H
+#define __PARAMETERS_H
+
+#include "kfly_defs.h"
+
+/*===========================================================================*/
+/* Module global definitions.                                                */
+/*===========================================================================*/
+
+/* Maximum number of registered parameter groups */
+#define PARAMETERS_MAX_GROUPS               16
+
+/* Size of the value of a parameter on the link, all types are sent as 32 bit
+   little endian values, floats as their IEEE 754 bits */
+#define PARAMETERS_VALUE_SIZE               4
+
+/* Maximum size of the payload of a KFly packet */
+#define PARAMETERS_MAX_PAYLOAD              255
+
+#define PARAMETER_INFO_SIZE                 (sizeof(parameter_info_t))
+#define PARAMETER_RANGE_SIZE                (sizeof(parameter_range_t))
+#define PARAMETER_REQUEST_SIZE              (sizeof(parameter_request_t))
+
+/* Parameters fitting in one packet */
+#define PARAMETERS_MAX_INFO_COUNT           ((PARAMETERS_MAX_PAYLOAD -        \
+                                              PARAMETER_RANGE_SIZE) /         \
+                                             PARAMETER_INFO_SIZE)
+#define PARAMETERS_MAX_VALUE_COUNT          ((PARAMETERS_MAX_PAYLOAD -        \
+                                              PARAMETER_RANGE_SIZE) /         \
+                                             PARAMETERS_VALUE_SIZE)
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Type of a parameter.
+ */
+typedef enum PACKED_VAR
+{
+    PARAMETER_TYPE_UINT8 = 0,
+    PARAMETER_TYPE_INT8 = 1,
+    PARAMETER_TYPE_UINT16 = 2,
+    PARAMETER_TYPE_INT16 = 3,
+    PARAMETER_TYPE_UINT32 = 4,
+    PARAMETER_TYPE_INT32 = 5,
+    PARAMETER_TYPE_FLOAT = 6
+} parameter_type_t;
+
+/**
+ * @brief   Module owning a parameter, the upper byte of its ID.
+ */
+typedef enum PACKED_VAR
+{
+    PARAMETER_MODULE_CONTROL = 1,
+    PARAMETER_MODULE_RC_OUTPUT = 2,
+    PARAMETER_MODULE_SERIAL = 3
+} parameter_module_t;
+
+/**
+ * @brief   Callback notifying a module that parameters of one of its groups
+ *          have been changed.
+ */
+typedef void (*parameter_changed_t)(void);
+
+/**
+ * @brief   Description of a parameter.
+ */
+typedef struct
+{
+    /**
+     * @brief   Type of the parameter.
+     */
+    parameter_type_t type;
+    /**
+     * @brief   Pointer to the parameter.
+     */
+    void *data;
+    /**
+     * @brief   Smallest allowed value, written values are bounded.
+     */
+    float min;
+    /**
+     * @brief   Largest allowed value.
+     */
+    float max;
+} parameter_t;
+
+/**
+ * @brief   Group of parameters with consecutive IDs, saved in the same flash
+ *          record.
+ */
+typedef struct
+{
+    /**
+     * @brief   Owning module.
+     */
+    parameter_module_t module;
+    /**
+     * @brief   ID of the first parameter, PARAMETER_ID(module, n).
+     */
+    uint16_t first_id;
+    /**
+     * @brief   UID of the flash record the parameters are saved in.
+     */
+    uint32_t flash_uid;
+    /**
+     * @brief   Parameters of the group.
+     */
+    const parameter_t *parameters;
+    /**
+     * @brief   Number of parameters in the group.
+     */
+    uint16_t count;
+    /**
+     * @brief   Called after parameters of the group have been written, or
+     *          NULL. Called from the thread parsing the command.
+     */
+    parameter_changed_t changed;
+} parameter_group_t;
+
+/**
+ * @brief   Description of a parameter on the link.
+ */
+typedef struct PACKED_VAR
+{
+    /**
+     * @brief   ID of the parameter.
+     */
+    uint16_t id;
+    /**
+     * @brief   Type of the parameter, parameter_type_t.
+     */
+    uint8_t type;
+    /**
+     * @brief   Owning module, parameter_module_t.
+     */
+    uint8_t module;
+    /**
+     * @brief   UID of the flash record the parameter is saved in.
+     */
+    uint32_t flash_uid;
+    /**
+     * @brief   Smallest allowed value.
+     */
+    float min;
+    /**
+     * @brief   Largest allowed value.
+     */
+    float max;
+} parameter_info_t;
+
+/**
+ * @brief   Header of the parameter messages. The parameters are addressed by
+ *          their index in the table, which is sorted by ID.
+ */
+typedef struct PACKED_VAR
+{
+    /**
+     * @brief   Number of parameters in the table.
+     */
+    uint16_t total;
+    /**
+     * @brief   Checksum over the description and value of all parameters.
+     */
+    uint16_t checksum;
+    /**
+     * @brief   Index of the first parameter in the message.
+     */
+    uint16_t first;
+    /**
+     * @brief   Number of parameters in the message.
+     */
+    uint8_t count;
+    /**
+     * @brief   Reserved for alignment.
+     */
+    uint8_t reserved;
+} parameter_range_t;
+
+/**
+ * @brief   Range of parameters requested or written by the ground station,
+ *          followed by the values when written.
+ */
+typedef struct PACKED_VAR
+{
+    /**
+     * @brief   Index of the first parameter.
+     */
+    uint16_t first;
+    /**
+     * @brief   Number of parameters.
+     */
+    uint8_t count;
+    /**
+     * @brief   Reserved for alignment.
+     */
+    uint8_t reserved;
+} parameter_request_t;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/**
+ * @brief   ID of the n-th parameter of a module.
+ */
+#define PARAMETER_ID(module, n)             ((uint16_t)(((module) << 8) | (n)))
+
+/**
+ * @brief   Unsigned parameter type matching the size of a variable, for
+ *          enums and bools.
+ */
+#define PARAMETER_TYPE_UNSIGNED_OF(var)                                       \
+    ((sizeof(var) == 1) ? PARAMETER_TYPE_UINT8 :                              \
+     (sizeof(var) == 2) ? PARAMETER_TYPE_UINT16 :                             \
+                          PARAMETER_TYPE_UINT32)
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+void ParametersRegister(const parameter_group_t *group);
+uint16_t ParametersCount(void);
+uint16_t ParametersChecksum(void);
+size_t ParametersGetInfo(uint16_t first, uint8_t count, uint8_t *dest);
+size_t ParametersGetValues(uint16_t first, uint8_t count, uint8_t *dest);
+uint8_t ParametersSetValues(uint16_t first,
+                            uint8_t count,
+                            const uint8_t *values);
+
+#endif
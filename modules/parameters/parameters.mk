@@ -0,0 +1,5 @@
+# List of all the module's related files.
+PARAMETERS_SRCS = $(MODULE_DIR)/parameters/src/parameters.c
+
+# Required include directories
+PARAMETERS_INC = $(MODULE_DIR)/parameters/inc
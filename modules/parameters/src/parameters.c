@@ -0,0 +1,461 @@
+/* *
+ *
+ * Typed parameter registry.
+ *
+ * Modules register groups of parameters with consecutive IDs, each with a
+ * type, bounds and the flash record it is saved in. The ground station reads
+ * the table and the values in ranges, a checksum over the entire set tells
+ * if a cached copy is still valid. Writes are bounded and the owning module
+ * is notified once per written range.
+ *
+ * */
+
+#include <string.h>
+#include "ch.h"
+#include "hal.h"
+#include "crc.h"
+#include "parameters.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+/* Registered groups, sorted by the ID of their first parameter */
+static const parameter_group_t *parameter_groups[PARAMETERS_MAX_GROUPS];
+static uint32_t parameter_group_count = 0;
+
+/* Total number of registered parameters */
+static uint16_t parameter_count = 0;
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief               Returns the size of a parameter type.
+ *
+ * @param[in] type      Parameter type.
+ * @return              Size in bytes.
+ */
+static size_t ParameterTypeSize(parameter_type_t type)
+{
+    switch (type)
+    {
+        case PARAMETER_TYPE_UINT8:
+        case PARAMETER_TYPE_INT8:
+            return 1;
+
+        case PARAMETER_TYPE_UINT16:
+        case PARAMETER_TYPE_INT16:
+            return 2;
+
+        default:
+            return 4;
+    }
+}
+
+/**
+ * @brief               Finds a parameter by its index in the table.
+ *
+ * @param[in] index     Index of the parameter.
+ * @param[out] group    Index of the group of the parameter.
+ * @param[out] id       ID of the parameter.
+ * @return              Pointer to the parameter, NULL if the index is out of
+ *                      range.
+ */
+static const parameter_t *ParameterFind(uint16_t index,
+                                        uint32_t *group,
+                                        uint16_t *id)
+{
+    uint32_t i;
+
+    for (i = 0; i < parameter_group_count; i++)
+    {
+        if (index < parameter_groups[i]->count)
+        {
+            *group = i;
+            *id = parameter_groups[i]->first_id + index;
+
+            return &parameter_groups[i]->parameters[index];
+        }
+
+        index -= parameter_groups[i]->count;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief               Reads a parameter as its 32 bit link value.
+ *
+ * @param[in] p         Pointer to the parameter.
+ * @return              Value, sign extended for signed types.
+ */
+static uint32_t ParameterRead(const parameter_t *p)
+{
+    uint8_t u8;
+    int8_t i8;
+    uint16_t u16;
+    int16_t i16;
+    uint32_t value;
+
+    osalSysLock();
+
+    switch (p->type)
+    {
+        case PARAMETER_TYPE_UINT8:
+            memcpy(&u8, p->data, 1);
+            value = u8;
+            break;
+
+        case PARAMETER_TYPE_INT8:
+            memcpy(&i8, p->data, 1);
+            value = (uint32_t)(int32_t)i8;
+            break;
+
+        case PARAMETER_TYPE_UINT16:
+            memcpy(&u16, p->data, 2);
+            value = u16;
+            break;
+
+        case PARAMETER_TYPE_INT16:
+            memcpy(&i16, p->data, 2);
+            value = (uint32_t)(int32_t)i16;
+            break;
+
+        default:
+            memcpy(&value, p->data, 4);
+            break;
+    }
+
+    osalSysUnlock();
+
+    return value;
+}
+
+/**
+ * @brief               Bounds and writes a parameter from its 32 bit link
+ *                      value.
+ *
+ * @param[in] p         Pointer to the parameter.
+ * @param[in] value     Value, floats as their IEEE 754 bits.
+ * @return              True if the parameter was written, false if the value
+ *                      was not a finite number.
+ */
+static bool ParameterWrite(const parameter_t *p, uint32_t value)
+{
+    int64_t integer;
+    float f;
+
+    if (p->type == PARAMETER_TYPE_FLOAT)
+    {
+        /* Reject NaN and infinity by their exponent, the firmware is built
+           with -ffast-math so isnan() can not be trusted */
+        if ((value & 0x7f800000) == 0x7f800000)
+            return false;
+
+        memcpy(&f, &value, 4);
+
+        if (f < p->min)
+            f = p->min;
+        else if (f > p->max)
+            f = p->max;
+
+        memcpy(&value, &f, 4);
+    }
+    else
+    {
+        if ((p->type == PARAMETER_TYPE_INT8) ||
+            (p->type == PARAMETER_TYPE_INT16) ||
+            (p->type == PARAMETER_TYPE_INT32))
+            integer = (int32_t)value;
+        else
+            integer = value;
+
+        if (integer < (int64_t)p->min)
+            integer = (int64_t)p->min;
+        else if (integer > (int64_t)p->max)
+            integer = (int64_t)p->max;
+
+        value = (uint32_t)integer;
+    }
+
+    /* Little endian, the low bytes hold the smaller types */
+    osalSysLock();
+    memcpy(p->data, &value, ParameterTypeSize(p->type));
+    osalSysUnlock();
+
+    return true;
+}
+
+/**
+ * @brief               Fills in the link description of a parameter.
+ *
+ * @param[in] p         Pointer to the parameter.
+ * @param[in] group     Group of the parameter.
+ * @param[in] id        ID of the parameter.
+ * @param[out] info     Pointer to the description.
+ */
+static void ParameterInfo(const parameter_t *p,
+                          const parameter_group_t *group,
+                          uint16_t id,
+                          parameter_info_t *info)
+{
+    info->id = id;
+    info->type = p->type;
+    info->module = group->module;
+    info->flash_uid = group->flash_uid;
+    info->min = p->min;
+    info->max = p->max;
+}
+
+/**
+ * @brief               Fills in the header of a parameter message.
+ *
+ * @param[in] first     Index of the first parameter in the message.
+ * @param[in] count     Number of parameters in the message.
+ * @param[out] dest     Pointer to the message.
+ */
+static void ParametersRangeHeader(uint16_t first, uint8_t count, uint8_t *dest)
+{
+    parameter_range_t range;
+
+    range.total = parameter_count;
+    range.checksum = ParametersChecksum();
+    range.first = first;
+    range.count = count;
+    range.reserved = 0;
+
+    memcpy(dest, &range, PARAMETER_RANGE_SIZE);
+}
+
+/**
+ * @brief               Bounds a range to the table.
+ *
+ * @param[in] first     Index of the first parameter.
+ * @param[in] count     Requested number of parameters.
+ * @param[in] max       Maximum number of parameters.
+ * @return              Number of parameters in the range.
+ */
+static uint8_t ParametersBoundRange(uint16_t first, uint8_t count, uint8_t max)
+{
+    if (first >= parameter_count)
+        return 0;
+
+    if (count > max)
+        count = max;
+
+    if (count > parameter_count - first)
+        count = parameter_count - first;
+
+    return count;
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief               Registers a group of parameters. The IDs of the group
+ *                      may not overlap with another group.
+ * @note                Must be called during initialization.
+ *
+ * @param[in] group     Pointer to the group, must stay valid.
+ */
+void ParametersRegister(const parameter_group_t *group)
+{
+    const parameter_group_t *other;
+    uint32_t i;
+
+    if (parameter_group_count >= PARAMETERS_MAX_GROUPS)
+        osalSysHalt("Parameter registration error.");
+
+    /* Keep the groups sorted by ID */
+    for (i = parameter_group_count; i > 0; i--)
+    {
+        other = parameter_groups[i - 1];
+
+        if (other->first_id < group->first_id)
+            break;
+
+        parameter_groups[i] = other;
+    }
+
+    parameter_groups[i] = group;
+    parameter_group_count++;
+    parameter_count += group->count;
+
+    /* Check the neighbours for overlapping IDs */
+    if (((i > 0) &&
+         (parameter_groups[i - 1]->first_id +
+          parameter_groups[i - 1]->count > group->first_id)) ||
+        ((i + 1 < parameter_group_count) &&
+         (group->first_id + group->count >
+          parameter_groups[i + 1]->first_id)))
+        osalSysHalt("Parameter registration error.");
+}
+
+/**
+ * @brief               Returns the number of registered parameters.
+ *
+ * @return              Number of parameters.
+ */
+uint16_t ParametersCount(void)
+{
+    return parameter_count;
+}
+
+/**
+ * @brief               Calculates a checksum over the description and value
+ *                      of all parameters, equal checksums mean a cached copy
+ *                      of the table is up to date.
+ *
+ * @return              CRC16 of the parameters.
+ */
+uint16_t ParametersChecksum(void)
+{
+    const parameter_group_t *group;
+    parameter_info_t info;
+    uint32_t i, value;
+    uint16_t n, crc = 0xffff;
+
+    for (i = 0; i < parameter_group_count; i++)
+    {
+        group = parameter_groups[i];
+
+        for (n = 0; n < group->count; n++)
+        {
+            ParameterInfo(&group->parameters[n],
+                          group,
+                          group->first_id + n,
+                          &info);
+            value = ParameterRead(&group->parameters[n]);
+
+            crc = CRC16_chunk((uint8_t *)&info, PARAMETER_INFO_SIZE, crc);
+            crc = CRC16_chunk((uint8_t *)&value, PARAMETERS_VALUE_SIZE, crc);
+        }
+    }
+
+    return crc;
+}
+
+/**
+ * @brief               Writes a message with the description of a range of
+ *                      parameters.
+ *
+ * @param[in] first     Index of the first parameter.
+ * @param[in] count     Requested number of parameters, bounded to the table
+ *                      and to PARAMETERS_MAX_INFO_COUNT.
+ * @param[out] dest     Pointer to the message, PARAMETERS_MAX_PAYLOAD bytes.
+ * @return              Size of the message.
+ */
+size_t ParametersGetInfo(uint16_t first, uint8_t count, uint8_t *dest)
+{
+    const parameter_t *p;
+    parameter_info_t info;
+    uint32_t group;
+    uint16_t id;
+    uint8_t n;
+
+    count = ParametersBoundRange(first, count, PARAMETERS_MAX_INFO_COUNT);
+    ParametersRangeHeader(first, count, dest);
+
+    for (n = 0; n < count; n++)
+    {
+        p = ParameterFind(first + n, &group, &id);
+        ParameterInfo(p, parameter_groups[group], id, &info);
+
+        memcpy(&dest[PARAMETER_RANGE_SIZE + n * PARAMETER_INFO_SIZE],
+               &info,
+               PARAMETER_INFO_SIZE);
+    }
+
+    return PARAMETER_RANGE_SIZE + count * PARAMETER_INFO_SIZE;
+}
+
+/**
+ * @brief               Writes a message with the values of a range of
+ *                      parameters.
+ *
+ * @param[in] first     Index of the first parameter.
+ * @param[in] count     Requested number of parameters, bounded to the table
+ *                      and to PARAMETERS_MAX_VALUE_COUNT. Zero gives only
+ *                      the number of parameters and the checksum.
+ * @param[out] dest     Pointer to the message, PARAMETERS_MAX_PAYLOAD bytes.
+ * @return              Size of the message.
+ */
+size_t ParametersGetValues(uint16_t first, uint8_t count, uint8_t *dest)
+{
+    const parameter_t *p;
+    uint32_t group, value;
+    uint16_t id;
+    uint8_t n;
+
+    count = ParametersBoundRange(first, count, PARAMETERS_MAX_VALUE_COUNT);
+    ParametersRangeHeader(first, count, dest);
+
+    for (n = 0; n < count; n++)
+    {
+        p = ParameterFind(first + n, &group, &id);
+        value = ParameterRead(p);
+
+        memcpy(&dest[PARAMETER_RANGE_SIZE + n * PARAMETERS_VALUE_SIZE],
+               &value,
+               PARAMETERS_VALUE_SIZE);
+    }
+
+    return PARAMETER_RANGE_SIZE + count * PARAMETERS_VALUE_SIZE;
+}
+
+/**
+ * @brief               Writes the values of a range of parameters, bounded
+ *                      to the limits of each parameter. The owning modules
+ *                      are notified once after all values are written.
+ *
+ * @param[in] first     Index of the first parameter.
+ * @param[in] count     Number of values.
+ * @param[in] values    Pointer to the values, PARAMETERS_VALUE_SIZE bytes
+ *                      each.
+ * @return              Number of parameters written.
+ */
+uint8_t ParametersSetValues(uint16_t first,
+                            uint8_t count,
+                            const uint8_t *values)
+{
+    const parameter_t *p;
+    uint32_t group, value, changed = 0;
+    uint16_t id;
+    uint8_t n, written = 0;
+
+    count = ParametersBoundRange(first, count, PARAMETERS_MAX_VALUE_COUNT);
+
+    for (n = 0; n < count; n++)
+    {
+        p = ParameterFind(first + n, &group, &id);
+        memcpy(&value, &values[n * PARAMETERS_VALUE_SIZE],
+               PARAMETERS_VALUE_SIZE);
+
+        if (ParameterWrite(p, value) == true)
+        {
+            changed |= (1 << group);
+            written++;
+        }
+    }
+
+    for (group = 0; group < parameter_group_count; group++)
+    {
+        if ((changed & (1 << group)) &&
+            (parameter_groups[group]->changed != NULL))
+            parameter_groups[group]->changed();
+    }
+
+    return written;
+}
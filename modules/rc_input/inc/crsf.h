@@ -0,0 +1,168 @@
+#ifndef __CRSF_H
+#define __CRSF_H
+
+#include "hal.h"
+
+/*===========================================================================*/
+/* Module global definitions.                                                */
+/*===========================================================================*/
+
+#define CRSF_BAUDRATE                       420000
+#define CRSF_ADDRESS_FLIGHT_CONTROLLER      0xc8
+#define CRSF_ADDRESS_BROADCAST              0x00
+#define CRSF_SYNC_BYTE                      0xee
+
+#define CRSF_FRAME_SIZE_MAX                 64
+#define CRSF_PAYLOAD_SIZE_MAX               (CRSF_FRAME_SIZE_MAX - 4)
+#define CRSF_FRAME_QUEUE_SIZE               4
+
+#define CRSF_FRAMETYPE_LINK_STATISTICS      0x14
+#define CRSF_FRAMETYPE_RC_CHANNELS_PACKED   0x16
+
+#define CRSF_NUMBER_OF_CHANNELS             16
+#define CRSF_RC_CHANNELS_PAYLOAD_SIZE       22
+
+#define CRSF_LINK_STATISTICS_SIZE           (sizeof(crsf_link_statistics_t))
+#define CRSF_STATISTICS_SIZE                (sizeof(crsf_statistics_t))
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   CRSF receive state.
+ */
+typedef enum {
+    /**
+     * @brief   Waiting for an address byte, single bytes from rxchar.
+     */
+    CRSF_WAITING_FOR_ADDRESS = 0,
+    /**
+     * @brief   Receiving the length byte.
+     */
+    CRSF_RECEIVING_LENGTH,
+    /**
+     * @brief   Receiving type, payload and CRC through DMA.
+     */
+    CRSF_RECEIVING_FRAME
+} crsf_state_t;
+
+/**
+ * @brief   CRSF frame.
+ */
+typedef struct PACKED_VAR {
+    /**
+     * @brief   Device address.
+     */
+    uint8_t address;
+    /**
+     * @brief   Number of bytes after this byte (type, payload and CRC).
+     */
+    uint8_t length;
+    /**
+     * @brief   Frame type.
+     */
+    uint8_t type;
+    /**
+     * @brief   Payload followed by the CRC.
+     */
+    uint8_t payload[CRSF_PAYLOAD_SIZE_MAX + 1];
+} crsf_frame_t;
+
+/**
+ * @brief   CRSF link statistics, as sent by the receiver.
+ */
+typedef struct PACKED_VAR {
+    /**
+     * @brief   Uplink RSSI of antenna 1 in -dBm.
+     */
+    uint8_t uplink_rssi_1;
+    /**
+     * @brief   Uplink RSSI of antenna 2 in -dBm.
+     */
+    uint8_t uplink_rssi_2;
+    /**
+     * @brief   Uplink link quality in percent.
+     */
+    uint8_t uplink_link_quality;
+    /**
+     * @brief   Uplink SNR in dB.
+     */
+    int8_t uplink_snr;
+    /**
+     * @brief   Active antenna.
+     */
+    uint8_t active_antenna;
+    /**
+     * @brief   RF mode (packet rate index).
+     */
+    uint8_t rf_mode;
+    /**
+     * @brief   Uplink TX power index.
+     */
+    uint8_t uplink_tx_power;
+    /**
+     * @brief   Downlink RSSI in -dBm.
+     */
+    uint8_t downlink_rssi;
+    /**
+     * @brief   Downlink link quality in percent.
+     */
+    uint8_t downlink_link_quality;
+    /**
+     * @brief   Downlink SNR in dB.
+     */
+    int8_t downlink_snr;
+} crsf_link_statistics_t;
+
+/**
+ * @brief   CRSF receiver statistics.
+ */
+typedef struct PACKED_VAR {
+    /**
+     * @brief   Latest link statistics from the receiver.
+     */
+    crsf_link_statistics_t link;
+    /**
+     * @brief   Number of correctly received frames.
+     */
+    uint32_t rx_success;
+    /**
+     * @brief   Number of frames with invalid CRC.
+     */
+    uint32_t rx_crc_error;
+    /**
+     * @brief   Number of frames with invalid length.
+     */
+    uint32_t rx_size_error;
+    /**
+     * @brief   Number of frames dropped due to a full queue.
+     */
+    uint32_t rx_overrun;
+    /**
+     * @brief   Number of UART errors (framing, noise, overrun).
+     */
+    uint32_t rx_uart_error;
+} crsf_statistics_t;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+void CRSFInit(void);
+void CRSFStart(void);
+void CRSFStop(void);
+msg_t CRSFGetFrame(crsf_frame_t *frame, systime_t timeout);
+void CRSFDecodeChannels(const crsf_frame_t *frame,
+                        uint16_t channels[CRSF_NUMBER_OF_CHANNELS]);
+void CRSFDecodeLinkStatistics(const crsf_frame_t *frame);
+crsf_statistics_t *ptrGetCRSFStatistics(void);
+
+#endif
@@ -135,7 +135,11 @@ typedef enum {
     /**
      * @brief   SBUS input: serial input
      */
-    RCINPUT_MODE_SBUS_INPUT = 2
+    RCINPUT_MODE_SBUS_INPUT = 2,
+    /**
+     * @brief   CRSF input: serial input on AUX3
+     */
+    RCINPUT_MODE_CRSF_INPUT = 3
 } rcinput_mode_t;
 
 /**
@@ -350,9 +354,11 @@ typedef struct PACKED_VAR {
 void RCInputInit(void);
 msg_t RCInputInitialization(void);
 float RCInputGetInputLevel(rcinput_role_selector_t role);
+float RCInputGetInterpolatedLevel(rcinput_role_selector_t role);
 rcinput_switch_position_t RCInputGetSwitchState(rcinput_role_selector_t role);
 void vParseSetRCInputSettings(const uint8_t *payload,
                               const size_t data_length);
+void RCInputParseSBUSByte(const uint8_t data);
 bool bActiveRCInputConnection(void);
 rcinput_data_t *ptrGetRCInputData(void);
 rcinput_settings_t *ptrGetRCInputSettings(void);
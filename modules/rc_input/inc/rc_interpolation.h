@@ -0,0 +1,107 @@
+#ifndef __RC_INTERPOLATION_H
+#define __RC_INTERPOLATION_H
+
+#include "rc_input.h"
+
+/*===========================================================================*/
+/* Module global definitions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Number of frames kept in the history.
+ */
+#define RCINTERPOLATION_HISTORY_SIZE        4
+
+/**
+ * @brief   Number of interpolated roles, throttle, pitch, roll and yaw.
+ */
+#define RCINTERPOLATION_NUMBER_OF_ROLES     4
+
+/**
+ * @brief   Frame interval limits in seconds, intervals outside are not used
+ *          in the estimate (lost frames or reconnects).
+ */
+#define RCINTERPOLATION_MIN_INTERVAL        0.001f
+#define RCINTERPOLATION_MAX_INTERVAL        0.1f
+
+/**
+ * @brief   Gain of the low pass filter for the frame interval estimate.
+ */
+#define RCINTERPOLATION_INTERVAL_GAIN       0.05f
+
+#define RCINTERPOLATION_SETTINGS_SIZE       (sizeof(rcinterpolation_settings_t))
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   RC interpolation modes.
+ */
+typedef enum PACKED_VAR {
+    /**
+     * @brief   No interpolation, the latest frame is used directly.
+     */
+    RCINTERPOLATION_MODE_NONE = 0,
+    /**
+     * @brief   Linear ramp from the previous to the latest frame over one
+     *          frame interval, adds one frame interval of delay.
+     */
+    RCINTERPOLATION_MODE_LINEAR = 1,
+    /**
+     * @brief   Extrapolation from the latest frame with the slope over the
+     *          last frames, no added delay.
+     */
+    RCINTERPOLATION_MODE_PREDICTIVE = 2
+} rcinterpolation_mode_t;
+
+/**
+ * @brief   RC interpolation settings.
+ */
+typedef struct PACKED_VAR {
+    /**
+     * @brief   Interpolation mode.
+     */
+    rcinterpolation_mode_t mode;
+    /**
+     * @brief   Maximum prediction horizon in frame intervals (0.0 to 1.0),
+     *          only used in predictive mode.
+     */
+    float max_prediction;
+} rcinterpolation_settings_t;
+
+/**
+ * @brief   Timestamped RC frame.
+ */
+typedef struct {
+    /**
+     * @brief   System time of the frame arrival.
+     */
+    systime_t time;
+    /**
+     * @brief   Calibrated levels of the interpolated roles.
+     */
+    float level[RCINTERPOLATION_NUMBER_OF_ROLES];
+} rcinterpolation_frame_t;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+void RCInterpolationInit(void);
+void RCInterpolationResetI(void);
+void RCInterpolationSettingsValidate(rcinterpolation_settings_t *settings);
+void RCInterpolationPushFrameI(
+            const float level[RCINTERPOLATION_NUMBER_OF_ROLES]);
+float RCInterpolationGetLevel(const rcinput_role_selector_t role);
+float fRCInterpolationGetFrameInterval(void);
+rcinterpolation_settings_t *ptrGetRCInterpolationSettings(void);
+
+#endif
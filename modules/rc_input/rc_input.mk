@@ -1,5 +1,7 @@
 # List of all the module's related files.
-RCINPUT_SRCS = $(MODULE_DIR)/rc_input/src/rc_input.c
+RCINPUT_SRCS = $(MODULE_DIR)/rc_input/src/rc_input.c \
+               $(MODULE_DIR)/rc_input/src/crsf.c \
+               $(MODULE_DIR)/rc_input/src/rc_interpolation.c
 
 # Required include directories
 RCINPUT_INC = $(MODULE_DIR)/rc_input/inc
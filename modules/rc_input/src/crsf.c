@@ -0,0 +1,295 @@
+/* *
+ *
+ * CRSF (Crossfire / ExpressLRS) receiver protocol.
+ *
+ * The receiver is connected to the AUX3 port and sends frames of the form:
+ *
+ *   [address] [length] [type] [payload ...] [CRC8]
+ *
+ * at 420 kbit/s, 8N1, where length counts type, payload and CRC. Reception
+ * is done on the frame level: the address byte is caught by the UART
+ * character callback, after which the length byte and the rest of the frame
+ * are received through DMA. Completed frames are put in a small queue and the
+ * CRC (DVB-S2) is checked in thread context by CRSFGetFrame.
+ *
+ * */
+
+#include "ch.h"
+#include "hal.h"
+#include "crc.h"
+#include "crsf.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+static void crsf_rxend(UARTDriver *uartp);
+static void crsf_rxchar(UARTDriver *uartp, uint16_t c);
+static void crsf_rxerr(UARTDriver *uartp, uartflags_t e);
+
+#define CRSF_UART_DRIVER                    UARTD4
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Queue of received frames, the frame at the write index is the one
+ *          being received.
+ */
+static crsf_frame_t crsf_frames[CRSF_FRAME_QUEUE_SIZE];
+static uint32_t crsf_write_idx;
+static uint32_t crsf_read_idx;
+static uint32_t crsf_queue_count;
+
+/**
+ * @brief   Semaphore counting the frames ready to be read.
+ */
+static semaphore_t crsf_frame_sem;
+
+/**
+ * @brief   Current receive state.
+ */
+static crsf_state_t crsf_state;
+
+/**
+ * @brief   Receiver and link statistics.
+ */
+static crsf_statistics_t crsf_statistics;
+
+/* CRSF configuration:  1 start + 8 data + 1 stop (8N1),
+ *                      baudrate = 420000 bit/s
+ */
+static const UARTConfig crsf_config =
+{
+    NULL,                   /* End of transmission buffer callback    */
+    NULL,                   /* Physical end of transmission callback  */
+    crsf_rxend,             /* Receive buffer filled callback         */
+    crsf_rxchar,            /* Character received while out of the
+                               receive state callback                 */
+    crsf_rxerr,             /* Receive error callback                 */
+    CRSF_BAUDRATE,          /* 420000 bit/s                           */
+    0,
+    USART_CR2_STOP1_BITS,   /* 1 stop bit                             */
+    0
+};
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief               Character callback, catches the address byte while
+ *                      no DMA reception is active.
+ *
+ * @param[in] uartp     Pointer to the UART driver.
+ * @param[in] c         Received character.
+ */
+static void crsf_rxchar(UARTDriver *uartp, uint16_t c)
+{
+    if ((c != CRSF_ADDRESS_FLIGHT_CONTROLLER) && (c != CRSF_SYNC_BYTE))
+        return;
+
+    osalSysLockFromISR();
+
+    crsf_frames[crsf_write_idx].address = (uint8_t)c;
+    crsf_state = CRSF_RECEIVING_LENGTH;
+    uartStartReceiveI(uartp, 1, &crsf_frames[crsf_write_idx].length);
+
+    osalSysUnlockFromISR();
+}
+
+/**
+ * @brief               DMA receive complete callback, receives the rest of
+ *                      the frame after the length and queues finished frames.
+ *
+ * @param[in] uartp     Pointer to the UART driver.
+ */
+static void crsf_rxend(UARTDriver *uartp)
+{
+    crsf_frame_t *frame = &crsf_frames[crsf_write_idx];
+
+    osalSysLockFromISR();
+
+    if (crsf_state == CRSF_RECEIVING_LENGTH)
+    {
+        /* At least type and CRC, and must fit the buffer. */
+        if ((frame->length < 2) || (frame->length > CRSF_FRAME_SIZE_MAX - 2))
+        {
+            crsf_statistics.rx_size_error++;
+            crsf_state = CRSF_WAITING_FOR_ADDRESS;
+        }
+        else
+        {
+            crsf_state = CRSF_RECEIVING_FRAME;
+            uartStartReceiveI(uartp, frame->length, &frame->type);
+        }
+    }
+    else if (crsf_state == CRSF_RECEIVING_FRAME)
+    {
+        crsf_state = CRSF_WAITING_FOR_ADDRESS;
+
+        /* Keep one free frame to receive into, else drop the new frame. */
+        if (crsf_queue_count < CRSF_FRAME_QUEUE_SIZE - 1)
+        {
+            crsf_queue_count++;
+            crsf_write_idx = (crsf_write_idx + 1) % CRSF_FRAME_QUEUE_SIZE;
+            chSemSignalI(&crsf_frame_sem);
+        }
+        else
+            crsf_statistics.rx_overrun++;
+    }
+
+    osalSysUnlockFromISR();
+}
+
+/**
+ * @brief               Receive error callback.
+ *
+ * @param[in] uartp     Pointer to the UART driver.
+ * @param[in] e         Error flags.
+ */
+static void crsf_rxerr(UARTDriver *uartp, uartflags_t e)
+{
+    (void)uartp;
+    (void)e;
+
+    /* A broken frame is caught by the CRC. */
+    crsf_statistics.rx_uart_error++;
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief           Initializes the CRSF receiver. The UART is started by the
+ *                  serial manager when AUX3 has the CRSF role.
+ */
+void CRSFInit(void)
+{
+    chSemObjectInit(&crsf_frame_sem, 0);
+
+    crsf_write_idx = 0;
+    crsf_read_idx = 0;
+    crsf_queue_count = 0;
+    crsf_state = CRSF_WAITING_FOR_ADDRESS;
+    memset(&crsf_statistics, 0, CRSF_STATISTICS_SIZE);
+}
+
+/**
+ * @brief           Starts the UART of the CRSF receiver.
+ */
+void CRSFStart(void)
+{
+    /* The UART is stopped, no callbacks can run */
+    crsf_state = CRSF_WAITING_FOR_ADDRESS;
+
+    uartStart(&CRSF_UART_DRIVER, &crsf_config);
+}
+
+/**
+ * @brief           Stops the UART of the CRSF receiver, frames already
+ *                  queued can still be read.
+ */
+void CRSFStop(void)
+{
+    uartStop(&CRSF_UART_DRIVER);
+}
+
+/**
+ * @brief               Waits for a new frame and checks its CRC.
+ *
+ * @param[out] frame    Pointer to where the frame will be copied.
+ * @param[in] timeout   Time to wait for a frame.
+ * @return              MSG_OK if a valid frame was received, MSG_TIMEOUT on
+ *                      timeout or MSG_RESET if the frame failed the CRC.
+ */
+msg_t CRSFGetFrame(crsf_frame_t *frame, systime_t timeout)
+{
+    msg_t status;
+    uint8_t crc;
+
+    status = chSemWaitTimeout(&crsf_frame_sem, timeout);
+
+    if (status != MSG_OK)
+        return status;
+
+    /* The ISR never writes to a queued frame, copy without locking. */
+    memcpy(frame, &crsf_frames[crsf_read_idx], sizeof(crsf_frame_t));
+
+    osalSysLock();
+    crsf_read_idx = (crsf_read_idx + 1) % CRSF_FRAME_QUEUE_SIZE;
+    crsf_queue_count--;
+    osalSysUnlock();
+
+    /* CRC over type and payload. */
+    crc = CRC8_DVB_S2(&frame->type, frame->length - 1);
+
+    if (crc != frame->payload[frame->length - 2])
+    {
+        crsf_statistics.rx_crc_error++;
+        return MSG_RESET;
+    }
+
+    crsf_statistics.rx_success++;
+
+    return MSG_OK;
+}
+
+/**
+ * @brief               Decodes a RC channels frame to pulse widths in us.
+ * @note                CRSF values 172 to 1811 map to 988 us to 2012 us.
+ *
+ * @param[in] frame     Frame of type CRSF_FRAMETYPE_RC_CHANNELS_PACKED.
+ * @param[out] channels Decoded channels.
+ */
+void CRSFDecodeChannels(const crsf_frame_t *frame,
+                        uint16_t channels[CRSF_NUMBER_OF_CHANNELS])
+{
+    uint32_t bits = 0, nbits = 0, ch = 0, i;
+    int32_t raw;
+
+    /* 16 channels of 11 bits, little endian bit order. */
+    for (i = 0; i < CRSF_RC_CHANNELS_PAYLOAD_SIZE; i++)
+    {
+        bits |= (uint32_t)frame->payload[i] << nbits;
+        nbits += 8;
+
+        while (nbits >= 11)
+        {
+            raw = (int32_t)(bits & 0x07ff);
+            bits >>= 11;
+            nbits -= 11;
+
+            channels[ch++] = (uint16_t)(1500 + ((raw - 992) * 5) / 8);
+        }
+    }
+}
+
+/**
+ * @brief               Decodes a link statistics frame into the statistics.
+ *
+ * @param[in] frame     Frame of type CRSF_FRAMETYPE_LINK_STATISTICS.
+ */
+void CRSFDecodeLinkStatistics(const crsf_frame_t *frame)
+{
+    osalSysLock();
+
+    memcpy(&crsf_statistics.link, frame->payload, CRSF_LINK_STATISTICS_SIZE);
+
+    osalSysUnlock();
+}
+
+/**
+ * @brief           Return the pointer to the CRSF statistics.
+ *
+ * @return          Pointer to the CRSF statistics.
+ */
+crsf_statistics_t *ptrGetCRSFStatistics(void)
+{
+    return &crsf_statistics;
+}
@@ -9,14 +9,18 @@
 #include "eicu.h"
 #include "flash_save.h"
 #include "rc_input.h"
+#include "crsf.h"
+#include "rc_interpolation.h"
 #include "trigonometry.h"
 
 /*===========================================================================*/
 /* Module local definitions.                                                 */
 /*===========================================================================*/
 static void ParseSBUSInput(const uint8_t data);
+static void ParseCRSFFrame(const crsf_frame_t *frame);
 static void ParseCPPMInput(const uint32_t capture);
 static void RawInputToCalibratedInput(void);
+static void PushInterpolationFrameI(void);
 static void cppm_callback(EICUDriver *eicup, eicuchannel_t channel);
 static void rssi_callback(EICUDriver *eicup, eicuchannel_t channel);
 static void vt_no_connection_timeout_callback(void *p);
@@ -111,63 +115,51 @@ static const EICUConfig rssi_rcinputcfg = {
 };
 
 uint16_t rssi_counter = 0;
-THD_WORKING_AREA(waThreadRCInputFlashSave, 256);
 THD_WORKING_AREA(waThreadRCInputSBUS, 256);
+THD_WORKING_AREA(waThreadRCInputCRSF, 256);
 
 /*===========================================================================*/
 /* Module local functions.                                                   */
 /*===========================================================================*/
 
 /**
- * @brief           Thread for the flash save operation.
+ * @brief           Thread for SBUS.
  *
  * @param[in] arg   Unused.
  * @return          Unused.
  */
-static THD_FUNCTION(ThreadRCInputFlashSave, arg)
+static THD_FUNCTION(ThreadRCInputSBUS, arg)
 {
     (void)arg;
 
-    /* Event registration for new estimation */
-    event_listener_t el;
-
     /* Set thread name */
-    chRegSetThreadName("RCInput FlashSave");
-
-    /* Register to new estimation */
-    chEvtRegisterMask(ptrGetFlashSaveEventSource(),
-                      &el,
-                      FLASHSAVE_SAVE_EVENTMASK);
+    chRegSetThreadName("RCInput SBUS");
 
     while (1)
     {
-        /* Wait for new estimation */
-        chEvtWaitOne(FLASHSAVE_SAVE_EVENTMASK);
-
-        /* Save RC input settings to flash */
-        FlashSave_Write(FlashSave_STR2ID("RCIN"),
-                        true,
-                        (uint8_t *)&rcinput_settings,
-                        RCINPUT_SETTINGS_SIZE);
+        ParseSBUSInput(sdGet(&SBUS_SERIAL_DRIVER));
     }
 }
 
 /**
- * @brief           Thread for SBUS.
+ * @brief           Thread for CRSF.
  *
  * @param[in] arg   Unused.
  * @return          Unused.
  */
-static THD_FUNCTION(ThreadRCInputSBUS, arg)
+static THD_FUNCTION(ThreadRCInputCRSF, arg)
 {
     (void)arg;
 
+    crsf_frame_t frame;
+
     /* Set thread name */
-    chRegSetThreadName("RCInput SBUS");
+    chRegSetThreadName("RCInput CRSF");
 
     while (1)
     {
-        ParseSBUSInput(sdGet(&SBUS_SERIAL_DRIVER));
+        if (CRSFGetFrame(&frame, TIME_INFINITE) == MSG_OK)
+            ParseCRSFFrame(&frame);
     }
 }
 
@@ -252,6 +244,10 @@ static void ParseSBUSInput(const uint8_t data)
           /* Parse new input to calibrated values. */
           RawInputToCalibratedInput();
 
+          osalSysLock();
+          PushInterpolationFrameI();
+          osalSysUnlock();
+
           chEvtBroadcastFlags(&rcinput_es, RCINPUT_NEWINPUT_EVENTMASK);
         }
         else
@@ -281,6 +277,69 @@ static void ParseSBUSInput(const uint8_t data)
             NULL);
 }
 
+/**
+ * @brief           Parses a CRSF frame with valid CRC.
+ *
+ * @param[in] frame The received frame.
+ */
+static void ParseCRSFFrame(const crsf_frame_t *frame)
+{
+    uint16_t channels[CRSF_NUMBER_OF_CHANNELS];
+    int i;
+
+    if (frame->type == CRSF_FRAMETYPE_LINK_STATISTICS)
+    {
+        if (frame->length != CRSF_LINK_STATISTICS_SIZE + 2)
+            return;
+
+        CRSFDecodeLinkStatistics(frame);
+
+        /* Use the uplink link quality as RSSI, both are in percent. */
+        rcinput_data.rssi =
+            ptrGetCRSFStatistics()->link.uplink_link_quality;
+
+        return;
+    }
+    else if ((frame->type != CRSF_FRAMETYPE_RC_CHANNELS_PACKED) ||
+             (frame->length != CRSF_RC_CHANNELS_PAYLOAD_SIZE + 2))
+        return;
+
+    /* SBUS has priority */
+    if (rcinput_data.input_mode == RCINPUT_MODE_SBUS_INPUT)
+        return;
+
+    /* Save the data */
+    CRSFDecodeChannels(frame, channels);
+
+    for (i = 0; i < CRSF_NUMBER_OF_CHANNELS; i++)
+        rcinput_data.value[i] = channels[i];
+
+    rcinput_data.number_active_connections = CRSF_NUMBER_OF_CHANNELS;
+
+    if (rcinput_data.active_connection.value == false)
+    {
+        rcinput_data.active_connection.value = true;
+        chEvtBroadcastFlags(&rcinput_es, RCINPUT_ACTIVE_EVENTMASK);
+    }
+
+    /* Set input mode */
+    rcinput_data.input_mode = RCINPUT_MODE_CRSF_INPUT;
+
+    /* Parse new input to calibrated values. */
+    RawInputToCalibratedInput();
+
+    osalSysLock();
+    PushInterpolationFrameI();
+    osalSysUnlock();
+
+    chEvtBroadcastFlags(&rcinput_es, RCINPUT_NEWINPUT_EVENTMASK);
+
+    chVTSet(&rcinput_timeout_vt,
+            MS2ST(RCINPUT_NO_CON_TIMEOUT_MS),
+            vt_no_connection_timeout_callback,
+            NULL);
+}
+
 /**
  * @brief               Parses CPPM inputs. This function runs inside a
  *                      osalSysLockFromISR.
@@ -291,8 +350,9 @@ static void ParseCPPMInput(const uint32_t capture)
 {
     static uint16_t cppm_count = 0; /* Current CPPM channel */
 
-    // SBUS has priority
-    if (rcinput_data.input_mode == RCINPUT_MODE_SBUS_INPUT)
+    // Serial inputs have priority
+    if ((rcinput_data.input_mode == RCINPUT_MODE_SBUS_INPUT) ||
+        (rcinput_data.input_mode == RCINPUT_MODE_CRSF_INPUT))
       return;
 
     if (rcinput_data.active_connection.value == true)
@@ -308,6 +368,7 @@ static void ParseCPPMInput(const uint32_t capture)
 
             /* Parse new input to calibrated values. */
             RawInputToCalibratedInput();
+            PushInterpolationFrameI();
 
             /* Reset CPPM counter */
             cppm_count = 0;
@@ -672,6 +733,30 @@ static void RawInputToCalibratedInput(void)
             RCINPUT_ROLE_SWITCHES_START] = GetSwitchState(i);
 }
 
+/**
+ * @brief   Adds the calibrated throttle, pitch, roll and yaw levels to the
+ *          interpolation history. Must be called from a locked context.
+ */
+static void PushInterpolationFrameI(void)
+{
+    float level[RCINTERPOLATION_NUMBER_OF_ROLES];
+    uint8_t idx;
+    int i;
+
+    /* The interpolated roles are the first roles. */
+    for (i = 0; i < RCINTERPOLATION_NUMBER_OF_ROLES; i++)
+    {
+        idx = RoleToIndex((rcinput_role_selector_t)i);
+
+        if (idx < RCINPUT_MAX_NUMBER_OF_INPUTS)
+            level[i] = rcinput_data.calibrated_values.calibrated_value[idx];
+        else
+            level[i] = 0.0f;
+    }
+
+    RCInterpolationPushFrameI(level);
+}
+
 /**
  * @brief           Timeout callback for RC Input connection.
  * @details         This callback in invoked when neither the CPPM nor PWM
@@ -688,6 +773,7 @@ static void vt_no_connection_timeout_callback(void *p)
 
     /* Reset all inputs. */
     RCInputDataReset();
+    RCInterpolationResetI();
 
     chVTResetI(&rcinput_timeout_vt);
     chEvtBroadcastFlagsI(&rcinput_es, RCINPUT_LOST_EVENTMASK);
@@ -760,22 +846,44 @@ void RCInputInit(void)
                    (uint8_t *)&rcinput_settings,
                    RCINPUT_SETTINGS_SIZE);
 
+    /* Initialize and read RC interpolation settings from flash */
+    RCInterpolationInit();
+
+    FlashSave_Read(FlashSave_STR2ID("RCIP"),
+                   (uint8_t *)ptrGetRCInterpolationSettings(),
+                   RCINTERPOLATION_SETTINGS_SIZE);
+
+    RCInterpolationSettingsValidate(ptrGetRCInterpolationSettings());
+
+    /* Register the settings for saving to flash */
+    FlashSave_Register(FlashSave_STR2ID("RCIN"),
+                       &rcinput_settings,
+                       RCINPUT_SETTINGS_SIZE,
+                       NULL);
+
+    FlashSave_Register(FlashSave_STR2ID("RCIP"),
+                       ptrGetRCInterpolationSettings(),
+                       RCINTERPOLATION_SETTINGS_SIZE,
+                       NULL);
+
     if (RCInputInitialization() != MSG_OK)
         osalSysHalt("RC input initialization failed.");
 
-    /* Start the Flash Save thread */
-    chThdCreateStatic(waThreadRCInputFlashSave,
-                      sizeof(waThreadRCInputFlashSave),
-                      NORMALPRIO,
-                      ThreadRCInputFlashSave,
-                      NULL);
-
     /* Start the SBUS thread */
     chThdCreateStatic(waThreadRCInputSBUS,
                       sizeof(waThreadRCInputSBUS),
                       HIGHPRIO,
                       ThreadRCInputSBUS,
                       NULL);
+
+    /* Start the CRSF receiver and thread */
+    CRSFInit();
+
+    chThdCreateStatic(waThreadRCInputCRSF,
+                      sizeof(waThreadRCInputCRSF),
+                      HIGHPRIO,
+                      ThreadRCInputCRSF,
+                      NULL);
 }
 
 /**
@@ -838,6 +946,28 @@ float RCInputGetInputLevel(const rcinput_role_selector_t role)
         return rcinput_data.calibrated_values.calibrated_value[idx];
 }
 
+/**
+ * @brief           Gets the analog level of the requested role, interpolated
+ *                  to the current time. Only throttle, pitch, roll and yaw
+ *                  are interpolated, other roles give the latest level.
+ *
+ * @param[in] role  The role to get the value of.
+ * @return          The interpolated analog value.
+ */
+float RCInputGetInterpolatedLevel(const rcinput_role_selector_t role)
+{
+    if (rcinput_data.active_connection.value == false)
+        return 0.0f;
+    else if (((uint32_t)role >= RCINTERPOLATION_NUMBER_OF_ROLES) ||
+             (ptrGetRCInterpolationSettings()->mode ==
+              RCINTERPOLATION_MODE_NONE))
+        return RCInputGetInputLevel(role);
+    else if (RoleToIndex(role) >= RCINPUT_MAX_NUMBER_OF_INPUTS)
+        return 0.0f;
+    else
+        return RCInterpolationGetLevel(role);
+}
+
 /**
  * @brief           Gets the current state of the requested switch.
  *
@@ -894,6 +1024,19 @@ bool bActiveRCInputConnection(void)
     return rcinput_data.active_connection.value;
 }
 
+/**
+ * @brief           Parses an SBUS byte received on an AUX port with the SBUS
+ *                  role.
+ * @note            The parser is shared with the SBUS input, only one SBUS
+ *                  receiver may be connected.
+ *
+ * @param[in] data  Received byte.
+ */
+void RCInputParseSBUSByte(const uint8_t data)
+{
+    ParseSBUSInput(data);
+}
+
 /**
  * @brief           Return the pointer to the RC Input data.
  *
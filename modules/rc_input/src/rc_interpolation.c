@@ -0,0 +1,251 @@
+/* *
+ *
+ * RC setpoint interpolation.
+ *
+ * RC frames arrive at 50 - 150 Hz while the control loop runs much faster,
+ * so using the latest frame directly gives staircase setpoints which the
+ * D-term amplifies. Each frame is stored with its arrival time and the
+ * setpoint is evaluated at control time, either as a linear ramp between
+ * the two latest frames or extrapolated from the latest frame.
+ *
+ * */
+
+#include "ch.h"
+#include "hal.h"
+#include "rc_interpolation.h"
+#include "trigonometry.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Frame history, newest at the head.
+ */
+static rcinterpolation_frame_t rcinterpolation_history[
+                                            RCINTERPOLATION_HISTORY_SIZE];
+static uint32_t rcinterpolation_head;
+static uint32_t rcinterpolation_count;
+
+/**
+ * @brief   Estimated frame interval in seconds.
+ */
+static float rcinterpolation_interval;
+
+/**
+ * @brief   RC interpolation settings.
+ */
+static rcinterpolation_settings_t rcinterpolation_settings;
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief           Returns a frame from the history.
+ *
+ * @param[in] age   Age of the frame, 0 is the newest.
+ * @return          Pointer to the frame.
+ */
+static inline const rcinterpolation_frame_t *GetFrame(const uint32_t age)
+{
+    return &rcinterpolation_history[(rcinterpolation_head +
+                                     RCINTERPOLATION_HISTORY_SIZE - age) %
+                                    RCINTERPOLATION_HISTORY_SIZE];
+}
+
+/**
+ * @brief           Converts a system time difference to seconds.
+ *
+ * @param[in] dt    Time difference in system ticks.
+ * @return          Time difference in seconds.
+ */
+static inline float TicksToSeconds(const systime_t dt)
+{
+    return (float)dt * (1.0f / (float)CH_CFG_ST_FREQUENCY);
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief           Initializes the RC interpolation, without interpolation.
+ */
+void RCInterpolationInit(void)
+{
+    rcinterpolation_settings.mode = RCINTERPOLATION_MODE_NONE;
+    rcinterpolation_settings.max_prediction = 1.0f;
+
+    osalSysLock();
+    RCInterpolationResetI();
+    osalSysUnlock();
+}
+
+/**
+ * @brief           Clears the frame history, used when the connection is
+ *                  lost.
+ */
+void RCInterpolationResetI(void)
+{
+    rcinterpolation_head = 0;
+    rcinterpolation_count = 0;
+    rcinterpolation_interval = 0.0f;
+}
+
+/**
+ * @brief               Bounds the settings to valid values.
+ *
+ * @param[in/out] settings  Settings to validate.
+ */
+void RCInterpolationSettingsValidate(rcinterpolation_settings_t *settings)
+{
+    if (settings->mode != RCINTERPOLATION_MODE_NONE &&
+        settings->mode != RCINTERPOLATION_MODE_LINEAR &&
+        settings->mode != RCINTERPOLATION_MODE_PREDICTIVE)
+        settings->mode = RCINTERPOLATION_MODE_NONE;
+
+    /* Catches NaN as well. */
+    if (!(settings->max_prediction >= 0.0f))
+        settings->max_prediction = 0.0f;
+    else if (settings->max_prediction > 1.0f)
+        settings->max_prediction = 1.0f;
+}
+
+/**
+ * @brief           Adds a new frame to the history and updates the frame
+ *                  interval estimate.
+ *
+ * @param[in] level Calibrated levels of throttle, pitch, roll and yaw.
+ */
+void RCInterpolationPushFrameI(
+            const float level[RCINTERPOLATION_NUMBER_OF_ROLES])
+{
+    const systime_t now = chVTGetSystemTimeX();
+    rcinterpolation_frame_t *frame;
+    int i;
+
+    if (rcinterpolation_count > 0)
+    {
+        const float dt = TicksToSeconds(now - GetFrame(0)->time);
+
+        if ((dt >= RCINTERPOLATION_MIN_INTERVAL) &&
+            (dt <= RCINTERPOLATION_MAX_INTERVAL))
+        {
+            if (rcinterpolation_interval == 0.0f)
+                rcinterpolation_interval = dt;
+            else
+                rcinterpolation_interval += RCINTERPOLATION_INTERVAL_GAIN *
+                                            (dt - rcinterpolation_interval);
+        }
+        else if (dt > RCINTERPOLATION_MAX_INTERVAL)
+        {
+            /* Too old to interpolate from, restart the history. */
+            rcinterpolation_count = 0;
+        }
+
+        rcinterpolation_head = (rcinterpolation_head + 1) %
+                               RCINTERPOLATION_HISTORY_SIZE;
+    }
+
+    frame = &rcinterpolation_history[rcinterpolation_head];
+    frame->time = now;
+
+    for (i = 0; i < RCINTERPOLATION_NUMBER_OF_ROLES; i++)
+        frame->level[i] = level[i];
+
+    if (rcinterpolation_count < RCINTERPOLATION_HISTORY_SIZE)
+        rcinterpolation_count++;
+}
+
+/**
+ * @brief           Evaluates the setpoint of a role at the current time.
+ *
+ * @param[in] role  Throttle, pitch, roll or yaw role.
+ * @return          The interpolated level.
+ */
+float RCInterpolationGetLevel(const rcinput_role_selector_t role)
+{
+    rcinterpolation_frame_t f0, f1, f2;
+    float interval, elapsed, level;
+    uint32_t count;
+
+    if ((uint32_t)role >= RCINTERPOLATION_NUMBER_OF_ROLES)
+        return 0.0f;
+
+    /* Copy the frames needed, the history is written from other threads and
+     * interrupts. */
+    osalSysLock();
+
+    count = rcinterpolation_count;
+    interval = rcinterpolation_interval;
+    elapsed = TicksToSeconds(chVTGetSystemTimeX() - GetFrame(0)->time);
+    f0 = *GetFrame(0);
+    f1 = *GetFrame(1);
+    f2 = *GetFrame(2);
+
+    osalSysUnlock();
+
+    if (count == 0)
+        return 0.0f;
+
+    /* Without interpolation or an interval estimate use the latest frame. */
+    if ((rcinterpolation_settings.mode == RCINTERPOLATION_MODE_NONE) ||
+        (count < 2) ||
+        (interval == 0.0f))
+        return f0.level[role];
+
+    if (rcinterpolation_settings.mode == RCINTERPOLATION_MODE_LINEAR)
+    {
+        /* Ramp from the previous to the latest frame over one interval. */
+        const float alpha = bound(1.0f, 0.0f, elapsed / interval);
+
+        level = f1.level[role] + alpha * (f0.level[role] - f1.level[role]);
+    }
+    else
+    {
+        /* Use the slope over up to two intervals, to smooth quantization,
+         * and extrapolate at most the maximum prediction horizon. */
+        const rcinterpolation_frame_t *fo = (count >= 3) ? &f2 : &f1;
+        const float span = TicksToSeconds(f0.time - fo->time);
+        const float horizon = fminf(elapsed, rcinterpolation_settings.
+                                             max_prediction * interval);
+
+        if (span > 0.0f)
+            level = f0.level[role] +
+                    (f0.level[role] - fo->level[role]) * (horizon / span);
+        else
+            level = f0.level[role];
+    }
+
+    /* Keep within the range of calibrated inputs. */
+    return bound(1.0f, -1.0f, level);
+}
+
+/**
+ * @brief           Returns the estimated RC frame interval.
+ *
+ * @return          Frame interval in seconds, 0 if unknown.
+ */
+float fRCInterpolationGetFrameInterval(void)
+{
+    return rcinterpolation_interval;
+}
+
+/**
+ * @brief           Return the pointer to the RC interpolation settings.
+ *
+ * @return          Pointer to the RC interpolation settings.
+ */
+rcinterpolation_settings_t *ptrGetRCInterpolationSettings(void)
+{
+    return &rcinterpolation_settings;
+}
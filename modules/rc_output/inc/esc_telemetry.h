@@ -0,0 +1,83 @@
+#ifndef __ESC_TELEMETRY_H
+#define __ESC_TELEMETRY_H
+
+#include "kfly_defs.h"
+
+/*===========================================================================*/
+/* Module global definitions.                                                */
+/*===========================================================================*/
+
+/* KISS / BLHeli32 telemetry frame, sent at 115200 bit/s 8N1 by the ESC whose
+   DShot packet had the telemetry bit set:
+
+     [temperature] [voltage 2] [current 2] [consumption 2] [eRPM 2] [CRC8]
+
+   with the 16 bit values big endian */
+#define ESC_TELEMETRY_FRAME_SIZE            10
+#define ESC_TELEMETRY_BAUDRATE              115200
+
+#define ESC_TELEMETRY_SIZE                  (sizeof(esc_telemetry_t))
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Latest ESC telemetry and decoder statistics.
+ */
+typedef struct PACKED_VAR
+{
+    /**
+     * @brief   ESC temperature, in deg C.
+     */
+    float temperature;
+    /**
+     * @brief   Battery voltage, in V.
+     */
+    float voltage;
+    /**
+     * @brief   Motor current, in A.
+     */
+    float current;
+    /**
+     * @brief   Consumed charge since power on, in mAh.
+     */
+    float consumption;
+    /**
+     * @brief   Electrical RPM.
+     */
+    float erpm;
+    /**
+     * @brief   Time since the last valid frame, in ms, saturated.
+     */
+    uint16_t age_ms;
+    /**
+     * @brief   Reserved for alignment.
+     */
+    uint16_t reserved;
+    /**
+     * @brief   Valid frames since start.
+     */
+    uint32_t frames;
+    /**
+     * @brief   Frames which failed the CRC since start.
+     */
+    uint32_t crc_errors;
+} esc_telemetry_t;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+void EscTelemetryInit(void);
+void EscTelemetryParseByte(const uint8_t data);
+void GetEscTelemetry(esc_telemetry_t *dest);
+
+#endif
@@ -1,5 +1,6 @@
 # List of all the module's related files.
-RCOUTPUT_SRCS = $(MODULE_DIR)/rc_output/src/rc_output.c
+RCOUTPUT_SRCS = $(MODULE_DIR)/rc_output/src/esc_telemetry.c \
+                $(MODULE_DIR)/rc_output/src/rc_output.c
 
 # Required include directories
 RCOUTPUT_INC = $(MODULE_DIR)/rc_output/inc
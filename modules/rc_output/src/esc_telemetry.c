@@ -0,0 +1,148 @@
+/* *
+ *
+ * KISS / BLHeli32 ESC telemetry decoder.
+ *
+ * The frames have no start marker, the decoder slides a window over the
+ * received bytes until the CRC matches and then stays aligned to the frames
+ * until a CRC fails.
+ *
+ * */
+
+#include <string.h>
+#include "ch.h"
+#include "hal.h"
+#include "crc.h"
+#include "esc_telemetry.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+/* Latest telemetry */
+static esc_telemetry_t esc_telemetry;
+
+/* Time of the latest valid frame */
+static systime_t esc_telemetry_time;
+
+/* Receive window, aligned to the frames while synchronized */
+static uint8_t esc_window[ESC_TELEMETRY_FRAME_SIZE];
+static uint32_t esc_window_count;
+static bool esc_synchronized;
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief               Reads a big endian 16 bit value.
+ *
+ * @param[in] data      Pointer to the value.
+ * @return              The value.
+ */
+static inline uint16_t EscTelemetryRead16(const uint8_t *data)
+{
+    return ((uint16_t)data[0] << 8) | data[1];
+}
+
+/**
+ * @brief               Decodes a frame with valid CRC.
+ *
+ * @param[in] frame     Pointer to the frame.
+ */
+static void EscTelemetryDecode(const uint8_t *frame)
+{
+    osalSysLock();
+
+    esc_telemetry.temperature = (float)frame[0];
+    esc_telemetry.voltage = 0.01f * (float)EscTelemetryRead16(&frame[1]);
+    esc_telemetry.current = 0.01f * (float)EscTelemetryRead16(&frame[3]);
+    esc_telemetry.consumption = (float)EscTelemetryRead16(&frame[5]);
+    esc_telemetry.erpm = 100.0f * (float)EscTelemetryRead16(&frame[7]);
+    esc_telemetry.frames++;
+    esc_telemetry_time = chVTGetSystemTimeX();
+
+    osalSysUnlock();
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief               Initializes the ESC telemetry decoder.
+ */
+void EscTelemetryInit(void)
+{
+    memset(&esc_telemetry, 0, ESC_TELEMETRY_SIZE);
+    esc_telemetry_time = chVTGetSystemTimeX();
+    esc_window_count = 0;
+    esc_synchronized = false;
+}
+
+/**
+ * @brief               Parses a byte received on a port with the ESC
+ *                      telemetry role.
+ *
+ * @param[in] data      Received byte.
+ */
+void EscTelemetryParseByte(const uint8_t data)
+{
+    esc_window[esc_window_count++] = data;
+
+    if (esc_window_count < ESC_TELEMETRY_FRAME_SIZE)
+        return;
+
+    if (CRC8(esc_window, ESC_TELEMETRY_FRAME_SIZE - 1) ==
+        esc_window[ESC_TELEMETRY_FRAME_SIZE - 1])
+    {
+        EscTelemetryDecode(esc_window);
+        esc_window_count = 0;
+        esc_synchronized = true;
+    }
+    else
+    {
+        /* Only a frame which was expected to be aligned is an error */
+        if (esc_synchronized == true)
+        {
+            osalSysLock();
+            esc_telemetry.crc_errors++;
+            osalSysUnlock();
+
+            esc_synchronized = false;
+        }
+
+        /* Slide the window one byte */
+        memmove(esc_window, &esc_window[1], ESC_TELEMETRY_FRAME_SIZE - 1);
+        esc_window_count = ESC_TELEMETRY_FRAME_SIZE - 1;
+    }
+}
+
+/**
+ * @brief               Reads the latest ESC telemetry.
+ *
+ * @param[out] dest     Pointer to the destination.
+ */
+void GetEscTelemetry(esc_telemetry_t *dest)
+{
+    systime_t age;
+
+    osalSysLock();
+
+    *dest = esc_telemetry;
+    age = chVTGetSystemTimeX() - esc_telemetry_time;
+
+    osalSysUnlock();
+
+    if (age >= MS2ST(0xffff))
+        dest->age_ms = 0xffff;
+    else
+        dest->age_ms = ST2MS(age);
+}
@@ -5,7 +5,9 @@
  * */
 
 #include "rc_output.h"
+#include "esc_telemetry.h"
 #include "flash_save.h"
+#include "parameters.h"
 
 /*===========================================================================*/
 /* Module local definitions.                                                 */
@@ -48,6 +50,16 @@
 #define DSHOT_BIT_0           26
 #define DSHOT_BIT_1           53
 
+/* Output mode of a bank in the parameter table */
+#define RCOUTPUT_MODE_PARAMETER(var)                                          \
+    {PARAMETER_TYPE_UNSIGNED_OF(rcoutput_mode_t), &(var),                     \
+     RCOUTPUT_MODE_50HZ_PWM, RCOUTPUT_MODE_DSHOT1200}
+
+/* Enable switch of a channel in the parameter table */
+#define RCOUTPUT_ENABLE_PARAMETER(ch)                                         \
+    {PARAMETER_TYPE_UNSIGNED_OF(bool),                                        \
+     &rcoutput_settings.channel_enabled[ch], 0, 1}
+
 /*===========================================================================*/
 /* Module exported variables.                                                */
 /*===========================================================================*/
@@ -93,48 +105,35 @@ rcoutput_configuration_t rcoutput_config;
 rcoutput_settings_t rcoutput_settings;
 
 /**
- * @brief Working area for the RC output flash save thread.
+ * @brief RC output settings in the parameter table, saved in the "RCOT"
+ *        record.
  */
-THD_WORKING_AREA(waThreadRCOutputFlashSave, 256);
+static const parameter_t rcoutput_parameter_table[] = {
+    RCOUTPUT_MODE_PARAMETER(rcoutput_settings.mode_bank1),
+    RCOUTPUT_MODE_PARAMETER(rcoutput_settings.mode_bank2),
+    RCOUTPUT_ENABLE_PARAMETER(0),
+    RCOUTPUT_ENABLE_PARAMETER(1),
+    RCOUTPUT_ENABLE_PARAMETER(2),
+    RCOUTPUT_ENABLE_PARAMETER(3),
+    RCOUTPUT_ENABLE_PARAMETER(4),
+    RCOUTPUT_ENABLE_PARAMETER(5),
+    RCOUTPUT_ENABLE_PARAMETER(6),
+    RCOUTPUT_ENABLE_PARAMETER(7)
+};
+
+static const parameter_group_t rcoutput_parameter_group = {
+    PARAMETER_MODULE_RC_OUTPUT,
+    PARAMETER_ID(PARAMETER_MODULE_RC_OUTPUT, 0),
+    FLASHSAVE_ID('R', 'C', 'O', 'T'),
+    rcoutput_parameter_table,
+    sizeof(rcoutput_parameter_table) / sizeof(parameter_t),
+    RCOutputTimerInit
+};
 
 /*===========================================================================*/
 /* Module local functions.                                                   */
 /*===========================================================================*/
 
-/**
- * @brief           Thread for the flash save operation.
- *
- * @param[in] arg   Unused.
- * @return          Unused.
- */
-static THD_FUNCTION(ThreadRCOutputFlashSave, arg)
-{
-    UNUSED(arg);
-
-    /* Event registration for new estimation */
-    event_listener_t el;
-
-    /* Set thread name */
-    chRegSetThreadName("RCOutput FlashSave");
-
-    /* Register to new estimation */
-    chEvtRegisterMask(ptrGetFlashSaveEventSource(),
-                      &el,
-                      FLASHSAVE_SAVE_EVENTMASK);
-
-    while (1)
-    {
-        /* Wait for new estimation */
-        chEvtWaitOne(FLASHSAVE_SAVE_EVENTMASK);
-
-        /* Save RC input settings to flash */
-        FlashSave_Write(FlashSave_STR2ID("RCOT"),
-                        true,
-                        (uint8_t *)&rcoutput_settings,
-                        RCOUTPUT_SETTINGS_SIZE);
-    }
-}
-
 /**
  * @brief   Reset for the RC output settings structure.
  */
@@ -334,12 +333,17 @@ void RCOutputInit(void)
                    (uint8_t *)&rcoutput_settings,
                    RCOUTPUT_SETTINGS_SIZE);
 
-    /* Start the Flash Save thread */
-    chThdCreateStatic(waThreadRCOutputFlashSave,
-                      sizeof(waThreadRCOutputFlashSave),
-                      NORMALPRIO,
-                      ThreadRCOutputFlashSave,
-                      NULL);
+    /* Register the settings for saving to flash */
+    FlashSave_Register(FlashSave_STR2ID("RCOT"),
+                       &rcoutput_settings,
+                       RCOUTPUT_SETTINGS_SIZE,
+                       NULL);
+
+    /* Register the settings in the parameter table */
+    ParametersRegister(&rcoutput_parameter_group);
+
+    /* Fed by the serial manager from a port with the ESC telemetry role */
+    EscTelemetryInit();
 
     // Set up DMAs and initialize timers
     rcoutput_config.bank1_dmap = DMA1;
@@ -0,0 +1,141 @@
+#ifndef __ACCEL_CALIBRATION_H
+#define __ACCEL_CALIBRATION_H
+
+#include "kfly_defs.h"
+
+/*===========================================================================*/
+/* Module global definitions.                                                */
+/*===========================================================================*/
+
+/* Orientations, the axis pointing up for position 2i is +i and for
+   position 2i + 1 it is -i */
+#define ACCEL_CALIBRATION_POSITIONS         6
+#define ACCEL_CALIBRATION_ALL_POSITIONS                                       \
+    ((1 << ACCEL_CALIBRATION_POSITIONS) - 1)
+#define ACCEL_CALIBRATION_NO_POSITION       0xFF
+
+/* Time the vehicle is held still in each orientation */
+#define ACCEL_CALIBRATION_CAPTURE_S         2.0f
+
+/* Stillness limits, standard deviation over a capture */
+#define ACCEL_CALIBRATION_ACC_STILL_G       0.01f
+#define ACCEL_CALIBRATION_GYRO_STILL_RADPS  0.02f
+
+/* The axis pointing up must hold this fraction of the squared norm, about
+   25 degrees from level */
+#define ACCEL_CALIBRATION_MIN_ALIGNMENT     0.8f
+
+/* Accepted deviation of the measured sensitivity from the nominal */
+#define ACCEL_CALIBRATION_MAX_SCALE_ERROR   0.2f
+
+#define ACCEL_CALIBRATION_STATUS_SIZE       (sizeof(accel_calibration_status_t))
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   State of the accelerometer calibration.
+ */
+typedef enum PACKED_VAR
+{
+    /**
+     * @brief   Not calibrating.
+     */
+    ACCEL_CALIBRATION_IDLE = 0,
+    /**
+     * @brief   Waiting for the vehicle to be still in an orientation which
+     *          is not captured yet.
+     */
+    ACCEL_CALIBRATION_WAITING = 1,
+    /**
+     * @brief   Averaging an orientation.
+     */
+    ACCEL_CALIBRATION_CAPTURING = 2,
+    /**
+     * @brief   All orientations captured, the result holds the solution.
+     */
+    ACCEL_CALIBRATION_SOLVED = 3,
+    /**
+     * @brief   The result is applied and saved to flash.
+     */
+    ACCEL_CALIBRATION_COMMITTED = 4,
+    /**
+     * @brief   The captures gave an invalid solution, or commit was requested
+     *          without one.
+     */
+    ACCEL_CALIBRATION_FAILED = 5
+} accel_calibration_state_t;
+
+/**
+ * @brief   Actions of the ManageAccelCalibration command.
+ */
+typedef enum PACKED_VAR
+{
+    /**
+     * @brief   Clears the captures and starts waiting for orientations.
+     */
+    ACCEL_CALIBRATION_ACTION_START = 0,
+    /**
+     * @brief   Stops the calibration, the result is discarded.
+     */
+    ACCEL_CALIBRATION_ACTION_STOP = 1,
+    /**
+     * @brief   Applies the result and saves it to flash.
+     */
+    ACCEL_CALIBRATION_ACTION_COMMIT = 2
+} accel_calibration_action_t;
+
+/**
+ * @brief   Status and result of the accelerometer calibration.
+ */
+typedef struct PACKED_VAR
+{
+    /**
+     * @brief   Calibration state.
+     */
+    accel_calibration_state_t state;
+    /**
+     * @brief   Captured orientations, bit n for position n.
+     */
+    uint8_t positions;
+    /**
+     * @brief   Orientation being captured, ACCEL_CALIBRATION_NO_POSITION if
+     *          none.
+     */
+    uint8_t capturing;
+    /**
+     * @brief   Reserved for alignment.
+     */
+    uint8_t reserved;
+    /**
+     * @brief   Solved bias in raw counts.
+     */
+    float bias[3];
+    /**
+     * @brief   Solved gain matrix, row major, correcting scale and axis
+     *          misalignment to an output in g.
+     */
+    float gain[3][3];
+} accel_calibration_status_t;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+void AccelCalibrationInit(uint32_t capture_samples,
+                          float accel_gain,
+                          float gyro_gain);
+void AccelCalibrationAddSample(const float accel[3],
+                               const int16_t raw_gyro[3]);
+bool AccelCalibrationRequest(accel_calibration_action_t action);
+void GetAccelCalibrationStatus(accel_calibration_status_t *status);
+
+#endif
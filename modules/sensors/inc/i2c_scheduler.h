@@ -0,0 +1,239 @@
+#ifndef __I2C_SCHEDULER_H
+#define __I2C_SCHEDULER_H
+
+/*===========================================================================*/
+/* Module global definitions.                                                */
+/*===========================================================================*/
+
+/* Timeout of a single transaction on the bus */
+#define I2C_SCHEDULER_TIMEOUT_MS        20
+
+/* Number of clock pulses sent to free a slave holding SDA low */
+#define I2C_SCHEDULER_RECOVERY_CLOCKS   9
+
+/* Half period of the recovery clock, 100 kHz */
+#define I2C_SCHEDULER_RECOVERY_HALF_US  5
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Transaction priorities, higher priority transactions are always
+ *          started before lower priority ones.
+ */
+typedef enum
+{
+    /**
+     * @brief   Accelerometer and gyro reads.
+     */
+    I2C_PRIORITY_HIGH = 0,
+    /**
+     * @brief   Magnetometer reads.
+     */
+    I2C_PRIORITY_NORMAL,
+    /**
+     * @brief   Barometer conversions and reads.
+     */
+    I2C_PRIORITY_LOW,
+    /**
+     * @brief   Number of priority levels.
+     */
+    I2C_PRIORITY_LEVELS
+} I2CPriority;
+
+/**
+ * @brief   Per device transaction statistics.
+ */
+typedef struct
+{
+    /**
+     * @brief   Number of completed transactions, including failed ones.
+     */
+    uint32_t transactions;
+    /**
+     * @brief   Number of failed transactions.
+     */
+    uint32_t errors;
+    /**
+     * @brief   Number of transactions that timed out.
+     */
+    uint32_t timeouts;
+    /**
+     * @brief   I2C error flags of the latest failed transaction.
+     */
+    i2cflags_t last_error;
+    /**
+     * @brief   Time from submission to completion of the latest transaction.
+     */
+    uint32_t latency_us;
+    /**
+     * @brief   Largest time from submission to completion.
+     */
+    uint32_t latency_max_us;
+    /**
+     * @brief   Largest time on the bus.
+     */
+    uint32_t bus_time_max_us;
+} I2CDeviceStatistics;
+
+/**
+ * @brief   Device on a scheduled bus.
+ */
+typedef struct
+{
+    /**
+     * @brief   7-bit address of the device.
+     */
+    i2caddr_t address;
+    /**
+     * @brief   Transaction statistics, updated by the scheduler thread.
+     */
+    I2CDeviceStatistics stats;
+} I2CDevice;
+
+typedef struct I2CTransaction I2CTransaction;
+
+/**
+ * @brief   Transaction completion callback, called from the scheduler
+ *          thread.
+ */
+typedef void (*I2CTransactionCallback)(I2CTransaction *transaction);
+
+/**
+ * @brief   I2C transaction, a write of txbytes followed by a read of
+ *          rxbytes. Owned by the scheduler from submission until it is done.
+ */
+struct I2CTransaction
+{
+    /**
+     * @brief   Device to access.
+     */
+    I2CDevice *device;
+    /**
+     * @brief   Priority of the transaction.
+     */
+    I2CPriority priority;
+    /**
+     * @brief   Bytes to write.
+     */
+    const uint8_t *txbuf;
+    /**
+     * @brief   Number of bytes to write.
+     */
+    size_t txbytes;
+    /**
+     * @brief   Buffer for the read bytes, may NOT be placed in CCM memory
+     *          because DMA directly accesses it.
+     */
+    uint8_t *rxbuf;
+    /**
+     * @brief   Number of bytes to read, 0 for a write only transaction.
+     */
+    size_t rxbytes;
+    /**
+     * @brief   Called when the transaction is done, can be NULL.
+     */
+    I2CTransactionCallback callback;
+    /**
+     * @brief   User argument for the callback.
+     */
+    void *arg;
+    /**
+     * @brief   Result of the transaction, MSG_OK if successful.
+     */
+    msg_t status;
+    /**
+     * @brief   Cycle counter at submission, for the latency statistics.
+     */
+    uint32_t submit_cycles;
+    /**
+     * @brief   Next transaction in the queue.
+     */
+    I2CTransaction *next;
+    /**
+     * @brief   Set when the transaction is done.
+     */
+    volatile bool done;
+    /**
+     * @brief   Thread waiting for the transaction to be done.
+     */
+    thread_reference_t waiter;
+};
+
+/**
+ * @brief   I2C scheduler data holder.
+ */
+typedef struct
+{
+    /**
+     * @brief   First queued transaction of each priority.
+     */
+    I2CTransaction *head[I2C_PRIORITY_LEVELS];
+    /**
+     * @brief   Last queued transaction of each priority.
+     */
+    I2CTransaction *tail[I2C_PRIORITY_LEVELS];
+    /**
+     * @brief   Counts the queued transactions.
+     */
+    semaphore_t pending;
+    /**
+     * @brief   Number of bus recoveries.
+     */
+    uint32_t recoveries;
+} I2CSchedulerData;
+
+/**
+ * @brief   I2C scheduler configuration.
+ */
+typedef struct
+{
+    /**
+     * @brief   Pointer to the started I2C driver.
+     */
+    I2CDriver *i2cp;
+    /**
+     * @brief   SCL port and pad, clocked manually for bus recovery.
+     */
+    ioportid_t scl_port;
+    uint16_t scl_pad;
+    /**
+     * @brief   SDA port and pad.
+     */
+    ioportid_t sda_port;
+    uint16_t sda_pad;
+    /**
+     * @brief   Pad mode of SCL and SDA for the I2C peripheral.
+     */
+    iomode_t i2c_pad_mode;
+    /**
+     * @brief   Pointer to the data holder.
+     */
+    I2CSchedulerData *data;
+} I2CSchedulerConfig;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+msg_t I2CSchedulerInit(const I2CSchedulerConfig *config);
+void I2CScheduler_Submit(const I2CSchedulerConfig *config,
+                         I2CTransaction *transaction);
+void I2CScheduler_SubmitI(const I2CSchedulerConfig *config,
+                          I2CTransaction *transaction);
+void I2CScheduler_Wait(I2CTransaction *transaction);
+msg_t I2CScheduler_Execute(const I2CSchedulerConfig *config,
+                           I2CTransaction *transaction);
+void I2CScheduler_GetStatistics(const I2CDevice *device,
+                                I2CDeviceStatistics *stats);
+void I2CScheduler_ResetStatistics(I2CDevice *device);
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef __MAG_CALIBRATION_H
+#define __MAG_CALIBRATION_H
+
+#include "kfly_defs.h"
+
+/*===========================================================================*/
+/* Module global definitions.                                                */
+/*===========================================================================*/
+
+/* Raw magnetometer counts are divided by this before fitting, to keep the
+   fit well conditioned */
+#define MAG_CALIBRATION_SCALE               (1000.0)
+
+/* Number of fitted ellipsoid parameters */
+#define MAG_CALIBRATION_PARAMETERS          9
+
+/* Coverage bins, 8 azimuth sectors times 4 equal area elevation bands */
+#define MAG_CALIBRATION_BINS                32
+
+/* Samples accepted per bin, so that a slow rotation does not outweigh the
+   rest of the sphere */
+#define MAG_CALIBRATION_SAMPLES_PER_BIN     32
+
+/* Most samples kept for the fit */
+#define MAG_CALIBRATION_MAX_SAMPLES         (MAG_CALIBRATION_BINS *           \
+                                             MAG_CALIBRATION_SAMPLES_PER_BIN)
+
+/* Largest offset of a sample from the first sample in raw counts, the
+   HMC5983 outputs -2048 to 2047 so only overflowed readings are further */
+#define MAG_CALIBRATION_MAX_OFFSET          4096
+
+/* Covered bins and samples needed before a fit is attempted */
+#define MAG_CALIBRATION_MIN_BINS            24
+#define MAG_CALIBRATION_MIN_SAMPLES         200
+
+/* Largest ratio of the longest and shortest ellipsoid axis accepted */
+#define MAG_CALIBRATION_MAX_AXIS_RATIO      2.0f
+
+/* Interval of the fit in the solver thread */
+#define MAG_CALIBRATION_SOLVE_INTERVAL_MS   500
+
+#define MAG_CALIBRATION_STATUS_SIZE         (sizeof(mag_calibration_status_t))
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   State of the magnetometer calibration.
+ */
+typedef enum PACKED_VAR
+{
+    /**
+     * @brief   Not collecting samples.
+     */
+    MAG_CALIBRATION_IDLE = 0,
+    /**
+     * @brief   Collecting samples, no valid fit yet.
+     */
+    MAG_CALIBRATION_COLLECTING = 1,
+    /**
+     * @brief   Collecting samples, the result holds a valid fit.
+     */
+    MAG_CALIBRATION_SOLVED = 2,
+    /**
+     * @brief   The result is applied and saved to flash in the background.
+     */
+    MAG_CALIBRATION_COMMITTED = 3,
+    /**
+     * @brief   Commit requested without a valid fit.
+     */
+    MAG_CALIBRATION_FAILED = 4
+} mag_calibration_state_t;
+
+/**
+ * @brief   Actions of the ManageMagnetometerCalibration command.
+ */
+typedef enum PACKED_VAR
+{
+    /**
+     * @brief   Clears the collected samples and starts collecting.
+     */
+    MAG_CALIBRATION_ACTION_START = 0,
+    /**
+     * @brief   Stops collecting, the result is discarded.
+     */
+    MAG_CALIBRATION_ACTION_STOP = 1,
+    /**
+     * @brief   Applies the result and saves it to flash.
+     */
+    MAG_CALIBRATION_ACTION_COMMIT = 2
+} mag_calibration_action_t;
+
+/**
+ * @brief   Status and result of the magnetometer calibration.
+ */
+typedef struct PACKED_VAR
+{
+    /**
+     * @brief   Calibration state.
+     */
+    mag_calibration_state_t state;
+    /**
+     * @brief   Number of coverage bins with samples.
+     */
+    uint8_t covered_bins;
+    /**
+     * @brief   Samples used in the fit.
+     */
+    uint16_t samples;
+    /**
+     * @brief   RMS of the relative field magnitude error of the fit.
+     */
+    float fit_error;
+    /**
+     * @brief   Fitted bias in raw counts.
+     */
+    float bias[3];
+    /**
+     * @brief   Fitted gain matrix, row major, with unity output at the
+     *          local field magnitude.
+     */
+    float gain[3][3];
+} mag_calibration_status_t;
+
+/**
+ * @brief   Sufficient statistics of the ellipsoid fit, calculated by the
+ *          solver thread from its running sums, relative to the mean of the
+ *          samples.
+ */
+typedef struct
+{
+    /**
+     * @brief   Upper triangle of D'D, row major, D holds one row per sample
+     *          of [x^2 y^2 z^2 2xy 2xz 2yz 2x 2y 2z].
+     */
+    double DtD[MAG_CALIBRATION_PARAMETERS * (MAG_CALIBRATION_PARAMETERS + 1)
+               / 2];
+    /**
+     * @brief   Column sums of D.
+     */
+    double Dt1[MAG_CALIBRATION_PARAMETERS];
+    /**
+     * @brief   Mean of the samples, the origin of the statistics, in raw
+     *          counts.
+     */
+    double origin[3];
+    /**
+     * @brief   Number of samples.
+     */
+    uint32_t samples;
+} mag_calibration_statistics_t;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+void MagCalibrationInit(void);
+void MagCalibrationAddSample(const int16_t raw_mag_data[3]);
+void MagCalibrationRequest(mag_calibration_action_t action);
+void GetMagCalibrationStatus(mag_calibration_status_t *status);
+
+#endif
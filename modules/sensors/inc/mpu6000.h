@@ -0,0 +1,92 @@
+#ifndef __MPU6000_H
+#define __MPU6000_H
+
+#include "mpu6050.h"
+
+/*===========================================================================*/
+/* Module global definitions.                                                */
+/*===========================================================================*/
+/*
+ * The MPU6000 and ICM-20602 have the register map of the MPU6050, the
+ * MPU6050_RA_* and configuration values are used for both.
+ */
+#define MPU6000_WHO_AM_I_MPU6000            0x68
+#define MPU6000_WHO_AM_I_ICM20602           0x12
+
+#define MPU6000_SPI_READ                    0x80
+
+#define MPU6000_USERCTRL_FIFO_EN            (1 << 6)
+#define MPU6000_USERCTRL_I2C_IF_DIS         (1 << 4)
+#define MPU6000_USERCTRL_FIFO_RESET         (1 << 2)
+
+/* ICM-20602 FIFO enable bits, it always adds the temperature */
+#define MPU6000_ICM20602_GYRO_FIFO_EN       (1 << 4)
+#define MPU6000_ICM20602_ACCEL_FIFO_EN      (1 << 3)
+
+/* ICM-20602 temperature in deg C = raw / sensitivity + 25 */
+#define MPU6000_ICM20602_TEMP_SENSITIVITY   326.8f
+#define MPU6000_ICM20602_TEMP_OFFSET_DEGC   25.0f
+
+/**
+ * @brief   Size of a FIFO frame with the accelerometer, temperature and gyro
+ *          enabled, the same layout as the data registers.
+ */
+#define MPU6000_FIFO_FRAME_SIZE             MPU6050_ACCEL_GYRO_TEMP_DATA_SIZE
+
+/**
+ * @brief   Size of the FIFO of the smallest supported sensor (ICM-20602).
+ */
+#define MPU6000_FIFO_SIZE                   1008
+
+/**
+ * @brief   Maximum number of frames read from the FIFO in one burst, twice
+ *          the 8 frames per wakeup at 8 kHz so a late wakeup is caught up.
+ */
+#define MPU6000_FIFO_MAX_FRAMES             16
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+typedef struct
+{
+    uint8_t dlp_cfg;
+    uint8_t gyro_range_sel;
+    uint8_t accel_range_sel;
+    uint8_t fifo_cfg;               /* FIFO_EN register, 0 disables the FIFO */
+    uint8_t int_pin_cfg;
+    uint8_t int_cfg;
+    uint8_t clock_reference;
+    uint8_t sample_rate_divider;
+    MPU6050_Data *data_holder;
+    SPIDriver *spip;
+    const SPIConfig *register_spicfg; /* Max 1 MHz for the configuration
+                                         registers, the data registers are
+                                         read with the bus configuration  */
+    ioportid_t cs_port;
+    uint16_t cs_pad;
+} MPU6000_Configuration;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+#define MPU6000_Select(cfg)     palClearPad((cfg)->cs_port, (cfg)->cs_pad)
+#define MPU6000_Unselect(cfg)   palSetPad((cfg)->cs_port, (cfg)->cs_pad)
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+msg_t MPU6000Init(const MPU6000_Configuration *cfg);
+msg_t MPU6000GetID(const MPU6000_Configuration *cfg, uint8_t id[1]);
+msg_t MPU6000ReadData(const MPU6000_Configuration *cfg, uint8_t data[14]);
+uint8_t MPU6000ReadFIFO(const MPU6000_Configuration *cfg,
+                        uint8_t *data,
+                        uint8_t max_frames);
+msg_t MPU6000ResetFIFO(const MPU6000_Configuration *cfg);
+float MPU6000GetAccelGain(const MPU6000_Configuration *cfg);
+float MPU6000GetGyroGain(const MPU6000_Configuration *cfg);
+
+#endif
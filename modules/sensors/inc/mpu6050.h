@@ -15,6 +15,10 @@
 #define MPU6050_LSB_TO_8G                   (1.0f / 4096.0f)
 #define MPU6050_LSB_TO_16G                  (1.0f / 2048.0f)
 
+/* Temperature in deg C = (raw + offset) / sensitivity */
+#define MPU6050_TEMP_OFFSET_LSB             12412.0f
+#define MPU6050_TEMP_SENSITIVITY            340.0f
+
 /* MPU6050 Address */
 #define MPU6050_ADDRESS_AD0_LOW             0x68 // Address pin low (GND)
 #define MPU6050_ADDRESS_AD0_HIGH            0x69 // Address pin high (VCC)
@@ -240,6 +244,9 @@ typedef struct
     float accel_data[3];        /* Accelerometer calibrated data holder */
     float gyro_data[3];         /* Gyroscope calibrated data holder     */
     float temperature;          /* Temperature deg C data holder        */
+    uint8_t who_am_i;           /* WHO_AM_I of the sensor, selects the
+                                   temperature conversion, 0 if it was
+                                   not read                             */
     int64_t sample_time_ns;     /* Time of the sample in nanoseconds    */
     mutex_t read_lock;          /* Keep listeners from reading if
                                    new data is being written            */
@@ -0,0 +1,88 @@
+#ifndef __MS5611_H
+#define __MS5611_H
+
+#include "i2c_scheduler.h"
+
+/*===========================================================================*/
+/* Module global definitions.                                                */
+/*===========================================================================*/
+#define MS5611_ADDRESS_CSB_LOW              0x77
+#define MS5611_ADDRESS_CSB_HIGH             0x76
+
+#define MS5611_CMD_RESET                    0x1E
+#define MS5611_CMD_CONVERT_D1               0x40
+#define MS5611_CMD_CONVERT_D2               0x50
+#define MS5611_CMD_ADC_READ                 0x00
+#define MS5611_CMD_PROM_READ                0xA0
+
+#define MS5611_OSR_256                      0x00
+#define MS5611_OSR_512                      0x02
+#define MS5611_OSR_1024                     0x04
+#define MS5611_OSR_2048                     0x06
+#define MS5611_OSR_4096                     0x08
+
+#define MS5611_PROM_WORDS                   8
+#define MS5611_ADC_DATA_SIZE                3
+
+/* Reset time as per datasheet */
+#define MS5611_RESET_TIME_MS                3
+
+/* Pressure conversions per temperature conversion */
+#define MS5611_PRESSURE_PER_TEMPERATURE     4
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+typedef enum
+{
+    MS5611_CONVERSION_NONE = 0,
+    MS5611_CONVERSION_PRESSURE,
+    MS5611_CONVERSION_TEMPERATURE
+} MS5611_Conversion;
+
+typedef struct
+{
+    uint32_t raw_pressure;          /* Pressure raw data holder (D1)        */
+    uint32_t raw_temperature;       /* Temperature raw data holder (D2)     */
+    float pressure;                 /* Pressure Pa data holder              */
+    float temperature;              /* Temperature deg C data holder        */
+    uint16_t prom[MS5611_PROM_WORDS];
+                                    /* Factory calibration C0 to C7         */
+    MS5611_Conversion converting;   /* Conversion started on the last step  */
+    MS5611_Conversion reading;      /* ADC read queued on the last step     */
+    uint8_t conversion_count;       /* Conversions since the last
+                                       temperature conversion               */
+    uint8_t command;                /* Command of the convert transaction   */
+    uint8_t adc_data[MS5611_ADC_DATA_SIZE];
+                                    /* ADC read buffer, may NOT be placed
+                                       in CCM memory because DMA directly
+                                       accesses it                          */
+    I2CDevice device;               /* Device on the scheduled bus          */
+    I2CTransaction convert;         /* Convert command transaction          */
+    I2CTransaction adc_read;        /* ADC read transaction                 */
+} MS5611_Data;
+
+typedef struct
+{
+    uint8_t osr;
+    uint8_t address_7bit;
+    MS5611_Data *data_holder;
+    const I2CSchedulerConfig *scheduler;
+} MS5611_Configuration;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+msg_t MS5611Init(const MS5611_Configuration *cfg);
+bool MS5611Step(const MS5611_Configuration *cfg);
+uint32_t MS5611GetConversionTimeUS(const MS5611_Configuration *cfg);
+
+#endif
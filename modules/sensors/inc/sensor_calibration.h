@@ -18,9 +18,11 @@ typedef struct
      */
     float bias[3];
     /**
-     * @brief   Sensor gain values.
+     * @brief   Sensor gain matrix, row major. The diagonal holds the per axis
+     *          gains and the off-diagonal elements correct cross-axis
+     *          sensitivity and soft-iron distortion.
      */
-    float gain[3];
+    float gain[3][3];
     /**
      * @brief   Lock for calibration data structure.
      */
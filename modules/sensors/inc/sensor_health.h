@@ -0,0 +1,131 @@
+#ifndef __SENSOR_HEALTH_H
+#define __SENSOR_HEALTH_H
+
+#include "kfly_defs.h"
+#include "i2c_scheduler.h"
+
+/*===========================================================================*/
+/* Module global definitions.                                                */
+/*===========================================================================*/
+
+/* Length of the statistics window, the RMS, peak and flags are updated at
+   the end of each window */
+#define SENSOR_HEALTH_WINDOW_S              1.0f
+
+/* Raw samples at or beyond this magnitude are counted as clipped, the
+   MPU6050 saturates at +32767 and -32768 */
+#define SENSOR_HEALTH_CLIP_LIMIT            32767
+
+/* The HMC5983 reports -4096 on overflow, the sign may be flipped by the
+   axis conversion */
+#define SENSOR_HEALTH_MAG_OVERFLOW          4096
+
+/* Identical consecutive samples needed to declare a sensor stuck, noise
+   makes long runs impossible on a working sensor */
+#define SENSOR_HEALTH_STUCK_S               0.25f
+
+/* Accelerometer RMS above which the vibration is flagged as high */
+#define SENSOR_HEALTH_VIBRATION_LIMIT_G     3.0f
+
+/* Maximum number of bus devices included in the statistics */
+#define SENSOR_HEALTH_MAX_DEVICES           4
+
+/* Health flags, also reported in the system status */
+#define SENSOR_HEALTH_ACCEL_CLIPPING        (1 << 0)
+#define SENSOR_HEALTH_GYRO_CLIPPING         (1 << 1)
+#define SENSOR_HEALTH_MAG_OVERFLOW_FLAG     (1 << 2)
+#define SENSOR_HEALTH_ACCEL_STUCK           (1 << 3)
+#define SENSOR_HEALTH_GYRO_STUCK            (1 << 4)
+#define SENSOR_HEALTH_MAG_STUCK             (1 << 5)
+#define SENSOR_HEALTH_HIGH_VIBRATION        (1 << 6)
+#define SENSOR_HEALTH_BUS_ERRORS            (1 << 7)
+
+#define SENSOR_HEALTH_SIZE                  (sizeof(sensor_health_t))
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Sensor health statistics.
+ */
+typedef struct PACKED_VAR
+{
+    /**
+     * @brief   Clipped accelerometer samples per axis since start.
+     */
+    uint32_t accel_clip_count[3];
+    /**
+     * @brief   Clipped gyro samples per axis since start.
+     */
+    uint32_t gyro_clip_count[3];
+    /**
+     * @brief   Magnetometer overflows since start.
+     */
+    uint32_t mag_overflow_count;
+    /**
+     * @brief   Accelerometer RMS around the mean of the last window, in g.
+     */
+    float accel_rms[3];
+    /**
+     * @brief   Largest accelerometer deviation from the mean of the last
+     *          window, in g.
+     */
+    float accel_peak[3];
+    /**
+     * @brief   Gyro RMS around the mean of the last window, in rad/s.
+     */
+    float gyro_rms[3];
+    /**
+     * @brief   Largest gyro deviation from the mean of the last window, in
+     *          rad/s.
+     */
+    float gyro_peak[3];
+    /**
+     * @brief   Times the accelerometer, gyro and magnetometer have been
+     *          stuck since start.
+     */
+    uint32_t accel_stuck_count;
+    uint32_t gyro_stuck_count;
+    uint32_t mag_stuck_count;
+    /**
+     * @brief   Transactions, errors and timeouts summed over the sensor
+     *          bus devices, at the end of the last window.
+     */
+    uint32_t i2c_transactions;
+    uint32_t i2c_errors;
+    uint32_t i2c_timeouts;
+    /**
+     * @brief   Sensor bus recoveries.
+     */
+    uint32_t i2c_recoveries;
+    /**
+     * @brief   Health flags, SENSOR_HEALTH_*.
+     */
+    uint8_t flags;
+} sensor_health_t;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+void SensorHealthInit(const I2CSchedulerConfig *scheduler,
+                      float accgyro_sample_hz,
+                      float mag_sample_hz,
+                      float accel_gain,
+                      float gyro_gain);
+void SensorHealthAddBusDevice(const I2CDevice *device);
+void SensorHealthAddAccGyro(const int16_t raw_accel[3],
+                            const int16_t raw_gyro[3]);
+void SensorHealthAddMag(const int16_t raw_mag[3]);
+void GetSensorHealth(sensor_health_t *dest);
+uint8_t GetSensorHealthFlags(void);
+
+#endif
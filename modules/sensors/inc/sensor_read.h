@@ -2,7 +2,9 @@
 #define __SENSOR_READ_H
 
 #include "mpu6050.h"
+#include "mpu6000.h"
 #include "hmc5983.h"
+#include "ms5611.h"
 #include "sensor_calibration.h"
 
 /*===========================================================================*/
@@ -10,6 +12,65 @@
 /*===========================================================================*/
 #define SENSOR_ACCGYRO_HZ                           200.0f
 #define SENSOR_ACCGYRO_DT                           (1.0f / SENSOR_ACCGYRO_HZ)
+#define SENSOR_MAG_HZ                               75.0f
+
+/**
+ * @brief   Enables the fixed-point front-end. The accelerometer and gyro are
+ *          then sampled SENSOR_ACCGYRO_DECIMATION times faster, low-pass
+ *          filtered and decimated in Q15 with a FIR filter, and converted to
+ *          float and calibrated at SENSOR_ACCGYRO_HZ.
+ */
+#if !defined(SENSOR_FIXED_POINT_FRONTEND)
+#define SENSOR_FIXED_POINT_FRONTEND                 FALSE
+#endif
+#define SENSOR_ACCGYRO_DECIMATION                   5
+#define SENSOR_FRONTEND_FIR_TAPS                    24
+#define SENSOR_FRONTEND_CUTOFF_HZ                   80.0f
+
+/**
+ * @brief   Reads the accelerometer and gyro from a MPU6000 or ICM-20602 on
+ *          SPI1, with the chip select and data ready interrupt of the RF
+ *          module connector, instead of the MPU6050 on I2C2. The samples are
+ *          buffered in the sensor FIFO and read in bursts of
+ *          SENSOR_SPI_IMU_BATCH samples.
+ */
+#if !defined(SENSOR_USE_SPI_IMU)
+#define SENSOR_USE_SPI_IMU                          FALSE
+#endif
+
+/**
+ * @brief   With both the SPI IMU and the fixed-point front-end the sensor is
+ *          sampled at 8 kHz. A first FIR stage then decimates by
+ *          SENSOR_ACCGYRO_PREDECIMATION to the front-end rate, where the
+ *          second stage above takes over. Only the sensor health statistics
+ *          see the samples at the full rate.
+ */
+#if (SENSOR_FIXED_POINT_FRONTEND == TRUE) && (SENSOR_USE_SPI_IMU == TRUE)
+#define SENSOR_ACCGYRO_PREDECIMATION                8
+#else
+#define SENSOR_ACCGYRO_PREDECIMATION                1
+#endif
+#define SENSOR_FRONTEND_PREFIR_TAPS                 32
+#define SENSOR_FRONTEND_PREFIR_CUTOFF_HZ            250.0f
+
+#if SENSOR_FIXED_POINT_FRONTEND == TRUE
+#define SENSOR_ACCGYRO_FRONTEND_HZ                  (SENSOR_ACCGYRO_HZ *       \
+                                                     SENSOR_ACCGYRO_DECIMATION)
+#else
+#define SENSOR_ACCGYRO_FRONTEND_HZ                  SENSOR_ACCGYRO_HZ
+#endif
+#define SENSOR_ACCGYRO_SAMPLE_HZ                                              \
+    (SENSOR_ACCGYRO_FRONTEND_HZ * SENSOR_ACCGYRO_PREDECIMATION)
+
+/**
+ * @brief   The SPI IMU wakes the sensor thread once per front-end sample.
+ */
+#if SENSOR_FIXED_POINT_FRONTEND == TRUE
+#define SENSOR_SPI_IMU_BATCH                        SENSOR_ACCGYRO_PREDECIMATION
+#else
+#define SENSOR_SPI_IMU_BATCH                        1
+#endif
+
 #define ACCGYRO_BIQUAD_CUT_HZ                       90.0f
 #define ACCGYRO_BUTTERWORTH_Q                       0.707106781f // Butterworth
 #define ACCGYRO_DATA_AVAILABLE_EVENTMASK            EVENT_MASK(0)
@@ -31,10 +92,19 @@ typedef struct
      * @brief   Pointer to the MPU6050 configuration.
      */
     const MPU6050_Configuration *mpu6050cfg;
+    /**
+     * @brief   Pointer to the MPU6000 configuration, NULL to use the MPU6050.
+     *          Both write to the same data holder.
+     */
+    const MPU6000_Configuration *mpu6000cfg;
     /**
      * @brief   Pointer to the HMC5983 configuration.
      */
     const HMC5983_Configuration *hmc5983cfg;
+    /**
+     * @brief   Pointer to the MS5611 configuration.
+     */
+    const MS5611_Configuration *ms5611cfg;
     /**
      * @brief   Pointer to MPU6050 calibration.
      */
@@ -125,17 +195,17 @@ typedef struct
      */
     float accelerometer_bias[3];
     /**
-     * @brief   Accelerometer gain.
+     * @brief   Accelerometer gain matrix, row major.
      */
-    float accelerometer_gain[3];
+    float accelerometer_gain[3][3];
     /**
      * @brief   Magnetometer bias.
      */
     float magnetometer_bias[3];
     /**
-     * @brief   Magnetometer gain.
+     * @brief   Magnetometer gain matrix, row major.
      */
-    float magnetometer_gain[3];
+    float magnetometer_gain[3][3];
     /**
      * @brief   Calibration time stamp.
      */
@@ -155,6 +225,7 @@ typedef struct
 /*===========================================================================*/
 msg_t SensorReadInit(void);
 void MPU6050cb(EXTDriver *extp, expchannel_t channel);
+void MPU6000cb(EXTDriver *extp, expchannel_t channel);
 void HMC5983cb(EXTDriver *extp, expchannel_t channel);
 event_source_t *ptrGetNewDataEventSource(void);
 int64_t rtGetLatestAccelerometerSamplingTimeNS(void);
@@ -166,6 +237,8 @@ int16_t GetRawGyroscopeTemperature(void);
 float GetGyroscopeTemperature(void);
 int16_t *ptrGetRawMagnetometerData(void);
 float *ptrGetMagnetometerData(void);
+bool IsBarometerAvailable(void);
+size_t GetSensorReadStackUnused(void);
 void GetIMUData(imu_data_t *data);
 void GetRawIMUData(imu_raw_data_t *data);
 void GetIMUCalibration(imu_calibration_t *cal);
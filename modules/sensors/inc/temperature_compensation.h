@@ -0,0 +1,81 @@
+#ifndef __TEMPERATURE_COMPENSATION_H
+#define __TEMPERATURE_COMPENSATION_H
+
+/*===========================================================================*/
+/* Module global definitions.                                                */
+/*===========================================================================*/
+
+/* Lookup table with one entry per degree from TEMPCOMP_TABLE_MIN_C, the
+   index is saturated to TEMPCOMP_TABLE_BITS */
+#define TEMPCOMP_TABLE_MIN_C                (-40)
+#define TEMPCOMP_TABLE_BITS                 7
+#define TEMPCOMP_TABLE_SIZE                 (1 << TEMPCOMP_TABLE_BITS)
+
+/* Accelerometer x, y, z followed by gyro x, y, z */
+#define TEMPCOMP_CHANNELS                   6
+
+/* The bias model is b(T) = c1 u + c2 u^2, with
+   u = (T - TEMPCOMP_REFERENCE_C) / TEMPCOMP_SCALE_C */
+#define TEMPCOMP_PARAMETERS                 2
+#define TEMPCOMP_REFERENCE_C                25.0f
+#define TEMPCOMP_SCALE_C                    10.0f
+
+/* Initial covariance and forgetting factor of the recursive least squares */
+#define TEMPCOMP_INITIAL_COVARIANCE         100.0f
+#define TEMPCOMP_FORGETTING                 1.0f
+
+/* Length of the averaging windows, each still window gives one update */
+#define TEMPCOMP_WINDOW_S                   1.0f
+
+/* Stillness limits, standard deviation within a window and change of the
+   accelerometer mean between windows */
+#define TEMPCOMP_GYRO_STILL_RADPS           0.01f
+#define TEMPCOMP_ACC_STILL_G                0.02f
+#define TEMPCOMP_ACC_DRIFT_G                0.01f
+
+#define TEMPCOMP_MODEL_SIZE                 (sizeof(tempcomp_model_t))
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Temperature bias model, saved to flash.
+ */
+typedef struct
+{
+    /**
+     * @brief   Model coefficients per channel, in raw counts.
+     */
+    float coeffs[TEMPCOMP_CHANNELS][TEMPCOMP_PARAMETERS];
+    /**
+     * @brief   Covariance of the recursive least squares, shared by all
+     *          channels as they have the same regressor.
+     */
+    float P[TEMPCOMP_PARAMETERS][TEMPCOMP_PARAMETERS];
+    /**
+     * @brief   Number of updates.
+     */
+    uint32_t updates;
+} tempcomp_model_t;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+void TempCompInit(uint32_t window_samples, float accel_gain, float gyro_gain);
+void TempCompAddSample(const int16_t raw_accel[3],
+                       const int16_t raw_gyro[3],
+                       float temperature);
+void TempCompGetOffsets(float temperature,
+                        float accel_offset[3],
+                        float gyro_offset[3]);
+
+#endif
@@ -1,7 +1,14 @@
 # List of all the module's related files.
-SENSORS_SRCS = $(MODULE_DIR)/sensors/src/hmc5983.c \
+SENSORS_SRCS = $(MODULE_DIR)/sensors/src/accel_calibration.c \
+               $(MODULE_DIR)/sensors/src/hmc5983.c \
+               $(MODULE_DIR)/sensors/src/i2c_scheduler.c \
+               $(MODULE_DIR)/sensors/src/mag_calibration.c \
+               $(MODULE_DIR)/sensors/src/ms5611.c \
+               $(MODULE_DIR)/sensors/src/mpu6000.c \
                $(MODULE_DIR)/sensors/src/mpu6050.c \
-               $(MODULE_DIR)/sensors/src/sensor_read.c
+               $(MODULE_DIR)/sensors/src/sensor_health.c \
+               $(MODULE_DIR)/sensors/src/sensor_read.c \
+               $(MODULE_DIR)/sensors/src/temperature_compensation.c
 
 # Required include directories
 SENSORS_INC = $(MODULE_DIR)/sensors/inc
@@ -0,0 +1,377 @@
+/* *
+ *
+ * On-board six position accelerometer calibration
+ *
+ * */
+
+#include <string.h>
+#include "ch.h"
+#include "hal.h"
+#include "flash_save.h"
+#include "sensor_read.h"
+#include "accel_calibration.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Welford accumulator of the mean and variance of three axes.
+ */
+typedef struct
+{
+    uint32_t n;
+    float mean[3];
+    float m2[3];
+} welford3_t;
+
+/* Lock of the captures and status */
+static mutex_t accel_calibration_lock;
+
+/* Accumulators of the current capture */
+static welford3_t acc_capture;
+static welford3_t gyro_capture;
+
+/* Mean of each captured orientation in raw counts */
+static float position_mean[ACCEL_CALIBRATION_POSITIONS][3];
+
+/* Calibration status and result */
+static accel_calibration_status_t accel_calibration_status;
+
+/* Capture length and stillness limits in raw counts */
+static uint32_t capture_length;
+static float acc_still_variance;
+static float gyro_still_variance;
+static float nominal_sensitivity;
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief               Clears a Welford accumulator.
+ *
+ * @param[out] w        Accumulator to clear.
+ */
+static inline void WelfordReset(welford3_t *w)
+{
+    memset(w, 0, sizeof(welford3_t));
+}
+
+/**
+ * @brief               Adds a sample to a Welford accumulator.
+ *
+ * @param[in/out] w     Accumulator to update.
+ * @param[in] x         Sample.
+ */
+static inline void WelfordUpdate(welford3_t *w, const float x[3])
+{
+    float delta;
+    int i;
+
+    w->n++;
+
+    for (i = 0; i < 3; i++)
+    {
+        delta = x[i] - w->mean[i];
+        w->mean[i] += delta / (float)w->n;
+        w->m2[i] += delta * (x[i] - w->mean[i]);
+    }
+}
+
+/**
+ * @brief               Checks the sample variance of all axes against a
+ *                      limit.
+ *
+ * @param[in] w         Accumulator to check.
+ * @param[in] variance  Largest accepted variance.
+ * @return              True if all axes are within the limit.
+ */
+static inline bool WelfordIsStill(const welford3_t *w, float variance)
+{
+    float limit = variance * (float)(w->n - 1);
+
+    return (w->m2[0] <= limit) && (w->m2[1] <= limit) && (w->m2[2] <= limit);
+}
+
+/**
+ * @brief               Finds the orientation of an accelerometer sample.
+ *
+ * @param[in] accel     Accelerometer sample.
+ * @return              The position, ACCEL_CALIBRATION_NO_POSITION if no
+ *                      axis is close enough to vertical.
+ */
+static uint8_t AccelCalibrationPosition(const float accel[3])
+{
+    float norm_sq = accel[0] * accel[0] + accel[1] * accel[1] +
+                    accel[2] * accel[2];
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        if (accel[i] * accel[i] >= ACCEL_CALIBRATION_MIN_ALIGNMENT * norm_sq)
+            return 2 * i + ((accel[i] < 0.0f) ? 1 : 0);
+    }
+
+    return ACCEL_CALIBRATION_NO_POSITION;
+}
+
+/**
+ * @brief               Solves for bias, scale and misalignment from the six
+ *                      captures.
+ * @details             In position 2i the reading is C e_i + b and in
+ *                      position 2i + 1 it is -C e_i + b, where C is the
+ *                      sensitivity matrix in counts per g. The bias is the
+ *                      mean of all captures, column i of C is half the
+ *                      difference of the two captures of axis i and the
+ *                      gain matrix is the inverse of C.
+ *
+ * @param[out] status   Status to store the result in.
+ * @return              True if the solution is valid.
+ */
+static bool AccelCalibrationSolve(accel_calibration_status_t *status)
+{
+    float C[3][3], adj[3][3], det, norm_sq, min_sq, max_sq;
+    int i, j;
+
+    for (j = 0; j < 3; j++)
+    {
+        status->bias[j] = 0.0f;
+
+        for (i = 0; i < ACCEL_CALIBRATION_POSITIONS; i++)
+            status->bias[j] += position_mean[i][j];
+
+        status->bias[j] *= (1.0f / ACCEL_CALIBRATION_POSITIONS);
+
+        for (i = 0; i < 3; i++)
+            C[j][i] = 0.5f * (position_mean[2 * i][j] -
+                              position_mean[2 * i + 1][j]);
+    }
+
+    /* Each axis must be close to the nominal sensitivity */
+    min_sq = (1.0f - ACCEL_CALIBRATION_MAX_SCALE_ERROR) * nominal_sensitivity;
+    min_sq *= min_sq;
+    max_sq = (1.0f + ACCEL_CALIBRATION_MAX_SCALE_ERROR) * nominal_sensitivity;
+    max_sq *= max_sq;
+
+    for (i = 0; i < 3; i++)
+    {
+        norm_sq = C[0][i] * C[0][i] + C[1][i] * C[1][i] + C[2][i] * C[2][i];
+
+        if ((norm_sq < min_sq) || (norm_sq > max_sq))
+            return false;
+    }
+
+    adj[0][0] = C[1][1] * C[2][2] - C[1][2] * C[2][1];
+    adj[0][1] = C[0][2] * C[2][1] - C[0][1] * C[2][2];
+    adj[0][2] = C[0][1] * C[1][2] - C[0][2] * C[1][1];
+    adj[1][0] = C[1][2] * C[2][0] - C[1][0] * C[2][2];
+    adj[1][1] = C[0][0] * C[2][2] - C[0][2] * C[2][0];
+    adj[1][2] = C[0][2] * C[1][0] - C[0][0] * C[1][2];
+    adj[2][0] = C[1][0] * C[2][1] - C[1][1] * C[2][0];
+    adj[2][1] = C[0][1] * C[2][0] - C[0][0] * C[2][1];
+    adj[2][2] = C[0][0] * C[1][1] - C[0][1] * C[1][0];
+
+    det = C[0][0] * adj[0][0] + C[0][1] * adj[1][0] + C[0][2] * adj[2][0];
+
+    /* A mirrored axis gives a negative determinant */
+    if (det <= 0.0f)
+        return false;
+
+    for (i = 0; i < 3; i++)
+        for (j = 0; j < 3; j++)
+            status->gain[i][j] = adj[i][j] / det;
+
+    return true;
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief               Initializes the accelerometer calibration.
+ *
+ * @param[in] capture_samples   Samples averaged per orientation.
+ * @param[in] accel_gain        Accelerometer gain in g per count.
+ * @param[in] gyro_gain         Gyro gain in rad/s per count.
+ */
+void AccelCalibrationInit(uint32_t capture_samples,
+                          float accel_gain,
+                          float gyro_gain)
+{
+    chMtxObjectInit(&accel_calibration_lock);
+
+    memset(&accel_calibration_status, 0, ACCEL_CALIBRATION_STATUS_SIZE);
+    accel_calibration_status.state = ACCEL_CALIBRATION_IDLE;
+    accel_calibration_status.capturing = ACCEL_CALIBRATION_NO_POSITION;
+
+    capture_length = (capture_samples > 1) ? capture_samples : 2;
+    acc_still_variance = (ACCEL_CALIBRATION_ACC_STILL_G / accel_gain) *
+                         (ACCEL_CALIBRATION_ACC_STILL_G / accel_gain);
+    gyro_still_variance = (ACCEL_CALIBRATION_GYRO_STILL_RADPS / gyro_gain) *
+                          (ACCEL_CALIBRATION_GYRO_STILL_RADPS / gyro_gain);
+    nominal_sensitivity = 1.0f / accel_gain;
+}
+
+/**
+ * @brief               Adds a sample to the capture of the current
+ *                      orientation while calibrating.
+ * @note                Called from the sensor read thread.
+ *
+ * @param[in] accel     Temperature compensated raw accelerometer sample.
+ * @param[in] raw_gyro  Raw gyro sample.
+ */
+void AccelCalibrationAddSample(const float accel[3],
+                               const int16_t raw_gyro[3])
+{
+    accel_calibration_status_t *status = &accel_calibration_status;
+    float gyro[3];
+    uint8_t position;
+    int i;
+
+    chMtxLock(&accel_calibration_lock);
+
+    if ((status->state != ACCEL_CALIBRATION_WAITING) &&
+        (status->state != ACCEL_CALIBRATION_CAPTURING))
+    {
+        chMtxUnlock(&accel_calibration_lock);
+        return;
+    }
+
+    position = AccelCalibrationPosition(accel);
+
+    /* A new orientation restarts the capture, captured ones are skipped */
+    if ((position == ACCEL_CALIBRATION_NO_POSITION) ||
+        ((status->positions & (1 << position)) != 0))
+    {
+        status->state = ACCEL_CALIBRATION_WAITING;
+        status->capturing = ACCEL_CALIBRATION_NO_POSITION;
+        chMtxUnlock(&accel_calibration_lock);
+        return;
+    }
+
+    if (position != status->capturing)
+    {
+        WelfordReset(&acc_capture);
+        WelfordReset(&gyro_capture);
+        status->state = ACCEL_CALIBRATION_CAPTURING;
+        status->capturing = position;
+    }
+
+    for (i = 0; i < 3; i++)
+        gyro[i] = (float)raw_gyro[i];
+
+    WelfordUpdate(&acc_capture, accel);
+    WelfordUpdate(&gyro_capture, gyro);
+
+    if (acc_capture.n >= capture_length)
+    {
+        if (WelfordIsStill(&acc_capture, acc_still_variance) &&
+            WelfordIsStill(&gyro_capture, gyro_still_variance))
+        {
+            memcpy(position_mean[position], acc_capture.mean,
+                   sizeof(acc_capture.mean));
+            status->positions |= (1 << position);
+        }
+
+        /* Moved during the capture, or done, start over */
+        WelfordReset(&acc_capture);
+        WelfordReset(&gyro_capture);
+
+        if (status->positions == ACCEL_CALIBRATION_ALL_POSITIONS)
+        {
+            status->capturing = ACCEL_CALIBRATION_NO_POSITION;
+            status->state = (AccelCalibrationSolve(status) == true) ?
+                    ACCEL_CALIBRATION_SOLVED : ACCEL_CALIBRATION_FAILED;
+        }
+    }
+
+    chMtxUnlock(&accel_calibration_lock);
+}
+
+/**
+ * @brief               Starts, stops or commits the calibration. A commit
+ *                      applies the solution to the accelerometer and saves
+ *                      the settings to flash in the background.
+ *
+ * @param[in] action    Requested action.
+ * @return              True if a solution was applied.
+ */
+bool AccelCalibrationRequest(accel_calibration_action_t action)
+{
+    accel_calibration_status_t *status = &accel_calibration_status;
+    sensor_calibration_t *cal;
+    bool applied = false;
+    int i, j;
+
+    chMtxLock(&accel_calibration_lock);
+
+    if (action == ACCEL_CALIBRATION_ACTION_START)
+    {
+        WelfordReset(&acc_capture);
+        WelfordReset(&gyro_capture);
+        memset(status, 0, ACCEL_CALIBRATION_STATUS_SIZE);
+        status->state = ACCEL_CALIBRATION_WAITING;
+        status->capturing = ACCEL_CALIBRATION_NO_POSITION;
+    }
+    else if (action == ACCEL_CALIBRATION_ACTION_STOP)
+    {
+        status->state = ACCEL_CALIBRATION_IDLE;
+        status->capturing = ACCEL_CALIBRATION_NO_POSITION;
+    }
+    else if (action == ACCEL_CALIBRATION_ACTION_COMMIT)
+    {
+        if (status->state == ACCEL_CALIBRATION_SOLVED)
+        {
+            cal = ptrGetAccelerometerCalibration();
+
+            chMtxLock(&cal->lock);
+
+            for (i = 0; i < 3; i++)
+            {
+                cal->bias[i] = status->bias[i];
+
+                for (j = 0; j < 3; j++)
+                    cal->gain[i][j] = status->gain[i][j];
+            }
+
+            chMtxUnlock(&cal->lock);
+
+            status->state = ACCEL_CALIBRATION_COMMITTED;
+            applied = true;
+        }
+        else
+        {
+            status->state = ACCEL_CALIBRATION_FAILED;
+        }
+    }
+
+    chMtxUnlock(&accel_calibration_lock);
+
+    /* The flash save thread takes a snapshot of the new calibration */
+    if (applied == true)
+        vBroadcastFlashSaveEvent();
+
+    return applied;
+}
+
+/**
+ * @brief               Copies the calibration status and result.
+ *
+ * @param[out] status   Copy of the status.
+ */
+void GetAccelCalibrationStatus(accel_calibration_status_t *status)
+{
+    chMtxLock(&accel_calibration_lock);
+    *status = accel_calibration_status;
+    chMtxUnlock(&accel_calibration_lock);
+}
@@ -0,0 +1,359 @@
+/* *
+ *
+ * Prioritized transaction scheduler for a shared I2C bus
+ *
+ * */
+
+#include "ch.h"
+#include "hal.h"
+#include "i2c_scheduler.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+#define I2C_SCHEDULER_CYCLES_PER_US     (STM32_SYSCLK / 1000000)
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+/* Working area for the I2C scheduler thread */
+THD_WORKING_AREA(waThreadI2CScheduler, 256);
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief               Removes the first transaction of the highest priority
+ *                      from the queue.
+ *
+ * @param[in] data      Pointer to the scheduler data holder.
+ * @return              The transaction, NULL if the queue is empty.
+ */
+static I2CTransaction *I2CSchedulerDequeueS(I2CSchedulerData *data)
+{
+    I2CTransaction *transaction;
+    int i;
+
+    for (i = 0; i < I2C_PRIORITY_LEVELS; i++)
+    {
+        transaction = data->head[i];
+
+        if (transaction != NULL)
+        {
+            data->head[i] = transaction->next;
+
+            if (data->head[i] == NULL)
+                data->tail[i] = NULL;
+
+            return transaction;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief               Frees a bus where a slave holds SDA low after an
+ *                      interrupted transaction, and restarts the driver.
+ * @details             SCL is clocked until the slave releases SDA and a
+ *                      STOP condition is generated, as per the I2C
+ *                      specification section 3.1.16.
+ *
+ * @param[in] config    Pointer to the scheduler configuration.
+ */
+static void I2CSchedulerRecoverBus(const I2CSchedulerConfig *config)
+{
+    const I2CConfig *i2ccfg = config->i2cp->config;
+    int i;
+
+    i2cStop(config->i2cp);
+
+    palSetPad(config->scl_port, config->scl_pad);
+    palSetPad(config->sda_port, config->sda_pad);
+    palSetPadMode(config->scl_port, config->scl_pad, PAL_MODE_OUTPUT_OPENDRAIN);
+    palSetPadMode(config->sda_port, config->sda_pad, PAL_MODE_OUTPUT_OPENDRAIN);
+
+    for (i = 0; i < I2C_SCHEDULER_RECOVERY_CLOCKS; i++)
+    {
+        if (palReadPad(config->sda_port, config->sda_pad) != 0)
+            break;
+
+        palClearPad(config->scl_port, config->scl_pad);
+        chSysPolledDelayX(US2RTC(STM32_HCLK, I2C_SCHEDULER_RECOVERY_HALF_US));
+        palSetPad(config->scl_port, config->scl_pad);
+        chSysPolledDelayX(US2RTC(STM32_HCLK, I2C_SCHEDULER_RECOVERY_HALF_US));
+    }
+
+    /* STOP: SDA low to high while SCL is high */
+    palClearPad(config->sda_port, config->sda_pad);
+    chSysPolledDelayX(US2RTC(STM32_HCLK, I2C_SCHEDULER_RECOVERY_HALF_US));
+    palSetPad(config->sda_port, config->sda_pad);
+    chSysPolledDelayX(US2RTC(STM32_HCLK, I2C_SCHEDULER_RECOVERY_HALF_US));
+
+    palSetPadMode(config->scl_port, config->scl_pad, config->i2c_pad_mode);
+    palSetPadMode(config->sda_port, config->sda_pad, config->i2c_pad_mode);
+
+    i2cStart(config->i2cp, i2ccfg);
+
+    config->data->recoveries++;
+}
+
+/**
+ * @brief               Performs a transaction on the bus and updates the
+ *                      statistics of its device.
+ *
+ * @param[in] config    Pointer to the scheduler configuration.
+ * @param[in] transaction Transaction to perform.
+ */
+static void I2CSchedulerServe(const I2CSchedulerConfig *config,
+                              I2CTransaction *transaction)
+{
+    I2CDeviceStatistics *stats = &transaction->device->stats;
+    uint32_t start, bus_time, latency;
+    i2cflags_t errors = I2C_NO_ERROR;
+    msg_t status;
+
+    i2cAcquireBus(config->i2cp);
+
+    start = DWT->CYCCNT;
+    status = i2cMasterTransmitTimeout(config->i2cp,
+                                      transaction->device->address,
+                                      transaction->txbuf,
+                                      transaction->txbytes,
+                                      transaction->rxbuf,
+                                      transaction->rxbytes,
+                                      OSAL_MS2ST(I2C_SCHEDULER_TIMEOUT_MS));
+
+    if (status != MSG_OK)
+    {
+        errors = i2cGetErrors(config->i2cp);
+
+        /* A timeout leaves the driver locked, a bus error or lost
+           arbitration can leave a slave driving SDA */
+        if ((status == MSG_TIMEOUT) ||
+            ((errors & (I2C_BUS_ERROR | I2C_ARBITRATION_LOST)) != 0))
+            I2CSchedulerRecoverBus(config);
+    }
+
+    i2cReleaseBus(config->i2cp);
+
+    bus_time = (DWT->CYCCNT - start) / I2C_SCHEDULER_CYCLES_PER_US;
+    latency = (DWT->CYCCNT - transaction->submit_cycles) /
+              I2C_SCHEDULER_CYCLES_PER_US;
+
+    chSysLock();
+
+    stats->transactions++;
+    stats->latency_us = latency;
+
+    if (latency > stats->latency_max_us)
+        stats->latency_max_us = latency;
+
+    if (bus_time > stats->bus_time_max_us)
+        stats->bus_time_max_us = bus_time;
+
+    if (status != MSG_OK)
+    {
+        stats->errors++;
+        stats->last_error = errors;
+
+        if (status == MSG_TIMEOUT)
+            stats->timeouts++;
+    }
+
+    chSysUnlock();
+
+    transaction->status = status;
+}
+
+/**
+ * @brief               Performs the queued transactions in priority order.
+ *
+ * @param[in] arg       Pointer to the scheduler configuration.
+ */
+static THD_FUNCTION(ThreadI2CScheduler, arg)
+{
+    const I2CSchedulerConfig *config = (const I2CSchedulerConfig *)arg;
+    I2CTransaction *transaction;
+
+    /* Set thread name */
+    chRegSetThreadName("I2C Scheduler");
+
+    while (1)
+    {
+        chSemWait(&config->data->pending);
+
+        chSysLock();
+        transaction = I2CSchedulerDequeueS(config->data);
+        chSysUnlock();
+
+        I2CSchedulerServe(config, transaction);
+
+        if (transaction->callback != NULL)
+            transaction->callback(transaction);
+
+        /* The owner may reuse the transaction as soon as it is done. */
+        chSysLock();
+        transaction->done = true;
+        chThdResumeS(&transaction->waiter, transaction->status);
+        chSysUnlock();
+    }
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief               Initializes the scheduler and starts its thread. The
+ *                      I2C driver must be started.
+ *
+ * @param[in] config    Pointer to the scheduler configuration.
+ * @return              MSG_OK if the initialization was successful.
+ */
+msg_t I2CSchedulerInit(const I2CSchedulerConfig *config)
+{
+    int i;
+
+    if ((config->i2cp == NULL) || (config->data == NULL))
+        return MSG_RESET;
+
+    for (i = 0; i < I2C_PRIORITY_LEVELS; i++)
+    {
+        config->data->head[i] = NULL;
+        config->data->tail[i] = NULL;
+    }
+
+    chSemObjectInit(&config->data->pending, 0);
+    config->data->recoveries = 0;
+
+    chThdCreateStatic(waThreadI2CScheduler,
+                      sizeof(waThreadI2CScheduler),
+                      HIGHPRIO,
+                      ThreadI2CScheduler,
+                      (void *)config);
+
+    return MSG_OK;
+}
+
+/**
+ * @brief               Queues a transaction from an ISR or locked context.
+ * @note                The transaction and its buffers must stay valid until
+ *                      the transaction is done.
+ *
+ * @param[in] config    Pointer to the scheduler configuration.
+ * @param[in] transaction Transaction to queue.
+ */
+void I2CScheduler_SubmitI(const I2CSchedulerConfig *config,
+                          I2CTransaction *transaction)
+{
+    I2CSchedulerData *data = config->data;
+    I2CPriority priority = transaction->priority;
+
+    osalDbgCheck(priority < I2C_PRIORITY_LEVELS);
+
+    transaction->done = false;
+    transaction->waiter = NULL;
+    transaction->next = NULL;
+    transaction->submit_cycles = DWT->CYCCNT;
+
+    if (data->tail[priority] == NULL)
+        data->head[priority] = transaction;
+    else
+        data->tail[priority]->next = transaction;
+
+    data->tail[priority] = transaction;
+
+    chSemSignalI(&data->pending);
+}
+
+/**
+ * @brief               Queues a transaction and returns immediately.
+ * @note                The transaction and its buffers must stay valid until
+ *                      the transaction is done, the callback is called from
+ *                      the scheduler thread when it is.
+ * @note                A transaction on the bus is never interrupted, so a
+ *                      high priority transaction waits at most for one lower
+ *                      priority transaction to finish.
+ *
+ * @param[in] config    Pointer to the scheduler configuration.
+ * @param[in] transaction Transaction to queue.
+ */
+void I2CScheduler_Submit(const I2CSchedulerConfig *config,
+                         I2CTransaction *transaction)
+{
+    chSysLock();
+    I2CScheduler_SubmitI(config, transaction);
+    chSchRescheduleS();
+    chSysUnlock();
+}
+
+/**
+ * @brief               Waits for a submitted transaction to be done.
+ * @note                Only one thread may wait for a transaction.
+ *
+ * @param[in] transaction Transaction to wait for.
+ */
+void I2CScheduler_Wait(I2CTransaction *transaction)
+{
+    chSysLock();
+
+    if (transaction->done == false)
+        chThdSuspendS(&transaction->waiter);
+
+    chSysUnlock();
+}
+
+/**
+ * @brief               Queues a transaction and waits for it to be done.
+ *
+ * @param[in] config    Pointer to the scheduler configuration.
+ * @param[in] transaction Transaction to perform.
+ * @return              The result of the transaction.
+ */
+msg_t I2CScheduler_Execute(const I2CSchedulerConfig *config,
+                           I2CTransaction *transaction)
+{
+    I2CScheduler_Submit(config, transaction);
+    I2CScheduler_Wait(transaction);
+
+    return transaction->status;
+}
+
+/**
+ * @brief               Copies the statistics of a device.
+ *
+ * @param[in] device    Device to read the statistics of.
+ * @param[out] stats    Copy of the statistics.
+ */
+void I2CScheduler_GetStatistics(const I2CDevice *device,
+                                I2CDeviceStatistics *stats)
+{
+    chSysLock();
+    *stats = device->stats;
+    chSysUnlock();
+}
+
+/**
+ * @brief               Clears the statistics of a device.
+ *
+ * @param[in] device    Device to clear the statistics of.
+ */
+void I2CScheduler_ResetStatistics(I2CDevice *device)
+{
+    chSysLock();
+    device->stats.transactions = 0;
+    device->stats.errors = 0;
+    device->stats.timeouts = 0;
+    device->stats.last_error = I2C_NO_ERROR;
+    device->stats.latency_us = 0;
+    device->stats.latency_max_us = 0;
+    device->stats.bus_time_max_us = 0;
+    chSysUnlock();
+}
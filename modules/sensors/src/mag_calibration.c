@@ -0,0 +1,745 @@
+/* *
+ *
+ * Online magnetometer calibration, least squares ellipsoid fit from
+ * running sums of the collected samples
+ *
+ * */
+
+#include <math.h>
+#include <string.h>
+#include "ch.h"
+#include "hal.h"
+#include "flash_save.h"
+#include "sensor_read.h"
+#include "estimation.h"
+#include "mag_calibration.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+#define MAG_CALIBRATION_COMMIT_EVENTMASK    EVENT_MASK(0)
+#define MAG_CALIBRATION_JACOBI_SWEEPS       16
+#define MAG_CALIBRATION_ORDER               4
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+/* Lock of the statistics and status */
+static mutex_t mag_calibration_lock;
+
+/**
+ * @brief   Running sums of the moments x^a y^b z^c, a + b + c <= 4, of the
+ *          samples in raw counts relative to the first sample, exact in
+ *          integers. With offsets of at most MAG_CALIBRATION_MAX_OFFSET each
+ *          term is at most 2^48 and the sums of MAG_CALIBRATION_MAX_SAMPLES
+ *          samples at most 2^58.
+ */
+typedef struct
+{
+    int64_t moment[MAG_CALIBRATION_ORDER + 1][MAG_CALIBRATION_ORDER + 1]
+                  [MAG_CALIBRATION_ORDER + 1];
+    int16_t origin[3];
+    uint32_t samples;
+    uint32_t processed;
+    uint32_t generation;
+} mag_calibration_sums_t;
+
+/* Samples collected from the sensor read thread, only appended to until
+   the next start. They are added to the sums in the solver thread, so the
+   sensor thread does no floating point math. */
+static int16_t collected[MAG_CALIBRATION_MAX_SAMPLES][3];
+static uint32_t collected_count;
+
+/* Running sums, only used by the solver thread */
+static mag_calibration_sums_t sums;
+
+/* Statistics being solved */
+static mag_calibration_statistics_t solving;
+
+/* Incremented on each start, so a fit of an old collection is dropped */
+static uint32_t generation;
+
+/* Coverage tracking */
+static uint8_t bin_samples[MAG_CALIBRATION_BINS];
+static int16_t raw_min[3], raw_max[3];
+
+/* Calibration status and latest valid fit */
+static mag_calibration_status_t mag_calibration_status;
+
+/* Moments around the mean, kept off the solver stack */
+static double shifted[MAG_CALIBRATION_ORDER + 1][MAG_CALIBRATION_ORDER + 1]
+                     [MAG_CALIBRATION_ORDER + 1];
+
+/* Cholesky factor of D'D, kept off the solver stack */
+static double cholesky[MAG_CALIBRATION_PARAMETERS][MAG_CALIBRATION_PARAMETERS];
+
+/* Private pointer to the solver thread */
+static thread_t *thread_mag_calibration_p = NULL;
+
+/* Working area for the solver thread */
+THD_WORKING_AREA(waThreadMagCalibration, 1024);
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief               Finds the coverage bin of a sample, from its direction
+ *                      seen from the center of the samples so far.
+ * @note                The bands split the sphere at z = -0.5, 0 and 0.5,
+ *                      which gives them equal area.
+ *
+ * @param[in] raw       Raw magnetometer sample.
+ * @return              The bin, or -1 if the direction is undefined.
+ */
+static int MagCalibrationBin(const int16_t raw[3])
+{
+    float v[3], r2;
+    int i, sector, band;
+
+    for (i = 0; i < 3; i++)
+    {
+        if (raw[i] < raw_min[i])
+            raw_min[i] = raw[i];
+
+        if (raw[i] > raw_max[i])
+            raw_max[i] = raw[i];
+
+        v[i] = (float)raw[i] - 0.5f * ((float)raw_min[i] + (float)raw_max[i]);
+    }
+
+    r2 = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+
+    if (r2 <= 0.0f)
+        return -1;
+
+    /* 45 degree azimuth sectors from the signs and the larger component */
+    sector = ((v[0] < 0.0f) ? 4 : 0) |
+             ((v[1] < 0.0f) ? 2 : 0) |
+             ((fabsf(v[0]) < fabsf(v[1])) ? 1 : 0);
+
+    if (4.0f * v[2] * v[2] >= r2)
+        band = (v[2] < 0.0f) ? 0 : 3;
+    else
+        band = (v[2] < 0.0f) ? 1 : 2;
+
+    return band * 8 + sector;
+}
+
+/**
+ * @brief               Eigendecomposition of a symmetric 3x3 matrix with
+ *                      cyclic Jacobi rotations.
+ *
+ * @param[in/out] a     Matrix to decompose, holds the eigenvalues on the
+ *                      diagonal on return.
+ * @param[out] v        Eigenvectors as columns.
+ */
+static void MagCalibrationEigen(double a[3][3], double v[3][3])
+{
+    double theta, t, c, s, x, y;
+    int sweep, p, q, k;
+
+    for (p = 0; p < 3; p++)
+        for (q = 0; q < 3; q++)
+            v[p][q] = (p == q) ? 1.0 : 0.0;
+
+    for (sweep = 0; sweep < MAG_CALIBRATION_JACOBI_SWEEPS; sweep++)
+    {
+        if ((fabs(a[0][1]) + fabs(a[0][2]) + fabs(a[1][2])) <
+            1e-15 * (fabs(a[0][0]) + fabs(a[1][1]) + fabs(a[2][2])))
+            break;
+
+        for (p = 0; p < 2; p++)
+        {
+            for (q = p + 1; q < 3; q++)
+            {
+                if (a[p][q] == 0.0)
+                    continue;
+
+                theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                t = 1.0 / (fabs(theta) + sqrt(theta * theta + 1.0));
+                if (theta < 0.0)
+                    t = -t;
+
+                c = 1.0 / sqrt(t * t + 1.0);
+                s = t * c;
+
+                for (k = 0; k < 3; k++)
+                {
+                    x = a[k][p];
+                    y = a[k][q];
+                    a[k][p] = c * x - s * y;
+                    a[k][q] = s * x + c * y;
+                }
+
+                for (k = 0; k < 3; k++)
+                {
+                    x = a[p][k];
+                    y = a[q][k];
+                    a[p][k] = c * x - s * y;
+                    a[q][k] = s * x + c * y;
+                }
+
+                for (k = 0; k < 3; k++)
+                {
+                    x = v[k][p];
+                    y = v[k][q];
+                    v[k][p] = c * x - s * y;
+                    v[k][q] = s * x + c * y;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief               Adds the new collected samples to the running sums,
+ *                      each sample is only added once.
+ * @note                Samples further than MAG_CALIBRATION_MAX_OFFSET from
+ *                      the first sample are skipped, they can only come from
+ *                      an overflowed reading.
+ *
+ * @param[in/out] s     Running sums.
+ * @param[in] samples   Raw magnetometer samples.
+ * @param[in] count     Number of collected samples.
+ */
+static void MagCalibrationAccumulate(mag_calibration_sums_t *s,
+                                     const int16_t samples[][3],
+                                     uint32_t count)
+{
+    int64_t p[3][MAG_CALIBRATION_ORDER + 1];
+    int32_t v;
+    int i, a, b, c;
+
+    for (; s->processed < count; s->processed++)
+    {
+        if (s->processed == 0)
+            for (i = 0; i < 3; i++)
+                s->origin[i] = samples[0][i];
+
+        for (i = 0; i < 3; i++)
+        {
+            v = (int32_t)samples[s->processed][i] - s->origin[i];
+
+            if ((v > MAG_CALIBRATION_MAX_OFFSET) ||
+                (v < -MAG_CALIBRATION_MAX_OFFSET))
+                break;
+
+            p[i][0] = 1;
+            for (a = 1; a <= MAG_CALIBRATION_ORDER; a++)
+                p[i][a] = p[i][a - 1] * v;
+        }
+
+        if (i < 3)
+            continue;
+
+        for (a = 0; a <= MAG_CALIBRATION_ORDER; a++)
+            for (b = 0; a + b <= MAG_CALIBRATION_ORDER; b++)
+                for (c = 0; a + b + c <= MAG_CALIBRATION_ORDER; c++)
+                    s->moment[a][b][c] += p[0][a] * p[1][b] * p[2][c];
+
+        s->samples++;
+    }
+}
+
+/**
+ * @brief               Calculates the statistics of the fit from the running
+ *                      sums. The moments are moved to the mean of the
+ *                      samples, so the origin of the fit is inside the
+ *                      ellipsoid, and scaled by MAG_CALIBRATION_SCALE to keep
+ *                      the solve well conditioned.
+ *
+ * @param[in] s         Running sums, with at least one sample.
+ * @param[out] stats    Statistics of the samples.
+ */
+static void MagCalibrationStatistics(const mag_calibration_sums_t *s,
+                                     mag_calibration_statistics_t *stats)
+{
+    /* Rows of D as coefficient times x^a y^b z^c */
+    static const uint8_t exponent[MAG_CALIBRATION_PARAMETERS][3] = {
+        {2, 0, 0}, {0, 2, 0}, {0, 0, 2}, {1, 1, 0}, {1, 0, 1},
+        {0, 1, 1}, {1, 0, 0}, {0, 1, 0}, {0, 0, 1}
+    };
+    static const double coefficient[MAG_CALIBRATION_PARAMETERS] =
+        {1.0, 1.0, 1.0, 2.0, 2.0, 2.0, 2.0, 2.0, 2.0};
+    static const double binomial[MAG_CALIBRATION_ORDER + 1]
+                                [MAG_CALIBRATION_ORDER + 1] = {
+        {1, 0, 0, 0, 0}, {1, 1, 0, 0, 0}, {1, 2, 1, 0, 0},
+        {1, 3, 3, 1, 0}, {1, 4, 6, 4, 1}
+    };
+    double p[3][MAG_CALIBRATION_ORDER + 1], scale[MAG_CALIBRATION_ORDER + 1];
+    double mean[3], sum;
+    int a, b, c, i, j, k, m;
+
+    scale[0] = 1.0;
+    for (a = 1; a <= MAG_CALIBRATION_ORDER; a++)
+        scale[a] = scale[a - 1] * MAG_CALIBRATION_SCALE;
+
+    for (i = 0; i < 3; i++)
+    {
+        mean[i] = (double)s->moment[i == 0][i == 1][i == 2] /
+                  (double)s->samples;
+
+        /* Powers of the negated mean in scaled units */
+        p[i][0] = 1.0;
+        for (a = 1; a <= MAG_CALIBRATION_ORDER; a++)
+            p[i][a] = p[i][a - 1] * -mean[i] / MAG_CALIBRATION_SCALE;
+    }
+
+    /* Binomial expansion of the moments around the mean */
+    for (a = 0; a <= MAG_CALIBRATION_ORDER; a++)
+    {
+        for (b = 0; a + b <= MAG_CALIBRATION_ORDER; b++)
+        {
+            for (c = 0; a + b + c <= MAG_CALIBRATION_ORDER; c++)
+            {
+                sum = 0.0;
+
+                for (i = 0; i <= a; i++)
+                    for (j = 0; j <= b; j++)
+                        for (k = 0; k <= c; k++)
+                            sum += binomial[a][i] * binomial[b][j] *
+                                   binomial[c][k] *
+                                   p[0][a - i] * p[1][b - j] * p[2][c - k] *
+                                   (double)s->moment[i][j][k] /
+                                   scale[i + j + k];
+
+                shifted[a][b][c] = sum;
+            }
+        }
+    }
+
+    for (i = 0, m = 0; i < MAG_CALIBRATION_PARAMETERS; i++)
+    {
+        stats->Dt1[i] = coefficient[i] * shifted[exponent[i][0]]
+                                                [exponent[i][1]]
+                                                [exponent[i][2]];
+
+        for (j = i; j < MAG_CALIBRATION_PARAMETERS; j++, m++)
+            stats->DtD[m] = coefficient[i] * coefficient[j] *
+                            shifted[exponent[i][0] + exponent[j][0]]
+                                   [exponent[i][1] + exponent[j][1]]
+                                   [exponent[i][2] + exponent[j][2]];
+    }
+
+    for (i = 0; i < 3; i++)
+        stats->origin[i] = (double)s->origin[i] + mean[i];
+
+    stats->samples = s->samples;
+}
+
+/**
+ * @brief               Solves the ellipsoid fit from its sufficient
+ *                      statistics.
+ * @details             The samples are fitted to
+ *                      ax^2 + by^2 + cz^2 + 2dxy + 2exz + 2fyz +
+ *                      2gx + 2hy + 2iz = 1
+ *                      in least squares, which in matrix form is
+ *                      x'Ax + 2b'x = 1. The center is c = -inv(A) b and
+ *                      (x - c)' A / k (x - c) = 1 with k = 1 + c'Ac, so the
+ *                      gain matrix is the symmetric square root of A / k.
+ *
+ * @param[in] stats     Statistics to solve.
+ * @param[out] result   Bias, gain and fit error on success.
+ * @return              True if the fit is a valid ellipsoid.
+ */
+static bool MagCalibrationSolve(const mag_calibration_statistics_t *stats,
+                                mag_calibration_status_t *result)
+{
+    const int n = MAG_CALIBRATION_PARAMETERS;
+    double x[MAG_CALIBRATION_PARAMETERS];
+    double A[3][3], V[3][3], adj[3][3], center[3], sq[3];
+    double sum, det, k, residual, lmin, lmax;
+    int i, j, m;
+
+    /* Cholesky factorization of D'D, only the lower triangle is used */
+    for (i = 0, m = 0; i < n; i++)
+        for (j = i; j < n; j++, m++)
+            cholesky[j][i] = stats->DtD[m];
+
+    for (j = 0; j < n; j++)
+    {
+        sum = cholesky[j][j];
+        for (m = 0; m < j; m++)
+            sum -= cholesky[j][m] * cholesky[j][m];
+
+        if (sum <= 0.0)
+            return false;
+
+        cholesky[j][j] = sqrt(sum);
+
+        for (i = j + 1; i < n; i++)
+        {
+            sum = cholesky[i][j];
+            for (m = 0; m < j; m++)
+                sum -= cholesky[i][m] * cholesky[j][m];
+
+            cholesky[i][j] = sum / cholesky[j][j];
+        }
+    }
+
+    /* Forward and back substitution of D'D x = D'1 */
+    for (i = 0; i < n; i++)
+    {
+        sum = stats->Dt1[i];
+        for (m = 0; m < i; m++)
+            sum -= cholesky[i][m] * x[m];
+
+        x[i] = sum / cholesky[i][i];
+    }
+
+    for (i = n - 1; i >= 0; i--)
+    {
+        sum = x[i];
+        for (m = i + 1; m < n; m++)
+            sum -= cholesky[m][i] * x[m];
+
+        x[i] = sum / cholesky[i][i];
+    }
+
+    /* Sum of squared algebraic residuals, x'D'Dx - 2x'D'1 + N */
+    residual = (double)stats->samples;
+    for (i = 0, m = 0; i < n; i++)
+    {
+        residual -= 2.0 * x[i] * stats->Dt1[i];
+
+        for (j = i; j < n; j++, m++)
+            residual += ((i == j) ? 1.0 : 2.0) * stats->DtD[m] * x[i] * x[j];
+    }
+
+    A[0][0] = x[0];
+    A[1][1] = x[1];
+    A[2][2] = x[2];
+    A[0][1] = A[1][0] = x[3];
+    A[0][2] = A[2][0] = x[4];
+    A[1][2] = A[2][1] = x[5];
+
+    /* Center from the adjugate of A */
+    adj[0][0] = A[1][1] * A[2][2] - A[1][2] * A[2][1];
+    adj[0][1] = A[0][2] * A[2][1] - A[0][1] * A[2][2];
+    adj[0][2] = A[0][1] * A[1][2] - A[0][2] * A[1][1];
+    adj[1][1] = A[0][0] * A[2][2] - A[0][2] * A[2][0];
+    adj[1][2] = A[0][2] * A[1][0] - A[0][0] * A[1][2];
+    adj[2][2] = A[0][0] * A[1][1] - A[0][1] * A[1][0];
+    adj[1][0] = adj[0][1];
+    adj[2][0] = adj[0][2];
+    adj[2][1] = adj[1][2];
+
+    det = A[0][0] * adj[0][0] + A[0][1] * adj[1][0] + A[0][2] * adj[2][0];
+
+    if (det <= 0.0)
+        return false;
+
+    for (i = 0; i < 3; i++)
+        center[i] = -(adj[i][0] * x[6] + adj[i][1] * x[7] + adj[i][2] * x[8])
+                    / det;
+
+    k = 1.0;
+    for (i = 0; i < 3; i++)
+        for (j = 0; j < 3; j++)
+            k += center[i] * A[i][j] * center[j];
+
+    if (k <= 0.0)
+        return false;
+
+    for (i = 0; i < 3; i++)
+        for (j = 0; j < 3; j++)
+            A[i][j] /= k;
+
+    /* Gain matrix as the symmetric square root of A / k */
+    MagCalibrationEigen(A, V);
+
+    lmin = lmax = A[0][0];
+    for (i = 0; i < 3; i++)
+    {
+        if (A[i][i] < lmin)
+            lmin = A[i][i];
+
+        if (A[i][i] > lmax)
+            lmax = A[i][i];
+    }
+
+    if ((lmin <= 0.0) ||
+        (lmax > lmin * (double)(MAG_CALIBRATION_MAX_AXIS_RATIO *
+                                MAG_CALIBRATION_MAX_AXIS_RATIO)))
+        return false;
+
+    for (i = 0; i < 3; i++)
+        sq[i] = sqrt(A[i][i]);
+
+    for (i = 0; i < 3; i++)
+    {
+        result->bias[i] = (float)(center[i] * MAG_CALIBRATION_SCALE +
+                                  stats->origin[i]);
+
+        for (j = 0; j < 3; j++)
+            result->gain[i][j] = (float)((V[i][0] * sq[0] * V[j][0] +
+                                          V[i][1] * sq[1] * V[j][1] +
+                                          V[i][2] * sq[2] * V[j][2]) /
+                                         MAG_CALIBRATION_SCALE);
+    }
+
+    /* The algebraic residual is about 2k times the relative error of the
+       field magnitude */
+    if (residual < 0.0)
+        residual = 0.0;
+
+    result->fit_error = (float)(sqrt(residual / (double)stats->samples) /
+                                (2.0 * k));
+
+    return true;
+}
+
+/**
+ * @brief               Applies the latest fit to the magnetometer, the flash
+ *                      save thread takes a snapshot of the new calibration
+ *                      and the estimation restarts from it.
+ *
+ * @param[in] fit       Fit to commit.
+ */
+static void MagCalibrationCommit(const mag_calibration_status_t *fit)
+{
+    sensor_calibration_t *cal = ptrGetMagnetometerCalibration();
+    int i, j;
+
+    chMtxLock(&cal->lock);
+
+    for (i = 0; i < 3; i++)
+    {
+        cal->bias[i] = fit->bias[i];
+
+        for (j = 0; j < 3; j++)
+            cal->gain[i][j] = fit->gain[i][j];
+    }
+
+    chMtxUnlock(&cal->lock);
+
+    vBroadcastFlashSaveEvent();
+    ResetEstimation();
+}
+
+/**
+ * @brief               Solves the fit periodically while collecting, and
+ *                      commits it on request.
+ * @note                The collected samples are read without the lock, they
+ *                      are only appended to, and a fit of samples replaced by
+ *                      a new start is dropped by the generation check.
+ *
+ * @param[in] arg       Unused.
+ */
+static THD_FUNCTION(ThreadMagCalibration, arg)
+{
+    (void)arg;
+
+    mag_calibration_status_t fit;
+    eventmask_t events;
+    uint32_t solved_generation, count, solved_count = 0;
+    bool collecting, solve, valid;
+
+    chRegSetThreadName("Mag Calibration");
+
+    memset(&sums, 0, sizeof(sums));
+
+    while (1)
+    {
+        events = chEvtWaitAnyTimeout(MAG_CALIBRATION_COMMIT_EVENTMASK,
+                                     MS2ST(MAG_CALIBRATION_SOLVE_INTERVAL_MS));
+
+        chMtxLock(&mag_calibration_lock);
+
+        collecting =
+            (mag_calibration_status.state == MAG_CALIBRATION_COLLECTING) ||
+            (mag_calibration_status.state == MAG_CALIBRATION_SOLVED);
+
+        solve = collecting &&
+                (mag_calibration_status.covered_bins >=
+                    MAG_CALIBRATION_MIN_BINS) &&
+                (collected_count >= MAG_CALIBRATION_MIN_SAMPLES);
+
+        count = collected_count;
+        solved_generation = generation;
+
+        chMtxUnlock(&mag_calibration_lock);
+
+        /* A new start clears the collected samples */
+        if (sums.generation != solved_generation)
+        {
+            memset(&sums, 0, sizeof(sums));
+            sums.generation = solved_generation;
+            solved_count = 0;
+        }
+
+        if (collecting == true)
+            MagCalibrationAccumulate(&sums, collected, count);
+
+        /* The fit only changes with new samples */
+        if ((solve == true) && (count != solved_count))
+        {
+            solved_count = count;
+
+            MagCalibrationStatistics(&sums, &solving);
+            valid = MagCalibrationSolve(&solving, &fit);
+
+            chMtxLock(&mag_calibration_lock);
+
+            if ((valid == true) && (solved_generation == generation) &&
+                (mag_calibration_status.state != MAG_CALIBRATION_IDLE))
+            {
+                memcpy(mag_calibration_status.bias, fit.bias,
+                       sizeof(fit.bias));
+                memcpy(mag_calibration_status.gain, fit.gain,
+                       sizeof(fit.gain));
+                mag_calibration_status.fit_error = fit.fit_error;
+                mag_calibration_status.state = MAG_CALIBRATION_SOLVED;
+            }
+
+            chMtxUnlock(&mag_calibration_lock);
+        }
+
+        if (events & MAG_CALIBRATION_COMMIT_EVENTMASK)
+        {
+            /* Collection stops on commit, so the fit is not changed by the
+               sensor thread while it is applied */
+            chMtxLock(&mag_calibration_lock);
+
+            valid = (mag_calibration_status.state == MAG_CALIBRATION_SOLVED);
+            fit = mag_calibration_status;
+
+            if (valid == false)
+                mag_calibration_status.state = MAG_CALIBRATION_FAILED;
+            else
+                mag_calibration_status.state = MAG_CALIBRATION_COMMITTED;
+
+            chMtxUnlock(&mag_calibration_lock);
+
+            if (valid == true)
+                MagCalibrationCommit(&fit);
+        }
+    }
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief               Initializes the magnetometer calibration and starts
+ *                      its solver thread.
+ */
+void MagCalibrationInit(void)
+{
+    chMtxObjectInit(&mag_calibration_lock);
+
+    memset(&mag_calibration_status, 0, MAG_CALIBRATION_STATUS_SIZE);
+    mag_calibration_status.state = MAG_CALIBRATION_IDLE;
+    generation = 0;
+
+    thread_mag_calibration_p = chThdCreateStatic(
+                                        waThreadMagCalibration,
+                                        sizeof(waThreadMagCalibration),
+                                        LOWPRIO,
+                                        ThreadMagCalibration,
+                                        NULL);
+}
+
+/**
+ * @brief               Adds a magnetometer sample to the fit while
+ *                      collecting, in constant time and without floating
+ *                      point math except for the coverage bin.
+ * @note                Called from the sensor read thread.
+ *
+ * @param[in] raw_mag_data  Raw magnetometer sample.
+ */
+void MagCalibrationAddSample(const int16_t raw_mag_data[3])
+{
+    int bin, i;
+
+    chMtxLock(&mag_calibration_lock);
+
+    if ((mag_calibration_status.state != MAG_CALIBRATION_COLLECTING) &&
+        (mag_calibration_status.state != MAG_CALIBRATION_SOLVED))
+    {
+        chMtxUnlock(&mag_calibration_lock);
+        return;
+    }
+
+    bin = MagCalibrationBin(raw_mag_data);
+
+    if ((bin < 0) || (bin_samples[bin] >= MAG_CALIBRATION_SAMPLES_PER_BIN) ||
+        (collected_count >= MAG_CALIBRATION_MAX_SAMPLES))
+    {
+        chMtxUnlock(&mag_calibration_lock);
+        return;
+    }
+
+    if (bin_samples[bin]++ == 0)
+        mag_calibration_status.covered_bins++;
+
+    for (i = 0; i < 3; i++)
+        collected[collected_count][i] = raw_mag_data[i];
+
+    collected_count++;
+    mag_calibration_status.samples = (uint16_t)collected_count;
+
+    chMtxUnlock(&mag_calibration_lock);
+}
+
+/**
+ * @brief               Starts, stops or commits the calibration.
+ * @note                The commit is done in the solver thread.
+ *
+ * @param[in] action    Requested action.
+ */
+void MagCalibrationRequest(mag_calibration_action_t action)
+{
+    int i;
+
+    if (action == MAG_CALIBRATION_ACTION_START)
+    {
+        chMtxLock(&mag_calibration_lock);
+
+        collected_count = 0;
+        memset(bin_samples, 0, sizeof(bin_samples));
+
+        for (i = 0; i < 3; i++)
+        {
+            raw_min[i] = INT16_MAX;
+            raw_max[i] = INT16_MIN;
+        }
+
+        memset(&mag_calibration_status, 0, MAG_CALIBRATION_STATUS_SIZE);
+        mag_calibration_status.state = MAG_CALIBRATION_COLLECTING;
+        generation++;
+
+        chMtxUnlock(&mag_calibration_lock);
+    }
+    else if (action == MAG_CALIBRATION_ACTION_STOP)
+    {
+        chMtxLock(&mag_calibration_lock);
+        mag_calibration_status.state = MAG_CALIBRATION_IDLE;
+        chMtxUnlock(&mag_calibration_lock);
+    }
+    else if ((action == MAG_CALIBRATION_ACTION_COMMIT) &&
+             (thread_mag_calibration_p != NULL))
+    {
+        chEvtSignal(thread_mag_calibration_p,
+                    MAG_CALIBRATION_COMMIT_EVENTMASK);
+    }
+}
+
+/**
+ * @brief               Copies the calibration status and latest fit.
+ *
+ * @param[out] status   Copy of the status.
+ */
+void GetMagCalibrationStatus(mag_calibration_status_t *status)
+{
+    chMtxLock(&mag_calibration_lock);
+    *status = mag_calibration_status;
+    chMtxUnlock(&mag_calibration_lock);
+}
@@ -0,0 +1,340 @@
+/* *
+ *
+ * Abstraction Layer for MPU6000 and ICM-20602 Accelerometer & Gyroscope
+ * over SPI
+ *
+ * */
+
+#include "ch.h"
+#include "hal.h"
+#include "mpu6000.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief Writes a register of the sensor with the register SPI
+ *        configuration, the bus configuration is restored after.
+ *
+ * @param[in] cfg   Pointer to configuration structure
+ * @param[in] reg   Register address
+ * @param[in] value Value to write
+ */
+static void MPU6000WriteRegister(const MPU6000_Configuration *cfg,
+                                 uint8_t reg,
+                                 uint8_t value)
+{
+    const SPIConfig *bus_spicfg;
+
+    spiAcquireBus(cfg->spip);
+    bus_spicfg = cfg->spip->config;
+    spiStart(cfg->spip, cfg->register_spicfg);
+
+    MPU6000_Select(cfg);
+    spiPolledExchange(cfg->spip, reg);
+    spiPolledExchange(cfg->spip, value);
+    MPU6000_Unselect(cfg);
+
+    spiStart(cfg->spip, bus_spicfg);
+    spiReleaseBus(cfg->spip);
+}
+
+/**
+ * @brief Reads a register of the sensor with the register SPI
+ *        configuration, the bus configuration is restored after.
+ *
+ * @param[in] cfg   Pointer to configuration structure
+ * @param[in] reg   Register address
+ * @return The register value
+ */
+static uint8_t MPU6000ReadRegister(const MPU6000_Configuration *cfg,
+                                   uint8_t reg)
+{
+    const SPIConfig *bus_spicfg;
+    uint8_t value;
+
+    spiAcquireBus(cfg->spip);
+    bus_spicfg = cfg->spip->config;
+    spiStart(cfg->spip, cfg->register_spicfg);
+
+    MPU6000_Select(cfg);
+    spiPolledExchange(cfg->spip, reg | MPU6000_SPI_READ);
+    value = spiPolledExchange(cfg->spip, 0xFF);
+    MPU6000_Unselect(cfg);
+
+    spiStart(cfg->spip, bus_spicfg);
+    spiReleaseBus(cfg->spip);
+
+    return value;
+}
+
+/**
+ * @brief Reads consecutive registers of the sensor with DMA, using the bus
+ *        SPI configuration. Only the data and FIFO registers may be read at
+ *        more than 1 MHz.
+ *
+ * @param[in] cfg   Pointer to configuration structure
+ * @param[in] reg   First register address
+ * @param[in] n     Number of bytes to read
+ * @param[out] data Pointer to where the data will be saved, may NOT be placed
+ *                  in CCM memory because DMA directly accesses it.
+ */
+static void MPU6000ReadBurst(const MPU6000_Configuration *cfg,
+                             uint8_t reg,
+                             size_t n,
+                             uint8_t *data)
+{
+    spiAcquireBus(cfg->spip);
+
+    MPU6000_Select(cfg);
+    spiPolledExchange(cfg->spip, reg | MPU6000_SPI_READ);
+    spiReceive(cfg->spip, n, data);
+    MPU6000_Unselect(cfg);
+
+    spiReleaseBus(cfg->spip);
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief Initializes the MPU6000 or ICM-20602 sensor
+ *
+ * @param[in] cfg Pointer to configuration structure
+ * @return MSG_OK if the initialization was successful
+ */
+msg_t MPU6000Init(const MPU6000_Configuration *cfg)
+{
+    uint8_t id, fifo_cfg;
+    msg_t status;
+
+    /* Error: Pointers not defined */
+    if ((cfg->data_holder == NULL) || (cfg->spip == NULL) ||
+        (cfg->register_spicfg == NULL))
+        return MSG_RESET;
+
+    /* Initialize the data event source and mutex */
+    chMtxObjectInit(&cfg->data_holder->read_lock);
+
+    /* Perform sensor reset, sleep for 100 ms as per datasheet */
+    MPU6000_Unselect(cfg);
+    MPU6000WriteRegister(cfg, MPU6050_RA_PWR_MGMT_1, MPU6050_DEVICE_RESET);
+    chThdSleepMilliseconds(100);
+
+    MPU6000WriteRegister(cfg,
+                         MPU6050_RA_SIGNAL_PATH_RESET,
+                         MPU6050_GYRO_RESET |
+                         MPU6050_ACCEL_RESET |
+                         MPU6050_TEMP_RESET);
+    chThdSleepMilliseconds(100);
+
+    /* Disable the I2C interface so the pins stay in SPI mode */
+    MPU6000WriteRegister(cfg,
+                         MPU6050_RA_USER_CTRL,
+                         MPU6000_USERCTRL_I2C_IF_DIS);
+
+    /* Set internal clock source and Sleep mode */
+    MPU6000WriteRegister(cfg, MPU6050_RA_PWR_MGMT_1, cfg->clock_reference);
+
+    /* Check the sensor */
+    status = MPU6000GetID(cfg, &id);
+
+    if (status != MSG_OK)
+        return status;
+
+    /* The temperature conversion differs between the sensors */
+    cfg->data_holder->who_am_i = id;
+
+    /* Set Sample Rate divider, Digital Low-Pass Filter and ranges */
+    MPU6000WriteRegister(cfg,
+                         MPU6050_RA_SMPLRT_DIV,
+                         cfg->sample_rate_divider);
+    MPU6000WriteRegister(cfg, MPU6050_RA_CONFIG, cfg->dlp_cfg);
+    MPU6000WriteRegister(cfg, MPU6050_RA_GYRO_CONFIG, cfg->gyro_range_sel);
+    MPU6000WriteRegister(cfg, MPU6050_RA_ACCEL_CONFIG, cfg->accel_range_sel);
+
+    /* Set FIFO, the ICM-20602 only has one enable bit per sensor */
+    fifo_cfg = cfg->fifo_cfg;
+
+    if ((id == MPU6000_WHO_AM_I_ICM20602) && (fifo_cfg != 0))
+        fifo_cfg = MPU6000_ICM20602_GYRO_FIFO_EN |
+                   MPU6000_ICM20602_ACCEL_FIFO_EN;
+
+    MPU6000WriteRegister(cfg, MPU6050_RA_FIFO_EN, fifo_cfg);
+
+    if (fifo_cfg != 0)
+        status = MPU6000ResetFIFO(cfg);
+
+    /* Set interrupt pin config and interrupts */
+    MPU6000WriteRegister(cfg, MPU6050_RA_INT_PIN_CFG, cfg->int_pin_cfg);
+    MPU6000WriteRegister(cfg, MPU6050_RA_INT_ENABLE, cfg->int_cfg);
+
+    return status;
+}
+
+/**
+ * @brief Reads the ID of the sensor
+ *
+ * @param[in] cfg Pointer to configuration structure
+ * @param[out] id Pointer to where the single byte id will be saved
+ *
+ * @return MSG_OK if a MPU6000 or ICM-20602 answered
+ */
+msg_t MPU6000GetID(const MPU6000_Configuration *cfg, uint8_t id[1])
+{
+    *id = MPU6000ReadRegister(cfg, MPU6050_RA_WHO_AM_I);
+
+    if ((*id == MPU6000_WHO_AM_I_MPU6000) ||
+        (*id == MPU6000_WHO_AM_I_ICM20602))
+        return MSG_OK;
+    else
+        return MSG_RESET;
+}
+
+/**
+ * @brief Reads the data registers of the sensor
+ *
+ * @param[in] cfg Pointer to configuration structure
+ * @param[out] data Pointer to where the data will be saved, may NOT be
+ *                  placed in CCM memory because DMA directly accesses it.
+ *
+ * @return MSG_OK
+ */
+msg_t MPU6000ReadData(const MPU6000_Configuration *cfg, uint8_t data[14])
+{
+    MPU6000ReadBurst(cfg,
+                     MPU6050_RA_ACCEL_XOUT_H,
+                     MPU6050_ACCEL_GYRO_TEMP_DATA_SIZE,
+                     data);
+
+    return MSG_OK;
+}
+
+/**
+ * @brief Reads all whole frames in the FIFO, up to max_frames, in one DMA
+ *        burst. The frames have the layout of the data registers.
+ *
+ * @note  If the FIFO has overflowed or is not a whole number of frames it is
+ *        reset and no frames are returned, as the frame alignment is lost.
+ *
+ * @param[in] cfg Pointer to configuration structure
+ * @param[out] data Pointer to where the frames will be saved, room for
+ *                  max_frames frames. May NOT be placed in CCM memory
+ *                  because DMA directly accesses it.
+ * @param[in] max_frames Maximum number of frames to read.
+ *
+ * @return The number of frames read
+ */
+uint8_t MPU6000ReadFIFO(const MPU6000_Configuration *cfg,
+                        uint8_t *data,
+                        uint8_t max_frames)
+{
+    uint16_t count, frames;
+
+    /* The FIFO count is latched when the high byte is read */
+    MPU6000ReadBurst(cfg, MPU6050_RA_FIFO_COUNTH, 2, data);
+    count = ((uint16_t)data[0] << 8) | data[1];
+
+    if ((count >= MPU6000_FIFO_SIZE) ||
+        ((count % MPU6000_FIFO_FRAME_SIZE) != 0))
+    {
+        MPU6000ResetFIFO(cfg);
+        return 0;
+    }
+
+    frames = count / MPU6000_FIFO_FRAME_SIZE;
+
+    if (frames > max_frames)
+        frames = max_frames;
+
+    if (frames > 0)
+        MPU6000ReadBurst(cfg,
+                         MPU6050_RA_FIFO_R_W,
+                         frames * MPU6000_FIFO_FRAME_SIZE,
+                         data);
+
+    return (uint8_t)frames;
+}
+
+/**
+ * @brief Empties the FIFO and enables it
+ *
+ * @param[in] cfg Pointer to configuration structure
+ * @return MSG_OK
+ */
+msg_t MPU6000ResetFIFO(const MPU6000_Configuration *cfg)
+{
+    MPU6000WriteRegister(cfg,
+                         MPU6050_RA_USER_CTRL,
+                         MPU6000_USERCTRL_I2C_IF_DIS |
+                         MPU6000_USERCTRL_FIFO_RESET);
+
+    MPU6000WriteRegister(cfg,
+                         MPU6050_RA_USER_CTRL,
+                         MPU6000_USERCTRL_I2C_IF_DIS |
+                         MPU6000_USERCTRL_FIFO_EN);
+
+    return MSG_OK;
+}
+
+/**
+ * @brief Get the gain of the accelerometer
+ *
+ * @param[in] cfg Pointer to configuration structure
+ * @return The gain of the accelerometer
+ */
+float MPU6000GetAccelGain(const MPU6000_Configuration *cfg)
+{
+    if (cfg->accel_range_sel == MPU6050_ACCEL_FS_2)
+        return MPU6050_LSB_TO_2G;
+
+    else if (cfg->accel_range_sel == MPU6050_ACCEL_FS_4)
+        return MPU6050_LSB_TO_4G;
+
+    else if (cfg->accel_range_sel == MPU6050_ACCEL_FS_8)
+        return MPU6050_LSB_TO_8G;
+
+    else if (cfg->accel_range_sel == MPU6050_ACCEL_FS_16)
+        return MPU6050_LSB_TO_16G;
+
+    else
+        return 0.0f;
+}
+
+/**
+ * @brief Get the gain of the gyroscope
+ *
+ * @param[in] cfg Pointer to configuration structure
+ * @return The gain of the gyroscope
+ */
+float MPU6000GetGyroGain(const MPU6000_Configuration *cfg)
+{
+    if (cfg->gyro_range_sel == MPU6050_GYRO_FS_250)
+        return MPU6050_DPS250_TO_RADPS;
+
+    else if (cfg->gyro_range_sel == MPU6050_GYRO_FS_500)
+        return MPU6050_DPS500_TO_RADPS;
+
+    else if (cfg->gyro_range_sel == MPU6050_GYRO_FS_1000)
+        return MPU6050_DPS1000_TO_RADPS;
+
+    else if (cfg->gyro_range_sel == MPU6050_GYRO_FS_2000)
+        return MPU6050_DPS2000_TO_RADPS;
+
+    else
+        return 0.0f;
+}
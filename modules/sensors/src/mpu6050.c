@@ -308,16 +308,16 @@ msg_t MPU6050ReadData(const MPU6050_Configuration *cfg, uint8_t data[14])
  */
 float MPU6050GetAccelGain(const MPU6050_Configuration *cfg)
 {
-    if (cfg->gyro_range_sel == MPU6050_ACCEL_FS_2)
+    if (cfg->accel_range_sel == MPU6050_ACCEL_FS_2)
         return MPU6050_LSB_TO_2G;
 
-    else if (cfg->gyro_range_sel == MPU6050_ACCEL_FS_4)
+    else if (cfg->accel_range_sel == MPU6050_ACCEL_FS_4)
         return MPU6050_LSB_TO_4G;
 
-    else if (cfg->gyro_range_sel == MPU6050_ACCEL_FS_8)
+    else if (cfg->accel_range_sel == MPU6050_ACCEL_FS_8)
         return MPU6050_LSB_TO_8G;
 
-    else if (cfg->gyro_range_sel == MPU6050_ACCEL_FS_16)
+    else if (cfg->accel_range_sel == MPU6050_ACCEL_FS_16)
         return MPU6050_LSB_TO_16G;
 
     else
@@ -0,0 +1,286 @@
+/* *
+ *
+ * Abstraction Layer for MS5611 Barometer
+ *
+ * */
+
+#include "ch.h"
+#include "hal.h"
+#include "ms5611.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+/* Command of the ADC read transaction */
+static const uint8_t adc_read_command = MS5611_CMD_ADC_READ;
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief Checks the CRC4 of the factory calibration, as per application
+ *        note AN520.
+ *
+ * @param[in] prom The calibration words C0 to C7, the CRC is in the low
+ *                 nibble of C7.
+ * @return True if the CRC is correct
+ */
+static bool MS5611CheckPROM(const uint16_t prom[MS5611_PROM_WORDS])
+{
+    uint16_t rem = 0, word;
+    int i, bit;
+
+    for (i = 0; i < 2 * MS5611_PROM_WORDS; i++)
+    {
+        word = prom[i >> 1];
+
+        /* The CRC itself is not part of the checksum */
+        if (i >= 2 * MS5611_PROM_WORDS - 2)
+            word &= 0xFF00;
+
+        if (i & 1)
+            rem ^= word & 0x00FF;
+        else
+            rem ^= word >> 8;
+
+        for (bit = 0; bit < 8; bit++)
+        {
+            if (rem & 0x8000)
+                rem = (rem << 1) ^ 0x3000;
+            else
+                rem <<= 1;
+        }
+    }
+
+    return ((rem >> 12) & 0x0F) == (prom[MS5611_PROM_WORDS - 1] & 0x0F);
+}
+
+/**
+ * @brief Calculates the temperature compensated pressure with the second
+ *        order compensation of the datasheet.
+ *
+ * @param[in/out] dh Pointer to data holder structure.
+ */
+static void MS5611Calculate(MS5611_Data *dh)
+{
+    int64_t dT, temp, off, sens, off2, sens2, t2;
+
+    dT = (int64_t)dh->raw_temperature - ((int64_t)dh->prom[5] << 8);
+    temp = 2000 + ((dT * dh->prom[6]) >> 23);
+    off = ((int64_t)dh->prom[2] << 16) + ((dh->prom[4] * dT) >> 7);
+    sens = ((int64_t)dh->prom[1] << 15) + ((dh->prom[3] * dT) >> 8);
+
+    if (temp < 2000)
+    {
+        t2 = (dT * dT) >> 31;
+        off2 = 5 * (temp - 2000) * (temp - 2000) / 2;
+        sens2 = 5 * (temp - 2000) * (temp - 2000) / 4;
+
+        if (temp < -1500)
+        {
+            off2 += 7 * (temp + 1500) * (temp + 1500);
+            sens2 += 11 * (temp + 1500) * (temp + 1500) / 2;
+        }
+
+        temp -= t2;
+        off -= off2;
+        sens -= sens2;
+    }
+
+    /* Pressure in 0.01 mbar which is Pa, temperature in 0.01 deg C */
+    dh->pressure = (float)((((int64_t)dh->raw_pressure * sens >> 21) - off)
+                           >> 15);
+    dh->temperature = (float)temp * 0.01f;
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief Initializes the MS5611 sensor. The sensor is reset and the factory
+ *        calibration is read through the bus scheduler.
+ *
+ * @param[in] cfg Pointer to configuration structure
+ * @return MSG_OK if the initialization was successful
+ */
+msg_t MS5611Init(const MS5611_Configuration *cfg)
+{
+    MS5611_Data *dh = cfg->data_holder;
+    msg_t status;
+    int i;
+
+    /* Error: Pointers not defined */
+    if ((dh == NULL) || (cfg->scheduler == NULL))
+        return MSG_RESET;
+
+    dh->device.address = cfg->address_7bit;
+    I2CScheduler_ResetStatistics(&dh->device);
+
+    dh->convert.device = &dh->device;
+    dh->convert.priority = I2C_PRIORITY_LOW;
+    dh->convert.txbuf = &dh->command;
+    dh->convert.txbytes = 1;
+    dh->convert.rxbuf = NULL;
+    dh->convert.rxbytes = 0;
+    dh->convert.callback = NULL;
+
+    dh->adc_read.device = &dh->device;
+    dh->adc_read.priority = I2C_PRIORITY_LOW;
+    dh->adc_read.txbuf = &adc_read_command;
+    dh->adc_read.txbytes = 1;
+    dh->adc_read.rxbuf = dh->adc_data;
+    dh->adc_read.rxbytes = MS5611_ADC_DATA_SIZE;
+    dh->adc_read.callback = NULL;
+
+    /* Perform sensor reset */
+    dh->command = MS5611_CMD_RESET;
+    status = I2CScheduler_Execute(cfg->scheduler, &dh->convert);
+
+    if (status != MSG_OK)
+        return status;
+
+    chThdSleepMilliseconds(MS5611_RESET_TIME_MS);
+
+    /* Read the factory calibration, uses the ADC read transaction with a
+       different command and length */
+    dh->adc_read.txbuf = &dh->command;
+    dh->adc_read.rxbytes = 2;
+
+    for (i = 0; i < MS5611_PROM_WORDS; i++)
+    {
+        dh->command = MS5611_CMD_PROM_READ + 2 * i;
+        status = I2CScheduler_Execute(cfg->scheduler, &dh->adc_read);
+
+        if (status != MSG_OK)
+            break;
+
+        dh->prom[i] = ((uint16_t)dh->adc_data[0] << 8) | dh->adc_data[1];
+    }
+
+    dh->adc_read.txbuf = &adc_read_command;
+    dh->adc_read.rxbytes = MS5611_ADC_DATA_SIZE;
+
+    if (status != MSG_OK)
+        return status;
+
+    if (MS5611CheckPROM(dh->prom) == false)
+        return MSG_RESET;
+
+    dh->raw_pressure = 0;
+    dh->raw_temperature = 0;
+    dh->pressure = 0.0f;
+    dh->temperature = 0.0f;
+    dh->converting = MS5611_CONVERSION_NONE;
+    dh->reading = MS5611_CONVERSION_NONE;
+    dh->conversion_count = MS5611_PRESSURE_PER_TEMPERATURE;
+
+    return MSG_OK;
+}
+
+/**
+ * @brief Advances the conversion state machine, shall be called at most
+ *        every MS5611GetConversionTimeUS.
+ * @details Each step processes the ADC read queued on the previous step,
+ *          queues a read of the conversion started on the previous step and
+ *          starts the next conversion. All transactions are queued at low
+ *          priority and the function never waits for the bus, a step is
+ *          skipped if the previous transactions are not done.
+ *
+ * @param[in] cfg Pointer to configuration structure
+ * @return True if there is a new pressure
+ */
+bool MS5611Step(const MS5611_Configuration *cfg)
+{
+    MS5611_Data *dh = cfg->data_holder;
+    uint32_t value;
+    bool new_pressure = false;
+
+    if ((dh->convert.done == false) || (dh->adc_read.done == false))
+        return false;
+
+    /* Process the ADC read queued on the previous step, zero is returned
+       if the conversion was not done */
+    if (dh->reading != MS5611_CONVERSION_NONE)
+    {
+        value = ((uint32_t)dh->adc_data[0] << 16) |
+                ((uint32_t)dh->adc_data[1] << 8) |
+                dh->adc_data[2];
+
+        if ((dh->adc_read.status == MSG_OK) && (value != 0))
+        {
+            if (dh->reading == MS5611_CONVERSION_TEMPERATURE)
+            {
+                dh->raw_temperature = value;
+            }
+            else if (dh->raw_temperature != 0)
+            {
+                dh->raw_pressure = value;
+                MS5611Calculate(dh);
+                new_pressure = true;
+            }
+        }
+
+        dh->reading = MS5611_CONVERSION_NONE;
+    }
+
+    /* Read the conversion started on the previous step */
+    if ((dh->converting != MS5611_CONVERSION_NONE) &&
+        (dh->convert.status == MSG_OK))
+    {
+        I2CScheduler_Submit(cfg->scheduler, &dh->adc_read);
+        dh->reading = dh->converting;
+    }
+
+    /* Start the next conversion, it is queued after the ADC read */
+    if (dh->conversion_count >= MS5611_PRESSURE_PER_TEMPERATURE)
+    {
+        dh->command = MS5611_CMD_CONVERT_D2 | cfg->osr;
+        dh->converting = MS5611_CONVERSION_TEMPERATURE;
+        dh->conversion_count = 0;
+    }
+    else
+    {
+        dh->command = MS5611_CMD_CONVERT_D1 | cfg->osr;
+        dh->converting = MS5611_CONVERSION_PRESSURE;
+        dh->conversion_count++;
+    }
+
+    I2CScheduler_Submit(cfg->scheduler, &dh->convert);
+
+    return new_pressure;
+}
+
+/**
+ * @brief Get the maximum conversion time of the sensor
+ *
+ * @param[in] cfg Pointer to configuration structure
+ * @return The conversion time in microseconds
+ */
+uint32_t MS5611GetConversionTimeUS(const MS5611_Configuration *cfg)
+{
+    if (cfg->osr == MS5611_OSR_256)
+        return 600;
+
+    else if (cfg->osr == MS5611_OSR_512)
+        return 1170;
+
+    else if (cfg->osr == MS5611_OSR_1024)
+        return 2280;
+
+    else if (cfg->osr == MS5611_OSR_2048)
+        return 4540;
+
+    else
+        return 9040;
+}
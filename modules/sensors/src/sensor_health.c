@@ -0,0 +1,400 @@
+/* *
+ *
+ * Streaming health statistics of the IMU: clipping, vibration, stuck
+ * samples and sensor bus errors, updated in constant time per sample
+ *
+ * */
+
+#include <math.h>
+#include <string.h>
+#include "ch.h"
+#include "hal.h"
+#include "sensor_health.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/* Accelerometer x, y, z followed by gyro x, y, z */
+#define SENSOR_HEALTH_CHANNELS          6
+
+/* Flags updated at the end of each window */
+#define SENSOR_HEALTH_WINDOW_FLAGS      (SENSOR_HEALTH_ACCEL_CLIPPING   | \
+                                         SENSOR_HEALTH_GYRO_CLIPPING    | \
+                                         SENSOR_HEALTH_MAG_OVERFLOW_FLAG| \
+                                         SENSOR_HEALTH_HIGH_VIBRATION   | \
+                                         SENSOR_HEALTH_BUS_ERRORS)
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+/* Published statistics, only the sensor read thread writes them */
+static sensor_health_t health;
+
+/* Sensor bus */
+static const I2CSchedulerConfig *bus_scheduler;
+static const I2CDevice *bus_devices[SENSOR_HEALTH_MAX_DEVICES];
+static uint32_t bus_device_count;
+
+/* Gains from raw counts to g and rad/s */
+static float channel_gain[SENSOR_HEALTH_CHANNELS];
+static float vibration_limit_sq;
+
+/* Statistics window, the samples are offset by the first sample of the
+   window to keep the variance accurate in single precision */
+static uint32_t window_length;
+static uint32_t window_count;
+static int16_t window_first[SENSOR_HEALTH_CHANNELS];
+static float window_sum[SENSOR_HEALTH_CHANNELS];
+static float window_sum_sq[SENSOR_HEALTH_CHANNELS];
+static int16_t window_min[SENSOR_HEALTH_CHANNELS];
+static int16_t window_max[SENSOR_HEALTH_CHANNELS];
+
+/* Counters at the start of the window, to detect new events */
+static uint32_t window_accel_clips;
+static uint32_t window_gyro_clips;
+static uint32_t window_mag_overflows;
+static uint32_t window_bus_errors;
+
+/* Stuck detection, length of the current run of identical samples */
+static uint32_t accgyro_stuck_limit;
+static uint32_t mag_stuck_limit;
+static uint32_t accel_run, gyro_run, mag_run;
+static int16_t last_accel[3], last_gyro[3], last_mag[3];
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief               Checks if a raw sample is at full scale.
+ *
+ * @param[in] x         Raw sample.
+ * @return              1 if the sample is clipped, else 0.
+ */
+static inline uint32_t SensorHealthIsClipped(int16_t x)
+{
+    return ((x >= SENSOR_HEALTH_CLIP_LIMIT) ||
+            (x <= -SENSOR_HEALTH_CLIP_LIMIT)) ? 1 : 0;
+}
+
+/**
+ * @brief               Updates the run of identical samples of a sensor.
+ *
+ * @param[in] x         New sample.
+ * @param[in,out] last  Previous sample, replaced with the new.
+ * @param[in,out] run   Length of the current run.
+ * @param[in] limit     Run length declaring the sensor stuck.
+ * @param[in] flag      Flag of the sensor.
+ * @return              True when the run reaches the limit, so each stuck
+ *                      event is counted once.
+ */
+static bool SensorHealthUpdateRun(const int16_t x[3],
+                                  int16_t last[3],
+                                  uint32_t *run,
+                                  uint32_t limit,
+                                  uint8_t flag)
+{
+    if ((x[0] == last[0]) && (x[1] == last[1]) && (x[2] == last[2]))
+    {
+        if (++(*run) == limit)
+        {
+            health.flags |= flag;
+            return true;
+        }
+    }
+    else
+    {
+        *run = 0;
+        health.flags &= ~flag;
+
+        last[0] = x[0];
+        last[1] = x[1];
+        last[2] = x[2];
+    }
+
+    return false;
+}
+
+/**
+ * @brief               Publishes the statistics of a finished window and
+ *                      updates the window flags.
+ */
+static void SensorHealthWindowDone(void)
+{
+    I2CDeviceStatistics stats;
+    float rms[SENSOR_HEALTH_CHANNELS], peak[SENSOR_HEALTH_CHANNELS];
+    float n = (float)window_length;
+    float m, var, hi, lo, vibration_sq;
+    uint32_t transactions, errors, timeouts, i;
+    uint8_t flags;
+    int c;
+
+    vibration_sq = 0.0f;
+
+    for (c = 0; c < SENSOR_HEALTH_CHANNELS; c++)
+    {
+        m = window_sum[c] / n;
+        var = window_sum_sq[c] / n - m * m;
+        if (var < 0.0f)
+            var = 0.0f;
+
+        /* Peak deviation from the window mean, in raw counts */
+        hi = (float)(window_max[c] - window_first[c]) - m;
+        lo = m - (float)(window_min[c] - window_first[c]);
+
+        rms[c] = sqrtf(var) * channel_gain[c];
+        peak[c] = ((hi > lo) ? hi : lo) * channel_gain[c];
+
+        if (c < 3)
+            vibration_sq += rms[c] * rms[c];
+    }
+
+    /* Sum the bus statistics of the sensors */
+    transactions = 0;
+    errors = 0;
+    timeouts = 0;
+
+    for (i = 0; i < bus_device_count; i++)
+    {
+        I2CScheduler_GetStatistics(bus_devices[i], &stats);
+        transactions += stats.transactions;
+        errors += stats.errors;
+        timeouts += stats.timeouts;
+    }
+
+    /* New events in this window raise the flags */
+    flags = 0;
+
+    if (health.accel_clip_count[0] + health.accel_clip_count[1] +
+        health.accel_clip_count[2] != window_accel_clips)
+        flags |= SENSOR_HEALTH_ACCEL_CLIPPING;
+
+    if (health.gyro_clip_count[0] + health.gyro_clip_count[1] +
+        health.gyro_clip_count[2] != window_gyro_clips)
+        flags |= SENSOR_HEALTH_GYRO_CLIPPING;
+
+    if (health.mag_overflow_count != window_mag_overflows)
+        flags |= SENSOR_HEALTH_MAG_OVERFLOW_FLAG;
+
+    if (vibration_sq > vibration_limit_sq)
+        flags |= SENSOR_HEALTH_HIGH_VIBRATION;
+
+    if (errors + timeouts != window_bus_errors)
+        flags |= SENSOR_HEALTH_BUS_ERRORS;
+
+    window_accel_clips = health.accel_clip_count[0] +
+                         health.accel_clip_count[1] +
+                         health.accel_clip_count[2];
+    window_gyro_clips = health.gyro_clip_count[0] +
+                        health.gyro_clip_count[1] +
+                        health.gyro_clip_count[2];
+    window_mag_overflows = health.mag_overflow_count;
+    window_bus_errors = errors + timeouts;
+
+    /* The statistics are copied by other threads */
+    chSysLock();
+
+    for (c = 0; c < 3; c++)
+    {
+        health.accel_rms[c] = rms[c];
+        health.accel_peak[c] = peak[c];
+        health.gyro_rms[c] = rms[c + 3];
+        health.gyro_peak[c] = peak[c + 3];
+    }
+
+    health.i2c_transactions = transactions;
+    health.i2c_errors = errors;
+    health.i2c_timeouts = timeouts;
+
+    if (bus_scheduler != NULL)
+        health.i2c_recoveries = bus_scheduler->data->recoveries;
+
+    health.flags = (health.flags & ~SENSOR_HEALTH_WINDOW_FLAGS) | flags;
+
+    chSysUnlock();
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief               Initializes the sensor health statistics.
+ *
+ * @param[in] scheduler         Scheduler of the sensor bus, may be NULL.
+ * @param[in] accgyro_sample_hz Accelerometer and gyro sample rate.
+ * @param[in] mag_sample_hz     Magnetometer sample rate.
+ * @param[in] accel_gain        Accelerometer gain in g per count.
+ * @param[in] gyro_gain         Gyro gain in rad/s per count.
+ */
+void SensorHealthInit(const I2CSchedulerConfig *scheduler,
+                      float accgyro_sample_hz,
+                      float mag_sample_hz,
+                      float accel_gain,
+                      float gyro_gain)
+{
+    int c;
+
+    memset(&health, 0, SENSOR_HEALTH_SIZE);
+
+    bus_scheduler = scheduler;
+    bus_device_count = 0;
+
+    for (c = 0; c < 3; c++)
+    {
+        channel_gain[c] = accel_gain;
+        channel_gain[c + 3] = gyro_gain;
+    }
+
+    vibration_limit_sq = SENSOR_HEALTH_VIBRATION_LIMIT_G *
+                         SENSOR_HEALTH_VIBRATION_LIMIT_G;
+
+    window_length = (uint32_t)(accgyro_sample_hz * SENSOR_HEALTH_WINDOW_S);
+    if (window_length == 0)
+        window_length = 1;
+    window_count = 0;
+
+    window_accel_clips = 0;
+    window_gyro_clips = 0;
+    window_mag_overflows = 0;
+    window_bus_errors = 0;
+
+    accgyro_stuck_limit = (uint32_t)(accgyro_sample_hz * SENSOR_HEALTH_STUCK_S);
+    mag_stuck_limit = (uint32_t)(mag_sample_hz * SENSOR_HEALTH_STUCK_S);
+    if (accgyro_stuck_limit < 2)
+        accgyro_stuck_limit = 2;
+    if (mag_stuck_limit < 2)
+        mag_stuck_limit = 2;
+
+    accel_run = 0;
+    gyro_run = 0;
+    mag_run = 0;
+}
+
+/**
+ * @brief               Adds a device of the sensor bus to the statistics.
+ *
+ * @param[in] device    Device to add.
+ */
+void SensorHealthAddBusDevice(const I2CDevice *device)
+{
+    if (bus_device_count < SENSOR_HEALTH_MAX_DEVICES)
+        bus_devices[bus_device_count++] = device;
+}
+
+/**
+ * @brief               Adds an accelerometer and gyro sample.
+ * @note                Called from the sensor read thread.
+ *
+ * @param[in] raw_accel Raw accelerometer sample.
+ * @param[in] raw_gyro  Raw gyro sample.
+ */
+void SensorHealthAddAccGyro(const int16_t raw_accel[3],
+                            const int16_t raw_gyro[3])
+{
+    int16_t x[SENSOR_HEALTH_CHANNELS];
+    float d;
+    int c;
+
+    for (c = 0; c < 3; c++)
+    {
+        x[c] = raw_accel[c];
+        x[c + 3] = raw_gyro[c];
+
+        health.accel_clip_count[c] += SensorHealthIsClipped(raw_accel[c]);
+        health.gyro_clip_count[c] += SensorHealthIsClipped(raw_gyro[c]);
+    }
+
+    if (SensorHealthUpdateRun(raw_accel, last_accel, &accel_run,
+                              accgyro_stuck_limit,
+                              SENSOR_HEALTH_ACCEL_STUCK) == true)
+        health.accel_stuck_count++;
+
+    if (SensorHealthUpdateRun(raw_gyro, last_gyro, &gyro_run,
+                              accgyro_stuck_limit,
+                              SENSOR_HEALTH_GYRO_STUCK) == true)
+        health.gyro_stuck_count++;
+
+    if (window_count == 0)
+    {
+        for (c = 0; c < SENSOR_HEALTH_CHANNELS; c++)
+        {
+            window_first[c] = x[c];
+            window_sum[c] = 0.0f;
+            window_sum_sq[c] = 0.0f;
+            window_min[c] = x[c];
+            window_max[c] = x[c];
+        }
+    }
+
+    for (c = 0; c < SENSOR_HEALTH_CHANNELS; c++)
+    {
+        d = (float)(x[c] - window_first[c]);
+        window_sum[c] += d;
+        window_sum_sq[c] += d * d;
+
+        if (x[c] < window_min[c])
+            window_min[c] = x[c];
+        else if (x[c] > window_max[c])
+            window_max[c] = x[c];
+    }
+
+    if (++window_count >= window_length)
+    {
+        SensorHealthWindowDone();
+        window_count = 0;
+    }
+}
+
+/**
+ * @brief               Adds a magnetometer sample.
+ * @note                Called from the sensor read thread.
+ *
+ * @param[in] raw_mag   Raw magnetometer sample.
+ */
+void SensorHealthAddMag(const int16_t raw_mag[3])
+{
+    int c;
+
+    for (c = 0; c < 3; c++)
+    {
+        if ((raw_mag[c] == SENSOR_HEALTH_MAG_OVERFLOW) ||
+            (raw_mag[c] == -SENSOR_HEALTH_MAG_OVERFLOW))
+        {
+            health.mag_overflow_count++;
+            break;
+        }
+    }
+
+    if (SensorHealthUpdateRun(raw_mag, last_mag, &mag_run, mag_stuck_limit,
+                              SENSOR_HEALTH_MAG_STUCK) == true)
+        health.mag_stuck_count++;
+}
+
+/**
+ * @brief               Copies the sensor health statistics.
+ *
+ * @param[out] dest     Destination address.
+ */
+void GetSensorHealth(sensor_health_t *dest)
+{
+    chSysLock();
+    *dest = health;
+    chSysUnlock();
+}
+
+/**
+ * @brief               Returns the sensor health flags.
+ *
+ * @return              Health flags, SENSOR_HEALTH_*.
+ */
+uint8_t GetSensorHealthFlags(void)
+{
+    return health.flags;
+}
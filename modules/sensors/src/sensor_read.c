@@ -4,23 +4,40 @@
  *
  * */
 
+#include <math.h>
 #include "ch.h"
 #include "hal.h"
 #include "kfly_defs.h"
 #include "flash_save.h"
 #include "sensor_read.h"
 #include "biquad.h"
+#include "fir_decimate.h"
+#include "i2c_scheduler.h"
+#include "mag_calibration.h"
+#include "temperature_compensation.h"
+#include "accel_calibration.h"
+#include "sensor_health.h"
 
 /*===========================================================================*/
 /* Module local definitions.                                                 */
 /*===========================================================================*/
+#define SENSOR_ACCGYRO_SAMPLE_NS    ((int64_t)(1e9f / SENSOR_ACCGYRO_SAMPLE_HZ))
+#define MAG_READ_DONE_EVENTMASK     EVENT_MASK(3)
+
 static int16_t twoscomplement2signed(uint8_t msb, uint8_t lsb);
 static void ApplyCalibration(sensor_calibration_t *cal,
-                             int16_t raw_data[3],
+                             const int16_t raw_data[3],
+                             const float offset[3],
                              float calibrated_data[3],
                              float sensor_gain);
 static void MPU6050ConvertAndSave(MPU6050_Data *dh,
                                   uint8_t data[14]);
+static bool MPU6050Calibrate(MPU6050_Data *dh,
+                             const int16_t accel[3],
+                             const int16_t gyro[3]);
+static void AccGyroProcess(uint8_t data[14], int64_t time_ns);
+static float AccGyroGetAccelGain(void);
+static float AccGyroGetGyroGain(void);
 static void HMC5983ConvertAndSave(HMC5983_Data *dh,
                                   uint8_t data[6]);
 
@@ -49,11 +66,45 @@ static const MPU6050_Configuration mpu6050cfg = {
     MPU6050_INTDRDY_ENABLE,         /* Interrupt enable config                */
     MPU6050_ADDRESS_AD0_HIGH,       /* MPU6050 address                        */
     MPU6050_CLK_X_REFERENCE,        /* Clock reference                        */
-    39,                             /* Sample rate divider: 8k/(39+1) = 200 Hz*/
+    (uint8_t)(8000.0f / SENSOR_ACCGYRO_SAMPLE_HZ) - 1,
+                                    /* Sample rate divider: 8k/(div+1)        */
     &mpu6050data,                   /* Pointer to data holder                 */
     &I2CD2                          /* Pointer to I2C Driver                  */
 };
 
+#if SENSOR_USE_SPI_IMU == TRUE
+/* MPU6000 configuration, the configuration registers are limited to 1 MHz */
+static const SPIConfig mpu6000_register_spicfg = {
+    NULL,
+    GPIOA,
+    GPIOA_RF_SEL,
+    SPI_CR1_BR_2 | SPI_CR1_BR_1 | SPI_CR1_CPHA | SPI_CR1_CPOL
+};
+static const MPU6000_Configuration mpu6000cfg = {
+    MPU6050_DLPF_BW_256,            /* Digital low-pass filter config: off    */
+    MPU6050_GYRO_FS_2000,           /* Gyro range config: 2000 dps            */
+    MPU6050_ACCEL_FS_16,            /* Accel range config: 16 g               */
+    MPU6050_TEMP_FIFO_EN |
+    MPU6050_XG_FIFO_EN   |
+    MPU6050_YG_FIFO_EN   |
+    MPU6050_ZG_FIFO_EN   |
+    MPU6050_ACCEL_FIFO_EN,          /* FIFO config: 14 byte frames            */
+    MPU6050_INTMODE_ACTIVEHIGH |
+    MPU6050_INTDRIVE_PUSHPULL  |
+    MPU6050_INTLATCH_50USPULSE |
+    MPU6050_INTCLEAR_ANYREAD,       /* Interrupt config                       */
+    MPU6050_INTDRDY_ENABLE,         /* Interrupt enable config                */
+    MPU6050_CLK_X_REFERENCE,        /* Clock reference                        */
+    (uint8_t)(8000.0f / SENSOR_ACCGYRO_SAMPLE_HZ) - 1,
+                                    /* Sample rate divider: 8k/(div+1)        */
+    &mpu6050data,                   /* Pointer to data holder                 */
+    &SPID1,                         /* Pointer to SPI Driver                  */
+    &mpu6000_register_spicfg,       /* Register SPI configuration             */
+    GPIOA,                          /* Chip select port                       */
+    GPIOA_RF_SEL                    /* Chip select pad                        */
+};
+#endif
+
 /* HMC5983 calibration, data holder and configuration */
 sensor_calibration_t hmc5983cal;
 HMC5983_Data hmc5983data;
@@ -70,10 +121,41 @@ static const HMC5983_Configuration hmc5983cfg = {
     &hmc5983data,                   /* Pointer to data holder             */
     &I2CD2                          /* Pointer to I2C Driver              */
 };
+
+/* Scheduler of the sensor I2C bus and its devices */
+static I2CSchedulerData i2c2_scheduler_data;
+static const I2CSchedulerConfig i2c2_scheduler_cfg = {
+    &I2CD2,                         /* Pointer to I2C Driver              */
+    GPIOB,                          /* SCL port                           */
+    GPIOB_SENSORS_SCL,              /* SCL pad                            */
+    GPIOB,                          /* SDA port                           */
+    GPIOB_SENSORS_SDA,              /* SDA pad                            */
+    PAL_MODE_ALTERNATE(4) |
+    PAL_STM32_OTYPE_OPENDRAIN,      /* SCL and SDA mode for I2C2          */
+    &i2c2_scheduler_data            /* Pointer to data holder             */
+};
+I2CDevice mpu6050_i2c_device;
+I2CDevice hmc5983_i2c_device;
+
+/* MS5611 data holder and configuration */
+MS5611_Data ms5611data;
+static const MS5611_Configuration ms5611cfg = {
+    MS5611_OSR_4096,                /* Oversampling: 4096, 9.04 ms        */
+    MS5611_ADDRESS_CSB_LOW,         /* MS5611 address                     */
+    &ms5611data,                    /* Pointer to data holder             */
+    &i2c2_scheduler_cfg             /* Pointer to the bus scheduler       */
+};
+
 /* Private pointers to sensor configurations */
 static const sensor_read_configuration_t sensorcfg = {
     &mpu6050cfg,
+#if SENSOR_USE_SPI_IMU == TRUE
+    &mpu6000cfg,
+#else
+    NULL,
+#endif
     &hmc5983cfg,
+    &ms5611cfg,
     &mpu6050cal,
     &hmc5983cal,
     &calibration_timestamp,
@@ -84,16 +166,66 @@ static const sensor_read_configuration_t sensorcfg = {
 biquad_df2t_t acc_lpf_biquad[3];
 biquad_df2t_t gyro_lpf_biquad[3];
 
+#if SENSOR_FIXED_POINT_FRONTEND == TRUE
+/* Decimation filters for the gyro and accelerometer */
+static fir_decimate_coeffs_t accgyro_fir_coeffs;
+static fir_decimate_state_t acc_fir_state[3];
+static fir_decimate_state_t gyro_fir_state[3];
+#endif
+
+#if SENSOR_ACCGYRO_PREDECIMATION > 1
+/* First decimation stage from the sample rate to the front-end rate */
+static fir_decimate_coeffs_t accgyro_prefir_coeffs;
+static fir_decimate_state_t acc_prefir_state[3];
+static fir_decimate_state_t gyro_prefir_state[3];
+#endif
+
 /* Private pointer to the Sensor Read Thread */
 static thread_t *thread_sensor_read_p = NULL;
 
 /* Temporary holder of sensor data */
 uint8_t temp_data[14]; /* NOTE: This variable may NOT be placed in CCM
                                  memory because DMA directly accesses it. */
+uint8_t mag_data[6];   /* NOTE: This variable may NOT be placed in CCM
+                                 memory because DMA directly accesses it. */
+
+/* Bus transactions of the accelerometer and gyro, and the magnetometer */
+static const uint8_t mpu6050_data_register = MPU6050_RA_ACCEL_XOUT_H;
+static const uint8_t hmc5983_data_register = HMC5983_RA_DATAX_H;
+static I2CTransaction accgyro_transaction;
+static I2CTransaction mag_transaction;
+
+#if SENSOR_USE_SPI_IMU == TRUE
+/* Temporary holder of MPU6000 FIFO frames */
+uint8_t fifo_data[MPU6000_FIFO_MAX_FRAMES * MPU6000_FIFO_FRAME_SIZE];
+                               /* NOTE: This variable may NOT be placed in CCM
+                                  memory because DMA directly accesses it. */
+
+/* Data ready interrupts since the sensor read thread was woken */
+static unsigned int mpu6000_samples = 0;
+#endif
+
+/* Barometer conversion timer, set if a barometer was found */
+static bool baro_available = false;
+static virtual_timer_t baro_vt;
+static systime_t baro_interval;
 
 /* Temporary holder for IMU calibration while saving to flash */
 imu_calibration_t imu_cal;
 
+/* Offset of sensors without temperature compensation */
+static const float zero_offset[3] = {0.0f, 0.0f, 0.0f};
+
+/* Layout of the IMU calibration saved before the gain matrices */
+typedef struct
+{
+    float accelerometer_bias[3];
+    float accelerometer_gain[3];
+    float magnetometer_bias[3];
+    float magnetometer_gain[3];
+    uint32_t timestamp;
+} imu_calibration_diagonal_t;
+
 /* Time measurement */
 volatile int64_t acc_gyro_time_ns;
 
@@ -113,49 +245,125 @@ static int64_t GetIMUTime(void)
   return imu_time + dwt;
 }
 
-/* Working area for the sensor read thread */
-THD_WORKING_AREA(waThreadSensorRead, 256);
-THD_WORKING_AREA(waThreadSensorReadFlashSave, 256);
+/* Working area for the sensor read thread. The deepest call chain is
+   ThreadSensorRead, SensorHealthAddAccGyro, I2CScheduler_GetStatistics at
+   368 bytes from -fstack-usage with the firmware flags on a host compiler,
+   plus about 64 bytes for the kernel calls. The thread and FPU contexts and
+   the interrupt stack are added by THD_WORKING_AREA. The size leaves about
+   50 % margin over the estimate, GetSensorReadStackUnused gives the
+   margin measured on the target. */
+THD_WORKING_AREA(waThreadSensorRead, 640);
 
 /*===========================================================================*/
 /* Module local functions.                                                   */
 /*===========================================================================*/
 
 /**
- * @brief           Thread for the flash save operation.
+ * @brief           Copies the current IMU calibration for saving.
  *
- * @param[in] arg   Unused.
- * @return          Unused.
+ * @param[out] data Pointer to the IMU calibration to save.
  */
-static THD_FUNCTION(ThreadSensorReadFlashSave, arg)
+static void IMUCalibrationSnapshot(void *data)
 {
-    (void)arg;
-
-    /* Event registration for new estimation */
-    event_listener_t el;
+    GetIMUCalibration((imu_calibration_t *)data);
+}
 
-    /* Set thread name */
-    chRegSetThreadName("SenRead FlashSave");
+/**
+ * @brief Reads an IMU calibration saved with per axis gains and converts it
+ *        to gain matrices.
+ */
+static void ReadDiagonalIMUCalibration(void)
+{
+    imu_calibration_diagonal_t diagonal;
+    int i, j;
 
-    /* Register to new estimation */
-    chEvtRegisterMask(ptrGetFlashSaveEventSource(),
-                      &el,
-                      FLASHSAVE_SAVE_EVENTMASK);
+    if (FlashSave_Read(FlashSave_STR2ID("SENC"),
+                       (uint8_t *)&diagonal,
+                       sizeof(imu_calibration_diagonal_t)) != FLASHSAVE_OK)
+        return;
 
-    while (1)
+    for (i = 0; i < 3; i++)
     {
-        /* Wait for new estimation */
-        chEvtWaitOne(FLASHSAVE_SAVE_EVENTMASK);
+        imu_cal.accelerometer_bias[i] = diagonal.accelerometer_bias[i];
+        imu_cal.magnetometer_bias[i] = diagonal.magnetometer_bias[i];
+
+        for (j = 0; j < 3; j++)
+        {
+            imu_cal.accelerometer_gain[i][j] =
+                    (i == j) ? diagonal.accelerometer_gain[i] : 0.0f;
+            imu_cal.magnetometer_gain[i][j] =
+                    (i == j) ? diagonal.magnetometer_gain[i] : 0.0f;
+        }
+    }
+
+    imu_cal.timestamp = diagonal.timestamp;
+
+    SetIMUCalibration(&imu_cal);
+}
+
+/**
+ * @brief Wakes the sensor read thread when a magnetometer read is done.
+ *
+ * @param[in] transaction The magnetometer transaction.
+ */
+static void MagReadDone(I2CTransaction *transaction)
+{
+    (void)transaction;
+
+    chEvtSignal(thread_sensor_read_p, MAG_READ_DONE_EVENTMASK);
+}
+
+/**
+ * @brief Wakes the sensor read thread when a barometer conversion is done.
+ *
+ * @param[in] arg Unused.
+ */
+static void BaroTimerCallback(void *arg)
+{
+    (void)arg;
 
-        /* Get IMU calibration */
-        GetIMUCalibration(&imu_cal);
+    chSysLockFromISR();
 
-        /* Save RC input settings to flash */
-        FlashSave_Write(FlashSave_STR2ID("SENC"),
-                        true,
-                        (uint8_t *)&imu_cal,
-                        sizeof(imu_calibration_t));
+    chVTSetI(&baro_vt, baro_interval, BaroTimerCallback, NULL);
+
+    if (thread_sensor_read_p != NULL)
+        chEvtSignalI(thread_sensor_read_p, BARO_DATA_AVAILABLE_EVENTMASK);
+
+    chSysUnlockFromISR();
+}
+
+/**
+ * @brief Initializes the transactions of the sensors on the I2C bus.
+ */
+static void SensorTransactionsInit(void)
+{
+    /* The MPU6050 is not on the bus when the SPI IMU is used */
+    if (sensorcfg.mpu6000cfg == NULL)
+    {
+        mpu6050_i2c_device.address = sensorcfg.mpu6050cfg->address_7bit;
+        I2CScheduler_ResetStatistics(&mpu6050_i2c_device);
+
+        accgyro_transaction.device = &mpu6050_i2c_device;
+        accgyro_transaction.priority = I2C_PRIORITY_HIGH;
+        accgyro_transaction.txbuf = &mpu6050_data_register;
+        accgyro_transaction.txbytes = 1;
+        accgyro_transaction.rxbuf = temp_data;
+        accgyro_transaction.rxbytes = MPU6050_ACCEL_GYRO_TEMP_DATA_SIZE;
+        accgyro_transaction.callback = NULL;
+        accgyro_transaction.done = true;
     }
+
+    hmc5983_i2c_device.address = sensorcfg.hmc5983cfg->address_7bit;
+    I2CScheduler_ResetStatistics(&hmc5983_i2c_device);
+
+    mag_transaction.device = &hmc5983_i2c_device;
+    mag_transaction.priority = I2C_PRIORITY_NORMAL;
+    mag_transaction.txbuf = &hmc5983_data_register;
+    mag_transaction.txbytes = 1;
+    mag_transaction.rxbuf = mag_data;
+    mag_transaction.rxbytes = 6;
+    mag_transaction.callback = MagReadDone;
+    mag_transaction.done = true;
 }
 
 /**
@@ -178,84 +386,236 @@ static THD_FUNCTION(ThreadSensorRead, arg)
         /* Waiting for an IRQ to happen.*/
         events = chEvtWaitAny(ACCGYRO_DATA_AVAILABLE_EVENTMASK |
                               MAG_DATA_AVAILABLE_EVENTMASK |
+                              MAG_READ_DONE_EVENTMASK |
                               BARO_DATA_AVAILABLE_EVENTMASK);
 
         if (events & ACCGYRO_DATA_AVAILABLE_EVENTMASK)
         {
-            /* Read the data */
-            MPU6050ReadData(sensorcfg.mpu6050cfg, temp_data);
-
-            /* Lock the data structure while changing it */
-            chMtxLock(&sensorcfg.mpu6050cfg->data_holder->read_lock);
-
-            /* Convert and save the raw data */
-            MPU6050ConvertAndSave(sensorcfg.mpu6050cfg->data_holder, temp_data);
-
-            /* Save the current sample time */
-            sensorcfg.mpu6050cfg->data_holder->sample_time_ns =
-                acc_gyro_time_ns;
-
-            /* Apply calibration and save calibrated data */
-            float *acc_p = sensorcfg.mpu6050cfg->data_holder->accel_data;
-            float *gyro_p = sensorcfg.mpu6050cfg->data_holder->gyro_data;
-
-            ApplyCalibration(sensorcfg.mpu6050cal,
-                             sensorcfg.mpu6050cfg->data_holder->raw_accel_data,
-                             acc_p,
-                             1.0f);
-
-            ApplyCalibration(NULL,
-                             sensorcfg.mpu6050cfg->data_holder->raw_gyro_data,
-                             gyro_p,
-                             MPU6050GetGyroGain(sensorcfg.mpu6050cfg));
-
-            /* Apply biquad filters */
-            for (int i = 0; i < 3; i++)
+#if SENSOR_USE_SPI_IMU == TRUE
+            if (sensorcfg.mpu6000cfg != NULL)
             {
-                acc_p[i] = BiquadDF2TApply(&acc_lpf_biquad[i], acc_p[i]);
-                gyro_p[i] = BiquadDF2TApply(&gyro_lpf_biquad[i], gyro_p[i]);
+                /* Read all buffered samples in one burst, the newest has the
+                   time of the latest data ready interrupt */
+                uint8_t n = MPU6000ReadFIFO(sensorcfg.mpu6000cfg,
+                                            fifo_data,
+                                            MPU6000_FIFO_MAX_FRAMES);
+                chSysLock();
+                int64_t time_ns = acc_gyro_time_ns;
+                chSysUnlock();
+
+                for (int i = 0; i < n; i++)
+                    AccGyroProcess(&fifo_data[i * MPU6000_FIFO_FRAME_SIZE],
+                                   time_ns - (int64_t)(n - 1 - i) *
+                                             SENSOR_ACCGYRO_SAMPLE_NS);
+            }
+            else
+#endif
+            {
+                /* Read the data, ahead of any queued magnetometer or
+                   barometer transaction */
+                if (I2CScheduler_Execute(&i2c2_scheduler_cfg,
+                                         &accgyro_transaction) == MSG_OK)
+                    AccGyroProcess(temp_data, acc_gyro_time_ns);
             }
-
-            /* Unlock the data structure */
-            chMtxUnlock(&sensorcfg.mpu6050cfg->data_holder->read_lock);
-
-            /* Broadcast new data available */
-            chEvtBroadcastFlags(sensorcfg.new_data_es,
-                                ACCGYRO_DATA_AVAILABLE_EVENTMASK);
         }
 
-        if (events & MAG_DATA_AVAILABLE_EVENTMASK)
+        /* Convert a finished read before a new one is queued into the same
+           buffer, the I2C scheduler thread writes mag_data */
+        if ((events & MAG_READ_DONE_EVENTMASK) &&
+            (mag_transaction.status == MSG_OK))
         {
-            /* Read the data */
-            HMC5983ReadData(sensorcfg.hmc5983cfg, temp_data);
-
             /* Lock the data structure while changing it */
             chMtxLock(&sensorcfg.hmc5983cfg->data_holder->read_lock);
 
             /* Convert and save the raw data */
-            HMC5983ConvertAndSave(sensorcfg.hmc5983cfg->data_holder, temp_data);
+            HMC5983ConvertAndSave(sensorcfg.hmc5983cfg->data_holder, mag_data);
 
             /* Apply calibration and save calibrated data */
-            ApplyCalibration(NULL,
+            ApplyCalibration(sensorcfg.hmc5983cal,
                              sensorcfg.hmc5983cfg->data_holder->raw_mag_data,
+                             zero_offset,
                              sensorcfg.hmc5983cfg->data_holder->mag_data,
                              1.0f);
 
             /* Unlock the data structure */
             chMtxUnlock(&sensorcfg.hmc5983cfg->data_holder->read_lock);
 
+            /* Feed the online calibration, only this thread writes the raw
+               data */
+            MagCalibrationAddSample(
+                        sensorcfg.hmc5983cfg->data_holder->raw_mag_data);
+            SensorHealthAddMag(sensorcfg.hmc5983cfg->data_holder->raw_mag_data);
+
             /* Broadcast new data available */
             chEvtBroadcastFlags(sensorcfg.new_data_es,
                                 MAG_DATA_AVAILABLE_EVENTMASK);
         }
 
+        if ((events & MAG_DATA_AVAILABLE_EVENTMASK) &&
+            (mag_transaction.done == true))
+        {
+            /* Queue the read, MagReadDone wakes the thread when it is done */
+            I2CScheduler_Submit(&i2c2_scheduler_cfg, &mag_transaction);
+        }
+
         if (events & BARO_DATA_AVAILABLE_EVENTMASK)
         {
+            /* Read the last conversion and start the next one, this never
+               waits for the bus */
+            if (MS5611Step(sensorcfg.ms5611cfg) == true)
+                chEvtBroadcastFlags(sensorcfg.new_data_es,
+                                    BARO_DATA_AVAILABLE_EVENTMASK);
+        }
+    }
+}
+
+#if SENSOR_ACCGYRO_PREDECIMATION > 1
+/**
+ * @brief Decimates the raw accelerometer and gyro samples from the sample
+ *        rate to the front-end rate.
+ *
+ * @param[in] dh Pointer to data holder structure.
+ * @param[out] accel Decimated accelerometer sample in raw counts.
+ * @param[out] gyro Decimated gyro sample in raw counts.
+ *
+ * @return True if there is a new decimated sample.
+ */
+static bool AccGyroPredecimate(const MPU6050_Data *dh,
+                               int16_t accel[3],
+                               int16_t gyro[3])
+{
+    int32_t acc_filtered, gyro_filtered;
+    bool ready = false;
+    int i;
+
+    /* All channels are in step, so all have an output or none */
+    for (i = 0; i < 3; i++)
+    {
+        ready = FIRDecimateQ15Push(&accgyro_prefir_coeffs,
+                                   &acc_prefir_state[i],
+                                   dh->raw_accel_data[i],
+                                   &acc_filtered);
+
+        (void)FIRDecimateQ15Push(&accgyro_prefir_coeffs,
+                                 &gyro_prefir_state[i],
+                                 dh->raw_gyro_data[i],
+                                 &gyro_filtered);
+
+        if (ready == true)
+        {
+            accel[i] = FIRDecimateQ15ToSample(acc_filtered);
+            gyro[i] = FIRDecimateQ15ToSample(gyro_filtered);
+        }
+    }
+
+    return ready;
+}
+#endif
+
+/**
+ * @brief Converts, calibrates and filters one accelerometer and gyro sample,
+ *        and broadcasts when there is new calibrated data.
+ *
+ * @param[in] data Pointer to the raw sample, in data register layout.
+ * @param[in] time_ns Sample time in nanoseconds.
+ */
+static void AccGyroProcess(uint8_t data[14], int64_t time_ns)
+{
+    MPU6050_Data *dh = sensorcfg.mpu6050cfg->data_holder;
+    float acc_offset[3], gyro_offset[3], acc_compensated[3];
+    int16_t accel[3], gyro[3];
+
+    /* Lock the data structure while changing it */
+    chMtxLock(&dh->read_lock);
+
+    /* Convert and save the raw data */
+    MPU6050ConvertAndSave(dh, data);
+
+    /* Track clipping, vibration and stuck samples */
+    SensorHealthAddAccGyro(dh->raw_accel_data, dh->raw_gyro_data);
+
+    /* Save the current sample time */
+    dh->sample_time_ns = time_ns;
+
+#if SENSOR_ACCGYRO_PREDECIMATION > 1
+    /* The rest runs at the front-end rate */
+    if (AccGyroPredecimate(dh, accel, gyro) == false)
+    {
+        chMtxUnlock(&dh->read_lock);
+        return;
+    }
+#else
+    for (int i = 0; i < 3; i++)
+    {
+        accel[i] = dh->raw_accel_data[i];
+        gyro[i] = dh->raw_gyro_data[i];
+    }
+#endif
+
+    /* Learn the temperature bias while disarmed and still */
+    TempCompAddSample(accel, gyro, dh->temperature);
+
+    /* Capture the orientations of the accelerometer calibration, with the
+       temperature bias removed */
+    TempCompGetOffsets(dh->temperature, acc_offset, gyro_offset);
+
+    for (int i = 0; i < 3; i++)
+        acc_compensated[i] = (float)accel[i] - acc_offset[i];
 
+    AccelCalibrationAddSample(acc_compensated, gyro);
+
+    /* Apply calibration and save calibrated data */
+    if (MPU6050Calibrate(dh, accel, gyro) == true)
+    {
+        /* Apply biquad filters */
+        for (int i = 0; i < 3; i++)
+        {
+            dh->accel_data[i] = BiquadDF2TApply(&acc_lpf_biquad[i],
+                                                dh->accel_data[i]);
+            dh->gyro_data[i] = BiquadDF2TApply(&gyro_lpf_biquad[i],
+                                               dh->gyro_data[i]);
         }
+
+        /* Unlock the data structure */
+        chMtxUnlock(&dh->read_lock);
+
+        /* Broadcast new data available */
+        chEvtBroadcastFlags(sensorcfg.new_data_es,
+                            ACCGYRO_DATA_AVAILABLE_EVENTMASK);
+    }
+    else
+    {
+        /* Unlock the data structure */
+        chMtxUnlock(&dh->read_lock);
     }
 }
 
+/**
+ * @brief Get the gain of the accelerometer in use.
+ *
+ * @return The gain of the accelerometer.
+ */
+static float AccGyroGetAccelGain(void)
+{
+    if (sensorcfg.mpu6000cfg != NULL)
+        return MPU6000GetAccelGain(sensorcfg.mpu6000cfg);
+    else
+        return MPU6050GetAccelGain(sensorcfg.mpu6050cfg);
+}
+
+/**
+ * @brief Get the gain of the gyroscope in use.
+ *
+ * @return The gain of the gyroscope.
+ */
+static float AccGyroGetGyroGain(void)
+{
+    if (sensorcfg.mpu6000cfg != NULL)
+        return MPU6000GetGyroGain(sensorcfg.mpu6000cfg);
+    else
+        return MPU6050GetGyroGain(sensorcfg.mpu6050cfg);
+}
+
 /**
  * @brief Converts two bytes in 2's complement form to a signed 16-bit value.
  *
@@ -269,6 +629,30 @@ static int16_t twoscomplement2signed(uint8_t msb, uint8_t lsb)
     return (int16_t)((((uint16_t)msb) << 8) | ((uint16_t)lsb));
 }
 
+/**
+ * @brief Multiplies bias corrected data with the calibration gain matrix.
+ * @note  The calibration must be locked.
+ *
+ * @param[in] cal Pointer to calibration structure.
+ * @param[in] unbiased Bias corrected data.
+ * @param[out] calibrated_data Pointer to the calibrated data array.
+ * @param[in] sensor_gain The gain of the sensor after calibration.
+ */
+static inline void CalibrationGain(const sensor_calibration_t *cal,
+                                   const float unbiased[3],
+                                   float calibrated_data[3],
+                                   float sensor_gain)
+{
+    int i;
+
+    /* Fused multiply-adds, single instructions on the FPU */
+    for (i = 0; i < 3; i++)
+        calibrated_data[i] = fmaf(cal->gain[i][0], unbiased[0],
+                                  fmaf(cal->gain[i][1], unbiased[1],
+                                       cal->gain[i][2] * unbiased[2])) *
+                             sensor_gain;
+}
+
 /**
  * @brief Applies sensor calibration to raw data values.
  *
@@ -277,32 +661,145 @@ static int16_t twoscomplement2signed(uint8_t msb, uint8_t lsb)
  *
  * @param[in] cal Pointer to calibration structure.
  * @param[in] raw_data Pointer to the raw data array.
+ * @param[in] offset Temperature bias in raw counts.
  * @param[out] calibrated_data Pointer to the calibrated data array.
  * @param[in] sensor_gain The gain of the sensor after calibration.
  */
 static void ApplyCalibration(sensor_calibration_t *cal,
-                             int16_t raw_data[3],
+                             const int16_t raw_data[3],
+                             const float offset[3],
                              float calibrated_data[3],
                              float sensor_gain)
 {
+    float unbiased[3];
+    int i;
+
+    if (cal != NULL)
+    {
+        chMtxLock(&cal->lock);
+        for (i = 0; i < 3; i++)
+            unbiased[i] = ((float)raw_data[i]) - offset[i] - cal->bias[i];
+
+        CalibrationGain(cal, unbiased, calibrated_data, sensor_gain);
+        chMtxUnlock(&cal->lock);
+    }
+    else
+    {
+        for (i = 0; i < 3; i++)
+            calibrated_data[i] = (((float)raw_data[i]) - offset[i]) *
+                                 sensor_gain;
+    }
+}
+
+#if SENSOR_FIXED_POINT_FRONTEND == TRUE
+/**
+ * @brief Applies sensor calibration to the output of the decimation filters.
+ *
+ * @details Same as ApplyCalibration, the bias and gain are applied after the
+ *          filter as they commute with its unity DC gain.
+ *
+ * @param[in] cal Pointer to calibration structure.
+ * @param[in] filtered_data Pointer to the filter outputs.
+ * @param[in] offset Temperature bias in raw counts.
+ * @param[out] calibrated_data Pointer to the calibrated data array.
+ * @param[in] sensor_gain The gain of the sensor after calibration.
+ */
+static void ApplyCalibrationDecimated(sensor_calibration_t *cal,
+                                      int32_t filtered_data[3],
+                                      const float offset[3],
+                                      float calibrated_data[3],
+                                      float sensor_gain)
+{
+    float unbiased[3];
+    int i;
+
     if (cal != NULL)
     {
         chMtxLock(&cal->lock);
-        calibrated_data[0] = (((float)raw_data[0]) - cal->bias[0]) * cal->gain[0]
-                             * sensor_gain;
-        calibrated_data[1] = (((float)raw_data[1]) - cal->bias[1]) * cal->gain[1]
-                             * sensor_gain;
-        calibrated_data[2] = (((float)raw_data[2]) - cal->bias[2]) * cal->gain[2]
-                             * sensor_gain;
+        for (i = 0; i < 3; i++)
+            unbiased[i] = (float)filtered_data[i] *
+                          FIR_DECIMATE_OUTPUT_SCALE - offset[i] - cal->bias[i];
+
+        CalibrationGain(cal, unbiased, calibrated_data, sensor_gain);
         chMtxUnlock(&cal->lock);
     }
     else
     {
-        calibrated_data[0] = ((float)raw_data[0]) * sensor_gain;
-        calibrated_data[1] = ((float)raw_data[1]) * sensor_gain;
-        calibrated_data[2] = ((float)raw_data[2]) * sensor_gain;
+        for (i = 0; i < 3; i++)
+            calibrated_data[i] = ((float)filtered_data[i] *
+                                  FIR_DECIMATE_OUTPUT_SCALE - offset[i]) *
+                                 sensor_gain;
+    }
+}
+#endif
+
+/**
+ * @brief Calibrates the accelerometer and gyro data. With the fixed-point
+ *        front-end the raw data is first filtered and decimated.
+ *
+ * @param[in/out] dh Pointer to data holder structure.
+ * @param[in] accel Accelerometer sample in raw counts.
+ * @param[in] gyro Gyro sample in raw counts.
+ *
+ * @return True if there is new calibrated data.
+ */
+static bool MPU6050Calibrate(MPU6050_Data *dh,
+                             const int16_t accel[3],
+                             const int16_t gyro[3])
+{
+    float acc_offset[3], gyro_offset[3];
+#if SENSOR_FIXED_POINT_FRONTEND == TRUE
+    int32_t acc_filtered[3], gyro_filtered[3];
+    bool ready = false;
+    int i;
+
+    /* All channels are in step, so all have an output or none */
+    for (i = 0; i < 3; i++)
+    {
+        ready = FIRDecimateQ15Push(&accgyro_fir_coeffs,
+                                   &acc_fir_state[i],
+                                   accel[i],
+                                   &acc_filtered[i]);
+
+        (void)FIRDecimateQ15Push(&accgyro_fir_coeffs,
+                                 &gyro_fir_state[i],
+                                 gyro[i],
+                                 &gyro_filtered[i]);
     }
 
+    if (ready == false)
+        return false;
+
+    TempCompGetOffsets(dh->temperature, acc_offset, gyro_offset);
+
+    ApplyCalibrationDecimated(sensorcfg.mpu6050cal,
+                              acc_filtered,
+                              acc_offset,
+                              dh->accel_data,
+                              1.0f);
+
+    ApplyCalibrationDecimated(NULL,
+                              gyro_filtered,
+                              gyro_offset,
+                              dh->gyro_data,
+                              AccGyroGetGyroGain());
+#else
+    TempCompGetOffsets(dh->temperature, acc_offset, gyro_offset);
+
+    ApplyCalibration(sensorcfg.mpu6050cal,
+                     accel,
+                     acc_offset,
+                     dh->accel_data,
+                     1.0f);
+
+    ApplyCalibration(NULL,
+                     gyro,
+                     gyro_offset,
+                     dh->gyro_data,
+                     AccGyroGetGyroGain());
+#endif
+
+    return true;
 }
 
 /**
@@ -327,7 +824,15 @@ static void MPU6050ConvertAndSave(MPU6050_Data *dh, uint8_t data[14])
     dh->raw_accel_data[2] = twoscomplement2signed(data[4], data[5]);
 
     dh->raw_temperature = twoscomplement2signed(data[6], data[7]);
-    dh->temperature = ((float)dh->raw_temperature  + 12412.0f) / 340.0f;
+
+    if (dh->who_am_i == MPU6000_WHO_AM_I_ICM20602)
+        dh->temperature = (float)dh->raw_temperature /
+                            MPU6000_ICM20602_TEMP_SENSITIVITY +
+                          MPU6000_ICM20602_TEMP_OFFSET_DEGC;
+    else
+        dh->temperature = ((float)dh->raw_temperature +
+                           MPU6050_TEMP_OFFSET_LSB) /
+                          MPU6050_TEMP_SENSITIVITY;
 
     dh->raw_gyro_data[0] = twoscomplement2signed(data[10], data[11]);
     dh->raw_gyro_data[1] = -twoscomplement2signed(data[8], data[9]);
@@ -392,19 +897,67 @@ msg_t SensorReadInit(void)
                          BIQUAD_TYPE_LPF);
     }
 
+#if SENSOR_FIXED_POINT_FRONTEND == TRUE
+    if (FIRDecimateDesignLPF(&accgyro_fir_coeffs,
+                             SENSOR_FRONTEND_FIR_TAPS,
+                             SENSOR_ACCGYRO_DECIMATION,
+                             SENSOR_FRONTEND_CUTOFF_HZ /
+                                SENSOR_ACCGYRO_FRONTEND_HZ) == false)
+        return MSG_RESET; /* Error! */
+
+    for (int i = 0; i < 3; i++)
+    {
+        FIRDecimateInitState(&acc_fir_state[i]);
+        FIRDecimateInitState(&gyro_fir_state[i]);
+    }
+#endif
+
+#if SENSOR_ACCGYRO_PREDECIMATION > 1
+    if (FIRDecimateDesignLPF(&accgyro_prefir_coeffs,
+                             SENSOR_FRONTEND_PREFIR_TAPS,
+                             SENSOR_ACCGYRO_PREDECIMATION,
+                             SENSOR_FRONTEND_PREFIR_CUTOFF_HZ /
+                                SENSOR_ACCGYRO_SAMPLE_HZ) == false)
+        return MSG_RESET; /* Error! */
+
+    for (int i = 0; i < 3; i++)
+    {
+        FIRDecimateInitState(&acc_prefir_state[i]);
+        FIRDecimateInitState(&gyro_prefir_state[i]);
+    }
+#endif
+
     /* Initialize the time measurement */
     (void)GetIMUTime();
 
     /* Initialize Accelerometer and Gyroscope */
-    if (MPU6050Init(sensorcfg.mpu6050cfg) != MSG_OK)
+    if (sensorcfg.mpu6000cfg != NULL)
+    {
+        if (MPU6000Init(sensorcfg.mpu6000cfg) != MSG_OK)
+            return MSG_RESET; /* Initialization failed */
+    }
+    else if (MPU6050Init(sensorcfg.mpu6050cfg) != MSG_OK)
         return MSG_RESET; /* Initialization failed */
 
     /* Initialize Magnetometer */
-    //if (HMC5983Init(sensorcfg.hmc5983cfg) != MSG_OK)
-    //    return MSG_RESET; /* Initialization failed */
+    if (HMC5983Init(sensorcfg.hmc5983cfg) != MSG_OK)
+        return MSG_RESET; /* Initialization failed */
+
+    /* Start the scheduler of the sensor bus, sensor reads are queued to it
+       so the accelerometer and gyro are never blocked by other sensors */
+    if (I2CSchedulerInit(&i2c2_scheduler_cfg) != MSG_OK)
+        return MSG_RESET; /* Initialization failed */
+
+    SensorTransactionsInit();
+
+    /* Initialize Barometer, it is optional */
+    if (MS5611Init(sensorcfg.ms5611cfg) == MSG_OK)
+    {
+        baro_available = true;
+        baro_interval = US2ST(MS5611GetConversionTimeUS(sensorcfg.ms5611cfg))
+                        + 1;
+    }
 
-    /* Initialize Barometer */
-    /* TODO: Add barometer code */
 
     /* If there are valid calibration pointers, initialize mutexes */
     if (sensorcfg.mpu6050cal != NULL)
@@ -417,10 +970,17 @@ msg_t SensorReadInit(void)
     osalEventObjectInit(sensorcfg.new_data_es);
 
     /* Initialize calibration */
-    mpu6050cal.gain[0] = mpu6050cal.gain[1] = mpu6050cal.gain[2] = 1.0f;
-    hmc5983cal.gain[0] = hmc5983cal.gain[1] = hmc5983cal.gain[2] = 1.0f;
-    mpu6050cal.bias[0] = mpu6050cal.bias[1] = mpu6050cal.bias[2] = 0.0f;
-    hmc5983cal.bias[0] = hmc5983cal.bias[1] = hmc5983cal.bias[2] = 0.0f;
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            mpu6050cal.gain[i][j] = (i == j) ? 1.0f : 0.0f;
+            hmc5983cal.gain[i][j] = (i == j) ? 1.0f : 0.0f;
+        }
+
+        mpu6050cal.bias[i] = 0.0f;
+        hmc5983cal.bias[i] = 0.0f;
+    }
     calibration_timestamp = 0;
 
     /* Read data from flash if available */
@@ -428,9 +988,42 @@ msg_t SensorReadInit(void)
                             (uint8_t *)&imu_cal,
                             SENSOR_IMU_CALIBRATION_SIZE);
 
-    /* Set IMU calibration */
+    /* Set IMU calibration, a calibration saved before the gain matrix is
+       converted */
     if (status == FLASHSAVE_OK)
         SetIMUCalibration(&imu_cal);
+    else if (status == FLASHSAVE_SIZE_MISSMATCH)
+        ReadDiagonalIMUCalibration();
+
+    /* Initialize the sensor health statistics over the sensor bus devices */
+    SensorHealthInit(&i2c2_scheduler_cfg,
+                     SENSOR_ACCGYRO_SAMPLE_HZ,
+                     SENSOR_MAG_HZ,
+                     AccGyroGetAccelGain(),
+                     AccGyroGetGyroGain());
+    if (sensorcfg.mpu6000cfg == NULL)
+        SensorHealthAddBusDevice(&mpu6050_i2c_device);
+
+    SensorHealthAddBusDevice(&hmc5983_i2c_device);
+
+    if (baro_available == true)
+        SensorHealthAddBusDevice(&sensorcfg.ms5611cfg->data_holder->device);
+
+    /* Initialize the online magnetometer calibration */
+    MagCalibrationInit();
+
+    /* Initialize the temperature compensation, learned over windows of
+       TEMPCOMP_WINDOW_S */
+    TempCompInit((uint32_t)(SENSOR_ACCGYRO_FRONTEND_HZ * TEMPCOMP_WINDOW_S),
+                 AccGyroGetAccelGain(),
+                 AccGyroGetGyroGain());
+
+    /* Initialize the on-board accelerometer calibration */
+    AccelCalibrationInit(
+            (uint32_t)(SENSOR_ACCGYRO_FRONTEND_HZ *
+                       ACCEL_CALIBRATION_CAPTURE_S),
+            AccGyroGetAccelGain(),
+            AccGyroGetGyroGain());
 
     /* Initialize read thread */
     chThdCreateStatic(waThreadSensorRead,
@@ -439,12 +1032,18 @@ msg_t SensorReadInit(void)
                       ThreadSensorRead,
                       NULL);
 
-    /* Initialize the Flash Save thread */
-    chThdCreateStatic(waThreadSensorReadFlashSave,
-                      sizeof(waThreadSensorReadFlashSave),
-                      NORMALPRIO,
-                      ThreadSensorReadFlashSave,
-                      NULL);
+    /* Start the barometer conversions */
+    if (baro_available == true)
+    {
+        chVTObjectInit(&baro_vt);
+        chVTSet(&baro_vt, baro_interval, BaroTimerCallback, NULL);
+    }
+
+    /* Register the IMU calibration for saving to flash */
+    FlashSave_Register(FlashSave_STR2ID("SENC"),
+                       &imu_cal,
+                       SENSOR_IMU_CALIBRATION_SIZE,
+                       IMUCalibrationSnapshot);
 
     return MSG_OK;
 }
@@ -472,6 +1071,40 @@ void MPU6050cb(EXTDriver *extp, expchannel_t channel)
     }
 }
 
+/**
+ * @brief MPU6000 external interrupt callback.
+ *
+ * @details The sensor read thread is woken every SENSOR_SPI_IMU_BATCH
+ *          samples to read the FIFO, the SPI DMA transfer can not be started
+ *          here as the bus is shared with the external flash.
+ *
+ * @param[in] extp      Pointer to EXT Driver.
+ * @param[in] channel   EXT Channel whom fired the interrupt.
+ */
+void MPU6000cb(EXTDriver *extp, expchannel_t channel)
+{
+    (void)extp;
+    (void)channel;
+
+#if SENSOR_USE_SPI_IMU == TRUE
+    int64_t cyci64 = GetIMUTime() * 1000;
+    acc_gyro_time_ns = cyci64 / 168;
+
+    if (++mpu6000_samples < SENSOR_SPI_IMU_BATCH)
+        return;
+
+    mpu6000_samples = 0;
+
+    if (thread_sensor_read_p != NULL)
+    {
+        /* Wakes up the sensor read thread */
+        chSysLockFromISR();
+        chEvtSignalI(thread_sensor_read_p, ACCGYRO_DATA_AVAILABLE_EVENTMASK);
+        chSysUnlockFromISR();
+    }
+#endif
+}
+
 /**
  * @brief HMC5983 external interrupt callback.
  *
@@ -492,6 +1125,42 @@ void HMC5983cb(EXTDriver *extp, expchannel_t channel)
     }
 }
 
+/**
+ * @brief   Check if a barometer was found at initialization.
+ *
+ * @return  True if the barometer is available.
+ */
+bool IsBarometerAvailable(void)
+{
+    return baro_available;
+}
+
+/**
+ * @brief   Returns the part of the sensor read stack that has never been
+ *          used, from the fill pattern of CH_DBG_FILL_THREADS.
+ *
+ * @return  Never used bytes of the stack, 0 without the fill pattern.
+ */
+size_t GetSensorReadStackUnused(void)
+{
+#if CH_DBG_FILL_THREADS == TRUE
+    /* The thread structure is at the bottom of the working area and the
+       stack grows down towards it */
+    const uint8_t *bottom = (const uint8_t *)waThreadSensorRead +
+                            sizeof(thread_t);
+    const uint8_t *top = (const uint8_t *)waThreadSensorRead +
+                         sizeof(waThreadSensorRead);
+    const uint8_t *p = bottom;
+
+    while ((p < top) && (*p == CH_DBG_STACK_FILL_VALUE))
+        p++;
+
+    return (size_t)(p - bottom);
+#else
+    return 0;
+#endif
+}
+
 /**
  * @brief   Get the new data event source.
  *
@@ -648,8 +1317,7 @@ void GetIMUData(imu_data_t *data)
 
     data->temperature = sensorcfg.mpu6050cfg->data_holder->temperature;
 
-    /* TODO: Get the true pressure */
-    data->pressure = 0;
+    data->pressure = sensorcfg.ms5611cfg->data_holder->pressure;
 
     data->acc_gyro_time_ns = rtGetLatestAccelerometerSamplingTimeNS();
 
@@ -682,8 +1350,7 @@ void GetRawIMUData(imu_raw_data_t *data)
 
     data->temperature = sensorcfg.mpu6050cfg->data_holder->raw_temperature;
 
-    /* TODO: Get the true pressure */
-    data->pressure = 0;
+    data->pressure = sensorcfg.ms5611cfg->data_holder->raw_pressure;
 
     data->acc_gyro_time_ns = rtGetLatestAccelerometerSamplingTimeNS();
 
@@ -698,7 +1365,7 @@ void GetRawIMUData(imu_raw_data_t *data)
  */
 void GetIMUCalibration(imu_calibration_t *cal)
 {
-    int i;
+    int i, j;
 
     /* Lock calibration structures before reading */
     LockSensorCalibration();
@@ -707,9 +1374,13 @@ void GetIMUCalibration(imu_calibration_t *cal)
     for (i = 0; i < 3; i++)
     {
         cal->accelerometer_bias[i] = sensorcfg.mpu6050cal->bias[i];
-        cal->accelerometer_gain[i] = sensorcfg.mpu6050cal->gain[i];
         cal->magnetometer_bias[i]  = sensorcfg.hmc5983cal->bias[i];
-        cal->magnetometer_gain[i]  = sensorcfg.hmc5983cal->gain[i];
+
+        for (j = 0; j < 3; j++)
+        {
+            cal->accelerometer_gain[i][j] = sensorcfg.mpu6050cal->gain[i][j];
+            cal->magnetometer_gain[i][j]  = sensorcfg.hmc5983cal->gain[i][j];
+        }
     }
 
     cal->timestamp = *sensorcfg.calibration_timestamp;
@@ -725,7 +1396,7 @@ void GetIMUCalibration(imu_calibration_t *cal)
  */
 void SetIMUCalibration(imu_calibration_t *cal)
 {
-    int i;
+    int i, j;
 
     /* Lock calibration structures before writing */
     LockSensorCalibration();
@@ -734,9 +1405,13 @@ void SetIMUCalibration(imu_calibration_t *cal)
     for (i = 0; i < 3; i++)
     {
          sensorcfg.mpu6050cal->bias[i] = cal->accelerometer_bias[i];
-         sensorcfg.mpu6050cal->gain[i] = cal->accelerometer_gain[i];
          sensorcfg.hmc5983cal->bias[i] = cal->magnetometer_bias[i];
-         sensorcfg.hmc5983cal->gain[i] = cal->magnetometer_gain[i];
+
+         for (j = 0; j < 3; j++)
+         {
+             sensorcfg.mpu6050cal->gain[i][j] = cal->accelerometer_gain[i][j];
+             sensorcfg.hmc5983cal->gain[i][j] = cal->magnetometer_gain[i][j];
+         }
     }
 
     *sensorcfg.calibration_timestamp = cal->timestamp;
@@ -779,7 +1454,7 @@ void UnlockSensorStructures(void)
 void LockSensorCalibration(void)
 {
     chMtxLock(&sensorcfg.mpu6050cal->lock);
-    //chMtxLock(&sensorcfg.hmc5983cal->lock);
+    chMtxLock(&sensorcfg.hmc5983cal->lock);
 }
 
 /**
@@ -787,7 +1462,7 @@ void LockSensorCalibration(void)
  */
 void UnlockSensorCalibration(void)
 {
-    //chMtxUnlock(&sensorcfg.hmc5983cal->lock);
+    chMtxUnlock(&sensorcfg.hmc5983cal->lock);
     chMtxUnlock(&sensorcfg.mpu6050cal->lock);
 }
 
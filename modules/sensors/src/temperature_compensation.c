@@ -0,0 +1,347 @@
+/* *
+ *
+ * Temperature compensation of the accelerometer and gyro bias, learned
+ * online with recursive least squares while the vehicle is disarmed and still
+ *
+ * The bias is fitted as a quadratic in temperature and evaluated into the
+ * per-degree table used by the sample path, instead of learning each
+ * degree as an independent bin:
+ *
+ * - The bias of MEMS accelerometers and gyros is smooth in temperature and
+ *   close to linear over the -40 to 85 C range of the sensors, with some
+ *   curvature. Over the 0 to 60 C seen in use, a quadratic is within the
+ *   noise of the 1 s still windows.
+ * - A still session only measures the bias change since its start, as the
+ *   turn-on offset and gravity are unknown. Each session therefore ties
+ *   the temperatures it covers to each other, and the polynomial ties
+ *   every session to one curve. Independent bins would need sessions that
+ *   overlap in temperature to be chained, and bins never visited would
+ *   stay at zero.
+ * - A warm-up from power on usually sweeps 10 to 20 C, which fits the
+ *   curve and extrapolates it to the whole table. Bins would need a visit
+ *   to every degree.
+ * - The flash record is 12 coefficients and a 2x2 covariance instead of
+ *   TEMPCOMP_TABLE_SIZE entries per channel.
+ *
+ * */
+
+#include <string.h>
+#include "ch.h"
+#include "hal.h"
+#include "flash_save.h"
+#include "arming.h"
+#include "temperature_compensation.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables and types.                                         */
+/*===========================================================================*/
+
+/* Learned model and its copy while saving to flash */
+static tempcomp_model_t model;
+static tempcomp_model_t model_save;
+
+/* Bias per degree, the last entry repeats the one before so the
+   interpolation saturates at the top of the table */
+static float tempcomp_table[TEMPCOMP_TABLE_SIZE + 1][TEMPCOMP_CHANNELS];
+
+/* Averaging window, the samples are offset by the first sample of the
+   window to keep the variance accurate in single precision */
+static uint32_t window_length;
+static uint32_t window_count;
+static float window_first[TEMPCOMP_CHANNELS];
+static float window_sum[TEMPCOMP_CHANNELS];
+static float window_sum_sq[TEMPCOMP_CHANNELS];
+static float window_temperature;
+
+/* Stillness limits in raw counts squared */
+static float still_variance[TEMPCOMP_CHANNELS];
+static float acc_drift_sq;
+
+/* Still session, the regression is done on the change from the first
+   window of the session which cancels gravity and the turn-on bias */
+static bool session_active;
+static float session_u;
+static float session_mean[TEMPCOMP_CHANNELS];
+static float last_acc_mean[3];
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief               Converts a temperature to the model regressor.
+ *
+ * @param[in] temperature   Temperature in deg C.
+ * @return              Normalized temperature.
+ */
+static inline float TempCompNormalize(float temperature)
+{
+    return (temperature - TEMPCOMP_REFERENCE_C) * (1.0f / TEMPCOMP_SCALE_C);
+}
+
+/**
+ * @brief               Evaluates the model for each degree of the table.
+ */
+static void TempCompBuildTable(void)
+{
+    float u;
+    int i, c;
+
+    for (i = 0; i < TEMPCOMP_TABLE_SIZE; i++)
+    {
+        u = TempCompNormalize((float)(TEMPCOMP_TABLE_MIN_C + i));
+
+        for (c = 0; c < TEMPCOMP_CHANNELS; c++)
+            tempcomp_table[i][c] = model.coeffs[c][0] * u +
+                                   model.coeffs[c][1] * u * u;
+    }
+
+    for (c = 0; c < TEMPCOMP_CHANNELS; c++)
+        tempcomp_table[TEMPCOMP_TABLE_SIZE][c] =
+                tempcomp_table[TEMPCOMP_TABLE_SIZE - 1][c];
+}
+
+/**
+ * @brief               Updates the model with the change of the window means
+ *                      since the start of the still session.
+ *
+ * @param[in] u         Normalized temperature of the window.
+ * @param[in] mean      Window means in raw counts.
+ */
+static void TempCompUpdateModel(float u, const float mean[TEMPCOMP_CHANNELS])
+{
+    float phi[TEMPCOMP_PARAMETERS], Pphi[TEMPCOMP_PARAMETERS];
+    float k[TEMPCOMP_PARAMETERS];
+    float denom, err;
+    int i, j, c;
+
+    phi[0] = u - session_u;
+    phi[1] = u * u - session_u * session_u;
+
+    for (i = 0; i < TEMPCOMP_PARAMETERS; i++)
+        Pphi[i] = model.P[i][0] * phi[0] + model.P[i][1] * phi[1];
+
+    denom = TEMPCOMP_FORGETTING + phi[0] * Pphi[0] + phi[1] * Pphi[1];
+
+    for (i = 0; i < TEMPCOMP_PARAMETERS; i++)
+        k[i] = Pphi[i] / denom;
+
+    /* The model is copied by the flash save thread */
+    chSysLock();
+
+    for (c = 0; c < TEMPCOMP_CHANNELS; c++)
+    {
+        err = (mean[c] - session_mean[c]) -
+              (model.coeffs[c][0] * phi[0] + model.coeffs[c][1] * phi[1]);
+
+        for (i = 0; i < TEMPCOMP_PARAMETERS; i++)
+            model.coeffs[c][i] += k[i] * err;
+    }
+
+    for (i = 0; i < TEMPCOMP_PARAMETERS; i++)
+        for (j = 0; j < TEMPCOMP_PARAMETERS; j++)
+            model.P[i][j] = (model.P[i][j] - k[i] * Pphi[j]) /
+                            TEMPCOMP_FORGETTING;
+
+    model.updates++;
+
+    chSysUnlock();
+
+    TempCompBuildTable();
+}
+
+/**
+ * @brief               Checks a finished window for stillness and updates the
+ *                      model with it.
+ */
+static void TempCompWindowDone(void)
+{
+    float mean[TEMPCOMP_CHANNELS];
+    float n = (float)window_length;
+    float m, u, drift_sq;
+    bool still = true;
+    int c;
+
+    for (c = 0; c < TEMPCOMP_CHANNELS; c++)
+    {
+        m = window_sum[c] / n;
+        mean[c] = window_first[c] + m;
+
+        if ((window_sum_sq[c] / n - m * m) > still_variance[c])
+            still = false;
+    }
+
+    drift_sq = 0.0f;
+    for (c = 0; c < 3; c++)
+    {
+        drift_sq += (mean[c] - last_acc_mean[c]) * (mean[c] - last_acc_mean[c]);
+        last_acc_mean[c] = mean[c];
+    }
+
+    if (drift_sq > acc_drift_sq)
+        still = false;
+
+    u = TempCompNormalize(window_temperature / n);
+
+    if ((still == false) || (bIsSystemArmed() == true))
+    {
+        session_active = false;
+    }
+    else if (session_active == false)
+    {
+        session_active = true;
+        session_u = u;
+        memcpy(session_mean, mean, sizeof(session_mean));
+    }
+    else
+    {
+        TempCompUpdateModel(u, mean);
+    }
+}
+
+/**
+ * @brief               Copies the model for saving.
+ *
+ * @param[out] data     Pointer to the model to save.
+ */
+static void TempCompSnapshot(void *data)
+{
+    chSysLock();
+    *(tempcomp_model_t *)data = model;
+    chSysUnlock();
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief               Initializes the temperature compensation, reads the
+ *                      model from flash and registers it for saving.
+ *
+ * @param[in] window_samples    Samples per averaging window.
+ * @param[in] accel_gain        Accelerometer gain in g per count.
+ * @param[in] gyro_gain         Gyro gain in rad/s per count.
+ */
+void TempCompInit(uint32_t window_samples, float accel_gain, float gyro_gain)
+{
+    int c;
+
+    memset(&model, 0, TEMPCOMP_MODEL_SIZE);
+    model.P[0][0] = TEMPCOMP_INITIAL_COVARIANCE;
+    model.P[1][1] = TEMPCOMP_INITIAL_COVARIANCE;
+
+    (void)FlashSave_Read(FlashSave_STR2ID("SENT"),
+                         (uint8_t *)&model,
+                         TEMPCOMP_MODEL_SIZE);
+
+    FlashSave_Register(FlashSave_STR2ID("SENT"),
+                       &model_save,
+                       TEMPCOMP_MODEL_SIZE,
+                       TempCompSnapshot);
+
+    TempCompBuildTable();
+
+    window_length = (window_samples > 0) ? window_samples : 1;
+    window_count = 0;
+    session_active = false;
+
+    for (c = 0; c < 3; c++)
+    {
+        still_variance[c] = (TEMPCOMP_ACC_STILL_G / accel_gain) *
+                            (TEMPCOMP_ACC_STILL_G / accel_gain);
+        still_variance[c + 3] = (TEMPCOMP_GYRO_STILL_RADPS / gyro_gain) *
+                                (TEMPCOMP_GYRO_STILL_RADPS / gyro_gain);
+        last_acc_mean[c] = 0.0f;
+    }
+
+    acc_drift_sq = (TEMPCOMP_ACC_DRIFT_G / accel_gain) *
+                   (TEMPCOMP_ACC_DRIFT_G / accel_gain);
+}
+
+/**
+ * @brief               Adds a raw sample to the averaging window, the model
+ *                      is updated when a still window is finished.
+ * @note                Called from the sensor read thread.
+ *
+ * @param[in] raw_accel     Raw accelerometer sample.
+ * @param[in] raw_gyro      Raw gyro sample.
+ * @param[in] temperature   Sensor temperature in deg C.
+ */
+void TempCompAddSample(const int16_t raw_accel[3],
+                       const int16_t raw_gyro[3],
+                       float temperature)
+{
+    float x[TEMPCOMP_CHANNELS];
+    int c;
+
+    for (c = 0; c < 3; c++)
+    {
+        x[c] = (float)raw_accel[c];
+        x[c + 3] = (float)raw_gyro[c];
+    }
+
+    if (window_count == 0)
+    {
+        for (c = 0; c < TEMPCOMP_CHANNELS; c++)
+        {
+            window_first[c] = x[c];
+            window_sum[c] = 0.0f;
+            window_sum_sq[c] = 0.0f;
+        }
+
+        window_temperature = 0.0f;
+    }
+
+    for (c = 0; c < TEMPCOMP_CHANNELS; c++)
+    {
+        x[c] -= window_first[c];
+        window_sum[c] += x[c];
+        window_sum_sq[c] += x[c] * x[c];
+    }
+
+    window_temperature += temperature;
+
+    if (++window_count >= window_length)
+    {
+        TempCompWindowDone();
+        window_count = 0;
+    }
+}
+
+/**
+ * @brief               Looks up the temperature bias, interpolated between
+ *                      the degrees of the table.
+ * @note                The table index is saturated instead of checked, so
+ *                      the lookup has no branches. Below the table the bias
+ *                      is extrapolated from the first degree.
+ *
+ * @param[in] temperature       Sensor temperature in deg C.
+ * @param[out] accel_offset     Accelerometer bias in raw counts.
+ * @param[out] gyro_offset      Gyro bias in raw counts.
+ */
+void TempCompGetOffsets(float temperature,
+                        float accel_offset[3],
+                        float gyro_offset[3])
+{
+    const float t = temperature - (float)TEMPCOMP_TABLE_MIN_C;
+    const uint32_t i = __USAT((int32_t)t, TEMPCOMP_TABLE_BITS);
+    const float frac = t - (float)i;
+    const float *lo = tempcomp_table[i];
+    const float *hi = tempcomp_table[i + 1];
+    int c;
+
+    for (c = 0; c < 3; c++)
+    {
+        accel_offset[c] = lo[c] + frac * (hi[c] - lo[c]);
+        gyro_offset[c] = lo[c + 3] + frac * (hi[c + 3] - lo[c + 3]);
+    }
+}
@@ -97,6 +97,16 @@ typedef struct PACKED_VAR
    * @brief   Flag for if the serial computer control is enabled.
    */
   bool8_t serial_interface_enabled;
+
+  /**
+   * @brief   Sensor health flags, SENSOR_HEALTH_* of sensor_health.h.
+   */
+  uint8_t sensor_health;
+
+  /**
+   * @brief   Status of the last save to flash, FlashSave_Status.
+   */
+  uint8_t flash_save_status;
 } system_status_t;
 
 /*===========================================================================*/
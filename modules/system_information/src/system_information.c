@@ -10,6 +10,7 @@
 #include "flash_save.h"
 #include "arming.h"
 #include "computer_control.h"
+#include "sensor_health.h"
 #include <string.h>
 
 /*===========================================================================*/
@@ -59,47 +60,10 @@ __attribute__((used, section(".sw_version"))) const char kfly_build_version[] =
 static system_strings_t system_strings;
 static system_status_t system_status;
 
-/** @brief  Work area for the flash save. */
-static THD_WORKING_AREA(waThreadSysInfoFlashSave, 256);
-
 /*===========================================================================*/
 /* Module local functions.                                                   */
 /*===========================================================================*/
 
-/**
- * @brief           Thread for the flash save operation.
- *
- * @param[in] arg   Unused.
- * @return          Unused.
- */
-static THD_FUNCTION(ThreadSysInfoFlashSave, arg)
-{
-  (void)arg;
-
-  /* Event registration for new estimation */
-  event_listener_t el;
-
-  /* Set thread name */
-  chRegSetThreadName("SysInfo FlashSave");
-
-  /* Register to new estimation */
-  chEvtRegisterMask(ptrGetFlashSaveEventSource(), &el,
-                    FLASHSAVE_SAVE_EVENTMASK);
-
-  while (1)
-  {
-    /* Wait for new estimation */
-    chEvtWaitOne(FLASHSAVE_SAVE_EVENTMASK);
-
-    /* Save settings to flash */
-    FlashSave_Write(FlashSave_STR2ID("SIVN"), true,
-                    (uint8_t *)system_strings.vehicle_name, VEHICLE_NAME_SIZE);
-
-    FlashSave_Write(FlashSave_STR2ID("SIVT"), true,
-                    (uint8_t *)system_strings.vehicle_type, VEHICLE_TYPE_SIZE);
-  }
-}
-
 /**
  * @brief   Sets the system information structure to sane values.
  */
@@ -130,6 +94,8 @@ static void SystemInformationReset(void)
   system_status.motors_armed.value             = false;
   system_status.in_air.value                   = false;
   system_status.serial_interface_enabled.value = false;
+  system_status.sensor_health                  = 0;
+  system_status.flash_save_status              = FLASHSAVE_OK;
 }
 
 /*===========================================================================*/
@@ -151,9 +117,12 @@ void SystemInformationInit()
   FlashSave_Read(FlashSave_STR2ID("SIVT"),
                  (uint8_t *)system_strings.vehicle_type, VEHICLE_TYPE_SIZE);
 
-  /* Start the Flash Save thread */
-  chThdCreateStatic(waThreadSysInfoFlashSave, sizeof(waThreadSysInfoFlashSave),
-                    NORMALPRIO, ThreadSysInfoFlashSave, NULL);
+  /* Register the settings for saving to flash */
+  FlashSave_Register(FlashSave_STR2ID("SIVN"),
+                     system_strings.vehicle_name, VEHICLE_NAME_SIZE, NULL);
+
+  FlashSave_Register(FlashSave_STR2ID("SIVT"),
+                     system_strings.vehicle_type, VEHICLE_TYPE_SIZE, NULL);
 }
 
 /**
@@ -176,6 +145,9 @@ void GetSystemStatus(system_status_t *dest)
   system_status.motors_armed.value             = bIsSystemArmed();
   system_status.in_air.value                   = bIsSystemArmed();
   system_status.serial_interface_enabled.value = ComputerControlLinkActive();
+  system_status.sensor_health                  = GetSensorHealthFlags();
+  system_status.flash_save_status              = FlashSave_GetLastSaveStatus();
+
   /* Copy the system information structure to its destination. */
   memcpy(dest, &system_status, sizeof(system_status_t));
 
@@ -23,6 +23,7 @@
 #include "control.h"
 #include "motion_capture.h"
 #include "system_information.h"
+#include "blackbox.h"
 
 /*===========================================================================*/
 /* Module local definitions.                                                 */
@@ -93,7 +94,8 @@ static void vSystemInitList(void)
      *
      * HMC5983 IRQ: Falling edge, on GPIOC, auto start
      * MPU6050 IRQ: Rising edge, on GPIOC, auto start
-     * RF Module IRQ: Not implemented
+     * RF Module IRQ: MPU6000 IRQ if SENSOR_USE_SPI_IMU, rising edge, on
+     *                GPIOC, auto start
      */
     static const EXTConfig extcfg = {
         {
@@ -116,7 +118,13 @@ static void vSystemInitList(void)
             {EXT_CH_MODE_RISING_EDGE    |
              EXT_CH_MODE_AUTOSTART      |
              EXT_MODE_GPIOC, MPU6050cb},    /* 14: MPU6050 IRQ      */
+#if SENSOR_USE_SPI_IMU == TRUE
+            {EXT_CH_MODE_RISING_EDGE    |
+             EXT_CH_MODE_AUTOSTART      |
+             EXT_MODE_GPIOC, MPU6000cb},    /* 15: MPU6000 IRQ      */
+#else
             {EXT_CH_MODE_DISABLED, NULL},   /* 15: RF Module IRQ    */
+#endif
             {EXT_CH_MODE_DISABLED, NULL},
             {EXT_CH_MODE_DISABLED, NULL},
             {EXT_CH_MODE_DISABLED, NULL},
@@ -233,6 +241,13 @@ static void vSystemInitList(void)
      *
      */
     ControlInit();
+
+    /*
+     *
+     * Start the blackbox recorder.
+     *
+     */
+    BlackboxInit();
 }
 
 /*